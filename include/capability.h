@@ -0,0 +1,45 @@
+/*
+ * Capability tokens
+ * The Name Server signs (user, file, permission, expiry, lease) with a key it
+ * shares with each Storage Server at SS_INIT. Clients present the token with
+ * their request and the SS authorizes it in memory, without reading .meta.
+ *
+ * Wire format: "cap=<R|W>.<expiry>.<mac>" where mac is the hex-encoded,
+ * truncated HMAC-SHA256 of "user\nfile\nperm\nexpiry\nlease".
+ */
+
+#ifndef CAPABILITY_H
+#define CAPABILITY_H
+
+#include "common.h"
+
+#define CAPABILITY_KEY_LEN 32
+#define CAPABILITY_MAC_LEN 16     // Bytes of HMAC kept (32 hex chars on the wire)
+#define MAX_CAPABILITY_LEN 96
+
+// Verification results
+typedef enum {
+    CAPABILITY_OK = 0,
+    CAPABILITY_INVALID,    // Malformed, forged, or issued for another user/file
+    CAPABILITY_DENIED,     // Genuine but does not grant the requested access
+    CAPABILITY_EXPIRED     // Genuine but past its expiry - ask the NM again
+} capability_status_t;
+
+// Key management
+int generate_capability_key(uint8_t key[CAPABILITY_KEY_LEN]);
+void encode_capability_key(const uint8_t key[CAPABILITY_KEY_LEN], char* hex, size_t size);
+int decode_capability_key(const char* hex, uint8_t key[CAPABILITY_KEY_LEN]);
+
+// Issuing and verifying tokens
+int issue_capability(const uint8_t key[CAPABILITY_KEY_LEN], const char* username,
+                     const char* filename, int access, time_t expiry,
+                     uint32_t lease_version, char* token, size_t size);
+capability_status_t verify_capability(const uint8_t key[CAPABILITY_KEY_LEN], const char* token,
+                                      const char* username, const char* filename,
+                                      int access, uint32_t lease_version, time_t now);
+
+// Args helpers (the " cap=<token>" suffix carried in request args)
+int append_capability_token(char* args, size_t size, const char* token);
+int extract_capability_token(char* args, char* token, size_t size);
+
+#endif // CAPABILITY_H
@@ -57,6 +57,7 @@ typedef struct {
     char access_list[MAX_CLIENTS][MAX_USERNAME_LEN];
     int access_permissions[MAX_CLIENTS];  // Bitmap of ACCESS_READ/ACCESS_WRITE
     int access_count;
+    uint32_t version;                     // Phase 7: Bumped by every ETIRW and UNDO
 } file_metadata_t;
 
 // Storage server info structure
@@ -98,6 +99,7 @@ typedef struct client_node {
 typedef struct file_hash_entry {
     char filename[MAX_FILENAME_LEN];
     int ss_socket_fd;  // Socket FD of the storage server containing this file
+    uint32_t lease_version;  // Registry version of the last placement/ACL change
     file_metadata_t metadata;
     struct file_hash_entry* next;
 } file_hash_entry_t;
@@ -13,20 +13,41 @@ typedef enum {
     FILE_OP_STREAM
 } file_operation_t;
 
-// Sentence structure
+// Sentence structure (heap-backed, grows as words are added)
 typedef struct {
-    char content[MAX_SENTENCE_LEN];
+    char* content;      // NUL-terminated
+    size_t length;
+    size_t capacity;
     int word_count;
     int locked;
     char locked_by[MAX_USERNAME_LEN];
     time_t lock_time;
 } sentence_t;
 
-// File content structure
+// A word inside a text buffer (offset/length, no copy)
 typedef struct {
-    sentence_t sentences[1000];  // Max 1000 sentences per file
+    size_t offset;
+    size_t length;
+} word_span_t;
+
+// Node of the sentence rope: an implicit treap ordered by sentence index.
+// Each node caches totals for its subtree so index lookups and size queries
+// cost O(log n).
+typedef struct sentence_node {
+    sentence_t sentence;
+    uint32_t priority;
+    struct sentence_node* left;
+    struct sentence_node* right;
+    int subtree_sentences;
+    size_t subtree_bytes;
+    int subtree_words;
+} sentence_node_t;
+
+// File content structure (memory proportional to the document)
+typedef struct {
+    sentence_node_t* root;
     int sentence_count;
-    char backup_content[MAX_CONTENT_LEN];  // For undo functionality
+    uint32_t seed;      // Treap priority generator state
     int has_backup;
 } file_content_t;
 
@@ -42,6 +63,17 @@ typedef struct {
 // Function prototypes for file operations
 int parse_file_into_sentences(const char* content, file_content_t* file_content);
 int serialize_sentences_to_content(const file_content_t* file_content, char* output, size_t max_size);
+size_t serialized_content_length(const file_content_t* file_content);
+int content_word_count(const file_content_t* file_content);
+void free_file_content(file_content_t* file_content);
+
+// Sentence rope access (O(log n) in the number of sentences)
+sentence_t* get_sentence(file_content_t* file_content, int index);
+void refresh_sentence_totals(file_content_t* file_content, int index);
+int insert_sentence(file_content_t* file_content, int index, const char* text);
+int remove_sentence(file_content_t* file_content, int index);
+int set_sentence_content(sentence_t* sentence, const char* text, size_t length);
+int next_word_span(const char* text, size_t length, size_t* cursor, word_span_t* span);
 int insert_word_at_position(sentence_t* sentence, int word_index, const char* word);
 int replace_word_at_position(sentence_t* sentence, int word_index, const char* word);
 int delete_word_at_position(sentence_t* sentence, int word_index);
@@ -7,6 +7,7 @@
 #define PROTOCOL_VERSION "1.0"
 #define HEARTBEAT_INTERVAL 30  // seconds
 #define CONNECTION_TIMEOUT 60  // seconds
+#define LOCATION_LEASE_TTL 30  // seconds a client may reuse an NM-issued SS location
 
 // Client command enumeration - all possible operations
 typedef enum {
@@ -29,7 +30,10 @@ typedef enum {
     CMD_REGISTER_SS,
     CMD_SS_INIT,          // Storage Server initialization
     CMD_CLIENT_INIT,      // Client initialization  
-    CMD_HEARTBEAT
+    CMD_HEARTBEAT,
+    CMD_REVERT,           // Restore a numbered revision or a checkpoint
+    CMD_CHECKPOINT,       // Save a named checkpoint
+    CMD_LISTCHECKPOINTS
 } command_t;
 
 // Status codes for responses - all possible return states
@@ -59,13 +63,17 @@ typedef enum {
     STATUS_ERROR_ALREADY_CONNECTED = 1022,
     STATUS_ERROR_NOT_CONNECTED = 1023,
     STATUS_ERROR_UNDO_NOT_AVAILABLE = 1024,
-    STATUS_ERROR_EXECUTION_FAILED = 1025
+    STATUS_ERROR_EXECUTION_FAILED = 1025,
+    STATUS_ERROR_LEASE_EXPIRED = 1026,    // Cached SS location is stale, ask the NM again
+    STATUS_ERROR_SERVER_BUSY = 1027,      // SS worker queue full, retry later
+    STATUS_ERROR_VERSION_MISMATCH = 1028  // IFVERSION did not match the document's version
 } status_t;
 
 // Request packet structure - client to server
 typedef struct {
     uint32_t magic;                     // Protocol magic number for validation
     command_t command;                  // Command type
+    uint32_t request_id;                // Tag echoed in the reply (NM<->SS control channel)
     char username[MAX_USERNAME_LEN];    // Username of requester
     char args[MAX_ARGS_LEN];           // Flexible payload for filenames, content, etc.
     uint32_t checksum;                  // Simple checksum for integrity
@@ -75,15 +83,30 @@ typedef struct {
 typedef struct {
     uint32_t magic;                         // Protocol magic number for validation
     status_t status;                        // Response status code
+    uint32_t request_id;                    // request_id of the request being answered
     char data[MAX_RESPONSE_DATA_LEN];      // Flexible payload for file content or error messages
     uint32_t checksum;                      // Simple checksum for integrity
 } response_packet_t;
 
+// Header sent ahead of READ/STREAM content. Its first fields line up with
+// response_packet_t, so a reader can tell content (STATUS_OK) from an error,
+// which is sent as a full response_packet_t instead.
+typedef struct {
+    uint32_t magic;
+    status_t status;
+    uint32_t request_id;
+    uint32_t version;                       // Phase 7: Document version being sent
+    uint64_t length;                        // Content bytes that follow
+} content_header_t;
+
 // Function prototypes for protocol handling
 int send_packet(int sockfd, request_packet_t* pkt);
 int recv_packet(int sockfd, response_packet_t* pkt);
 int send_response(int sockfd, response_packet_t* pkt);
 int recv_request(int sockfd, request_packet_t* pkt);
+int send_content_header(int sockfd, uint32_t request_id, uint64_t length, uint32_t version);
+int recv_content_header(int sockfd, response_packet_t* error, uint64_t* length,
+                        uint32_t* version);
 
 // Utility functions for packet creation and validation
 uint32_t calculate_checksum(const void* data, size_t len);
@@ -96,6 +119,13 @@ int parse_view_args(const char* args, int* show_all, int* show_details);
 int parse_write_args(const char* args, char* filename, int* sentence_index);
 int parse_access_args(const char* args, char* filename, char* target_user, int* access_type);
 
+// Location lease helpers (the "lease=<version>" token carried in args)
+int append_lease_token(char* args, size_t size, uint32_t version);
+int extract_lease_token(char* args, uint32_t* version);
+
+// Phase 7: Conditional writes (the "IFVERSION <version>" option of WRITE/ETIRW)
+int extract_version_condition(char* args, uint32_t* version);
+
 // String conversion utilities
 const char* command_to_string(command_t cmd);
 const char* status_to_string(status_t status);
@@ -0,0 +1,33 @@
+/*
+ * SHA-256 and HMAC-SHA256
+ * Small self-contained implementation (FIPS 180-4 / RFC 2104) so the
+ * servers do not need an external crypto library.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LEN 32
+#define SHA256_BLOCK_LEN 64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t bit_count;
+    uint8_t buffer[SHA256_BLOCK_LEN];
+    size_t buffer_len;
+} sha256_ctx_t;
+
+// Incremental hashing
+void sha256_init(sha256_ctx_t* ctx);
+void sha256_update(sha256_ctx_t* ctx, const void* data, size_t len);
+void sha256_final(sha256_ctx_t* ctx, uint8_t digest[SHA256_DIGEST_LEN]);
+
+// One-shot helpers
+void sha256(const void* data, size_t len, uint8_t digest[SHA256_DIGEST_LEN]);
+void hmac_sha256(const uint8_t* key, size_t key_len, const void* data, size_t len,
+                 uint8_t mac[SHA256_DIGEST_LEN]);
+
+#endif // SHA256_H
@@ -0,0 +1,41 @@
+/*
+ * Storage Server Chunk Store Header
+ * Named checkpoints of documents, kept as manifests of content-addressed,
+ * sentence-aligned chunks shared by every checkpoint and file
+ */
+
+#ifndef SS_CAS_H
+#define SS_CAS_H
+
+#include "common.h"
+#include "ss_doc_cache.h"
+
+#define SS_CAS_DIR ".cas"                  // Under the storage path
+#define SS_CAS_CHUNK_MIN (2 * 1024)        // A chunk may close at a sentence end past this
+#define SS_CAS_CHUNK_MAX (16 * 1024)       // and must close at the first one past this
+#define SS_CAS_BOUNDARY_MASK 0x7           // Sentence hashes that close a chunk (1 in 8)
+#define SS_CAS_MAX_TAG_LEN 64
+
+// Store lifecycle
+int ss_cas_init(const char* storage_path);
+
+// Tags start with a letter (so REVERT can tell them from revision numbers)
+// and use only letters, digits, '_', '-' and '.'
+int ss_cas_valid_tag(const char* tag);
+
+// Checkpoint a document version under @tag; -1 with errno EEXIST if the
+// tag is taken. Only chunks not already stored are written.
+int ss_cas_checkpoint(const char* filename, const char* tag, const char* user,
+                      const cached_doc_t* doc, int* total_chunks, int* new_chunks);
+
+// Rebuild a checkpoint into a malloc'd, NUL-terminated buffer (0 or -1)
+int ss_cas_read(const char* filename, const char* tag, char** content, size_t* length);
+
+// One line per checkpoint, oldest first; returns the number listed
+int ss_cas_list(const char* filename, char* out, size_t size);
+
+// Drop a document's checkpoints (DELETE) and the chunks only they used;
+// chunks other checkpoints use stay
+void ss_cas_remove(const char* filename);
+
+#endif // SS_CAS_H
@@ -0,0 +1,77 @@
+/*
+ * Storage Server Document Cache Header
+ * Shared, refcounted, parsed copies of hot documents with an LRU memory budget.
+ * Each cached entry is a document's current committed version; readers pin
+ * the version current when they start.
+ */
+
+#ifndef SS_DOC_CACHE_H
+#define SS_DOC_CACHE_H
+
+#include "common.h"
+
+#define SS_DOC_CACHE_BUDGET (64 * 1024 * 1024)  // Bytes of cached documents
+#define SS_DOC_CACHE_BUCKETS 256
+#define SS_DOC_CACHE_MAX_ENTRIES 512   // Each entry holds its file open
+
+// One sentence of a cached document, as a span of its content
+typedef struct {
+    size_t offset;
+    size_t length;
+    int word_count;
+} doc_sentence_t;
+
+typedef struct cached_doc {
+    char filename[MAX_FILENAME_LEN];
+    char* content;              // Whole document, NUL-terminated
+    size_t length;
+    int fd;                     // The file content was read from or written
+                                // to (-1 if none). Commits replace files
+                                // rather than rewrite them, so it keeps
+                                // holding this version. Set at most once
+                                // after publication (load it atomically).
+    doc_sentence_t* sentences;
+    int sentence_count;
+    int word_count;
+    size_t footprint;           // Bytes charged against the budget
+    int unwritten;              // Phase 7: Committed but not yet in its file;
+                                // pinned so the stale file is never reloaded
+    uint32_t version;           // Phase 7: Document version (from its metadata on a load)
+
+    // Owned by the cache (protected by its mutex)
+    int refcount;
+    int cached;                 // Still reachable from the table
+    struct cached_doc* hash_next;
+    struct cached_doc* lru_prev;
+    struct cached_doc* lru_next;
+} cached_doc_t;
+
+// Cache lifecycle
+void doc_cache_init(const char* storage_path, size_t budget);
+
+// Get a document (loading and parsing it on a miss); NULL if it cannot be read.
+// The returned document is read-only and stays valid until released.
+cached_doc_t* doc_cache_acquire(const char* filename);
+void doc_cache_retain(cached_doc_t* doc);     // Another reference to one already held
+void doc_cache_release(cached_doc_t* doc);
+
+// Drop a document after its file changed (commit, UNDO, DELETE, CREATE)
+void doc_cache_invalidate(const char* filename);
+
+// Phase 7: Make a committed version current in one step: readers starting
+// after it get it, readers holding the old one keep it. @content (malloc'd,
+// NUL-terminated) is taken over on success and becomes @version. Unless
+// @written (its file already holds it), the entry is pinned until
+// doc_cache_mark_written (early-ack commits). Returns it with a reference
+// held for the caller, or NULL (content still the caller's).
+cached_doc_t* doc_cache_publish(const char* filename, char* content, size_t length,
+                                uint32_t version, int written);
+
+// Phase 7: A published version reached its file; it may be evicted again
+void doc_cache_mark_written(cached_doc_t* doc);
+
+// Split text into sentence spans (same rules as parse_file_into_sentences)
+int index_document_sentences(const char* content, size_t length,
+                             doc_sentence_t** sentences, int* word_count);
+
+#endif // SS_DOC_CACHE_H
@@ -0,0 +1,64 @@
+/*
+ * Storage Server Disk I/O Header
+ * The file operations of the storage server (documents, .bak and .meta
+ * files), crash-safe through temp files and renames, run as linked batches
+ * on an io_uring or, where the kernel does not offer one, as plain
+ * synchronous system calls.
+ */
+
+#ifndef SS_IO_H
+#define SS_IO_H
+
+#include "common.h"
+
+#define SS_IO_SMALL_FILE (16 * 1024)   // Read in one step; longer files take more
+
+// ss_io_write_file flags
+#define SS_IO_EXCL 0x1                 // Fail with EEXIST instead of replacing
+#define SS_IO_DATASYNC 0x2             // fdatasync before close
+
+typedef enum {
+    SS_IO_SYNC = 0,
+    SS_IO_URING
+} ss_io_backend_t;
+
+// One document commit: the new content is written and synced to a temp
+// file, which then takes the document's name. The document's .meta can be
+// replaced in the same step: its new text gets a temp file of its own,
+// shares the data sync and is renamed into place just before the document.
+typedef struct {
+    const char* path;
+    const char* backup_path;    // Keep the old version under this name; NULL for none
+    const char* data;
+    size_t length;
+    const char* meta_path;      // .meta to replace along with the document; NULL for none
+    const char* meta;           // Its new text
+    size_t meta_length;
+
+    // Result
+    const char* failed_step;    // "write", "metadata" or "backup" when the commit fails
+} ss_io_commit_t;
+
+// Backend lifecycle. Asking for SS_IO_URING falls back to SS_IO_SYNC when the
+// ring cannot be set up; the backend actually in use is returned.
+ss_io_backend_t ss_io_init(ss_io_backend_t wanted);
+const char* ss_io_backend_name(void);
+
+// All return 0 (or a byte count) on success and -1 with errno set on failure
+ssize_t ss_io_pread(int fd, char* buffer, size_t length, off_t offset);
+int ss_io_read_file(const char* path, char** data, size_t* length);
+int ss_io_write_file(const char* path, const char* data, size_t length, int flags);  // Atomic replace
+int ss_io_rename(const char* from, const char* to);
+int ss_io_unlink(const char* path);
+
+// Crash-safe: on any failure the document keeps its previous content (a
+// failed document rename leaves the new .meta in place for the caller to
+// put back). Concurrent commits share their fsyncs (group commit).
+int ss_io_commit(ss_io_commit_t* commit);
+int ss_io_sync_data(int fd);    // fdatasync in the commits' group sync
+void ss_io_sync_stats(unsigned long* syncs, unsigned long* flushes);
+
+// Startup: remove temp files of writes interrupted by a crash
+int ss_io_remove_temp_files(const char* dir_path);
+
+#endif // SS_IO_H
@@ -0,0 +1,55 @@
+/*
+ * Storage Server Sentence Lock Table Header
+ * WRITE sessions' sentence locks, kept per file in a hash map striped
+ * across mutexes so writers of different files never contend. A lock covers
+ * a whole sentence or a range of its words. Locks are leases that lapse
+ * unless renewed, and busy locks queue their waiters.
+ */
+
+#ifndef SS_LOCK_TABLE_H
+#define SS_LOCK_TABLE_H
+
+#include "common.h"
+#include <limits.h>
+#include <stdint.h>
+
+#define SS_LOCK_STRIPES 64             // Mutexes guarding the file buckets
+#define SS_LOCK_BUCKETS 1024           // File buckets (a multiple of the stripes)
+#define SS_LOCK_FILE_SLOTS 64          // Sentence buckets of one file's lock object
+#ifndef SS_LOCK_LEASE_SECONDS
+#define SS_LOCK_LEASE_SECONDS 120      // A lock lapses this long after its last renewal
+#endif
+#define SS_LOCK_MAX_WAIT_SECONDS 60    // Longest a WRITE may wait for a busy lock
+#define SS_LOCK_LAST_WORD INT_MAX      // Range end of a whole-sentence lock
+
+// Table lifecycle
+void ss_lock_table_init(void);
+
+/*
+ * Lock words @first_word..@last_word (0..SS_LOCK_LAST_WORD for the whole
+ * sentence) of a sentence of a file for @user. Ranges of different users
+ * may not overlap; taking a lock the same user already holds succeeds, and
+ * a lock whose lease lapsed is dropped. Busy words are waited for up to
+ * @wait_ms (0 to fail at once); waiters are granted in arrival order. When
+ * another user keeps them, their name is copied to @holder
+ * (MAX_USERNAME_LEN bytes, may be NULL).
+ *
+ * Returns: 1 if the range is held by @user, 0 if someone else holds part
+ *          of it, -1 on allocation failure
+ */
+int ss_lock_acquire(const char* filename, int sentence, int first_word, int last_word,
+                    const char* user, int wait_ms, char* holder);
+
+// Extend a held lock's lease; -1 if @user no longer holds it (it lapsed
+// and was taken over)
+int ss_lock_renew(const char* filename, int sentence, int first_word, int last_word,
+                  const char* user);
+
+// Drop a lock and grant the waiters it blocked; -1 if @user does not hold it
+int ss_lock_release(const char* filename, int sentence, int first_word, int last_word,
+                    const char* user);
+
+// Locks currently held across all files
+int ss_lock_count(void);
+
+#endif // SS_LOCK_TABLE_H
@@ -0,0 +1,44 @@
+/*
+ * Storage Server Document Materializer Header
+ * Background writer of early-ack commits: documents acknowledged from the
+ * edit log are written to their files later, coalescing
+ * commits of the same file
+ */
+
+#ifndef SS_MATERIALIZER_H
+#define SS_MATERIALIZER_H
+
+#include "common.h"
+#include "ss_doc_cache.h"
+#include <stdint.h>
+
+#define SS_MATERIALIZE_DELAY_MS 20     // A commit waits this long for newer ones to coalesce
+
+/*
+ * Start the writer thread. @write_document writes a published version to
+ * its file on behalf of @user (the last committer), returning 0 or -1; a
+ * failed write is retried. @record_revision then appends each version
+ * written, coalesced ones included, to the revision log in commit order.
+ */
+int ss_materializer_init(int (*write_document)(const cached_doc_t* doc, const char* user),
+                         void (*record_revision)(const cached_doc_t* previous,
+                                                 const cached_doc_t* doc));
+
+/*
+ * Queue a published version (see doc_cache_publish) for writing, taking
+ * over the caller's reference; @previous is the version it replaced (the
+ * caller keeps its reference). A version still queued for the same file is
+ * written no more. @log_id is the commit's edit log ID, ended once the
+ * version is written and its revision recorded.
+ */
+void ss_materializer_queue(cached_doc_t* doc, cached_doc_t* previous, const char* user,
+                           uint64_t log_id);
+
+// Wait until no version of @filename is queued or being written; callers
+// about to replace or delete the file hold its commit lock
+void ss_materializer_drain(const char* filename);
+
+// Write out everything queued (shutdown)
+void ss_materializer_drain_all(void);
+
+#endif // SS_MATERIALIZER_H
@@ -0,0 +1,82 @@
+/*
+ * Storage Server Metadata Cache Header
+ * The parsed .meta of every document, kept in a hash map so permission
+ * checks, ownership checks and INFO never read a file. Changes are made in
+ * the map and written through to .meta (commit statistics by a background
+ * writer).
+ */
+
+#ifndef SS_META_CACHE_H
+#define SS_META_CACHE_H
+
+#include "common.h"
+#include <stdint.h>
+
+#define SS_META_BUCKETS 1024
+
+// A commit's new .meta, installed by ss_io_commit together with the content
+typedef struct {
+    char path[MAX_PATH_LEN];
+    char* text;                 // malloc'd; NULL if the document has no metadata
+    size_t length;
+    uint32_t version;
+} ss_meta_commit_t;
+
+/*
+ * Map lifecycle. Starts the writer thread; needs the I/O backend.
+ *
+ * Returns: 0 on success, -1 if the writer could not be started (changes
+ *          are then written synchronously)
+ */
+int ss_meta_init(const char* storage_path);
+
+// Parse @filename's .meta into the map (startup); 0, or -1 if it has none
+int ss_meta_load(const char* filename);
+
+// Copy a document's metadata; 0, or -1 if the map has none
+int ss_meta_get(const char* filename, file_metadata_t* meta);
+
+// A document's version (0 if unknown)
+uint32_t ss_meta_version(const char* filename);
+
+/*
+ * Check a user's access (the owner has all of it).
+ *
+ * Returns: 1 if allowed, 0 if denied, -1 if the document has no metadata
+ */
+int ss_meta_check_access(const char* filename, const char* username, int access);
+
+/*
+ * Updates. Each changes the map at once. Ownership and access lists are
+ * synced to the .meta before returning, versions with the content they
+ * belong to; commit statistics queue a write, and queued writes of the
+ * same file are merged.
+ */
+
+// A new, empty document owned by @owner (who gets RW); 0 or -1
+int ss_meta_create(const char* filename, const char* owner);
+
+// Replace the access list with @acl's; -1 (errno ENOENT if the document
+// has no metadata)
+int ss_meta_set_acl(const char* filename, const file_metadata_t* acl);
+
+// Statistics and version after a commit by @user; -1 if no metadata
+int ss_meta_record_commit(const char* filename, int word_count, int char_count, size_t size,
+                          const char* user, uint32_t version);
+
+// The .meta for a commit of @version, to be replaced in the content's own
+// synced step; 0, or -1 if it could not be serialized
+int ss_meta_prepare_version(const char* filename, uint32_t version,
+                            ss_meta_commit_t* prepared);
+
+// After that commit: take the version on success, otherwise put the old
+// one back in the .meta (synced). Frees the prepared text.
+void ss_meta_finish_version(const char* filename, ss_meta_commit_t* prepared, int committed);
+
+// Forget a deleted document and remove its .meta (after any write in flight)
+void ss_meta_remove(const char* filename);
+
+// Wait until every queued write is on disk (shutdown)
+void ss_meta_flush(void);
+
+#endif // SS_META_CACHE_H
@@ -0,0 +1,42 @@
+/*
+ * Storage Server Revision Log Header
+ * Per-document history of committed versions, stored as word-aligned
+ * deltas with periodic full checkpoints
+ */
+
+#ifndef SS_REVLOG_H
+#define SS_REVLOG_H
+
+#include "common.h"
+
+#define SS_REVLOG_CHAIN_LIMIT 16       // Deltas between two full checkpoints
+
+// Log lifecycle
+void ss_revlog_init(const char* storage_path);
+
+// Newest revision of a document (0 if it has no history yet)
+int ss_revlog_head(const char* filename);
+
+// Revision that @steps UNDOs from the head lead back to; -1 if the history
+// is shorter than that
+int ss_revlog_undo_target(const char* filename, int steps);
+
+// Rebuild a revision into a malloc'd, NUL-terminated buffer (0 or -1)
+int ss_revlog_read(const char* filename, int revision, char** content, size_t* length);
+
+/*
+ * Record a new version after it was committed. @previous is the version it
+ * replaced (NULL if unknown) and is what the delta is taken against; a
+ * document's first append also records it as revision 1. @restores is the
+ * revision an UNDO/REVERT brought back, 0 for an edit. Callers serialize
+ * appends per document.
+ *
+ * Returns: The new revision, or -1
+ */
+int ss_revlog_append(const char* filename, const char* previous, size_t previous_length,
+                     const char* content, size_t length, int restores);
+
+// Drop a document's history (DELETE)
+void ss_revlog_remove(const char* filename);
+
+#endif // SS_REVLOG_H
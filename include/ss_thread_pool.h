@@ -0,0 +1,52 @@
+/*
+ * Storage Server Thread Pool Header
+ * Fixed set of worker threads fed by a bounded task queue
+ */
+
+#ifndef SS_THREAD_POOL_H
+#define SS_THREAD_POOL_H
+
+#include "common.h"
+
+// Defaults (overridable on the storage server command line)
+#define SS_DEFAULT_WORKERS 32
+#define SS_DEFAULT_QUEUE_DEPTH 4096
+#define SS_DEFAULT_STACK_KB 256
+
+// Name Server control channel workers (CREATE/DELETE/UPDATE_ACL/UNDO/EXEC reads),
+// each with its own queue; a file's commands always go to the same one
+#define SS_CONTROL_WORKERS 4
+#define SS_CONTROL_QUEUE_DEPTH 256
+
+typedef void (*ss_task_fn)(void* arg);
+
+typedef struct {
+    ss_task_fn fn;
+    void* arg;
+} ss_task_t;
+
+typedef struct {
+    pthread_t* workers;
+    int worker_count;
+
+    // Bounded ring of pending tasks (multi-producer, multi-consumer)
+    ss_task_t* tasks;
+    int capacity;
+    int head;
+    int tail;
+    int count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    int shutdown;
+} ss_thread_pool_t;
+
+// Pool lifecycle
+ss_thread_pool_t* ss_thread_pool_create(int worker_count, int queue_depth, size_t stack_size);
+void ss_thread_pool_destroy(ss_thread_pool_t* pool);
+
+// Queue a task; never blocks. Returns 0, or -1 if the queue is full
+int ss_thread_pool_submit(ss_thread_pool_t* pool, ss_task_fn fn, void* arg);
+int ss_thread_pool_pending(ss_thread_pool_t* pool);
+
+#endif // SS_THREAD_POOL_H
@@ -0,0 +1,80 @@
+/*
+ * Storage Server Edit Log Header
+ * Write-ahead log of WRITE sessions' word updates, so the edits of sessions
+ * open when the server stopped can be resumed after a restart, and of
+ * early-ack commits whose documents are not yet written
+ */
+
+#ifndef SS_WAL_H
+#define SS_WAL_H
+
+#include "common.h"
+#include <stdint.h>
+
+#define SS_WAL_DIR ".wal"                      // Under the storage path
+#define SS_WAL_SEGMENT_BYTES (4 * 1024 * 1024) // A new segment starts past this
+#define SS_WAL_FLUSH_MS 10                     // Longest an append waits for its fsync
+#define SS_WAL_BUFFER_BYTES (256 * 1024)       // Flush early once this much is pending
+
+/*
+ * Log lifecycle. Replays the segments under the storage path: sessions
+ * without an end record are kept for their users to resume, with their
+ * sentence locks taken again, and the log restarts from a fresh segment.
+ * Unended commits are passed to @restore first, oldest first; @latest is
+ * 1 for the last one of its file (the one to write out) and 0 for those
+ * it superseded, which still need their revisions. Needs the lock table.
+ * Starts the flusher thread.
+ *
+ * Returns: The number of sessions recovered, or -1
+ */
+int ss_wal_init(const char* storage_path,
+                int (*restore)(const char* filename, const char* user,
+                               const char* content, size_t length, uint32_t version,
+                               int latest));
+
+// Write out and sync everything appended so far (shutdown)
+void ss_wal_flush(void);
+
+/*
+ * Log the start of a WRITE session on words @first_word..@last_word of a
+ * sentence. @base is the sentence as locked (NULL when appending one).
+ * Appends are buffered and synced in groups by the flusher, off the
+ * caller's path.
+ *
+ * Returns: The session's log ID, or 0 if it could not be logged
+ */
+uint64_t ss_wal_begin(const char* filename, int sentence, int first_word, int last_word,
+                      const char* user, const char* base, size_t base_length);
+
+// Log a word update applied to session @id (ignored for ID 0)
+void ss_wal_edit(uint64_t id, int word_index, const char* content);
+
+/*
+ * Phase 7: Log a committed document before its file is written (early-ack
+ * commits) as @version of the file; ss_wal_flush makes it durable. End it with ss_wal_end once the
+ * file holds it.
+ *
+ * Returns: The commit's log ID, or 0 if it could not be logged
+ */
+uint64_t ss_wal_commit(const char* filename, const char* user, const char* content,
+                       size_t length, uint32_t version);
+
+// Log that session @id committed or was abandoned, or that commit @id was
+// written to its file (ignored for ID 0)
+void ss_wal_end(uint64_t id, int committed);
+
+/*
+ * Hand a recovered session back to its user. A session of @user on the
+ * same words of the same sentence that still reads @base is resumed: each
+ * logged word update is passed to @apply and the session's ID is stored in
+ * @id. A matching session whose sentence changed since is rolled back.
+ *
+ * Returns: The number of word updates replayed (0 if there was nothing to
+ *          resume), or -1 if @apply failed
+ */
+int ss_wal_resume(const char* filename, int sentence, int first_word, int last_word,
+                  const char* user, const char* base, size_t base_length,
+                  int (*apply)(void* ctx, int word_index, const char* content), void* ctx,
+                  uint64_t* id);
+
+#endif // SS_WAL_H
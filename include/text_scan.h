@@ -0,0 +1,26 @@
+/*
+ * Text Scanning Kernels
+ * Whitespace and sentence-delimiter scans used by the document parsers and
+ * statistics. Vectorized (SSE2/AVX2) on x86 with a scalar fallback; the
+ * widest kernel the CPU supports is chosen at first use.
+ */
+
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <stddef.h>
+
+// Index of the first '.', '!' or '?' in text, or length if there is none
+size_t text_find_delimiter(const char* text, size_t length);
+
+// Number of words that start in text. *in_word carries whether the byte
+// before text was part of a word, so a document can be counted in blocks
+// (start with 0). Whitespace is the C locale isspace() set.
+size_t text_count_words(const char* text, size_t length, int* in_word);
+
+// Kernel selection ("scalar", "sse2", "avx2"), for benchmarks and tests.
+// Returns 0, or -1 if the kernel is not available on this CPU
+int text_scan_use(const char* kernel);
+const char* text_scan_kernel(void);
+
+#endif // TEXT_SCAN_H
@@ -8,6 +8,7 @@
 #include "../../include/protocol.h"
 #include "../../include/logging.h"
 #include "../../include/errors.h"
+#include "../../include/capability.h"
 #include <signal.h>
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -20,6 +21,31 @@ static int nm_port;
 static int nm_socket = -1;
 static int connected = 0;
 
+// Phase 7: Location cache - NM-issued leases let repeated READ/STREAM/WRITE
+// calls on the same file go straight to the Storage Server
+#define LOCATION_CACHE_SIZE 64
+
+typedef struct {
+    char filename[MAX_FILENAME_LEN];
+    char ss_ip[INET_ADDRSTRLEN];
+    int ss_port;
+    int access;              // Access the NM vouched for (ACCESS_READ/ACCESS_WRITE)
+    uint32_t lease_version;  // Registry version the SS validates
+    char capability[MAX_CAPABILITY_LEN];  // NM-signed grant the SS checks without .meta
+    time_t expires_at;
+} location_entry_t;
+
+typedef struct {
+    char ss_ip[INET_ADDRSTRLEN];
+    int ss_port;
+    uint32_t lease_version;
+    char capability[MAX_CAPABILITY_LEN];
+    int has_lease;
+    int from_cache;
+} ss_location_t;
+
+static location_entry_t location_cache[LOCATION_CACHE_SIZE];
+
 // Function prototypes
 void connect_to_name_server();
 void register_with_name_server();
@@ -43,6 +69,13 @@ void handle_access_command(command_t cmd, const char* args);
 void handle_exec_command(command_t cmd, const char* args);
 void handle_undo_command(command_t cmd, const char* args);
 
+// Phase 7: Location cache helpers
+int resolve_file_location(command_t cmd, const char* nm_args, const char* filename,
+                          int access, ss_location_t* loc);
+void invalidate_cached_location(const char* filename);
+int connect_to_storage_server(const ss_location_t* loc);
+void append_location_tokens(char* args, size_t size, const ss_location_t* loc);
+
 int main(int argc, char* argv[]) {
     if (argc != 3) {
         fprintf(stderr, "Usage: %s <nm_ip> <nm_port>\n", argv[0]);
@@ -217,7 +250,11 @@ void execute_command(const char* input) {
         handle_access_command(cmd, args);
     } else if (strcasecmp(cmd_str, "EXEC") == 0) {
         handle_exec_command(cmd, args);
-    } else if (strcasecmp(cmd_str, "UNDO") == 0) {
+    } else if (strcasecmp(cmd_str, "UNDO") == 0 ||
+               strcasecmp(cmd_str, "REVERT") == 0) {
+        handle_undo_command(cmd, args);
+    } else if (strcasecmp(cmd_str, "CHECKPOINT") == 0 ||
+               strcasecmp(cmd_str, "LISTCHECKPOINTS") == 0) {
         handle_undo_command(cmd, args);
     } else {
         printf("Error: Unknown command '%s'. Type 'HELP' for available commands.\n", cmd_str);
@@ -257,10 +294,17 @@ void display_help() {
     printf("  READ <filename>          - Read file content\n");
     printf("  CREATE <filename>        - Create new file\n");
     printf("  WRITE <filename> <sent#> - Edit file sentence\n");
+    printf("  WRITE <file> <sent#> <s> - Edit, waiting up to s seconds for a busy sentence\n");
+    printf("  WRITE <file> <n>:<a>-<b> - Edit only words a-b, sharing the sentence\n");
+    printf("  WRITE ... IFVERSION <v>  - Edit only if the file is still at version v\n");
     printf("  DELETE <filename>        - Delete file\n");
     printf("  INFO <filename>          - Show file information\n");
     printf("  STREAM <filename>        - Stream file content\n");
-    printf("  UNDO <filename>          - Undo last change\n");
+    printf("  UNDO <filename> [n]      - Undo the last n changes (default 1)\n");
+    printf("  REVERT <filename> <rev>  - Restore a revision (numbers shown on save)\n");
+    printf("  REVERT <filename> <tag>  - Restore a checkpoint\n");
+    printf("  CHECKPOINT <file> <tag>  - Save the current content as a named checkpoint\n");
+    printf("  LISTCHECKPOINTS <file>   - List a file's checkpoints\n");
     printf("\n");
     printf("Access Control:\n");
     printf("  ADDACCESS -R <file> <user> - Grant read access\n");
@@ -331,91 +375,82 @@ void handle_read_command(command_t cmd, const char* args) {
     
     sscanf(args, "%s", filename);
     
-    // Step 1: Ask Name Server for storage server location
+    // Step 1: Resolve storage server location (lease cache, then Name Server)
     request_packet_t request;
-    memset(&request, 0, sizeof(request));
-    request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_READ;
-    strncpy(request.username, username, sizeof(request.username) - 1);
-    strncpy(request.args, filename, sizeof(request.args) - 1);
-    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
-    
-    if (send_packet(nm_socket, &request) < 0) {
-        printf("Error: Failed to send READ request to Name Server\n");
-        return;
-    }
-    
-    // Step 2: Get response from Name Server
     response_packet_t response;
-    if (recv_packet(nm_socket, &response) <= 0) {
-        printf("Error: No response from Name Server\n");
-        return;
-    }
-    
-    if (response.status != STATUS_OK) {
-        printf("Error: %s\n", response.data);
-        return;
-    }
-    
-    // Step 3: Parse Storage Server location (format: "IP:PORT")
-    char ss_ip[INET_ADDRSTRLEN];
-    int ss_port;
-    if (sscanf(response.data, "%[^:]:%d", ss_ip, &ss_port) != 2) {
-        printf("Error: Invalid storage server location: %s\n", response.data);
-        return;
-    }
-    
-    printf("Connecting to Storage Server at %s:%d...\n", ss_ip, ss_port);
-    
-    // Step 4: Connect to Storage Server
-    int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (ss_socket == -1) {
-        printf("Error: Failed to create socket\n");
-        return;
-    }
-    
-    struct sockaddr_in ss_addr;
-    memset(&ss_addr, 0, sizeof(ss_addr));
-    ss_addr.sin_family = AF_INET;
-    ss_addr.sin_port = htons(ss_port);
-    
-    if (inet_pton(AF_INET, ss_ip, &ss_addr.sin_addr) <= 0) {
-        printf("Error: Invalid storage server address\n");
-        close(ss_socket);
-        return;
-    }
-    
-    if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) == -1) {
-        printf("Error: Failed to connect to storage server: %s\n", strerror(errno));
-        close(ss_socket);
-        return;
+    uint64_t content_length = 0;
+    uint32_t version = 0;
+    int ss_socket = -1;
+    
+    for (int attempt = 0; attempt < 2 && ss_socket < 0; attempt++) {
+        ss_location_t loc;
+        if (resolve_file_location(CMD_READ, filename, filename, ACCESS_READ, &loc) != 0) {
+            return;
+        }
+        
+        printf("Connecting to Storage Server at %s:%d...\n", loc.ss_ip, loc.ss_port);
+        
+        // Step 2: Connect to Storage Server
+        ss_socket = connect_to_storage_server(&loc);
+        if (ss_socket < 0) {
+            if (loc.from_cache) {
+                invalidate_cached_location(filename);
+                continue;
+            }
+            return;
+        }
+        
+        // Step 3: Send READ request to Storage Server (with our lease)
+        memset(&request, 0, sizeof(request));
+        request.magic = PROTOCOL_MAGIC;
+        request.command = CMD_READ;
+        strncpy(request.username, username, sizeof(request.username) - 1);
+        strncpy(request.args, filename, sizeof(request.args) - 1);
+        append_location_tokens(request.args, sizeof(request.args), &loc);
+        request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
+        
+        if (send_packet(ss_socket, &request) < 0) {
+            printf("Error: Failed to send READ request to storage server\n");
+            close(ss_socket);
+            return;
+        }
+        
+        // Step 4: A status packet instead of a content header means an error
+        // or a stale lease
+        int status = recv_content_header(ss_socket, &response, &content_length, &version);
+        if (status != 0) {
+            close(ss_socket);
+            ss_socket = -1;
+            if (status > 0 && (response.status == STATUS_ERROR_LEASE_EXPIRED ||
+                               (loc.from_cache && response.status == STATUS_ERROR_NOT_FOUND))) {
+                invalidate_cached_location(filename);
+                continue;
+            }
+            printf("Error: %s\n", status > 0 ? response.data : "Failed to read from storage server");
+            return;
+        }
     }
     
-    // Step 5: Send READ request to Storage Server
-    memset(&request, 0, sizeof(request));
-    request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_READ;
-    strncpy(request.username, username, sizeof(request.username) - 1);
-    strncpy(request.args, filename, sizeof(request.args) - 1);
-    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
-    
-    if (send_packet(ss_socket, &request) < 0) {
-        printf("Error: Failed to send READ request to storage server\n");
-        close(ss_socket);
+    if (ss_socket < 0) {
+        printf("Error: Storage server location changed, please retry\n");
         return;
     }
     
-    // Step 6: Read file content from Storage Server
-    printf("\n--- File Content: %s ---\n", filename);
+    // Step 5: Read file content from Storage Server
+    // Phase 7: The version to pass to WRITE ... IFVERSION
+    printf("\n--- File Content: %s (version %u) ---\n", filename, version);
     char buffer[4096];
-    ssize_t bytes;
+    ssize_t bytes = 0;
+    uint64_t remaining = content_length;
     
-    while ((bytes = recv(ss_socket, buffer, sizeof(buffer) - 1, 0)) > 0) {
+    while (remaining > 0 &&
+           (bytes = recv(ss_socket, buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer) - 1, 0)) > 0) {
         buffer[bytes] = '\0';
         printf("%s", buffer);
+        remaining -= bytes;
     }
     
-    if (bytes < 0) {
+    if (remaining > 0) {
         printf("\nError: Failed to read from storage server\n");
     } else {
         printf("\n--- End of File ---\n");
@@ -483,11 +518,27 @@ void handle_write_command(command_t cmd, const char* args) {
     
     // Parse filename and sentence number from args
     char filename[MAX_FILENAME_LEN];
+    char target[32];
     int sentence_num = 0;
-    
-    if (args == NULL || sscanf(args, "%s %d", filename, &sentence_num) != 2) {
+    int first_word = 0;
+    int last_word = -1;
+    int wait_seconds = 0;
+    
+    // Phase 7: "IFVERSION <v>" makes the edit conditional on the version read
+    char write_args[MAX_ARGS_LEN] = "";
+    uint32_t if_version = 0;
+    int conditional = 0;
+    if (args != NULL) {
+        strncpy(write_args, args, sizeof(write_args) - 1);
+        conditional = extract_version_condition(write_args, &if_version);
+    }
+    
+    if (args == NULL || conditional < 0 ||
+        sscanf(write_args, "%s %31s %d", filename, target, &wait_seconds) < 2 ||
+        sscanf(target, "%d", &sentence_num) != 1) {
         printf("Error: WRITE requires filename and sentence number\n");
-        printf("Usage: WRITE <filename> <sentence_num> (0-based indexing)\n");
+        printf("Usage: WRITE <filename> <sentence_num>[:<first>-<last>] [wait_seconds] "
+               "[IFVERSION <version>] (0-based indexing)\n");
         return;
     }
     
@@ -496,97 +547,107 @@ void handle_write_command(command_t cmd, const char* args) {
         printf("Error: Sentence number must be >= 0\n");
         return;
     }
-    
-    // Step 1: Ask Name Server for storage server location
-    request_packet_t request;
-    memset(&request, 0, sizeof(request));
-    request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_WRITE;
-    strncpy(request.username, username, sizeof(request.username) - 1);
-    snprintf(request.args, sizeof(request.args), "%s %d", filename, sentence_num);
-    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
-    
-    if (send_packet(nm_socket, &request) < 0) {
-        printf("Error: Failed to send WRITE request to name server\n");
+    // Phase 7: "<sentence>:<first>-<last>" locks only those words
+    if (strchr(target, ':') != NULL &&
+        (sscanf(target, "%*d:%d-%d", &first_word, &last_word) != 2 ||
+         first_word < 0 || last_word < first_word)) {
+        printf("Error: Word range must be <sentence>:<first>-<last> with 0 <= first <= last\n");
         return;
     }
-    
-    // Step 2: Receive response from Name Server
-    response_packet_t response;
-    if (recv_packet(nm_socket, &response) <= 0) {
-        printf("Error: Failed to receive response from name server\n");
-        return;
-    }
-    
-    if (response.status != STATUS_OK) {
-        printf("Error: %s\n", response.data);
+    if (wait_seconds < 0) {
+        printf("Error: Wait time must be >= 0 seconds\n");
         return;
     }
     
-    // Step 3: Parse SS IP:PORT from response
-    char ss_ip[INET_ADDRSTRLEN];
-    int ss_port;
-    if (sscanf(response.data, "%[^:]:%d", ss_ip, &ss_port) != 2) {
-        printf("Error: Invalid storage server location: %s\n", response.data);
-        return;
+    // Step 1: Resolve storage server location (lease cache, then Name Server)
+    request_packet_t request;
+    response_packet_t response;
+    int ss_socket = -1;
+    char nm_args[MAX_ARGS_LEN];
+    snprintf(nm_args, sizeof(nm_args), "%s %d", filename, sentence_num);
+    
+    for (int attempt = 0; attempt < 2 && ss_socket < 0; attempt++) {
+        ss_location_t loc;
+        if (resolve_file_location(CMD_WRITE, nm_args, filename, ACCESS_WRITE, &loc) != 0) {
+            return;
+        }
+        
+        // Step 2: Connect to Storage Server
+        ss_socket = connect_to_storage_server(&loc);
+        if (ss_socket < 0) {
+            if (loc.from_cache) {
+                invalidate_cached_location(filename);
+                continue;
+            }
+            return;
+        }
+        
+        // Step 3: Send initial WRITE request to Storage Server (with our lease)
+        memset(&request, 0, sizeof(request));
+        request.magic = PROTOCOL_MAGIC;
+        request.command = CMD_WRITE;
+        strncpy(request.username, username, sizeof(request.username) - 1);
+        // Phase 7: A wait time lets the SS queue us for a busy sentence
+        if (wait_seconds > 0) {
+            snprintf(request.args, sizeof(request.args), "%s %s %d", filename, target,
+                     wait_seconds);
+        } else {
+            snprintf(request.args, sizeof(request.args), "%s %s", filename, target);
+        }
+        if (conditional) {
+            size_t used = strlen(request.args);
+            snprintf(request.args + used, sizeof(request.args) - used, " IFVERSION %u", if_version);
+        }
+        append_location_tokens(request.args, sizeof(request.args), &loc);
+        request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
+        
+        if (send_packet(ss_socket, &request) < 0) {
+            printf("Error: Failed to send WRITE request to storage server\n");
+            close(ss_socket);
+            return;
+        }
+        
+        // Step 4: Receive response from Storage Server (lock acquisition)
+        if (recv_packet(ss_socket, &response) <= 0) {
+            printf("Error: Failed to receive response from storage server\n");
+            close(ss_socket);
+            return;
+        }
+        
+        if (response.status != STATUS_OK) {
+            close(ss_socket);
+            ss_socket = -1;
+            if (response.status == STATUS_ERROR_LEASE_EXPIRED ||
+                (loc.from_cache && response.status == STATUS_ERROR_NOT_FOUND)) {
+                invalidate_cached_location(filename);
+                continue;
+            }
+            printf("Error: %s\n", response.data);
+            return;
+        }
     }
     
-    // Step 4: Connect to Storage Server
-    int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (ss_socket < 0) {
-        printf("Error: Failed to create socket for storage server\n");
-        return;
-    }
-    
-    struct sockaddr_in ss_addr;
-    memset(&ss_addr, 0, sizeof(ss_addr));
-    ss_addr.sin_family = AF_INET;
-    ss_addr.sin_port = htons(ss_port);
-    
-    if (inet_pton(AF_INET, ss_ip, &ss_addr.sin_addr) <= 0) {
-        printf("Error: Invalid storage server IP address: %s\n", ss_ip);
-        close(ss_socket);
-        return;
-    }
-    
-    if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) < 0) {
-        printf("Error: Failed to connect to storage server at %s:%d\n", ss_ip, ss_port);
-        close(ss_socket);
-        return;
-    }
-    
-    // Step 5: Send initial WRITE request to Storage Server
-    memset(&request, 0, sizeof(request));
-    request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_WRITE;
-    strncpy(request.username, username, sizeof(request.username) - 1);
-    snprintf(request.args, sizeof(request.args), "%s %d", filename, sentence_num);
-    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
-    
-    if (send_packet(ss_socket, &request) < 0) {
-        printf("Error: Failed to send WRITE request to storage server\n");
-        close(ss_socket);
+        printf("Error: Storage server location changed, please retry\n");
         return;
     }
     
-    // Step 6: Receive response from Storage Server (lock acquisition)
-    if (recv_packet(ss_socket, &response) <= 0) {
-        printf("Error: Failed to receive response from storage server\n");
-        close(ss_socket);
-        return;
+    if (last_word >= 0) {
+        printf("Lock acquired for words %d-%d of sentence %d of '%s'\n", first_word, last_word,
+               sentence_num, filename);
+    } else {
+        printf("Lock acquired for sentence %d of '%s'\n", sentence_num, filename);
     }
-    
-    if (response.status != STATUS_OK) {
-        printf("Error: %s\n", response.data);
-        close(ss_socket);
-        return;
+    // Phase 7: The SS may hand back edits of a session a restart interrupted
+    const char* resumed = strstr(response.data, "; resumed ");
+    if (resumed != NULL) {
+        printf("Note: %s (saved before the storage server restarted)\n", resumed + 2);
     }
-    
-    printf("Lock acquired for sentence %d of '%s'\n", sentence_num, filename);
     printf("Enter word updates in format: <word_index> <content> (0-based indexing)\n");
-    printf("Type 'ETIRW' when done to save changes\n");
+    printf("Type 'ETIRW' when done to save changes "
+           "('ETIRW IFVERSION <v>' saves only if no one else saved since version v)\n");
     
-    // Step 7: Enter interactive word update loop
+    // Step 5: Enter interactive word update loop
     char* line = NULL;
     while (1) {
         line = readline("WRITE> ");
@@ -606,14 +667,30 @@ void handle_write_command(command_t cmd, const char* args) {
         
         add_history(line);
         
-        // Check for ETIRW command
-        if (strcmp(trimmed, "ETIRW") == 0 || strcmp(trimmed, "etirw") == 0) {
+        // Check for ETIRW command (Phase 7: optionally "ETIRW IFVERSION <v>")
+        if ((strncmp(trimmed, "ETIRW", 5) == 0 || strncmp(trimmed, "etirw", 5) == 0) &&
+            (trimmed[5] == '\0' || trimmed[5] == ' ')) {
+            char condition[64] = "";
+            strncpy(condition, trimmed + 5, sizeof(condition) - 1);
+            uint32_t etirw_version = 0;
+            int etirw_conditional = extract_version_condition(condition, &etirw_version);
+            if (etirw_conditional < 0 || strspn(condition, " \t") != strlen(condition)) {
+                printf("Invalid format. Use: ETIRW [IFVERSION <version>]\n");
+                free(line);
+                continue;
+            }
+            
             // Send ETIRW command
             memset(&request, 0, sizeof(request));
             request.magic = PROTOCOL_MAGIC;
             request.command = CMD_ETIRW;
             strncpy(request.username, username, sizeof(request.username) - 1);
-            strncpy(request.args, filename, sizeof(request.args) - 1);
+            if (etirw_conditional) {
+                snprintf(request.args, sizeof(request.args), "%s IFVERSION %u", filename,
+                         etirw_version);
+            } else {
+                strncpy(request.args, filename, sizeof(request.args) - 1);
+            }
             request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
             
             if (send_packet(ss_socket, &request) < 0) {
@@ -630,7 +707,14 @@ void handle_write_command(command_t cmd, const char* args) {
             }
             
             if (response.status == STATUS_OK) {
-                printf("Changes saved successfully\n");
+                // Phase 7: Show the revision number REVERT can return to
+                // and the file's new version
+                const char* revision = strstr(response.data, "(revision");
+                if (revision == NULL) {
+                    revision = strstr(response.data, "(version");
+                }
+                printf("Changes saved successfully%s%s\n", revision ? " " : "",
+                       revision ? revision : "");
             } else {
                 printf("Error saving changes: %s\n", response.data);
             }
@@ -701,6 +785,11 @@ void handle_write_command(command_t cmd, const char* args) {
             printf("Word %d updated\n", word_index); // Show 0-based index to user
         } else {
             printf("Error: %s\n", response.data);
+            if (response.status == STATUS_ERROR_TIMEOUT) {
+                // Phase 7: The lock's lease lapsed; the SS ended the session
+                free(line);
+                break;
+            }
         }
         
         free(line);
@@ -817,88 +906,78 @@ void handle_stream_command(command_t cmd, const char* args) {
     
     sscanf(args, "%s", filename);
     
-    // Step 1: Ask Name Server for storage server location
+    // Step 1: Resolve storage server location (lease cache, then Name Server)
     request_packet_t request;
-    memset(&request, 0, sizeof(request));
-    request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_STREAM;
-    strncpy(request.username, username, sizeof(request.username) - 1);
-    strncpy(request.args, filename, sizeof(request.args) - 1);
-    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
-    
-    if (send_packet(nm_socket, &request) < 0) {
-        printf("Error: Failed to send STREAM request to Name Server\n");
-        return;
-    }
-    
-    // Step 2: Get response from Name Server
     response_packet_t response;
-    if (recv_packet(nm_socket, &response) <= 0) {
-        printf("Error: No response from Name Server\n");
-        return;
-    }
-    
-    if (response.status != STATUS_OK) {
-        printf("Error: %s\n", response.data);
-        return;
-    }
-    
-    // Step 3: Parse Storage Server location (format: "IP:PORT")
-    char ss_ip[INET_ADDRSTRLEN];
-    int ss_port;
-    if (sscanf(response.data, "%[^:]:%d", ss_ip, &ss_port) != 2) {
-        printf("Error: Invalid storage server location: %s\n", response.data);
-        return;
-    }
-    
-    printf("Streaming from Storage Server at %s:%d...\n", ss_ip, ss_port);
-    
-    // Step 4: Connect to Storage Server
-    int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (ss_socket == -1) {
-        printf("Error: Failed to create socket\n");
-        return;
-    }
-    
-    struct sockaddr_in ss_addr;
-    memset(&ss_addr, 0, sizeof(ss_addr));
-    ss_addr.sin_family = AF_INET;
-    ss_addr.sin_port = htons(ss_port);
-    
-    if (inet_pton(AF_INET, ss_ip, &ss_addr.sin_addr) <= 0) {
-        printf("Error: Invalid storage server address\n");
-        close(ss_socket);
-        return;
-    }
-    
-    if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) == -1) {
-        printf("Error: Failed to connect to storage server: %s\n", strerror(errno));
-        close(ss_socket);
-        return;
+    uint64_t content_length = 0;
+    uint32_t version = 0;
+    int ss_socket = -1;
+    
+    for (int attempt = 0; attempt < 2 && ss_socket < 0; attempt++) {
+        ss_location_t loc;
+        if (resolve_file_location(CMD_STREAM, filename, filename, ACCESS_READ, &loc) != 0) {
+            return;
+        }
+        
+        printf("Streaming from Storage Server at %s:%d...\n", loc.ss_ip, loc.ss_port);
+        
+        // Step 2: Connect to Storage Server
+        ss_socket = connect_to_storage_server(&loc);
+        if (ss_socket < 0) {
+            if (loc.from_cache) {
+                invalidate_cached_location(filename);
+                continue;
+            }
+            return;
+        }
+        
+        // Step 3: Send STREAM request to Storage Server (with our lease)
+        memset(&request, 0, sizeof(request));
+        request.magic = PROTOCOL_MAGIC;
+        request.command = CMD_STREAM;
+        strncpy(request.username, username, sizeof(request.username) - 1);
+        strncpy(request.args, filename, sizeof(request.args) - 1);
+        append_location_tokens(request.args, sizeof(request.args), &loc);
+        request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
+        
+        if (send_packet(ss_socket, &request) < 0) {
+            printf("Error: Failed to send STREAM request to storage server\n");
+            close(ss_socket);
+            return;
+        }
+        
+        // Step 4: A status packet instead of a content header means an error
+        // or a stale lease
+        int status = recv_content_header(ss_socket, &response, &content_length, &version);
+        if (status != 0) {
+            close(ss_socket);
+            ss_socket = -1;
+            if (status > 0 && (response.status == STATUS_ERROR_LEASE_EXPIRED ||
+                               (loc.from_cache && response.status == STATUS_ERROR_NOT_FOUND))) {
+                invalidate_cached_location(filename);
+                continue;
+            }
+            printf("Error: %s\n", status > 0 ? response.data : "Failed to stream from storage server");
+            return;
+        }
     }
     
-    // Step 5: Send STREAM request to Storage Server
-    memset(&request, 0, sizeof(request));
-    request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_STREAM;
-    strncpy(request.username, username, sizeof(request.username) - 1);
-    strncpy(request.args, filename, sizeof(request.args) - 1);
-    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
-    
-    if (send_packet(ss_socket, &request) < 0) {
-        printf("Error: Failed to send STREAM request to storage server\n");
-        close(ss_socket);
+    if (ss_socket < 0) {
+        printf("Error: Storage server location changed, please retry\n");
         return;
     }
     
-    // Step 6: Stream file content word-by-word with delay
-    printf("\n--- Streaming: %s ---\n", filename);
+    // Step 5: Stream file content word-by-word with delay
+    printf("\n--- Streaming: %s (version %u) ---\n", filename, version);
     char buffer[4096];
-    ssize_t bytes;
+    ssize_t bytes = 0;
     char accumulated[8192] = "";
     int acc_len = 0;
+    uint64_t remaining = content_length;
     
-    while ((bytes = recv(ss_socket, buffer, sizeof(buffer) - 1, 0)) > 0) {
+    while (remaining > 0 &&
+           (bytes = recv(ss_socket, buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer) - 1, 0)) > 0) {
+        remaining -= bytes;
         buffer[bytes] = '\0';
         
         // Accumulate data
@@ -951,7 +1030,7 @@ void handle_stream_command(command_t cmd, const char* args) {
         printf("%s", accumulated);
     }
     
-    if (bytes < 0) {
+    if (remaining > 0) {
         printf("\nError: Failed to stream from storage server\n");
     } else {
         printf("\n--- End of Stream ---\n");
@@ -1084,28 +1163,49 @@ void handle_exec_command(command_t cmd, const char* args) {
     }
 }
 
+// Phase 7: UNDO <filename> [n], REVERT <filename> <rev|tag>,
+// CHECKPOINT <filename> <tag> and LISTCHECKPOINTS <filename>
 void handle_undo_command(command_t cmd, const char* args) { 
-    (void)cmd;
-    
-    // Parse filename from args
+    // Parse filename and the optional step count / revision / tag from args
     char filename[MAX_FILENAME_LEN];
-    if (args == NULL || sscanf(args, "%s", filename) != 1) {
-        printf("Error: UNDO requires a filename\n");
-        printf("Usage: UNDO <filename>\n");
+    char which[64] = "1";
+    int fields = (args != NULL) ? sscanf(args, "%255s %63s", filename, which) : 0;
+    
+    if (fields < 1) {
+        printf("Error: %s requires a filename\n", command_to_string(cmd));
+        return;
+    }
+    if (cmd == CMD_REVERT && fields != 2) {
+        printf("Error: REVERT requires a filename and a revision number or checkpoint tag\n");
+        printf("Usage: REVERT <filename> <revision|tag>\n");
+        return;
+    }
+    if (cmd == CMD_CHECKPOINT && fields != 2) {
+        printf("Error: CHECKPOINT requires a filename and a tag\n");
+        printf("Usage: CHECKPOINT <filename> <tag>\n");
+        return;
+    }
+    if (cmd == CMD_UNDO && atoi(which) < 1) {
+        printf("Error: UNDO step count must be a positive number\n");
+        printf("Usage: UNDO <filename> [steps]\n");
         return;
     }
     
-    // Send UNDO request to Name Server
+    // Send the request to Name Server
     request_packet_t request;
     memset(&request, 0, sizeof(request));
     request.magic = PROTOCOL_MAGIC;
-    request.command = CMD_UNDO;
+    request.command = cmd;
     strncpy(request.username, username, sizeof(request.username) - 1);
-    strncpy(request.args, filename, sizeof(request.args) - 1);
+    if (cmd == CMD_LISTCHECKPOINTS) {
+        snprintf(request.args, sizeof(request.args), "%s", filename);
+    } else {
+        snprintf(request.args, sizeof(request.args), "%s %s", filename, which);
+    }
     request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
     
     if (send_packet(nm_socket, &request) < 0) {
-        printf("Error: Failed to send UNDO request\n");
+        printf("Error: Failed to send %s request\n", command_to_string(request.command));
         return;
     }
     
@@ -1117,7 +1217,7 @@ void handle_undo_command(command_t cmd, const char* args) {
     }
     
     if (response.status == STATUS_OK) {
-        printf("File '%s' restored from backup\n", filename);
+        printf("%s\n", response.data);
     } else {
         printf("Error: %s\n", response.data);
     }
@@ -1167,4 +1267,149 @@ void cleanup_and_exit(int signal) {
     }
     
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
+// ===========================
+// Phase 7: Location Cache
+// ===========================
+
+static unsigned int location_slot(const char* filename) {
+    unsigned int hash = 5381;
+    int c;
+    
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    
+    return hash % LOCATION_CACHE_SIZE;
+}
+
+// Drop a cached location (stale lease, vanished file or unreachable SS)
+void invalidate_cached_location(const char* filename) {
+    location_entry_t* entry = &location_cache[location_slot(filename)];
+    if (strcmp(entry->filename, filename) == 0) {
+        memset(entry, 0, sizeof(*entry));
+    }
+}
+
+// Resolve where a file lives: reuse an unexpired lease that covers the
+// requested access, otherwise ask the Name Server (which also checks access)
+int resolve_file_location(command_t cmd, const char* nm_args, const char* filename,
+                          int access, ss_location_t* loc) {
+    memset(loc, 0, sizeof(*loc));
+    
+    location_entry_t* entry = &location_cache[location_slot(filename)];
+    if (strcmp(entry->filename, filename) == 0 && (entry->access & access) == access &&
+        entry->expires_at > time(NULL)) {
+        strncpy(loc->ss_ip, entry->ss_ip, sizeof(loc->ss_ip) - 1);
+        loc->ss_port = entry->ss_port;
+        loc->lease_version = entry->lease_version;
+        strncpy(loc->capability, entry->capability, sizeof(loc->capability) - 1);
+        loc->has_lease = 1;
+        loc->from_cache = 1;
+        return 0;
+    }
+    
+    request_packet_t request;
+    memset(&request, 0, sizeof(request));
+    request.magic = PROTOCOL_MAGIC;
+    request.command = cmd;
+    strncpy(request.username, username, sizeof(request.username) - 1);
+    strncpy(request.args, nm_args, sizeof(request.args) - 1);
+    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
+    
+    if (send_packet(nm_socket, &request) < 0) {
+        printf("Error: Failed to send %s request to Name Server\n", command_to_string(cmd));
+        return -1;
+    }
+    
+    response_packet_t response;
+    if (recv_packet(nm_socket, &response) <= 0) {
+        printf("Error: No response from Name Server\n");
+        return -1;
+    }
+    
+    if (response.status != STATUS_OK) {
+        printf("Error: %s\n", response.data);
+        return -1;
+    }
+    
+    // Format: "IP:PORT ttl=<seconds> lease=<version> cap=<token> version=<document version>"
+    // (older NMs send "IP:PORT" or omit the capability)
+    int ttl = 0;
+    unsigned int lease_version = 0;
+    int fields = sscanf(response.data, "%15[^:]:%d ttl=%d lease=%u cap=%95s",
+                        loc->ss_ip, &loc->ss_port, &ttl, &lease_version, loc->capability);
+    if (fields < 2) {
+        printf("Error: Invalid storage server location: %s\n", response.data);
+        return -1;
+    }
+    
+    if (fields >= 4) {
+        loc->lease_version = lease_version;
+        loc->has_lease = 1;
+        
+        int granted = access;
+        if (fields == 5) {
+            // The capability covers exactly what it grants ('W' implies read)
+            granted = (loc->capability[0] == 'W') ? ACCESS_BOTH : ACCESS_READ;
+        } else if (strcmp(entry->filename, filename) == 0 && entry->lease_version == lease_version &&
+                   strcmp(entry->ss_ip, loc->ss_ip) == 0 && entry->ss_port == loc->ss_port &&
+                   entry->expires_at > time(NULL)) {
+            // Keep the access bits of a still-valid lease for the same location
+            granted |= entry->access;
+        }
+        
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
+        strncpy(entry->ss_ip, loc->ss_ip, sizeof(entry->ss_ip) - 1);
+        entry->ss_port = loc->ss_port;
+        entry->access = granted;
+        entry->lease_version = lease_version;
+        strncpy(entry->capability, loc->capability, sizeof(entry->capability) - 1);
+        entry->expires_at = time(NULL) + ttl;
+    }
+    
+    return 0;
+}
+
+// Attach the lease (and capability, if any) to a request for the SS.
+// The capability goes first: the SS strips the lease, then the capability.
+void append_location_tokens(char* args, size_t size, const ss_location_t* loc) {
+    if (!loc->has_lease) {
+        return;
+    }
+    if (loc->capability[0] != '\0') {
+        append_capability_token(args, size, loc->capability);
+    }
+    append_lease_token(args, size, loc->lease_version);
+}
+
+// Open a TCP connection to a storage server; returns the socket or -1
+int connect_to_storage_server(const ss_location_t* loc) {
+    int ss_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (ss_socket == -1) {
+        printf("Error: Failed to create socket\n");
+        return -1;
+    }
+    
+    struct sockaddr_in ss_addr;
+    memset(&ss_addr, 0, sizeof(ss_addr));
+    ss_addr.sin_family = AF_INET;
+    ss_addr.sin_port = htons(loc->ss_port);
+    
+    if (inet_pton(AF_INET, loc->ss_ip, &ss_addr.sin_addr) <= 0) {
+        printf("Error: Invalid storage server address\n");
+        close(ss_socket);
+        return -1;
+    }
+    
+    if (connect(ss_socket, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) == -1) {
+        if (!loc->from_cache) {
+            printf("Error: Failed to connect to storage server: %s\n", strerror(errno));
+        }
+        close(ss_socket);
+        return -1;
+    }
+    
+    return ss_socket;
+}
@@ -0,0 +1,170 @@
+/*
+ * Capability token implementation for Docs++
+ * Signs and verifies NM-issued access grants with HMAC-SHA256
+ */
+
+#include "../include/capability.h"
+#include "../include/sha256.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void to_hex(const uint8_t* bytes, size_t len, char* out) {
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = hex_digits[bytes[i] >> 4];
+        out[i * 2 + 1] = hex_digits[bytes[i] & 0x0f];
+    }
+    out[len * 2] = '\0';
+}
+
+static int from_hex(const char* hex, uint8_t* bytes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned int byte;
+        if (!hex[i * 2] || !hex[i * 2 + 1] || sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            return -1;
+        }
+        bytes[i] = (uint8_t)byte;
+    }
+    return 0;
+}
+
+// Compute the truncated MAC over the fields a token binds together
+static void capability_mac(const uint8_t key[CAPABILITY_KEY_LEN], const char* username,
+                           const char* filename, char perm, long expiry,
+                           uint32_t lease_version, uint8_t mac[CAPABILITY_MAC_LEN]) {
+    char payload[MAX_USERNAME_LEN + MAX_FILENAME_LEN + 64];
+    int len = snprintf(payload, sizeof(payload), "%s\n%s\n%c\n%ld\n%u",
+                       username, filename, perm, expiry, lease_version);
+    if (len < 0 || len >= (int)sizeof(payload)) {
+        len = sizeof(payload) - 1;
+    }
+
+    uint8_t full[SHA256_DIGEST_LEN];
+    hmac_sha256(key, CAPABILITY_KEY_LEN, payload, (size_t)len, full);
+    memcpy(mac, full, CAPABILITY_MAC_LEN);
+}
+
+// Fill key with random bytes; falls back to a time/pid mix without /dev/urandom
+int generate_capability_key(uint8_t key[CAPABILITY_KEY_LEN]) {
+    FILE* fp = fopen("/dev/urandom", "rb");
+    if (fp != NULL) {
+        size_t got = fread(key, 1, CAPABILITY_KEY_LEN, fp);
+        fclose(fp);
+        if (got == CAPABILITY_KEY_LEN) {
+            return 0;
+        }
+    }
+
+    char seed[64];
+    snprintf(seed, sizeof(seed), "%ld:%d:%ld", (long)time(NULL), (int)getpid(), (long)clock());
+    sha256(seed, strlen(seed), key);
+    return -1;
+}
+
+void encode_capability_key(const uint8_t key[CAPABILITY_KEY_LEN], char* hex, size_t size) {
+    if (size < CAPABILITY_KEY_LEN * 2 + 1) {
+        if (size > 0) hex[0] = '\0';
+        return;
+    }
+    to_hex(key, CAPABILITY_KEY_LEN, hex);
+}
+
+int decode_capability_key(const char* hex, uint8_t key[CAPABILITY_KEY_LEN]) {
+    if (hex == NULL) {
+        return -1;
+    }
+    return from_hex(hex, key, CAPABILITY_KEY_LEN);
+}
+
+/**
+ * issue_capability - Sign an access grant for one user and file
+ * @key: Shared NM/SS key
+ * @access: ACCESS_READ, or ACCESS_WRITE/ACCESS_BOTH for a write grant
+ * @expiry: Absolute time after which the grant is refused
+ * @lease_version: Location lease the grant is bound to
+ * @token: Output "<R|W>.<expiry>.<mac>"
+ *
+ * Returns: 0 on success, -1 if token does not fit
+ */
+int issue_capability(const uint8_t key[CAPABILITY_KEY_LEN], const char* username,
+                     const char* filename, int access, time_t expiry,
+                     uint32_t lease_version, char* token, size_t size) {
+    char perm = (access & ACCESS_WRITE) ? 'W' : 'R';
+    uint8_t mac[CAPABILITY_MAC_LEN];
+    char mac_hex[CAPABILITY_MAC_LEN * 2 + 1];
+
+    capability_mac(key, username, filename, perm, (long)expiry, lease_version, mac);
+    to_hex(mac, CAPABILITY_MAC_LEN, mac_hex);
+
+    int written = snprintf(token, size, "%c.%ld.%s", perm, (long)expiry, mac_hex);
+    return (written < 0 || (size_t)written >= size) ? -1 : 0;
+}
+
+/**
+ * verify_capability - Check a presented token entirely in memory
+ * @access: Access the request needs (a W grant also covers reads)
+ * @now: Current time, passed in so callers can share one clock read
+ *
+ * Returns: CAPABILITY_OK or the reason the token is refused
+ */
+capability_status_t verify_capability(const uint8_t key[CAPABILITY_KEY_LEN], const char* token,
+                                      const char* username, const char* filename,
+                                      int access, uint32_t lease_version, time_t now) {
+    char perm;
+    long expiry;
+    char mac_hex[CAPABILITY_MAC_LEN * 2 + 2];
+
+    if (token == NULL || sscanf(token, "%c.%ld.%33s", &perm, &expiry, mac_hex) != 3 ||
+        strlen(mac_hex) != CAPABILITY_MAC_LEN * 2 || (perm != 'R' && perm != 'W')) {
+        return CAPABILITY_INVALID;
+    }
+
+    uint8_t presented[CAPABILITY_MAC_LEN];
+    uint8_t expected[CAPABILITY_MAC_LEN];
+    if (from_hex(mac_hex, presented, CAPABILITY_MAC_LEN) != 0) {
+        return CAPABILITY_INVALID;
+    }
+    capability_mac(key, username, filename, perm, expiry, lease_version, expected);
+
+    // Constant-time comparison
+    uint8_t diff = 0;
+    for (int i = 0; i < CAPABILITY_MAC_LEN; i++) {
+        diff |= presented[i] ^ expected[i];
+    }
+    if (diff != 0) {
+        return CAPABILITY_INVALID;
+    }
+
+    if ((access & ACCESS_WRITE) && perm != 'W') {
+        return CAPABILITY_DENIED;
+    }
+    if (now > (time_t)expiry) {
+        return CAPABILITY_EXPIRED;
+    }
+
+    return CAPABILITY_OK;
+}
+
+// Append a " cap=<token>" suffix to request args
+int append_capability_token(char* args, size_t size, const char* token) {
+    size_t len = strlen(args);
+    int written = snprintf(args + len, size - len, " cap=%s", token);
+    if (written < 0 || (size_t)written >= size - len) {
+        args[len] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+// Find and strip a trailing " cap=<token>" suffix
+// Returns 1 if a token was found, 0 otherwise
+int extract_capability_token(char* args, char* token, size_t size) {
+    char* suffix = strstr(args, " cap=");
+    if (suffix == NULL) {
+        return 0;
+    }
+
+    snprintf(token, size, "%s", suffix + 5);
+    token[strcspn(token, " ")] = '\0';
+    *suffix = '\0';
+    return 1;
+}
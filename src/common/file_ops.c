@@ -1,5 +1,6 @@
 #include "../include/file_ops.h"
 #include "../include/common.h"
+#include "../include/text_scan.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,9 +14,118 @@ int is_sentence_delimiter(char c) {
     return (c == '.' || c == '!' || c == '?');
 }
 
+/**
+ * Set a sentence's text, growing its buffer as needed
+ */
+int set_sentence_content(sentence_t* sentence, const char* text, size_t length) {
+    if (!sentence || !text) {
+        return -1;
+    }
+
+    if (sentence->content == NULL || length + 1 > sentence->capacity) {
+        size_t capacity = (length + 1 > 16) ? length + 1 : 16;
+        char* grown = realloc(sentence->content, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        sentence->content = grown;
+        sentence->capacity = capacity;
+    }
+
+    memmove(sentence->content, text, length);
+    sentence->content[length] = '\0';
+    sentence->length = length;
+    sentence->word_count = count_words_in_sentence(sentence->content);
+    return 0;
+}
+
+// Sentence rope internals (implicit treap keyed by position)
+
+static uint32_t next_priority(file_content_t* file_content) {
+    // xorshift32: cheap, and per-document so it needs no locking
+    uint32_t x = file_content->seed ? file_content->seed : 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    file_content->seed = x;
+    return x;
+}
+
+static int node_sentences(const sentence_node_t* node) {
+    return node ? node->subtree_sentences : 0;
+}
+
+static void pull_totals(sentence_node_t* node) {
+    node->subtree_sentences = 1 + node_sentences(node->left) + node_sentences(node->right);
+    node->subtree_bytes = node->sentence.length +
+                          (node->left ? node->left->subtree_bytes : 0) +
+                          (node->right ? node->right->subtree_bytes : 0);
+    node->subtree_words = node->sentence.word_count +
+                          (node->left ? node->left->subtree_words : 0) +
+                          (node->right ? node->right->subtree_words : 0);
+}
+
+// Split into the first `count` sentences and the rest
+static void split_nodes(sentence_node_t* node, int count,
+                        sentence_node_t** left, sentence_node_t** right) {
+    if (node == NULL) {
+        *left = *right = NULL;
+        return;
+    }
+
+    if (node_sentences(node->left) < count) {
+        split_nodes(node->right, count - node_sentences(node->left) - 1, &node->right, right);
+        *left = node;
+    } else {
+        split_nodes(node->left, count, left, &node->left);
+        *right = node;
+    }
+    pull_totals(node);
+}
+
+static sentence_node_t* merge_nodes(sentence_node_t* left, sentence_node_t* right) {
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+
+    if (left->priority > right->priority) {
+        left->right = merge_nodes(left->right, right);
+        pull_totals(left);
+        return left;
+    }
+    right->left = merge_nodes(left, right->left);
+    pull_totals(right);
+    return right;
+}
+
+static void free_nodes(sentence_node_t* node) {
+    if (node == NULL) {
+        return;
+    }
+    free_nodes(node->left);
+    free_nodes(node->right);
+    free(node->sentence.content);
+    free(node);
+}
+
+static sentence_node_t* new_sentence_node(file_content_t* file_content,
+                                          const char* text, size_t length) {
+    sentence_node_t* node = calloc(1, sizeof(sentence_node_t));
+    if (node == NULL) {
+        return NULL;
+    }
+    if (set_sentence_content(&node->sentence, text, length) != 0) {
+        free(node);
+        return NULL;
+    }
+    node->priority = next_priority(file_content);
+    pull_totals(node);
+    return node;
+}
+
 /**
  * Parse file content into sentences
- * Splits content by sentence delimiters (. ! ?)
+ * Splits content by sentence delimiters (. ! ?). The result must be
+ * released with free_file_content().
  */
 int parse_file_into_sentences(const char* content, file_content_t* file_content) {
     if (!content || !file_content) {
@@ -24,76 +134,182 @@ int parse_file_into_sentences(const char* content, file_content_t* file_content)
 
     memset(file_content, 0, sizeof(file_content_t));
     
-    int sentence_idx = 0;
-    int char_idx = 0;
-    int content_len = strlen(content);
+    size_t content_len = strlen(content);
+    size_t start = 0;
     
-    for (int i = 0; i < content_len && sentence_idx < 1000; i++) {
-        char c = content[i];
+    while (start < content_len) {
+        // A sentence ends at a delimiter or at the end of the content
+        size_t end = start + text_find_delimiter(content + start, content_len - start);
+        if (end < content_len) {
+            end++;  // Keep the delimiter
+        }
         
-        // Add character to current sentence
-        if (char_idx < MAX_SENTENCE_LEN - 1) {
-            file_content->sentences[sentence_idx].content[char_idx++] = c;
+        sentence_node_t* node = new_sentence_node(file_content, content + start, end - start);
+        if (node == NULL) {
+            free_file_content(file_content);
+            return -1;
         }
+        file_content->root = merge_nodes(file_content->root, node);
+        file_content->sentence_count++;
         
-        // Check if we hit a sentence delimiter
-        if (is_sentence_delimiter(c)) {
-            // Skip whitespace after delimiter
-            while (i + 1 < content_len && isspace(content[i + 1])) {
-                i++;
-            }
-            
-            // Null-terminate current sentence
-            file_content->sentences[sentence_idx].content[char_idx] = '\0';
-            
-            // Count words in this sentence
-            file_content->sentences[sentence_idx].word_count = 
-                count_words_in_sentence(file_content->sentences[sentence_idx].content);
-            
-            // Move to next sentence
-            sentence_idx++;
-            char_idx = 0;
+        // Skip whitespace after delimiter
+        while (end < content_len && isspace((unsigned char)content[end])) {
+            end++;
         }
+        start = end;
     }
     
-    // Handle last sentence if it doesn't end with a delimiter
-    if (char_idx > 0 && sentence_idx < 1000) {
-        file_content->sentences[sentence_idx].content[char_idx] = '\0';
-        file_content->sentences[sentence_idx].word_count = 
-            count_words_in_sentence(file_content->sentences[sentence_idx].content);
-        sentence_idx++;
+    return 0;
+}
+
+/**
+ * Release every sentence of a parsed document
+ */
+void free_file_content(file_content_t* file_content) {
+    if (!file_content) {
+        return;
     }
-    
-    file_content->sentence_count = sentence_idx;
+    free_nodes(file_content->root);
+    file_content->root = NULL;
+    file_content->sentence_count = 0;
+}
+
+/**
+ * Get the sentence at a 0-based index, or NULL if out of range
+ */
+sentence_t* get_sentence(file_content_t* file_content, int index) {
+    if (!file_content || index < 0 || index >= file_content->sentence_count) {
+        return NULL;
+    }
+
+    sentence_node_t* node = file_content->root;
+    while (node != NULL) {
+        int left_count = node_sentences(node->left);
+        if (index < left_count) {
+            node = node->left;
+        } else if (index == left_count) {
+            return &node->sentence;
+        } else {
+            index -= left_count + 1;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+// Recompute cached totals on the path to a sentence (deepest node first)
+static void refresh_path(sentence_node_t* node, int index) {
+    if (node == NULL) {
+        return;
+    }
+    int left_count = node_sentences(node->left);
+    if (index < left_count) {
+        refresh_path(node->left, index);
+    } else if (index > left_count) {
+        refresh_path(node->right, index - left_count - 1);
+    }
+    pull_totals(node);
+}
+
+/**
+ * Update document totals after a sentence returned by get_sentence() changed
+ */
+void refresh_sentence_totals(file_content_t* file_content, int index) {
+    if (!file_content || index < 0 || index >= file_content->sentence_count) {
+        return;
+    }
+    refresh_path(file_content->root, index);
+}
+
+/**
+ * Insert a new sentence before position index (index == count appends)
+ */
+int insert_sentence(file_content_t* file_content, int index, const char* text) {
+    if (!file_content || !text || index < 0 || index > file_content->sentence_count) {
+        return -1;
+    }
+
+    sentence_node_t* node = new_sentence_node(file_content, text, strlen(text));
+    if (node == NULL) {
+        return -1;
+    }
+
+    sentence_node_t *left, *right;
+    split_nodes(file_content->root, index, &left, &right);
+    file_content->root = merge_nodes(merge_nodes(left, node), right);
+    file_content->sentence_count++;
+    return 0;
+}
+
+/**
+ * Remove the sentence at position index
+ */
+int remove_sentence(file_content_t* file_content, int index) {
+    if (!file_content || index < 0 || index >= file_content->sentence_count) {
+        return -1;
+    }
+
+    sentence_node_t *left, *middle, *right;
+    split_nodes(file_content->root, index, &left, &right);
+    split_nodes(right, 1, &middle, &right);
+    free_nodes(middle);
+    file_content->root = merge_nodes(left, right);
+    file_content->sentence_count--;
     return 0;
 }
 
+/**
+ * Length of the serialized document (sentences joined by single spaces)
+ */
+size_t serialized_content_length(const file_content_t* file_content) {
+    if (!file_content || file_content->root == NULL) {
+        return 0;
+    }
+    return file_content->root->subtree_bytes + (file_content->sentence_count - 1);
+}
+
+/**
+ * Total words in the document (sum of the cached sentence counts)
+ */
+int content_word_count(const file_content_t* file_content) {
+    if (!file_content || file_content->root == NULL) {
+        return 0;
+    }
+    return file_content->root->subtree_words;
+}
+
+static void serialize_nodes(const sentence_node_t* node, char* output, size_t* offset, int* emitted) {
+    if (node == NULL) {
+        return;
+    }
+    serialize_nodes(node->left, output, offset, emitted);
+    
+    // Add space between sentences (except before the first)
+    if ((*emitted)++ > 0) {
+        output[(*offset)++] = ' ';
+    }
+    memcpy(output + *offset, node->sentence.content, node->sentence.length);
+    *offset += node->sentence.length;
+    
+    serialize_nodes(node->right, output, offset, emitted);
+}
+
 /**
  * Serialize sentences back into content string
+ * max_size must exceed serialized_content_length()
  */
 int serialize_sentences_to_content(const file_content_t* file_content, char* output, size_t max_size) {
-    if (!file_content || !output) {
+    if (!file_content || !output || max_size == 0) {
         return -1;
     }
 
-    size_t offset = 0;
-    for (int i = 0; i < file_content->sentence_count; i++) {
-        const char* sentence = file_content->sentences[i].content;
-        size_t len = strlen(sentence);
-        
-        if (offset + len >= max_size) {
-            return -1;  // Output buffer too small
-        }
-        
-        strcpy(output + offset, sentence);
-        offset += len;
-        
-        // Add space between sentences (except after last sentence)
-        if (i < file_content->sentence_count - 1 && offset < max_size - 1) {
-            output[offset++] = ' ';
-        }
+    if (serialized_content_length(file_content) >= max_size) {
+        return -1;  // Output buffer too small
     }
-    
+
+    size_t offset = 0;
+    int emitted = 0;
+    serialize_nodes(file_content->root, output, &offset, &emitted);
     output[offset] = '\0';
     return 0;
 }
@@ -105,19 +321,8 @@ int serialize_sentences_to_content(const file_content_t* file_content, char* out
 int count_words_in_sentence(const char* sentence) {
     if (!sentence) return 0;
     
-    int count = 0;
     int in_word = 0;
-    
-    for (int i = 0; sentence[i] != '\0'; i++) {
-        if (isspace(sentence[i])) {
-            in_word = 0;
-        } else if (!in_word) {
-            in_word = 1;
-            count++;
-        }
-    }
-    
-    return count;
+    return (int)text_count_words(sentence, strlen(sentence), &in_word);
 }
 
 /**
@@ -129,216 +334,205 @@ int count_chars_in_sentence(const char* sentence) {
 }
 
 /**
- * Replace word at specified position in a sentence
- * word_index is 0-based
+ * Find the next word at or after *cursor
+ * Words are maximal runs of non-whitespace. Reentrant: all state is in
+ * *cursor, and the text is never modified.
+ * Returns 1 and fills span if a word was found, 0 at the end of the text
  */
-int replace_word_at_position(sentence_t* sentence, int word_index, const char* content) {
-    if (!sentence || !content || word_index < 0) {
-        return -1;
+int next_word_span(const char* text, size_t length, size_t* cursor, word_span_t* span) {
+    size_t i = *cursor;
+    while (i < length && isspace((unsigned char)text[i])) {
+        i++;
+    }
+    if (i >= length) {
+        *cursor = length;
+        return 0;
     }
 
-    char temp[MAX_SENTENCE_LEN];
-    char* existing_words[100];  // Existing words in sentence
-    int existing_count = 0;
-    
-    // Parse existing sentence into words
-    strncpy(temp, sentence->content, MAX_SENTENCE_LEN - 1);
-    temp[MAX_SENTENCE_LEN - 1] = '\0';
-    
-    char* token = strtok(temp, " \t\n\r");
-    while (token != NULL && existing_count < 100) {
-        existing_words[existing_count++] = token;
-        token = strtok(NULL, " \t\n\r");
+    span->offset = i;
+    while (i < length && !isspace((unsigned char)text[i])) {
+        i++;
     }
-    
-    // Parse new content into words
-    char content_temp[MAX_SENTENCE_LEN];
-    char* new_words[100];  // New words from content
+    span->length = i - span->offset;
+    *cursor = i;
+    return 1;
+}
+
+/**
+ * Find the span of the word at word_index
+ * Returns 1 if found; otherwise 0, with *word_count set to the number of
+ * words and span describing the last word (if any)
+ */
+static int find_word_span(const char* text, size_t length, int word_index,
+                          word_span_t* span, int* word_count) {
+    size_t cursor = 0;
+    int count = 0;
+    word_span_t current;
+
+    while (next_word_span(text, length, &cursor, &current)) {
+        *span = current;
+        if (count++ == word_index) {
+            *word_count = count;
+            return 1;
+        }
+    }
+    *word_count = count;
+    return 0;
+}
+
+/**
+ * Replace remove_len bytes at offset with a gap of insert_len bytes
+ * Returns a pointer to the gap for the caller to fill, or NULL if the
+ * sentence could not grow
+ */
+static char* splice_sentence(sentence_t* sentence, size_t offset, size_t remove_len, size_t insert_len) {
+    size_t new_length = sentence->length - remove_len + insert_len;
+
+    if (new_length + 1 > sentence->capacity) {
+        size_t capacity = sentence->capacity ? sentence->capacity : 16;
+        while (capacity < new_length + 1) {
+            capacity *= 2;
+        }
+        char* grown = realloc(sentence->content, capacity);
+        if (grown == NULL) {
+            return NULL;
+        }
+        sentence->content = grown;
+        sentence->capacity = capacity;
+    }
+
+    memmove(sentence->content + offset + insert_len,
+            sentence->content + offset + remove_len,
+            sentence->length - offset - remove_len + 1);  // Including the NUL
+    sentence->length = new_length;
+    return sentence->content + offset;
+}
+
+/**
+ * Insert words before the word at word_index (word_index == count appends)
+ * text holds the words to insert; its whitespace is normalized to single
+ * spaces. Whitespace elsewhere in the sentence is left as it was.
+ */
+static int insert_words(sentence_t* sentence, int word_index, const char* text) {
+    size_t text_len = strlen(text);
+    size_t cursor = 0;
+    word_span_t token;
+    size_t words_len = 0;
     int new_count = 0;
-    
-    strncpy(content_temp, content, MAX_SENTENCE_LEN - 1);
-    content_temp[MAX_SENTENCE_LEN - 1] = '\0';
-    
-    token = strtok(content_temp, " \t\n\r");
-    while (token != NULL && new_count < 100) {
-        new_words[new_count++] = token;
-        token = strtok(NULL, " \t\n\r");
+
+    // Size the inserted text: words joined by single spaces
+    while (next_word_span(text, text_len, &cursor, &token)) {
+        words_len += token.length + (new_count > 0 ? 1 : 0);
+        new_count++;
     }
-    
     if (new_count == 0) {
         return -1;  // No content to insert
     }
-    
-    // Validate word_index - allow inserting at end or within existing words
-    if (word_index > existing_count) {
+
+    word_span_t target = {0, 0};
+    int existing_count = 0;
+    size_t at;
+    size_t gap;
+    int lead_space = 0;
+
+    if (sentence->content == NULL) {
+        if (set_sentence_content(sentence, "", 0) != 0) {
+            return -1;
+        }
+    }
+
+    if (find_word_span(sentence->content, sentence->length, word_index, &target, &existing_count)) {
+        at = target.offset;             // "new words" + ' ' before the target
+        gap = words_len + 1;
+    } else if (word_index == existing_count && existing_count > 0) {
+        at = target.offset + target.length;  // ' ' + "new words" after the last word
+        gap = words_len + 1;
+        lead_space = 1;
+    } else if (word_index == 0) {
+        at = 0;                         // Sentence has no words yet
+        gap = words_len;
+        sentence->length = 0;
+        sentence->content[0] = '\0';
+    } else {
         return -1;  // Don't allow gaps
     }
-    
-    // Build new sentence: words[0..word_index-1] + new_content + words[word_index..end]
-    char new_sentence[MAX_SENTENCE_LEN];
-    int offset = 0;
-    
-    // Add existing words before insertion point
-    for (int i = 0; i < word_index && i < existing_count; i++) {
-        int len = strlen(existing_words[i]);
-        if (offset + len + 1 >= MAX_SENTENCE_LEN) return -1;
-        
-        strcpy(new_sentence + offset, existing_words[i]);
-        offset += len;
-        if (offset < MAX_SENTENCE_LEN - 1) new_sentence[offset++] = ' ';
+
+    char* out = splice_sentence(sentence, at, 0, gap);
+    if (out == NULL) {
+        return -1;
     }
-    
-    // Add new words from content
-    for (int i = 0; i < new_count; i++) {
-        int len = strlen(new_words[i]);
-        if (offset + len + 1 >= MAX_SENTENCE_LEN) return -1;
-        
-        strcpy(new_sentence + offset, new_words[i]);
-        offset += len;
-        if (i < new_count - 1 || word_index < existing_count) {
-            if (offset < MAX_SENTENCE_LEN - 1) new_sentence[offset++] = ' ';
-        }
+
+    if (lead_space) {
+        *out++ = ' ';
     }
-    
-    // Add remaining existing words after insertion point
-    for (int i = word_index; i < existing_count; i++) {
-        int len = strlen(existing_words[i]);
-        if (offset + len + 1 >= MAX_SENTENCE_LEN) return -1;
-        
-        if (offset > 0 && new_sentence[offset-1] != ' ') {
-            if (offset < MAX_SENTENCE_LEN - 1) new_sentence[offset++] = ' ';
-        }
-        strcpy(new_sentence + offset, existing_words[i]);
-        offset += len;
-        if (i < existing_count - 1) {
-            if (offset < MAX_SENTENCE_LEN - 1) new_sentence[offset++] = ' ';
+    cursor = 0;
+    int written = 0;
+    while (next_word_span(text, text_len, &cursor, &token)) {
+        if (written++ > 0) {
+            *out++ = ' ';
         }
+        memcpy(out, text + token.offset, token.length);
+        out += token.length;
     }
-    
-    new_sentence[offset] = '\0';
-    
-    // Copy result back to sentence
-    strncpy(sentence->content, new_sentence, MAX_SENTENCE_LEN - 1);
-    sentence->content[MAX_SENTENCE_LEN - 1] = '\0';
-    sentence->word_count = count_words_in_sentence(sentence->content);
-    
+    if (!lead_space && gap > words_len) {
+        *out = ' ';
+    }
+
+    sentence->word_count += new_count;
     return 0;
 }
 
 /**
- * Insert word at specified position in a sentence
+ * Replace word at specified position in a sentence
+ * word_index is 0-based. The words in content are inserted before the
+ * word at word_index, or appended when word_index equals the word count.
  */
-int insert_word_at_position(sentence_t* sentence, int word_index, const char* word) {
-    if (!sentence || !word || word_index < 0) {
+int replace_word_at_position(sentence_t* sentence, int word_index, const char* content) {
+    if (!sentence || !content || word_index < 0) {
         return -1;
     }
+    return insert_words(sentence, word_index, content);
+}
 
-    char temp[MAX_SENTENCE_LEN];
-    char* words[100];
-    int word_count = 0;
-    
-    strncpy(temp, sentence->content, MAX_SENTENCE_LEN - 1);
-    temp[MAX_SENTENCE_LEN - 1] = '\0';
-    
-    char* token = strtok(temp, " \t\n\r");
-    while (token != NULL && word_count < 100) {
-        words[word_count++] = token;
-        token = strtok(NULL, " \t\n\r");
-    }
-    
-    if (word_index > word_count) {
+/**
+ * Insert word at specified position in a sentence
+ */
+int insert_word_at_position(sentence_t* sentence, int word_index, const char* word) {
+    if (!sentence || !word || word_index < 0) {
         return -1;
     }
-    
-    char new_content[MAX_SENTENCE_LEN];
-    int offset = 0;
-    
-    for (int i = 0; i <= word_count; i++) {
-        const char* current_word;
-        
-        if (i == word_index) {
-            current_word = word;
-        } else if (i < word_index) {
-            current_word = words[i];
-        } else {
-            current_word = words[i - 1];
-        }
-        
-        int len = strlen(current_word);
-        
-        if (offset + len + 1 >= MAX_SENTENCE_LEN) {
-            return -1;
-        }
-        
-        strcpy(new_content + offset, current_word);
-        offset += len;
-        
-        if (i < word_count) {
-            new_content[offset++] = ' ';
-        }
-    }
-    
-    new_content[offset] = '\0';
-    strncpy(sentence->content, new_content, MAX_SENTENCE_LEN);
-    sentence->content[MAX_SENTENCE_LEN - 1] = '\0';
-    sentence->word_count = count_words_in_sentence(sentence->content);
-    
-    return 0;
+    return insert_words(sentence, word_index, word);
 }
 
 /**
  * Delete word at specified position in a sentence
  */
 int delete_word_at_position(sentence_t* sentence, int word_index) {
-    if (!sentence || word_index < 0) {
+    if (!sentence || !sentence->content || word_index < 0) {
         return -1;
     }
 
-    char temp[MAX_SENTENCE_LEN];
-    char* words[100];
+    word_span_t target;
     int word_count = 0;
-    
-    strncpy(temp, sentence->content, MAX_SENTENCE_LEN - 1);
-    temp[MAX_SENTENCE_LEN - 1] = '\0';
-    
-    char* token = strtok(temp, " \t\n\r");
-    while (token != NULL && word_count < 100) {
-        words[word_count++] = token;
-        token = strtok(NULL, " \t\n\r");
-    }
-    
-    if (word_index >= word_count) {
+    if (!find_word_span(sentence->content, sentence->length, word_index, &target, &word_count)) {
         return -1;
     }
-    
-    char new_content[MAX_SENTENCE_LEN];
-    int offset = 0;
-    
-    for (int i = 0; i < word_count; i++) {
-        if (i == word_index) {
-            continue;  // Skip this word
-        }
-        
-        const char* current_word = words[i];
-        int len = strlen(current_word);
-        
-        if (offset + len + 1 >= MAX_SENTENCE_LEN) {
-            return -1;
-        }
-        
-        if (offset > 0) {
-            new_content[offset++] = ' ';
+
+    // Take the whitespace after the word with it, or before it for the last word
+    size_t start = target.offset;
+    size_t end = target.offset + target.length;
+    while (end < sentence->length && isspace((unsigned char)sentence->content[end])) {
+        end++;
+    }
+    if (end == sentence->length) {
+        end = target.offset + target.length;
+        while (start > 0 && isspace((unsigned char)sentence->content[start - 1])) {
+            start--;
         }
-        
-        strcpy(new_content + offset, current_word);
-        offset += len;
     }
-    
-    new_content[offset] = '\0';
-    strncpy(sentence->content, new_content, MAX_SENTENCE_LEN);
-    sentence->content[MAX_SENTENCE_LEN - 1] = '\0';
-    sentence->word_count = count_words_in_sentence(sentence->content);
-    
+
+    splice_sentence(sentence, start, end - start, 0);  // Shrinking never fails
+    sentence->word_count--;
     return 0;
 }
 
@@ -351,30 +545,27 @@ int split_sentence_at_delimiter(const char* input, char sentences[][MAX_SENTENCE
     }
 
     int sentence_idx = 0;
-    int char_idx = 0;
-    int input_len = strlen(input);
+    size_t input_len = strlen(input);
+    size_t start = 0;
     
-    for (int i = 0; i < input_len && sentence_idx < max_sentences; i++) {
-        char c = input[i];
-        
-        if (char_idx < MAX_SENTENCE_LEN - 1) {
-            sentences[sentence_idx][char_idx++] = c;
+    while (start < input_len && sentence_idx < max_sentences) {
+        size_t end = start + text_find_delimiter(input + start, input_len - start);
+        if (end < input_len) {
+            end++;
         }
         
-        if (is_sentence_delimiter(c)) {
-            while (i + 1 < input_len && isspace(input[i + 1])) {
-                i++;
-            }
-            
-            sentences[sentence_idx][char_idx] = '\0';
-            sentence_idx++;
-            char_idx = 0;
+        size_t len = end - start;
+        if (len > MAX_SENTENCE_LEN - 1) {
+            len = MAX_SENTENCE_LEN - 1;
         }
-    }
-    
-    if (char_idx > 0 && sentence_idx < max_sentences) {
-        sentences[sentence_idx][char_idx] = '\0';
+        memcpy(sentences[sentence_idx], input + start, len);
+        sentences[sentence_idx][len] = '\0';
         sentence_idx++;
+        
+        while (end < input_len && isspace((unsigned char)input[end])) {
+            end++;
+        }
+        start = end;
     }
     
     return sentence_idx;
@@ -4,6 +4,8 @@
  */
 
 #include "../include/protocol.h"
+#include <ctype.h>
+#include <stddef.h>
 #include <sys/socket.h>
 #include <string.h>
 #include <errno.h>
@@ -128,6 +130,81 @@ int send_response(int sockfd, response_packet_t* pkt) {
     return total_sent;
 }
 
+// Send the header that precedes READ/STREAM content
+int send_content_header(int sockfd, uint32_t request_id, uint64_t length, uint32_t version) {
+    content_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PROTOCOL_MAGIC;
+    header.status = STATUS_OK;
+    header.request_id = request_id;
+    header.version = version;
+    header.length = length;
+    
+    size_t total_sent = 0;
+    while (total_sent < sizeof(header)) {
+        ssize_t sent = send(sockfd, (char*)&header + total_sent, sizeof(header) - total_sent, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) continue; // Interrupted, retry
+            return -1;
+        }
+        total_sent += sent;
+    }
+    return 0;
+}
+
+static int recv_exact(int sockfd, void* buffer, size_t size) {
+    size_t total_received = 0;
+    while (total_received < size) {
+        ssize_t received = recv(sockfd, (char*)buffer + total_received, size - total_received, 0);
+        if (received == -1) {
+            if (errno == EINTR) continue; // Interrupted, retry
+            return -1;
+        }
+        if (received == 0) {
+            return -1; // Connection closed
+        }
+        total_received += received;
+    }
+    return 0;
+}
+
+/**
+ * recv_content_header - Read the reply that starts a READ/STREAM transfer
+ * @sockfd: Storage server socket
+ * @error: Filled when the server answered with a status packet
+ * @length: Filled with the content length when content follows
+ * @version: Filled with the document's version when content follows
+ *
+ * Returns: 0 if content follows, 1 if a status packet was read into error,
+ *          -1 on a malformed reply or connection error
+ */
+int recv_content_header(int sockfd, response_packet_t* error, uint64_t* length,
+                        uint32_t* version) {
+    // magic, status and request_id are shared by both reply kinds
+    const size_t common = offsetof(content_header_t, version);
+    content_header_t header;
+    
+    if (recv_exact(sockfd, &header, common) != 0 || header.magic != PROTOCOL_MAGIC) {
+        return -1;
+    }
+    
+    if (header.status == STATUS_OK) {
+        if (recv_exact(sockfd, (char*)&header + common, sizeof(header) - common) != 0) {
+            return -1;
+        }
+        *length = header.length;
+        *version = header.version;
+        return 0;
+    }
+    
+    memcpy(error, &header, common);
+    if (recv_exact(sockfd, (char*)error + common, sizeof(response_packet_t) - common) != 0 ||
+        !validate_packet_integrity(error, sizeof(response_packet_t))) {
+        return -1;
+    }
+    return 1;
+}
+
 // Receive a request packet over TCP socket
 int recv_request(int sockfd, request_packet_t* pkt) {
     if (sockfd < 0 || pkt == NULL) {
@@ -275,6 +352,78 @@ int parse_access_args(const char* args, char* filename, char* target_user, int*
     return 0;
 }
 
+// Append a " lease=<version>" token to an args string
+int append_lease_token(char* args, size_t size, uint32_t version) {
+    if (!args) {
+        return -1;
+    }
+    
+    size_t len = strlen(args);
+    int written = snprintf(args + len, size - len, " lease=%u", version);
+    if (written < 0 || (size_t)written >= size - len) {
+        args[len] = '\0';
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Find and strip a trailing " lease=<version>" token from args
+// Returns 1 if a token was found, 0 if args carry no lease
+int extract_lease_token(char* args, uint32_t* version) {
+    if (!args || !version) {
+        return 0;
+    }
+    
+    char* token = strstr(args, " lease=");
+    if (token == NULL) {
+        token = (strncmp(args, "lease=", 6) == 0) ? args : NULL;
+        if (token == NULL) {
+            return 0;
+        }
+    }
+    
+    unsigned int parsed = 0;
+    if (sscanf(strchr(token, '=') + 1, "%u", &parsed) != 1) {
+        return 0;
+    }
+    
+    *version = parsed;
+    *token = '\0';
+    return 1;
+}
+
+// Phase 7: Find and strip an " IFVERSION <version>" condition from args
+// (WRITE/ETIRW). Returns 1 if one was found, 0 if args carry none, -1 if
+// the version is missing or not a number
+int extract_version_condition(char* args, uint32_t* version) {
+    if (!args || !version) {
+        return 0;
+    }
+    
+    char* token = strstr(args, " IFVERSION");
+    if (token == NULL) {
+        token = (strncmp(args, "IFVERSION", 9) == 0) ? args : NULL;
+        if (token == NULL) {
+            return 0;
+        }
+    }
+    
+    const char* value = strstr(token, "IFVERSION") + 9;
+    while (*value == ' ') {
+        value++;
+    }
+    unsigned int parsed = 0;
+    int consumed = 0;
+    if (!isdigit((unsigned char)*value) || sscanf(value, "%u%n", &parsed, &consumed) != 1) {
+        return -1;
+    }
+    
+    *version = parsed;
+    memmove(token, value + consumed, strlen(value + consumed) + 1);
+    return 1;
+}
+
 // Convert command enum to string
 const char* command_to_string(command_t cmd) {
     switch (cmd) {
@@ -294,6 +443,9 @@ const char* command_to_string(command_t cmd) {
         case CMD_REGISTER_CLIENT: return "REGISTER_CLIENT";
         case CMD_REGISTER_SS: return "REGISTER_SS";
         case CMD_HEARTBEAT: return "HEARTBEAT";
+        case CMD_REVERT: return "REVERT";
+        case CMD_CHECKPOINT: return "CHECKPOINT";
+        case CMD_LISTCHECKPOINTS: return "LISTCHECKPOINTS";
         default: return "UNKNOWN";
     }
 }
@@ -327,6 +479,9 @@ const char* status_to_string(status_t status) {
         case STATUS_ERROR_NOT_CONNECTED: return "Not connected";
         case STATUS_ERROR_UNDO_NOT_AVAILABLE: return "Undo not available";
         case STATUS_ERROR_EXECUTION_FAILED: return "Command execution failed";
+        case STATUS_ERROR_LEASE_EXPIRED: return "Location lease expired";
+        case STATUS_ERROR_SERVER_BUSY: return "Server busy";
+        case STATUS_ERROR_VERSION_MISMATCH: return "Document version changed";
         default: return "Unknown error";
     }
 }
@@ -348,6 +503,9 @@ command_t string_to_command(const char* str) {
     if (strcasecmp(str, "ADDACCESS") == 0) return CMD_ADDACCESS;
     if (strcasecmp(str, "REMACCESS") == 0) return CMD_REMACCESS;
     if (strcasecmp(str, "EXEC") == 0) return CMD_EXEC;
+    if (strcasecmp(str, "REVERT") == 0) return CMD_REVERT;
+    if (strcasecmp(str, "CHECKPOINT") == 0) return CMD_CHECKPOINT;
+    if (strcasecmp(str, "LISTCHECKPOINTS") == 0) return CMD_LISTCHECKPOINTS;
     
     return 0; // Unknown command
 }
\ No newline at end of file
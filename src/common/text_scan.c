@@ -0,0 +1,227 @@
+/*
+ * Text Scanning Kernels for Docs++
+ * Classify whitespace and sentence delimiters 16 (SSE2) or 32 (AVX2) bytes
+ * at a time. Each vector kernel finishes the unaligned tail with the scalar
+ * code, so all kernels give identical results.
+ */
+
+#include "../include/text_scan.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXT_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    const char* name;
+    size_t (*find_delimiter)(const char* text, size_t length);
+    size_t (*count_words)(const char* text, size_t length, int* in_word);
+} text_kernel_t;
+
+// Same set as isspace() in the C locale: ' ' and '\t' through '\r'
+static int is_space_byte(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static int is_delimiter_byte(char c) {
+    return c == '.' || c == '!' || c == '?';
+}
+
+// Scalar kernels
+
+static size_t find_delimiter_scalar(const char* text, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (is_delimiter_byte(text[i])) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static size_t count_words_scalar(const char* text, size_t length, int* in_word) {
+    size_t count = 0;
+    int word = *in_word;
+
+    for (size_t i = 0; i < length; i++) {
+        if (is_space_byte((unsigned char)text[i])) {
+            word = 0;
+        } else if (!word) {
+            word = 1;
+            count++;
+        }
+    }
+
+    *in_word = word;
+    return count;
+}
+
+#ifdef TEXT_SCAN_X86
+
+// SSE2 kernels (16 bytes per step)
+
+__attribute__((target("sse2")))
+static size_t find_delimiter_sse2(const char* text, size_t length) {
+    const __m128i period = _mm_set1_epi8('.');
+    const __m128i bang = _mm_set1_epi8('!');
+    const __m128i question = _mm_set1_epi8('?');
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(c, period),
+                                   _mm_or_si128(_mm_cmpeq_epi8(c, bang),
+                                                _mm_cmpeq_epi8(c, question)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + find_delimiter_scalar(text + i, length - i);
+}
+
+__attribute__((target("sse2")))
+static size_t count_words_sse2(const char* text, size_t length, int* in_word) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i control_span = _mm_set1_epi8('\r' - '\t');
+    uint32_t prev_space = *in_word ? 0 : 1;
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(text + i));
+        // '\t'..'\r' is an unsigned range check: (c - '\t') <= 4
+        __m128i shifted = _mm_sub_epi8(c, tab);
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, control_span), shifted);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(c, space), control);
+
+        // A word starts at a non-space byte whose predecessor is a space
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(ws);
+        uint32_t starts = ~mask & ((mask << 1) | prev_space) & 0xFFFF;
+        count += __builtin_popcount(starts);
+        prev_space = (mask >> 15) & 1;
+    }
+
+    int word = !prev_space;
+    count += count_words_scalar(text + i, length - i, &word);
+    *in_word = word;
+    return count;
+}
+
+// AVX2 kernels (32 bytes per step)
+
+__attribute__((target("avx2")))
+static size_t find_delimiter_avx2(const char* text, size_t length) {
+    const __m256i period = _mm256_set1_epi8('.');
+    const __m256i bang = _mm256_set1_epi8('!');
+    const __m256i question = _mm256_set1_epi8('?');
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(c, period),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(c, bang),
+                                                      _mm256_cmpeq_epi8(c, question)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + find_delimiter_sse2(text + i, length - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_words_avx2(const char* text, size_t length, int* in_word) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i control_span = _mm256_set1_epi8('\r' - '\t');
+    uint32_t prev_space = *in_word ? 0 : 1;
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i shifted = _mm256_sub_epi8(c, tab);
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, control_span), shifted);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(c, space), control);
+
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(ws);
+        uint32_t starts = ~mask & ((mask << 1) | prev_space);
+        count += __builtin_popcount(starts);
+        prev_space = mask >> 31;
+    }
+
+    int word = !prev_space;
+    count += count_words_sse2(text + i, length - i, &word);
+    *in_word = word;
+    return count;
+}
+
+#endif // TEXT_SCAN_X86
+
+// Ordered from narrowest to widest
+static const text_kernel_t kernels[] = {
+    {"scalar", find_delimiter_scalar, count_words_scalar},
+#ifdef TEXT_SCAN_X86
+    {"sse2", find_delimiter_sse2, count_words_sse2},
+    {"avx2", find_delimiter_avx2, count_words_avx2},
+#endif
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+static const text_kernel_t* active_kernel = &kernels[0];
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static int kernel_supported(const text_kernel_t* kernel) {
+#ifdef TEXT_SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(kernel->name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(kernel->name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    }
+#endif
+    return strcmp(kernel->name, "scalar") == 0;
+}
+
+// Pick the widest kernel this CPU supports
+static void select_kernel(void) {
+    for (size_t i = 0; i < KERNEL_COUNT; i++) {
+        if (kernel_supported(&kernels[i])) {
+            active_kernel = &kernels[i];
+        }
+    }
+}
+
+size_t text_find_delimiter(const char* text, size_t length) {
+    pthread_once(&kernel_once, select_kernel);
+    return active_kernel->find_delimiter(text, length);
+}
+
+size_t text_count_words(const char* text, size_t length, int* in_word) {
+    pthread_once(&kernel_once, select_kernel);
+    return active_kernel->count_words(text, length, in_word);
+}
+
+int text_scan_use(const char* kernel) {
+    pthread_once(&kernel_once, select_kernel);
+    for (size_t i = 0; i < KERNEL_COUNT; i++) {
+        if (strcmp(kernels[i].name, kernel) == 0 && kernel_supported(&kernels[i])) {
+            active_kernel = &kernels[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* text_scan_kernel(void) {
+    pthread_once(&kernel_once, select_kernel);
+    return active_kernel->name;
+}
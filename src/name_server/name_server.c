@@ -9,9 +9,11 @@
 #include "../../include/logging.h"
 #include "../../include/errors.h"
 #include "../../include/nm_state.h"
+#include "../../include/capability.h"
 #include <signal.h>
 #include <sys/wait.h>
 #include <dirent.h>
+#include <poll.h>
 
 // Global state - Phase 2: Use linked lists and hash table
 static ss_node_t* storage_servers_list = NULL;
@@ -20,7 +22,22 @@ static file_hash_table_t file_table;
 static int server_socket = -1;
 static fd_set* global_master_fds = NULL;  // Global reference to master_fds
 
+// Phase 7: Registry version - bumped whenever a file's placement or ACL changes.
+// Location leases handed to clients carry the file's version at issue time so
+// a Storage Server can reject a client that cached a location across a change.
+static uint32_t registry_version = 0;
+
+// Phase 7: Key for signing capability tokens, shared with each SS at SS_INIT
+static uint8_t capability_key[CAPABILITY_KEY_LEN];
+
+// Phase 7: Control calls to storage servers are tagged so a reply can be
+// matched to its request; a late reply to a call that timed out is skipped.
+#define NM_SS_REPLY_TIMEOUT_MS 10000
+static uint32_t next_ss_request_id = 0;
+
 // Function prototypes
+int nm_ss_send(int ss_fd, request_packet_t* request);
+int nm_ss_recv(int ss_fd, uint32_t request_id, response_packet_t* response);
 void handle_client_registration(int client_socket);
 void handle_storage_server_registration(int ss_socket);
 void handle_client_request(int client_socket);
@@ -55,11 +72,18 @@ void handle_stream_file(int sockfd, request_packet_t* req);
 
 // Phase 5.3: Write and undo handlers
 void handle_write_file(int sockfd, request_packet_t* req);
-void handle_undo_file(int sockfd, request_packet_t* req);
+void handle_history_command(int sockfd, request_packet_t* req);
 
 // Phase 5.4: Exec handler
 void handle_exec_command(int sockfd, request_packet_t* req);
 
+// Phase 7: Location leases
+void format_location_lease(char* out, size_t size, ss_node_t* ss, file_hash_entry_t* entry,
+                           const char* username, int access);
+
+// Phase 7: Document versions and statistics, as the storage server has them
+int refresh_document_stats(file_hash_entry_t* entry);
+
 // Scan existing files in storage directories and add them to registry
 void scan_storage_files() {
     LOG_INFO_MSG("NAME_SERVER", "Scanning for existing files in storage directories");
@@ -127,6 +151,8 @@ void scan_storage_files() {
                 sscanf(line + 11, "%d", &new_entry->metadata.char_count);
             } else if (strncmp(line, "size=", 5) == 0) {
                 sscanf(line + 5, "%zu", &new_entry->metadata.size);
+            } else if (strncmp(line, "version=", 8) == 0) {
+                sscanf(line + 8, "%u", &new_entry->metadata.version);
             } else if (strncmp(line, "created=", 8) == 0) {
                 // Parse timestamp if needed - for now set to current time
                 new_entry->metadata.created = time(NULL);
@@ -381,6 +407,11 @@ void init_name_server_state() {
     // Load persistent user registry
     load_user_registry(&clients_list);
     
+    // Phase 7: Fresh capability key per NM run (tokens never outlive it)
+    if (generate_capability_key(capability_key) != 0) {
+        LOG_WARNING_MSG("NAME_SERVER", "No /dev/urandom, capability key derived from time/pid");
+    }
+    
     printf("Name Server state initialized:\n");
     printf("  - Storage servers list: ready\n");
     printf("  - Clients list: ready\n");
@@ -439,6 +470,9 @@ void process_connection_data(int sockfd) {
         case CMD_WRITE: cmd_name = "WRITE"; break;
         case CMD_STREAM: cmd_name = "STREAM"; break;
         case CMD_UNDO: cmd_name = "UNDO"; break;
+        case CMD_REVERT: cmd_name = "REVERT"; break;
+        case CMD_CHECKPOINT: cmd_name = "CHECKPOINT"; break;
+        case CMD_LISTCHECKPOINTS: cmd_name = "LISTCHECKPOINTS"; break;
         case CMD_EXEC: cmd_name = "EXEC"; break;
         case CMD_LIST: cmd_name = "LIST"; break;
         case CMD_VIEW: cmd_name = "VIEW"; break;
@@ -479,7 +513,10 @@ void process_connection_data(int sockfd) {
             handle_write_file(sockfd, &request);
             break;
         case CMD_UNDO:
-            handle_undo_file(sockfd, &request);
+        case CMD_REVERT:
+        case CMD_CHECKPOINT:
+        case CMD_LISTCHECKPOINTS:
+            handle_history_command(sockfd, &request);
             break;
         case CMD_EXEC:
             handle_exec_command(sockfd, &request);
@@ -545,6 +582,9 @@ void handle_ss_init(int sockfd, request_packet_t* req) {
     char* files_str = strtok(NULL, ":");
     
     if (ip_str && port_str) {
+        // Phase 7: Every file on a (re)registering SS starts a new lease epoch
+        uint32_t lease_version = ++registry_version;
+        
         strncpy(ss_info.ip, ip_str, sizeof(ss_info.ip) - 1);
         ss_info.client_port = atoi(port_str);
         ss_info.active = 1;
@@ -560,6 +600,10 @@ void handle_ss_init(int sockfd, request_packet_t* req) {
                 
                 // Add to file hash table
                 add_file_to_table(&file_table, file_token, sockfd, NULL);
+                file_hash_entry_t* entry = find_file_in_table(&file_table, file_token);
+                if (entry) {
+                    entry->lease_version = lease_version;
+                }
                 
                 ss_info.file_count++;
                 file_token = strtok(NULL, ",");
@@ -577,8 +621,10 @@ void handle_ss_init(int sockfd, request_packet_t* req) {
             memset(&response, 0, sizeof(response));
             response.magic = PROTOCOL_MAGIC;
             response.status = STATUS_OK;
+            char key_hex[CAPABILITY_KEY_LEN * 2 + 1];
+            encode_capability_key(capability_key, key_hex, sizeof(key_hex));
             snprintf(response.data, sizeof(response.data), 
-                    "SS registered: %d files", ss_info.file_count);
+                    "SS registered: %d files key=%s lease=%u", ss_info.file_count, key_hex, lease_version);
             response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
             
             send_response(sockfd, &response);
@@ -725,15 +771,17 @@ void handle_create_file(int client_fd, request_packet_t* req) {
                 selected_ss->data.ip, selected_ss->data.client_port);
     
     // Step 3: Forward CREATE request to selected storage server
+    uint32_t lease_version = ++registry_version;
     request_packet_t ss_request;
     memset(&ss_request, 0, sizeof(ss_request));
     ss_request.magic = PROTOCOL_MAGIC;
     ss_request.command = CMD_CREATE;
     strncpy(ss_request.username, req->username, sizeof(ss_request.username) - 1);
     snprintf(ss_request.args, sizeof(ss_request.args), "%s", filename);
+    append_lease_token(ss_request.args, sizeof(ss_request.args), lease_version);
     ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
     
-    if (send_packet(selected_ss->socket_fd, &ss_request) < 0) {
+    if (nm_ss_send(selected_ss->socket_fd, &ss_request) < 0) {
         response.status = STATUS_ERROR_NETWORK;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to communicate with storage server");
@@ -745,7 +793,7 @@ void handle_create_file(int client_fd, request_packet_t* req) {
     
     // Step 4: Wait for acknowledgment from storage server
     response_packet_t ss_response;
-    int result = recv_packet(selected_ss->socket_fd, &ss_response);
+    int result = nm_ss_recv(selected_ss->socket_fd, ss_request.request_id, &ss_response);
     if (result <= 0) {
         response.status = STATUS_ERROR_NETWORK;
         snprintf(response.data, sizeof(response.data), 
@@ -788,6 +836,8 @@ void handle_create_file(int client_fd, request_packet_t* req) {
     if (add_file_to_table(&file_table, filename, selected_ss->socket_fd, &metadata) < 0) {
         LOG_ERROR_MSG("NAME_SERVER", "Failed to add file to registry");
         // File created on SS but not in registry - warn but continue
+    } else {
+        find_file_in_table(&file_table, filename)->lease_version = lease_version;
     }
     
     LOG_INFO_MSG("NAME_SERVER", "File '%s' created successfully by user '%s'", 
@@ -867,7 +917,7 @@ void handle_delete_file(int client_fd, request_packet_t* req) {
     snprintf(ss_request.args, sizeof(ss_request.args), "%s", filename);
     ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
     
-    if (send_packet(ss_fd, &ss_request) < 0) {
+    if (nm_ss_send(ss_fd, &ss_request) < 0) {
         response.status = STATUS_ERROR_NETWORK;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to communicate with storage server");
@@ -879,7 +929,7 @@ void handle_delete_file(int client_fd, request_packet_t* req) {
     
     // Step 5: Wait for acknowledgment from storage server
     response_packet_t ss_response;
-    int result = recv_packet(ss_fd, &ss_response);
+    int result = nm_ss_recv(ss_fd, ss_request.request_id, &ss_response);
     if (result <= 0) {
         response.status = STATUS_ERROR_NETWORK;
         snprintf(response.data, sizeof(response.data), 
@@ -1177,6 +1227,9 @@ void handle_info_file(int client_fd, request_packet_t* req) {
         return;
     }
     
+    // Phase 7: Commits happen on the SS; ask it for the current statistics
+    refresh_document_stats(file_entry);
+    
     // Format file information
     char info[MAX_RESPONSE_DATA_LEN];
     int offset = 0;
@@ -1205,6 +1258,8 @@ void handle_info_file(int client_fd, request_packet_t* req) {
                       "  Word Count: %d\n", file_entry->metadata.word_count);
     offset += snprintf(info + offset, MAX_RESPONSE_DATA_LEN - offset,
                       "  Character Count: %d\n", file_entry->metadata.char_count);
+    offset += snprintf(info + offset, MAX_RESPONSE_DATA_LEN - offset,
+                      "  Version: %u\n", file_entry->metadata.version);
     offset += snprintf(info + offset, MAX_RESPONSE_DATA_LEN - offset,
                       "  Created: %s\n", created_str);
     offset += snprintf(info + offset, MAX_RESPONSE_DATA_LEN - offset,
@@ -1351,10 +1406,13 @@ void handle_addaccess(int client_fd, request_packet_t* req) {
     // Forward the original user as the actor
     strncpy(ss_request.username, req->username, sizeof(ss_request.username) - 1);
     snprintf(ss_request.args, sizeof(ss_request.args), "%s %s", filename, acl_str);
+    // Phase 7: An ACL change invalidates every outstanding lease for this file
+    uint32_t lease_version = registry_version + 1;
+    append_lease_token(ss_request.args, sizeof(ss_request.args), lease_version);
     ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
 
     // Send to SS and wait for response
-    if (send_packet(ss_fd, &ss_request) < 0) {
+    if (nm_ss_send(ss_fd, &ss_request) < 0) {
         // rollback
         memcpy(&file_entry->metadata, &old_meta, sizeof(file_metadata_t));
         response.status = STATUS_ERROR_NETWORK;
@@ -1366,7 +1424,7 @@ void handle_addaccess(int client_fd, request_packet_t* req) {
     }
 
     response_packet_t ss_response;
-    int r = recv_packet(ss_fd, &ss_response);
+    int r = nm_ss_recv(ss_fd, ss_request.request_id, &ss_response);
     if (r <= 0 || ss_response.status != STATUS_OK) {
         // rollback
         memcpy(&file_entry->metadata, &old_meta, sizeof(file_metadata_t));
@@ -1379,6 +1437,9 @@ void handle_addaccess(int client_fd, request_packet_t* req) {
     }
 
     // Persisted successfully
+    registry_version = lease_version;
+    file_entry->lease_version = lease_version;
+    
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), "Access granted successfully");
     response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
@@ -1494,9 +1555,12 @@ void handle_remaccess(int client_fd, request_packet_t* req) {
     ss_request.command = CMD_UPDATE_ACL;
     strncpy(ss_request.username, req->username, sizeof(ss_request.username) - 1);
     snprintf(ss_request.args, sizeof(ss_request.args), "%s %s", filename, acl_str);
+    // Phase 7: Revocation must not be bypassed by a cached location lease
+    uint32_t lease_version = registry_version + 1;
+    append_lease_token(ss_request.args, sizeof(ss_request.args), lease_version);
     ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
 
-    if (send_packet(ss_fd, &ss_request) < 0) {
+    if (nm_ss_send(ss_fd, &ss_request) < 0) {
         // rollback: restore old metadata
         memcpy(&file_entry->metadata, &old_meta, sizeof(file_metadata_t));
         response.status = STATUS_ERROR_NETWORK;
@@ -1508,7 +1572,7 @@ void handle_remaccess(int client_fd, request_packet_t* req) {
     }
 
     response_packet_t ss_response;
-    int r = recv_packet(ss_fd, &ss_response);
+    int r = nm_ss_recv(ss_fd, ss_request.request_id, &ss_response);
     if (r <= 0 || ss_response.status != STATUS_OK) {
         // rollback
         memcpy(&file_entry->metadata, &old_meta, sizeof(file_metadata_t));
@@ -1520,6 +1584,9 @@ void handle_remaccess(int client_fd, request_packet_t* req) {
         return;
     }
 
+    registry_version = lease_version;
+    file_entry->lease_version = lease_version;
+    
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), "Access revoked successfully");
     response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
@@ -1578,9 +1645,11 @@ void handle_read_file(int client_fd, request_packet_t* req) {
         return;
     }
     
-    // Send storage server location to client
-    char location[128];
-    snprintf(location, sizeof(location), "%s:%d", ss->data.ip, ss->data.client_port);
+    // Send storage server location to client (with a cacheable lease). No
+    // SS round trip here: the reply carries the version the registry last
+    // learned, and the SS sends the current one with the content.
+    char location[256];
+    format_location_lease(location, sizeof(location), ss, file_entry, req->username, ACCESS_READ);
     
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), "%s", location);
@@ -1640,9 +1709,11 @@ void handle_stream_file(int client_fd, request_packet_t* req) {
         return;
     }
     
-    // Send storage server location to client
-    char location[128];
-    snprintf(location, sizeof(location), "%s:%d", ss->data.ip, ss->data.client_port);
+    // Send storage server location to client (with a cacheable lease). No
+    // SS round trip here: the reply carries the version the registry last
+    // learned, and the SS sends the current one with the content.
+    char location[256];
+    format_location_lease(location, sizeof(location), ss, file_entry, req->username, ACCESS_READ);
     
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), "%s", location);
@@ -1703,9 +1774,11 @@ void handle_write_file(int client_fd, request_packet_t* req) {
         return;
     }
     
-    // Send storage server location to client
-    char location[128];
-    snprintf(location, sizeof(location), "%s:%d", ss->data.ip, ss->data.client_port);
+    // Send storage server location to client (with a cacheable lease). No
+    // SS round trip here: the reply carries the version the registry last
+    // learned, and the SS sends the current one with the content.
+    char location[256];
+    format_location_lease(location, sizeof(location), ss, file_entry, req->username, ACCESS_WRITE);
     
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), "%s", location);
@@ -1717,9 +1790,13 @@ void handle_write_file(int client_fd, request_packet_t* req) {
 }
 
 // Phase 5.3: Handle UNDO file request - forward to storage server
-void handle_undo_file(int client_fd, request_packet_t* req) {
-    LOG_INFO_MSG("NAME_SERVER", "Handling UNDO request for file: %s by user: %s",
-                 req->args, req->username);
+// Phase 7: Also REVERT, CHECKPOINT and LISTCHECKPOINTS; the arguments after
+// the filename are passed through. Listing needs read access, the rest write.
+void handle_history_command(int client_fd, request_packet_t* req) {
+    const char* cmd_name = command_to_string(req->command);
+    int required_access = (req->command == CMD_LISTCHECKPOINTS) ? ACCESS_READ : ACCESS_WRITE;
+    LOG_INFO_MSG("NAME_SERVER", "Handling %s request for file: %s by user: %s",
+                 cmd_name, req->args, req->username);
     
     response_packet_t response;
     memset(&response, 0, sizeof(response));
@@ -1740,15 +1817,17 @@ void handle_undo_file(int client_fd, request_packet_t* req) {
         return;
     }
     
-    // Check write access (undo requires write permission)
-    if (!check_user_has_access(file_entry, req->username, ACCESS_WRITE)) {
-        response.status = STATUS_ERROR_WRITE_PERMISSION;
+    // Check access (undo/revert/checkpoint require write permission)
+    if (!check_user_has_access(file_entry, req->username, required_access)) {
+        int write = (required_access == ACCESS_WRITE);
+        response.status = write ? STATUS_ERROR_WRITE_PERMISSION : STATUS_ERROR_READ_PERMISSION;
         snprintf(response.data, sizeof(response.data), 
-                "Permission denied: You do not have write access to this file");
+                "Permission denied: You do not have %s access to this file",
+                write ? "write" : "read");
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
         send_response(client_fd, &response);
-        LOG_WARNING_MSG("NAME_SERVER", "User '%s' denied undo access to file '%s'",
-                       req->username, filename);
+        LOG_WARNING_MSG("NAME_SERVER", "User '%s' denied %s access to file '%s'",
+                       req->username, cmd_name, filename);
         return;
     }
     
@@ -1765,42 +1844,42 @@ void handle_undo_file(int client_fd, request_packet_t* req) {
         return;
     }
     
-    // Forward CMD_UNDO request to storage server
+    // Forward the request to storage server
     request_packet_t ss_request;
     memset(&ss_request, 0, sizeof(ss_request));
     ss_request.magic = PROTOCOL_MAGIC;
-    ss_request.command = CMD_UNDO;
+    ss_request.command = req->command;
     strncpy(ss_request.username, req->username, sizeof(ss_request.username) - 1);
-    strncpy(ss_request.args, filename, sizeof(ss_request.args) - 1);
+    strncpy(ss_request.args, req->args, sizeof(ss_request.args) - 1);
     ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
     
-    if (send_packet(ss_fd, &ss_request) < 0) {
+    if (nm_ss_send(ss_fd, &ss_request) < 0) {
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to communicate with storage server");
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
         send_response(client_fd, &response);
-        LOG_ERROR_MSG("NAME_SERVER", "Failed to forward UNDO to storage server");
+        LOG_ERROR_MSG("NAME_SERVER", "Failed to forward %s to storage server", cmd_name);
         return;
     }
     
     // Receive response from storage server
     response_packet_t ss_response;
-    if (recv_packet(ss_fd, &ss_response) <= 0) {
+    if (nm_ss_recv(ss_fd, ss_request.request_id, &ss_response) <= 0) {
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to receive response from storage server");
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
         send_response(client_fd, &response);
-        LOG_ERROR_MSG("NAME_SERVER", "Failed to receive UNDO response from storage server");
+        LOG_ERROR_MSG("NAME_SERVER", "Failed to receive %s response from storage server", cmd_name);
         return;
     }
     
     // Forward storage server's response to client
     send_response(client_fd, &ss_response);
     
-    LOG_INFO_MSG("NAME_SERVER", "UNDO operation for '%s' by '%s': %s",
-                 filename, req->username, 
+    LOG_INFO_MSG("NAME_SERVER", "%s operation for '%s' by '%s': %s",
+                 cmd_name, filename, req->username, 
                  ss_response.status == STATUS_OK ? "SUCCESS" : "FAILED");
 }
 
@@ -1862,7 +1941,7 @@ void handle_exec_command(int client_fd, request_packet_t* req) {
     strncpy(ss_request.args, filename, sizeof(ss_request.args) - 1);
     ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
     
-    if (send_packet(ss_fd, &ss_request) < 0) {
+    if (nm_ss_send(ss_fd, &ss_request) < 0) {
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to communicate with storage server");
@@ -1874,7 +1953,7 @@ void handle_exec_command(int client_fd, request_packet_t* req) {
     
     // Receive file content from storage server
     response_packet_t ss_response;
-    if (recv_packet(ss_fd, &ss_response) <= 0) {
+    if (nm_ss_recv(ss_fd, ss_request.request_id, &ss_response) <= 0) {
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to receive file from storage server");
@@ -1985,4 +2064,127 @@ void handle_exec_command(int client_fd, request_packet_t* req) {
         LOG_INFO_MSG("NAME_SERVER", "EXEC completed for '%s' by '%s' (exit status: %d)",
                      filename, req->username, WEXITSTATUS(status));
     }
-}
\ No newline at end of file
+}
+
+// Phase 7: Format a location reply as
+// "IP:PORT ttl=<seconds> lease=<version> cap=<token> version=<document version>".
+// Clients may reuse the location for ttl seconds; the SS rejects the lease
+// once the file's placement or ACL has changed since it was issued, and
+// authorizes the request from the signed capability instead of its .meta file.
+// The document version is the last one refresh_document_stats learned
+// (INFO asks the SS); readers get the current one in the SS content header.
+void format_location_lease(char* out, size_t size, ss_node_t* ss, file_hash_entry_t* entry,
+                           const char* username, int access) {
+    char capability[MAX_CAPABILITY_LEN];
+    time_t expiry = time(NULL) + LOCATION_LEASE_TTL;
+    
+    if (issue_capability(capability_key, username, entry->filename, access, expiry,
+                         entry->lease_version, capability, sizeof(capability)) != 0) {
+        snprintf(out, size, "%s:%d ttl=%d lease=%u version=%u", ss->data.ip,
+                 ss->data.client_port, LOCATION_LEASE_TTL, entry->lease_version,
+                 entry->metadata.version);
+        return;
+    }
+    
+    snprintf(out, size, "%s:%d ttl=%d lease=%u cap=%s version=%u", ss->data.ip,
+             ss->data.client_port, LOCATION_LEASE_TTL, entry->lease_version, capability,
+             entry->metadata.version);
+}
+
+/**
+ * refresh_document_stats - Ask a file's storage server for its statistics
+ * @entry: Registry entry, updated in place
+ *
+ * The version, size and counts change with every ETIRW and UNDO on the SS.
+ * If the SS cannot answer, the registry keeps the values it last learned.
+ * It waits for the SS, so only INFO calls it, never a location lookup.
+ *
+ * Returns: 0 on success, -1 if the values were not refreshed
+ */
+int refresh_document_stats(file_hash_entry_t* entry) {
+    request_packet_t ss_request;
+    memset(&ss_request, 0, sizeof(ss_request));
+    ss_request.magic = PROTOCOL_MAGIC;
+    ss_request.command = CMD_INFO;
+    strncpy(ss_request.args, entry->filename, sizeof(ss_request.args) - 1);
+    ss_request.checksum = calculate_checksum(&ss_request, sizeof(ss_request) - sizeof(uint32_t));
+    
+    response_packet_t ss_response;
+    if (entry->ss_socket_fd < 0 || nm_ss_send(entry->ss_socket_fd, &ss_request) < 0 ||
+        nm_ss_recv(entry->ss_socket_fd, ss_request.request_id, &ss_response) <= 0 ||
+        ss_response.status != STATUS_OK) {
+        LOG_WARNING_MSG("NAME_SERVER", "Could not refresh statistics of '%s'", entry->filename);
+        return -1;
+    }
+    
+    unsigned int version = 0;
+    size_t size = 0;
+    int words = 0;
+    int chars = 0;
+    long modified = 0, accessed = 0;
+    char accessed_by[MAX_USERNAME_LEN] = "";
+    if (sscanf(ss_response.data,
+               "version=%u size=%zu words=%d chars=%d modified=%ld accessed=%ld accessed_by=%63s",
+               &version, &size, &words, &chars, &modified, &accessed, accessed_by) != 7) {
+        LOG_WARNING_MSG("NAME_SERVER", "Malformed statistics for '%s': %s",
+                       entry->filename, ss_response.data);
+        return -1;
+    }
+    
+    entry->metadata.version = version;
+    entry->metadata.size = size;
+    entry->metadata.word_count = words;
+    entry->metadata.char_count = chars;
+    if (modified > 0) {
+        entry->metadata.last_modified = (time_t)modified;
+    }
+    if (accessed > 0) {
+        entry->metadata.last_accessed = (time_t)accessed;
+    }
+    if (strcmp(accessed_by, "-") != 0) {
+        strncpy(entry->metadata.last_accessed_by, accessed_by,
+                sizeof(entry->metadata.last_accessed_by) - 1);
+    }
+    return 0;
+}
+
+// Phase 7: Send a control request to a storage server under a fresh request_id
+int nm_ss_send(int ss_fd, request_packet_t* request) {
+    request->request_id = ++next_ss_request_id;
+    if (request->request_id == 0) {
+        request->request_id = ++next_ss_request_id;  // 0 means untagged
+    }
+    return send_packet(ss_fd, request);
+}
+
+/**
+ * nm_ss_recv - Wait for a storage server's reply to one control request
+ * @ss_fd: Storage server socket
+ * @request_id: request_id the reply must carry
+ * @response: Output reply
+ *
+ * Replies to other (abandoned) requests are logged and skipped.
+ *
+ * Returns: >0 on success, 0 if the SS closed the connection, -1 on error or timeout
+ */
+int nm_ss_recv(int ss_fd, uint32_t request_id, response_packet_t* response) {
+    while (1) {
+        struct pollfd pfd = { .fd = ss_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, NM_SS_REPLY_TIMEOUT_MS);
+        if (ready == 0) {
+            LOG_ERROR_MSG("NAME_SERVER", "Timed out waiting for SS reply %u", request_id);
+            return -1;
+        }
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        
+        int result = recv_packet(ss_fd, response);
+        if (result <= 0 || response->request_id == request_id) {
+            return result;
+        }
+        LOG_WARNING_MSG("NAME_SERVER", "Skipping stale SS reply %u (waiting for %u)",
+                        response->request_id, request_id);
+    }
+}
@@ -78,6 +78,7 @@ int add_file_to_table(file_hash_table_t* table, const char* filename, int ss_soc
     strncpy(new_entry->filename, filename, sizeof(new_entry->filename) - 1);
     new_entry->filename[sizeof(new_entry->filename) - 1] = '\0';
     new_entry->ss_socket_fd = ss_socket_fd;
+    new_entry->lease_version = 0;
     if (metadata) {
         new_entry->metadata = *metadata;
     } else {
@@ -0,0 +1,549 @@
+/*
+ * Storage Server Chunk Store Implementation
+ * A checkpoint splits the document at sentence ends into chunks of a few
+ * KB and stores each under the SHA-256 of its content:
+ *
+ *   .cas/chunks/<first two hex digits>/<hash>
+ *   .cas/checkpoints/<filename>/<tag>     (manifest: header + chunk list)
+ *
+ * Whether a sentence end closes a chunk depends only on that sentence's
+ * text (and the chunk's size), so an edit moves at most the boundaries
+ * around it and the other chunks keep their hashes. A new checkpoint of a
+ * mostly unchanged or appended-to document therefore writes only the
+ * changed chunks and its manifest; identical text in other checkpoints or
+ * other files is stored once.
+ *
+ * Chunks are synced before the manifest that names them is written, and a
+ * chunk is never modified once stored. Chunks no manifest names any more
+ * (after a DELETE, or left by a checkpoint that never got its manifest) are
+ * swept at startup and after each removal: every manifest is read to mark
+ * the chunks in use, then the rest are unlinked.
+ */
+
+#include "../../include/ss_cas.h"
+#include "../../include/logging.h"
+#include "../../include/sha256.h"
+#include "../../include/ss_io.h"
+#include <ctype.h>
+#include <dirent.h>
+
+static char cas_root[MAX_PATH_LEN];
+// Shared by checkpoints (from storing chunks to writing the manifest),
+// exclusive for a sweep, so no chunk is swept before its manifest exists
+static pthread_rwlock_t store_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+typedef char chunk_hex_t[2 * SHA256_DIGEST_LEN + 1];
+
+static int sweep_chunks(void);
+
+/**
+ * ss_cas_init - Create the store's directories under the storage path
+ * @storage_path: Storage server's root directory
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int ss_cas_init(const char* storage_path) {
+    char path[MAX_PATH_LEN];
+    snprintf(cas_root, sizeof(cas_root), "%s/%s", storage_path, SS_CAS_DIR);
+
+    const char* dirs[] = {"", "/chunks", "/checkpoints"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s%s", cas_root, dirs[i]);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR_MSG("CAS", "Failed to create %s: %s", path, strerror(errno));
+            return -1;
+        }
+    }
+    sweep_chunks();
+    return 0;
+}
+
+int ss_cas_valid_tag(const char* tag) {
+    size_t length = strlen(tag);
+    if (length == 0 || length >= SS_CAS_MAX_TAG_LEN || !isalpha((unsigned char)tag[0])) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)tag[i];
+        if (!isalnum(c) && c != '_' && c != '-' && c != '.') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void digest_to_hex(const uint8_t digest[SHA256_DIGEST_LEN], char hex[2 * SHA256_DIGEST_LEN + 1]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    hex[2 * SHA256_DIGEST_LEN] = '\0';
+}
+
+static void chunk_path(const char* hex, char* path, size_t size) {
+    snprintf(path, size, "%s/chunks/%.2s/%s", cas_root, hex, hex);
+}
+
+static void manifest_path(const char* filename, const char* tag, char* path, size_t size) {
+    if (tag != NULL) {
+        snprintf(path, size, "%s/checkpoints/%s/%s", cas_root, filename, tag);
+    } else {
+        snprintf(path, size, "%s/checkpoints/%s", cas_root, filename);
+    }
+}
+
+// Store one chunk unless an identical one already exists
+static int store_chunk(const char* data, size_t length, char* hex, int* created) {
+    uint8_t digest[SHA256_DIGEST_LEN];
+    sha256(data, length, digest);
+    digest_to_hex(digest, hex);
+
+    char path[MAX_PATH_LEN];
+    chunk_path(hex, path, sizeof(path));
+    *created = 0;
+    if (access(path, F_OK) == 0) {
+        return 0;
+    }
+
+    char dir[MAX_PATH_LEN + sizeof("/chunks/xx")];
+    snprintf(dir, sizeof(dir), "%s/chunks/%.2s", cas_root, hex);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    // Same name, same content: a concurrent writer of this chunk is harmless
+    if (ss_io_write_file(path, data, length, SS_IO_DATASYNC) != 0) {
+        return -1;
+    }
+    *created = 1;
+    return 0;
+}
+
+static uint32_t sentence_hash(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * ss_cas_checkpoint - Save a document version as a named checkpoint
+ * @filename: The document
+ * @tag: Checkpoint name (see ss_cas_valid_tag)
+ * @user: Who created it
+ * @doc: The version to save, with its sentence index
+ * @total_chunks: Output chunks in the checkpoint
+ * @new_chunks: Output chunks that had to be written
+ *
+ * Returns: 0 on success, -1 on failure (errno EEXIST if the tag is taken)
+ */
+int ss_cas_checkpoint(const char* filename, const char* tag, const char* user,
+                      const cached_doc_t* doc, int* total_chunks, int* new_chunks) {
+    char path[MAX_PATH_LEN];
+    manifest_path(filename, tag, path, sizeof(path));
+    if (access(path, F_OK) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    char* manifest = NULL;
+    size_t manifest_length = 0;
+    FILE* out = open_memstream(&manifest, &manifest_length);
+    if (out == NULL) {
+        return -1;
+    }
+    pthread_rwlock_rdlock(&store_lock);
+
+    // Chunks are runs of whole sentences, each with the whitespace after it
+    int result = 0;
+    size_t start = 0;
+    *total_chunks = 0;
+    *new_chunks = 0;
+    for (int i = 0; result == 0 && start < doc->length; i++) {
+        size_t end = doc->length;
+        if (i + 1 < doc->sentence_count) {
+            end = doc->sentences[i + 1].offset;
+            const doc_sentence_t* sentence = &doc->sentences[i];
+            size_t size = end - start;
+            if (size < SS_CAS_CHUNK_MAX &&
+                (size < SS_CAS_CHUNK_MIN ||
+                 (sentence_hash(doc->content + sentence->offset, sentence->length) &
+                  SS_CAS_BOUNDARY_MASK) != 0)) {
+                continue;
+            }
+        }
+
+        char hex[2 * SHA256_DIGEST_LEN + 1];
+        int created;
+        result = store_chunk(doc->content + start, end - start, hex, &created);
+        fprintf(out, "%s %zu\n", hex, end - start);
+        *total_chunks += 1;
+        *new_chunks += created;
+        start = end;
+    }
+    fclose(out);
+
+    if (result == 0) {
+        // Header first, so listing reads only the top of each manifest
+        char header[512];
+        int header_length = snprintf(header, sizeof(header),
+                                     "created=%ld\ncreated_by=%s\nlength=%zu\nchunks=%d\n",
+                                     (long)time(NULL), user, doc->length, *total_chunks);
+        char* full = malloc(header_length + manifest_length);
+        char dir[MAX_PATH_LEN];
+        manifest_path(filename, NULL, dir, sizeof(dir));
+        if (full == NULL || (mkdir(dir, 0755) != 0 && errno != EEXIST)) {
+            result = -1;
+        } else {
+            memcpy(full, header, header_length);
+            memcpy(full + header_length, manifest, manifest_length);
+            result = ss_io_write_file(path, full, header_length + manifest_length,
+                                      SS_IO_EXCL | SS_IO_DATASYNC);
+        }
+        free(full);
+    }
+    int saved_errno = errno;
+    pthread_rwlock_unlock(&store_lock);
+    errno = saved_errno;
+    free(manifest);
+
+    if (result == 0) {
+        LOG_INFO_MSG("CAS", "Checkpoint '%s' of '%s': %d chunks, %d new", tag, filename,
+                     *total_chunks, *new_chunks);
+    }
+    return result;
+}
+
+/**
+ * ss_cas_read - Rebuild a checkpoint's content
+ * @filename: The document
+ * @tag: Checkpoint name
+ * @content: Output buffer (malloc'd, NUL-terminated, caller frees)
+ * @length: Output content length
+ *
+ * Every chunk is checked against its hash.
+ *
+ * Returns: 0 on success, -1 on failure (errno ENOENT if there is no such
+ *          checkpoint)
+ */
+int ss_cas_read(const char* filename, const char* tag, char** content, size_t* length) {
+    char path[MAX_PATH_LEN];
+    char* manifest = NULL;
+    size_t manifest_length;
+    manifest_path(filename, tag, path, sizeof(path));
+    if (ss_io_read_file(path, &manifest, &manifest_length) != 0) {
+        return -1;
+    }
+
+    size_t total = 0;
+    char* line_end = strstr(manifest, "length=");
+    if (line_end == NULL || sscanf(line_end, "length=%zu", &total) != 1 ||
+        (*content = malloc(total + 1)) == NULL) {
+        free(manifest);
+        errno = EIO;
+        return -1;
+    }
+
+    size_t filled = 0;
+    int result = 0;
+    char* save = NULL;
+    for (char* line = strtok_r(manifest, "\n", &save); line != NULL && result == 0;
+         line = strtok_r(NULL, "\n", &save)) {
+        char hex[2 * SHA256_DIGEST_LEN + 1];
+        size_t chunk_length;
+        if (strchr(line, '=') != NULL) {
+            continue;  // Header
+        }
+        if (sscanf(line, "%64s %zu", hex, &chunk_length) != 2 || chunk_length > total - filled) {
+            result = -1;
+            break;
+        }
+
+        char chunk_file[MAX_PATH_LEN];
+        char* chunk = NULL;
+        size_t read_length;
+        chunk_path(hex, chunk_file, sizeof(chunk_file));
+        if (ss_io_read_file(chunk_file, &chunk, &read_length) != 0) {
+            result = -1;
+            break;
+        }
+        uint8_t digest[SHA256_DIGEST_LEN];
+        char actual[2 * SHA256_DIGEST_LEN + 1];
+        sha256(chunk, read_length, digest);
+        digest_to_hex(digest, actual);
+        if (read_length != chunk_length || strcmp(actual, hex) != 0) {
+            LOG_ERROR_MSG("CAS", "Chunk %s of checkpoint '%s' of '%s' is damaged", hex, tag, filename);
+            result = -1;
+        } else {
+            memcpy(*content + filled, chunk, chunk_length);
+            filled += chunk_length;
+        }
+        free(chunk);
+    }
+    free(manifest);
+
+    if (result != 0 || filled != total) {
+        free(*content);
+        *content = NULL;
+        errno = EIO;
+        return -1;
+    }
+    (*content)[total] = '\0';
+    *length = total;
+    return 0;
+}
+
+typedef struct {
+    char tag[SS_CAS_MAX_TAG_LEN];
+    long created;
+    char created_by[MAX_USERNAME_LEN];
+    size_t length;
+    int chunks;
+} checkpoint_info_t;
+
+static int compare_checkpoints(const void* a, const void* b) {
+    const checkpoint_info_t* x = a;
+    const checkpoint_info_t* y = b;
+    if (x->created != y->created) {
+        return (x->created < y->created) ? -1 : 1;
+    }
+    return strcmp(x->tag, y->tag);
+}
+
+/**
+ * ss_cas_list - Describe a document's checkpoints
+ * @filename: The document
+ * @out: Output text, one checkpoint per line (oldest first)
+ * @size: Size of @out
+ *
+ * Returns: Number of checkpoints
+ */
+int ss_cas_list(const char* filename, char* out, size_t size) {
+    char dir_path[MAX_PATH_LEN];
+    manifest_path(filename, NULL, dir_path, sizeof(dir_path));
+    out[0] = '\0';
+
+    DIR* dir = opendir(dir_path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    int capacity = 16;
+    checkpoint_info_t* list = malloc(capacity * sizeof(checkpoint_info_t));
+    struct dirent* entry;
+    while (list != NULL && (entry = readdir(dir)) != NULL) {
+        if (!ss_cas_valid_tag(entry->d_name)) {
+            continue;  // ".", "..", temp files
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            checkpoint_info_t* grown = realloc(list, capacity * sizeof(checkpoint_info_t));
+            if (grown == NULL) {
+                break;
+            }
+            list = grown;
+        }
+
+        char path[MAX_PATH_LEN];
+        char header[512];
+        manifest_path(filename, entry->d_name, path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        ssize_t n = (fd >= 0) ? ss_io_pread(fd, header, sizeof(header) - 1, 0) : -1;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (n <= 0) {
+            continue;
+        }
+        header[n] = '\0';
+
+        checkpoint_info_t* info = &list[count];
+        memset(info, 0, sizeof(*info));
+        strncpy(info->tag, entry->d_name, sizeof(info->tag) - 1);
+        char* field;
+        if ((field = strstr(header, "created=")) != NULL) sscanf(field, "created=%ld", &info->created);
+        if ((field = strstr(header, "created_by=")) != NULL) sscanf(field, "created_by=%63s", info->created_by);
+        if ((field = strstr(header, "length=")) != NULL) sscanf(field, "length=%zu", &info->length);
+        if ((field = strstr(header, "chunks=")) != NULL) sscanf(field, "chunks=%d", &info->chunks);
+        count++;
+    }
+    closedir(dir);
+    if (list == NULL) {
+        return 0;
+    }
+
+    qsort(list, count, sizeof(checkpoint_info_t), compare_checkpoints);
+    size_t used = 0;
+    for (int i = 0; i < count && used < size; i++) {
+        char when[32];
+        time_t created = (time_t)list[i].created;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&created));
+        int n = snprintf(out + used, size - used, "%-20s %s  %-12s %zu bytes, %d chunks\n",
+                         list[i].tag, when, list[i].created_by, list[i].length, list[i].chunks);
+        if (n < 0 || (size_t)n >= size - used) {
+            break;
+        }
+        used += n;
+    }
+    free(list);
+    return count;
+}
+
+void ss_cas_remove(const char* filename) {
+    char dir_path[MAX_PATH_LEN];
+    manifest_path(filename, NULL, dir_path, sizeof(dir_path));
+
+    DIR* dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            char path[MAX_PATH_LEN + MAX_FILENAME_LEN];
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    rmdir(dir_path);
+
+    // Its chunks that no other checkpoint shares are garbage now
+    sweep_chunks();
+}
+
+static int compare_hex(const void* a, const void* b) {
+    return strcmp((const char*)a, (const char*)b);
+}
+
+// Add the chunks one manifest names to @marks; 0 or -1
+static int mark_manifest(const char* path, chunk_hex_t** marks, size_t* count, size_t* capacity) {
+    char* manifest = NULL;
+    size_t length;
+    if (ss_io_read_file(path, &manifest, &length) != 0) {
+        return -1;
+    }
+    int result = 0;
+    char* save = NULL;
+    for (char* line = strtok_r(manifest, "\n", &save); line != NULL && result == 0;
+         line = strtok_r(NULL, "\n", &save)) {
+        if (strchr(line, '=') != NULL) {
+            continue;  // Header
+        }
+        if (*count == *capacity) {
+            size_t grown_capacity = (*capacity > 0) ? *capacity * 2 : 256;
+            chunk_hex_t* grown = realloc(*marks, grown_capacity * sizeof(chunk_hex_t));
+            if (grown == NULL) {
+                result = -1;
+                break;
+            }
+            *marks = grown;
+            *capacity = grown_capacity;
+        }
+        if (sscanf(line, "%64s", (*marks)[*count]) == 1) {
+            *count += 1;
+        }
+    }
+    free(manifest);
+    return result;
+}
+
+// Every chunk some manifest names, sorted; 0, or -1 if one could not be read
+static int mark_chunks(chunk_hex_t** marks, size_t* count) {
+    char root[MAX_PATH_LEN + sizeof("/checkpoints")];
+    snprintf(root, sizeof(root), "%s/checkpoints", cas_root);
+    size_t capacity = 0;
+    *marks = NULL;
+    *count = 0;
+
+    DIR* files = opendir(root);
+    if (files == NULL) {
+        return -1;
+    }
+    int result = 0;
+    struct dirent* file;
+    while (result == 0 && (file = readdir(files)) != NULL) {
+        if (strcmp(file->d_name, ".") == 0 || strcmp(file->d_name, "..") == 0) {
+            continue;
+        }
+        char dir_path[sizeof(root) + MAX_FILENAME_LEN];
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", root, file->d_name);
+        DIR* dir = opendir(dir_path);
+        if (dir == NULL) {
+            result = (errno == ENOTDIR) ? 0 : -1;
+            continue;
+        }
+        struct dirent* entry;
+        while (result == 0 && (entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                char path[sizeof(dir_path) + MAX_FILENAME_LEN];
+                snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+                result = mark_manifest(path, marks, count, &capacity);
+            }
+        }
+        closedir(dir);
+    }
+    closedir(files);
+
+    if (result == 0 && *count > 0) {
+        qsort(*marks, *count, sizeof(chunk_hex_t), compare_hex);
+    }
+    return result;
+}
+
+// Mark and sweep: unlink the chunks no manifest names; returns how many,
+// or -1 if the manifests could not all be read (then nothing is removed)
+static int sweep_chunks(void) {
+    pthread_rwlock_wrlock(&store_lock);
+    chunk_hex_t* marks = NULL;
+    size_t count = 0;
+    if (mark_chunks(&marks, &count) != 0) {
+        pthread_rwlock_unlock(&store_lock);
+        free(marks);
+        LOG_WARNING_MSG("CAS", "Could not read every checkpoint; unused chunks are kept");
+        return -1;
+    }
+
+    char root[MAX_PATH_LEN + sizeof("/chunks")];
+    snprintf(root, sizeof(root), "%s/chunks", cas_root);
+    int removed = 0;
+    DIR* buckets = opendir(root);
+    struct dirent* bucket;
+    while (buckets != NULL && (bucket = readdir(buckets)) != NULL) {
+        if (strlen(bucket->d_name) != 2) {
+            continue;  // ".", ".."
+        }
+        char dir_path[sizeof(root) + MAX_FILENAME_LEN];
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", root, bucket->d_name);
+        DIR* dir = opendir(dir_path);
+        struct dirent* entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            if (strlen(entry->d_name) != 2 * SHA256_DIGEST_LEN ||
+                (count > 0 && bsearch(entry->d_name, marks, count, sizeof(chunk_hex_t),
+                                      compare_hex) != NULL)) {
+                continue;  // In use (or not a chunk)
+            }
+            char path[sizeof(dir_path) + MAX_FILENAME_LEN];
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            if (unlink(path) == 0) {
+                removed++;
+            }
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+    }
+    if (buckets != NULL) {
+        closedir(buckets);
+    }
+    pthread_rwlock_unlock(&store_lock);
+    free(marks);
+
+    if (removed > 0) {
+        LOG_INFO_MSG("CAS", "Removed %d chunks no checkpoint uses", removed);
+    }
+    return removed;
+}
@@ -0,0 +1,413 @@
+/*
+ * Storage Server Document Cache Implementation
+ * READ, STREAM and WRITE share one parsed copy of each hot document instead
+ * of re-reading and re-parsing the file per request. Entries are refcounted:
+ * invalidation unlinks an entry at once, and the memory is freed when the
+ * last holder releases it. Unreferenced entries are evicted in LRU order
+ * once the budget is exceeded.
+ *
+ * Phase 7: The table entry of a document is its committed version pointer.
+ * Commits publish the new version by swapping the entry under the cache
+ * mutex, so a reader gets either the old or the new version in full, never
+ * a file in mid-replace, and needs no reload after a commit. With early-ack
+ * commits the version is published before its file is written; such
+ * entries are never evicted until written, so a miss cannot reload the old
+ * file.
+ */
+
+#include "../../include/ss_doc_cache.h"
+#include "../../include/file_ops.h"
+#include "../../include/logging.h"
+#include "../../include/ss_io.h"
+#include "../../include/ss_meta_cache.h"
+#include "../../include/text_scan.h"
+#include <ctype.h>
+
+static cached_doc_t* doc_table[SS_DOC_CACHE_BUCKETS];
+static cached_doc_t* lru_head = NULL;   // Most recently used
+static cached_doc_t* lru_tail = NULL;   // Eviction candidate
+static size_t cache_bytes = 0;
+static int cache_entries = 0;
+static size_t cache_budget = SS_DOC_CACHE_BUDGET;
+static uint64_t invalidation_epoch = 0;  // Bumped by every invalidation
+static char cache_root[MAX_PATH_LEN];
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int doc_hash(const char* filename) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash % SS_DOC_CACHE_BUCKETS;
+}
+
+static void free_doc(cached_doc_t* doc) {
+    if (doc->fd >= 0) {
+        close(doc->fd);
+    }
+    free(doc->content);
+    free(doc->sentences);
+    free(doc);
+}
+
+// LRU and table helpers (cache_mutex held)
+static void lru_unlink(cached_doc_t* doc) {
+    if (doc->lru_prev) doc->lru_prev->lru_next = doc->lru_next;
+    else lru_head = doc->lru_next;
+    if (doc->lru_next) doc->lru_next->lru_prev = doc->lru_prev;
+    else lru_tail = doc->lru_prev;
+    doc->lru_prev = doc->lru_next = NULL;
+}
+
+static void lru_push_front(cached_doc_t* doc) {
+    doc->lru_prev = NULL;
+    doc->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = doc;
+    lru_head = doc;
+    if (lru_tail == NULL) lru_tail = doc;
+}
+
+static void table_remove(cached_doc_t* doc) {
+    cached_doc_t** link = &doc_table[doc_hash(doc->filename)];
+    while (*link != NULL && *link != doc) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == doc) {
+        *link = doc->hash_next;
+    }
+    doc->hash_next = NULL;
+    lru_unlink(doc);
+    cache_bytes -= doc->footprint;
+    cache_entries--;
+    doc->cached = 0;
+}
+
+static void evict_over_budget(void) {
+    cached_doc_t* doc = lru_tail;
+    while ((cache_bytes > cache_budget || cache_entries > SS_DOC_CACHE_MAX_ENTRIES) && doc != NULL) {
+        cached_doc_t* prev = doc->lru_prev;
+        if (doc->refcount == 0 && !doc->unwritten) {
+            LOG_INFO_MSG("DOC_CACHE", "Evicting '%s' (%zu bytes)", doc->filename, doc->footprint);
+            table_remove(doc);
+            free_doc(doc);
+        }
+        doc = prev;
+    }
+}
+
+/**
+ * index_document_sentences - Split text into sentence spans
+ * @content: Document text
+ * @length: Bytes of content
+ * @sentences: Output array (malloc'd, caller frees)
+ * @word_count: Output total word count
+ *
+ * A sentence ends at '.', '!' or '?'; whitespace after the delimiter is not
+ * part of either sentence. Trailing text without a delimiter is a sentence.
+ *
+ * Returns: Number of sentences, or -1 on allocation failure
+ */
+int index_document_sentences(const char* content, size_t length,
+                             doc_sentence_t** sentences, int* word_count) {
+    int capacity = 16;
+    int count = 0;
+    doc_sentence_t* spans = malloc(capacity * sizeof(doc_sentence_t));
+    if (spans == NULL) {
+        return -1;
+    }
+
+    *word_count = 0;
+    size_t start = 0;
+
+    while (start < length) {
+        size_t end = start + text_find_delimiter(content + start, length - start);
+        if (end < length) {
+            end++;  // Keep the delimiter
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            doc_sentence_t* grown = realloc(spans, capacity * sizeof(doc_sentence_t));
+            if (grown == NULL) {
+                free(spans);
+                return -1;
+            }
+            spans = grown;
+        }
+        int in_word = 0;
+        spans[count].offset = start;
+        spans[count].length = end - start;
+        spans[count].word_count = (int)text_count_words(content + start, end - start, &in_word);
+        *word_count += spans[count].word_count;
+        count++;
+
+        // Skip whitespace after the delimiter
+        while (end < length && isspace((unsigned char)content[end])) {
+            end++;
+        }
+        start = end;
+    }
+
+    *sentences = spans;
+    return count;
+}
+
+void doc_cache_init(const char* storage_path, size_t budget) {
+    strncpy(cache_root, storage_path, sizeof(cache_root) - 1);
+    cache_budget = budget;
+    LOG_INFO_MSG("DOC_CACHE", "Document cache ready (budget %zu KB)", budget / 1024);
+}
+
+// Phase 7: Descriptor on a file just written with a published version, for
+// sendfile; -1 if it does not hold @length bytes (then memory is used)
+static int open_written(const char* filename, size_t length) {
+    char filepath[MAX_PATH_LEN + MAX_FILENAME_LEN];
+    snprintf(filepath, sizeof(filepath), "%s/%s", cache_root, filename);
+
+    struct stat st;
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && (fstat(fd, &st) != 0 || (size_t)st.st_size != length)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Read and parse a document from disk (no locks held)
+static cached_doc_t* load_doc(const char* filename) {
+    char filepath[MAX_PATH_LEN + MAX_FILENAME_LEN];
+    snprintf(filepath, sizeof(filepath), "%s/%s", cache_root, filename);
+
+    // The version first: racing a commit, the copy is at least as new as it
+    uint32_t version = ss_meta_version(filename);
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    cached_doc_t* doc = calloc(1, sizeof(cached_doc_t));
+    if (doc == NULL || fstat(fd, &st) != 0 ||
+        (doc->content = malloc((size_t)st.st_size + 1)) == NULL) {
+        free(doc);
+        close(fd);
+        return NULL;
+    }
+    doc->fd = fd;
+    doc->version = version;
+
+    // Read the whole version; later commits go to a new file, not this one
+    ssize_t n = ss_io_pread(fd, doc->content, (size_t)st.st_size, 0);
+    doc->length = (n > 0) ? (size_t)n : 0;
+    doc->content[doc->length] = '\0';
+
+    doc->sentence_count = index_document_sentences(doc->content, doc->length,
+                                                   &doc->sentences, &doc->word_count);
+    if (doc->sentence_count < 0) {
+        free_doc(doc);
+        return NULL;
+    }
+
+    strncpy(doc->filename, filename, sizeof(doc->filename) - 1);
+    doc->footprint = sizeof(cached_doc_t) + doc->length + 1 +
+                     doc->sentence_count * sizeof(doc_sentence_t);
+    return doc;
+}
+
+/**
+ * doc_cache_acquire - Get a shared, parsed copy of a document
+ * @filename: The filename
+ *
+ * Returns: The document with a reference held for the caller, or NULL if
+ *          the file cannot be read
+ */
+cached_doc_t* doc_cache_acquire(const char* filename) {
+    unsigned int index = doc_hash(filename);
+
+    pthread_mutex_lock(&cache_mutex);
+    for (cached_doc_t* doc = doc_table[index]; doc != NULL; doc = doc->hash_next) {
+        if (strcmp(doc->filename, filename) == 0) {
+            doc->refcount++;
+            lru_unlink(doc);
+            lru_push_front(doc);
+            pthread_mutex_unlock(&cache_mutex);
+            return doc;
+        }
+    }
+    uint64_t epoch = invalidation_epoch;
+    pthread_mutex_unlock(&cache_mutex);
+
+    // Miss: load outside the lock so other documents stay available
+    cached_doc_t* loaded = load_doc(filename);
+    if (loaded == NULL) {
+        return NULL;
+    }
+    loaded->refcount = 1;
+
+    pthread_mutex_lock(&cache_mutex);
+
+    // Another thread may have loaded it meanwhile
+    for (cached_doc_t* doc = doc_table[index]; doc != NULL; doc = doc->hash_next) {
+        if (strcmp(doc->filename, filename) == 0) {
+            doc->refcount++;
+            pthread_mutex_unlock(&cache_mutex);
+            free_doc(loaded);
+            return doc;
+        }
+    }
+
+    // A file changed while we were reading: our copy may predate it, so hand
+    // it out uncached rather than publish it
+    if (epoch == invalidation_epoch) {
+        loaded->cached = 1;
+        loaded->hash_next = doc_table[index];
+        doc_table[index] = loaded;
+        lru_push_front(loaded);
+        cache_bytes += loaded->footprint;
+        cache_entries++;
+        evict_over_budget();
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
+    return loaded;
+}
+
+// Take another reference to a document the caller already holds
+void doc_cache_retain(cached_doc_t* doc) {
+    if (doc == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    doc->refcount++;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+// Drop a reference; an invalidated or uncached document is freed by its last holder
+void doc_cache_release(cached_doc_t* doc) {
+    if (doc == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    int free_now = (--doc->refcount == 0 && !doc->cached);
+    if (!free_now && doc->refcount == 0) {
+        evict_over_budget();
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (free_now) {
+        free_doc(doc);
+    }
+}
+
+/**
+ * doc_cache_publish - Make a committed version current
+ * @filename: The filename
+ * @content: New content (malloc'd, NUL-terminated); taken over on success
+ * @length: Bytes of content
+ * @version: Its document version
+ * @written: 1 if the file already holds it, 0 to pin it until it does
+ *
+ * Returns: The new version with a reference held for the caller, or NULL
+ *          on allocation failure
+ */
+cached_doc_t* doc_cache_publish(const char* filename, char* content, size_t length,
+                                uint32_t version, int written) {
+    cached_doc_t* doc = calloc(1, sizeof(cached_doc_t));
+    if (doc == NULL) {
+        return NULL;
+    }
+    doc->sentence_count = index_document_sentences(content, length,
+                                                   &doc->sentences, &doc->word_count);
+    if (doc->sentence_count < 0) {
+        free(doc);
+        return NULL;
+    }
+    doc->content = content;
+    doc->length = length;
+    // The caller just renamed the file into place (and holds its commit lock)
+    doc->fd = written ? open_written(filename, length) : -1;
+    strncpy(doc->filename, filename, sizeof(doc->filename) - 1);
+    doc->footprint = sizeof(cached_doc_t) + length + 1 +
+                     doc->sentence_count * sizeof(doc_sentence_t);
+    doc->unwritten = !written;
+    doc->version = version;
+    doc->refcount = 1;
+
+    unsigned int index = doc_hash(filename);
+    cached_doc_t* to_free = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    invalidation_epoch++;   // Loads of the old file in flight must not be cached
+    for (cached_doc_t* old = doc_table[index]; old != NULL; old = old->hash_next) {
+        if (strcmp(old->filename, filename) == 0) {
+            table_remove(old);
+            if (old->refcount == 0) {
+                to_free = old;
+            }
+            break;
+        }
+    }
+    doc->cached = 1;
+    doc->hash_next = doc_table[index];
+    doc_table[index] = doc;
+    lru_push_front(doc);
+    cache_bytes += doc->footprint;
+    cache_entries++;
+    evict_over_budget();
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (to_free != NULL) {
+        free_doc(to_free);
+    }
+    return doc;
+}
+
+// Unpin a published version once its file holds it, and serve it from the
+// file from now on (readers load the fd once, so it is stored atomically)
+void doc_cache_mark_written(cached_doc_t* doc) {
+    int fd = open_written(doc->filename, doc->length);
+
+    pthread_mutex_lock(&cache_mutex);
+    if (fd >= 0 && __atomic_load_n(&doc->fd, __ATOMIC_ACQUIRE) < 0) {
+        __atomic_store_n(&doc->fd, fd, __ATOMIC_RELEASE);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    doc->unwritten = 0;
+    if (doc->cached && doc->refcount == 0) {
+        evict_over_budget();
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * doc_cache_invalidate - Forget a document whose file changed
+ * @filename: The filename
+ *
+ * Holders keep their (now old) copy until they release it.
+ */
+void doc_cache_invalidate(const char* filename) {
+    cached_doc_t* to_free = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    invalidation_epoch++;
+    for (cached_doc_t* doc = doc_table[doc_hash(filename)]; doc != NULL; doc = doc->hash_next) {
+        if (strcmp(doc->filename, filename) == 0) {
+            table_remove(doc);
+            if (doc->refcount == 0) {
+                to_free = doc;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (to_free != NULL) {
+        free_doc(to_free);
+    }
+}
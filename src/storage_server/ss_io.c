@@ -0,0 +1,1075 @@
+/*
+ * Storage Server Disk I/O Implementation
+ * With io_uring, each operation is prepared as a small batch of linked
+ * submissions (e.g. open -> read -> close of a .meta file) and handed to
+ * the kernel in one io_uring_enter, which also waits for the completions.
+ * Files are opened into direct (fixed) descriptors so a chain never
+ * returns to user space. Each thread has its own small ring, created on
+ * first use; the rings are driven through raw system calls (no liburing).
+ *
+ * Files are never rewritten in place. A commit writes the new version, and
+ * the document's new .meta if it has one, to temp files next to them and
+ * syncs both, renames the .meta's temp file into place, then the
+ * document's, and finally syncs the directory. A crash at any point leaves
+ * either the old or the new version under the document's name, with a
+ * .meta at least as new. Only a caller that names a backup (the legacy
+ * layout) gets the old version hard-linked to it before the renames.
+ * Concurrent commits share their syncs (group commit): the first to arrive
+ * flushes everything queued behind it.
+ *
+ * The synchronous backend performs the same steps with plain calls and is
+ * used when the kernel has no usable io_uring (old kernel, seccomp).
+ */
+
+#include "../../include/ss_io.h"
+#include "../../include/logging.h"
+#include <dirent.h>
+#include <stdint.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SS_IO_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define SS_IO_MAX_TRANSFER (1U << 30)  // Largest single read/write submission
+
+static ss_io_backend_t io_backend = SS_IO_SYNC;
+static unsigned long temp_sequence = 0;
+
+// Temp name next to @path: "<dir>/.<name>.<n>.tmp". Dot files are not
+// listed as documents, and leftovers are removed at startup.
+static void temp_path_for(const char* path, char* out, size_t size) {
+    unsigned long n = __atomic_add_fetch(&temp_sequence, 1, __ATOMIC_RELAXED);
+    const char* name = strrchr(path, '/');
+    int dir_length = (name != NULL) ? (int)(name - path) + 1 : 0;
+    snprintf(out, size, "%.*s.%s.%lu.tmp", dir_length, path, path + dir_length, n);
+}
+
+static void dir_path_for(const char* path, char* out, size_t size) {
+    const char* name = strrchr(path, '/');
+    if (name == NULL) {
+        snprintf(out, size, ".");
+    } else {
+        snprintf(out, size, "%.*s", (name == path) ? 1 : (int)(name - path), path);
+    }
+}
+
+// One caller of a group sync (see group_sync)
+typedef struct sync_waiter {
+    int fds[2];                 // Files whose data to sync (a document, its .meta), or -1
+    const char* dir;            // Directory whose entries to sync, or NULL
+    int errors[2];              // 0 or an errno value per file (errors[0]: the directory)
+    int done;
+    struct sync_waiter* next;
+} sync_waiter_t;
+
+// Synchronous backend
+
+static ssize_t pread_sync(int fd, char* buffer, size_t length, off_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = pread(fd, buffer + done, length - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+
+    return (ssize_t)done;
+}
+
+static int read_file_sync(const char* path, char** data, size_t* length) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    char* buffer = NULL;
+    ssize_t n = -1;
+    if (fstat(fd, &st) == 0 && (buffer = malloc((size_t)st.st_size + 1)) != NULL) {
+        n = pread_sync(fd, buffer, (size_t)st.st_size, 0);
+    }
+    int saved_errno = errno;
+    close(fd);
+
+    if (n < 0) {
+        free(buffer);
+        errno = saved_errno;
+        return -1;
+    }
+    buffer[n] = '\0';
+    *data = buffer;
+    *length = (size_t)n;
+    return 0;
+}
+
+static int write_all(int fd, const char* data, size_t length) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = write(fd, data + done, length - done);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (n > 0) {
+            done += n;
+        }
+    }
+    return 0;
+}
+
+// Write a file that must not exist yet
+static int create_file_sync(const char* path, const char* data, size_t length, int flags) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int result = write_all(fd, data, length);
+    if (result == 0 && (flags & SS_IO_DATASYNC)) {
+        result = fdatasync(fd);
+    }
+
+    int saved_errno = errno;
+    if (close(fd) != 0 && result == 0) {
+        return -1;
+    }
+    errno = saved_errno;
+    return result;
+}
+
+// Replace through a temp file so readers never see a half-written file
+static int write_file_sync(const char* path, const char* data, size_t length, int flags) {
+    if (flags & SS_IO_EXCL) {
+        return create_file_sync(path, data, length, flags);
+    }
+
+    char temp[MAX_PATH_LEN];
+    temp_path_for(path, temp, sizeof(temp));
+    if (create_file_sync(temp, data, length, flags) != 0 || rename(temp, path) != 0) {
+        int saved_errno = errno;
+        unlink(temp);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+static int write_version_sync(int fd, int meta_fd, ss_io_commit_t* commit) {
+    if (write_all(fd, commit->data, commit->length) != 0) {
+        commit->failed_step = "write";
+        return -1;
+    }
+    if (meta_fd >= 0 && write_all(meta_fd, commit->meta, commit->meta_length) != 0) {
+        commit->failed_step = "metadata";
+        return -1;
+    }
+    return 0;
+}
+
+static int install_version_sync(ss_io_commit_t* commit, const char* temp, const char* meta_temp,
+                                const char* backup_temp) {
+    if (commit->backup_path != NULL &&
+        (link(commit->path, backup_temp) != 0 || rename(backup_temp, commit->backup_path) != 0)) {
+        commit->failed_step = "backup";
+        return -1;
+    }
+    if (commit->meta_path != NULL && rename(meta_temp, commit->meta_path) != 0) {
+        commit->failed_step = "metadata";
+        return -1;
+    }
+    if (rename(temp, commit->path) != 0) {
+        commit->failed_step = "write";
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef SS_IO_HAVE_URING
+
+#define SS_IO_MAX_BATCH 8              // Largest batch (a commit); also the ring size
+#define SS_IO_DOC_SLOT 0               // Direct descriptor slots of each ring
+#define SS_IO_META_SLOT 1
+#define SS_IO_SLOTS 2
+
+// Submissions prepared by one worker and completed together
+typedef struct {
+    struct io_uring_sqe sqes[SS_IO_MAX_BATCH];
+    int results[SS_IO_MAX_BATCH];      // cqe->res: a count, 0, or -errno
+    int count;
+} io_batch_t;
+
+// One ring per thread: a worker submits a batch and waits for its
+// completions in the same io_uring_enter, with no locking or hand-off
+typedef struct {
+    int fd;
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+} io_ring_t;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static io_ring_t ring_unavailable;     // Marks a thread whose ring could not be set up
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Batch preparation
+
+static struct io_uring_sqe* batch_add(io_batch_t* batch, int opcode, int fd, unsigned flags) {
+    struct io_uring_sqe* sqe = &batch->sqes[batch->count];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->flags = flags;
+    sqe->user_data = batch->count;
+    batch->results[batch->count] = -ECANCELED;
+    batch->count++;
+    return sqe;
+}
+
+static void add_open(io_batch_t* batch, const char* path, int open_flags, int slot, unsigned flags) {
+    struct io_uring_sqe* sqe = batch_add(batch, IORING_OP_OPENAT, AT_FDCWD, flags);
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->len = 0666;
+    sqe->open_flags = open_flags;
+    sqe->file_index = slot + 1;
+}
+
+static void add_rw(io_batch_t* batch, int opcode, int slot, const char* buffer, size_t length,
+                   unsigned flags) {
+    struct io_uring_sqe* sqe = batch_add(batch, opcode, slot, flags | IOSQE_FIXED_FILE);
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = (unsigned)length;
+    sqe->off = 0;
+}
+
+static void add_fdatasync(io_batch_t* batch, int slot, unsigned flags) {
+    struct io_uring_sqe* sqe = batch_add(batch, IORING_OP_FSYNC, slot, flags | IOSQE_FIXED_FILE);
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+}
+
+static void add_close(io_batch_t* batch, int slot) {
+    struct io_uring_sqe* sqe = batch_add(batch, IORING_OP_CLOSE, 0, 0);
+    sqe->file_index = slot + 1;
+}
+
+static void add_rename(io_batch_t* batch, const char* from, const char* to, unsigned flags) {
+    struct io_uring_sqe* sqe = batch_add(batch, IORING_OP_RENAMEAT, AT_FDCWD, flags);
+    sqe->addr = (uint64_t)(uintptr_t)from;
+    sqe->len = (unsigned)AT_FDCWD;
+    sqe->addr2 = (uint64_t)(uintptr_t)to;
+}
+
+static void add_link(io_batch_t* batch, const char* from, const char* to, unsigned flags) {
+    struct io_uring_sqe* sqe = batch_add(batch, IORING_OP_LINKAT, AT_FDCWD, flags);
+    sqe->addr = (uint64_t)(uintptr_t)from;
+    sqe->len = (unsigned)AT_FDCWD;
+    sqe->addr2 = (uint64_t)(uintptr_t)to;
+}
+
+/**
+ * run_batch - Submit a prepared batch and wait for all its completions
+ * @ring: The calling thread's ring
+ * @batch: The batch (results are left in batch->results)
+ *
+ * The ring is private to the thread and empty between batches, so results
+ * are matched to operations by index alone.
+ */
+static void run_batch(io_ring_t* ring, io_batch_t* batch) {
+    unsigned tail = *ring->sq_tail;
+    for (int i = 0; i < batch->count; i++) {
+        unsigned index = (tail + i) & *ring->sq_mask;
+        ring->sqes[index] = batch->sqes[i];
+        ring->sq_array[index] = index;
+    }
+    __atomic_store_n(ring->sq_tail, tail + batch->count, __ATOMIC_RELEASE);
+
+    int unsubmitted = batch->count;
+    int outstanding = 0;
+    while (unsubmitted > 0 || outstanding > 0) {
+        // Submits, then waits only if everything was taken
+        int n = sys_io_uring_enter(ring->fd, unsubmitted, unsubmitted + outstanding,
+                                   IORING_ENTER_GETEVENTS);
+        if (n >= 0) {
+            unsubmitted -= n;
+            outstanding += n;
+        } else if (unsubmitted > 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // The kernel took none of the rest; withdraw them as failed
+            int error = errno;
+            __atomic_store_n(ring->sq_tail, tail + batch->count - unsubmitted, __ATOMIC_RELEASE);
+            for (int i = batch->count - unsubmitted; i < batch->count; i++) {
+                batch->results[i] = -error;
+            }
+            unsubmitted = 0;
+        }
+
+        unsigned head = *ring->cq_head;
+        unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            batch->results[cqe->user_data] = cqe->res;
+            outstanding--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+// io_uring operations
+
+static ssize_t pread_uring(io_ring_t* ring, int fd, char* buffer, size_t length, off_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        size_t chunk = length - done < SS_IO_MAX_TRANSFER ? length - done : SS_IO_MAX_TRANSFER;
+        io_batch_t batch;
+        batch.count = 0;
+        struct io_uring_sqe* sqe = batch_add(&batch, IORING_OP_READ, fd, 0);
+        sqe->addr = (uint64_t)(uintptr_t)(buffer + done);
+        sqe->len = (unsigned)chunk;
+        sqe->off = (uint64_t)(offset + (off_t)done);
+        run_batch(ring, &batch);
+
+        int result = batch.results[0];
+        if (result == -EINTR || result == -EAGAIN) {
+            continue;
+        }
+        if (result < 0) {
+            errno = -result;
+            return -1;
+        }
+        if (result == 0) {
+            break;
+        }
+        done += result;
+    }
+
+    return (ssize_t)done;
+}
+
+// One read covers small files (.meta); anything longer is read in full afterwards
+static int read_file_uring(io_ring_t* ring, const char* path, char** data, size_t* length) {
+    char* buffer = malloc(SS_IO_SMALL_FILE + 1);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    io_batch_t batch;
+    batch.count = 0;
+    add_open(&batch, path, O_RDONLY, SS_IO_META_SLOT, IOSQE_IO_LINK);
+    add_rw(&batch, IORING_OP_READ, SS_IO_META_SLOT, buffer, SS_IO_SMALL_FILE, IOSQE_IO_HARDLINK);
+    add_close(&batch, SS_IO_META_SLOT);
+    run_batch(ring, &batch);
+
+    int result = (batch.results[0] < 0) ? batch.results[0] : batch.results[1];
+    if (result < 0) {
+        free(buffer);
+        errno = -result;
+        return -1;
+    }
+    if (result == SS_IO_SMALL_FILE) {
+        free(buffer);
+        return read_file_sync(path, data, length);
+    }
+
+    buffer[result] = '\0';
+    *data = buffer;
+    *length = (size_t)result;
+    return 0;
+}
+
+static int write_file_uring(io_ring_t* ring, const char* path, const char* data, size_t length,
+                            int flags) {
+    if (length > SS_IO_MAX_TRANSFER) {
+        return write_file_sync(path, data, length, flags);
+    }
+
+    // SS_IO_EXCL creates the file in place; a replacement goes to a temp file
+    char temp[MAX_PATH_LEN];
+    const char* target = path;
+    if (!(flags & SS_IO_EXCL)) {
+        temp_path_for(path, temp, sizeof(temp));
+        target = temp;
+    }
+
+    io_batch_t batch;
+    batch.count = 0;
+    add_open(&batch, target, O_WRONLY | O_CREAT | O_EXCL, SS_IO_DOC_SLOT, IOSQE_IO_LINK);
+    add_rw(&batch, IORING_OP_WRITE, SS_IO_DOC_SLOT, data, length, IOSQE_IO_HARDLINK);
+    if (flags & SS_IO_DATASYNC) {
+        add_fdatasync(&batch, SS_IO_DOC_SLOT, IOSQE_IO_HARDLINK);
+    }
+    add_close(&batch, SS_IO_DOC_SLOT);
+    run_batch(ring, &batch);
+
+    int error = 0;
+    for (int i = 0; i < batch.count - 1 && error == 0; i++) {
+        if (batch.results[i] < 0) {
+            error = -batch.results[i];
+        }
+    }
+    if (error == 0 && (size_t)batch.results[1] != length) {
+        error = ENOSPC;
+    }
+    if (target == path) {
+        errno = error;
+        return (error == 0) ? 0 : -1;
+    }
+
+    // The rename waits for the results: a failed write must not be installed
+    batch.count = 0;
+    if (error == 0) {
+        add_rename(&batch, temp, path, 0);
+    } else if (batch.results[0] == 0) {
+        struct io_uring_sqe* sqe = batch_add(&batch, IORING_OP_UNLINKAT, AT_FDCWD, 0);
+        sqe->addr = (uint64_t)(uintptr_t)temp;
+    }
+    if (batch.count > 0) {
+        run_batch(ring, &batch);
+    }
+    if (error == 0 && batch.results[0] < 0) {
+        error = -batch.results[0];
+        unlink(temp);
+    }
+    errno = error;
+    return (error == 0) ? 0 : -1;
+}
+
+static int path_op_uring(io_ring_t* ring, int opcode, const char* path, const char* to) {
+    io_batch_t batch;
+    batch.count = 0;
+    if (opcode == IORING_OP_RENAMEAT) {
+        add_rename(&batch, path, to, 0);
+    } else {
+        struct io_uring_sqe* sqe = batch_add(&batch, IORING_OP_UNLINKAT, AT_FDCWD, 0);
+        sqe->addr = (uint64_t)(uintptr_t)path;
+    }
+    run_batch(ring, &batch);
+
+    if (batch.results[0] < 0) {
+        errno = -batch.results[0];
+        return -1;
+    }
+    return 0;
+}
+
+static void add_write(io_batch_t* batch, int fd, const char* data, size_t length) {
+    struct io_uring_sqe* sqe = batch_add(batch, IORING_OP_WRITE, fd, 0);
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (unsigned)length;
+    sqe->off = 0;
+}
+
+// A short write (e.g. a full disk) is finished synchronously to learn why
+static int finish_write(int fd, const char* data, size_t length, int written) {
+    if (written < 0) {
+        errno = -written;
+        return -1;
+    }
+    return write_all(fd, data + written, length - (size_t)written);
+}
+
+/*
+ * New version batch: write(temp) alongside write(.meta temp). The temp
+ * files are normal descriptors so that whichever thread leads the group
+ * sync can flush them.
+ */
+static int write_version_uring(io_ring_t* ring, int fd, int meta_fd, ss_io_commit_t* commit) {
+    if (commit->length > SS_IO_MAX_TRANSFER || commit->meta_length > SS_IO_MAX_TRANSFER) {
+        return write_version_sync(fd, meta_fd, commit);
+    }
+
+    io_batch_t batch;
+    batch.count = 0;
+    add_write(&batch, fd, commit->data, commit->length);
+    if (meta_fd >= 0) {
+        add_write(&batch, meta_fd, commit->meta, commit->meta_length);
+    }
+    run_batch(ring, &batch);
+
+    if (finish_write(fd, commit->data, commit->length, batch.results[0]) != 0) {
+        commit->failed_step = "write";
+        return -1;
+    }
+    if (meta_fd >= 0 &&
+        finish_write(meta_fd, commit->meta, commit->meta_length, batch.results[1]) != 0) {
+        commit->failed_step = "metadata";
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Install batch: link(doc -> .bak temp) -> rename(.bak temp -> .bak) ->
+ * rename(.meta temp -> .meta) -> rename(temp -> doc). The links stop the
+ * chain at the first failure, so the document is only replaced once the
+ * old version is safe as the backup and the .meta is in place.
+ */
+static int install_version_uring(io_ring_t* ring, ss_io_commit_t* commit, const char* temp,
+                                 const char* meta_temp, const char* backup_temp) {
+    const char* steps[SS_IO_MAX_BATCH];
+    io_batch_t batch;
+    batch.count = 0;
+    if (commit->backup_path != NULL) {
+        steps[batch.count] = "backup";
+        add_link(&batch, commit->path, backup_temp, IOSQE_IO_LINK);
+        steps[batch.count] = "backup";
+        add_rename(&batch, backup_temp, commit->backup_path, IOSQE_IO_LINK);
+    }
+    if (commit->meta_path != NULL) {
+        steps[batch.count] = "metadata";
+        add_rename(&batch, meta_temp, commit->meta_path, IOSQE_IO_LINK);
+    }
+    steps[batch.count] = "write";
+    add_rename(&batch, temp, commit->path, 0);
+    run_batch(ring, &batch);
+
+    for (int i = 0; i < batch.count; i++) {
+        if (batch.results[i] < 0) {
+            commit->failed_step = steps[i];
+            errno = -batch.results[i];
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Ring lifecycle
+
+static void ring_destroy(io_ring_t* ring) {
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map != NULL) munmap(ring->sq_map, ring->sq_map_size);
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring);
+}
+
+static void ring_key_destructor(void* value) {
+    if (value != &ring_unavailable) {
+        ring_destroy((io_ring_t*)value);
+    }
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, ring_key_destructor);
+}
+
+// Every opcode the backend submits must be supported by this kernel
+static int ring_ops_supported(io_ring_t* ring) {
+    static const int needed[] = {
+        IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_READ, IORING_OP_WRITE,
+        IORING_OP_FSYNC, IORING_OP_RENAMEAT, IORING_OP_UNLINKAT, IORING_OP_LINKAT
+    };
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_size);
+    if (probe == NULL || sys_io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        free(probe);
+        return 0;
+    }
+
+    int supported = 1;
+    for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+            supported = 0;
+        }
+    }
+    free(probe);
+    return supported;
+}
+
+// Open into a direct descriptor and close it again. Kernels that predate
+// direct descriptors would hand back a normal one instead.
+static int ring_self_test(io_ring_t* ring) {
+    io_batch_t batch;
+    batch.count = 0;
+    add_open(&batch, "/", O_RDONLY | O_DIRECTORY, SS_IO_DOC_SLOT, IOSQE_IO_LINK);
+    add_close(&batch, SS_IO_DOC_SLOT);
+    run_batch(ring, &batch);
+    return (batch.results[0] == 0 && batch.results[1] == 0) ? 0 : -1;
+}
+
+static io_ring_t* ring_create(void) {
+    io_ring_t* ring = calloc(1, sizeof(io_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = sys_io_uring_setup(SS_IO_MAX_BATCH, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        ring_destroy(ring);
+        return NULL;
+    }
+    ring->cq_map = ring->sq_map;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->cq_map == MAP_FAILED) ring->cq_map = NULL;
+        if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    char* sq = ring->sq_map;
+    char* cq = ring->cq_map;
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Sparse table of direct descriptors for the open/close chains
+    int empty[SS_IO_SLOTS] = {-1, -1};
+    if (!ring_ops_supported(ring) ||
+        sys_io_uring_register(ring->fd, IORING_REGISTER_FILES, empty, SS_IO_SLOTS) < 0 ||
+        ring_self_test(ring) != 0) {
+        ring_destroy(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+// The calling thread's ring, set up on first use; NULL if it cannot be
+static io_ring_t* thread_ring(void) {
+    if (io_backend != SS_IO_URING) {
+        return NULL;
+    }
+    pthread_once(&ring_key_once, create_ring_key);
+
+    io_ring_t* ring = pthread_getspecific(ring_key);
+    if (ring == NULL) {
+        ring = ring_create();
+        if (ring == NULL) {
+            LOG_WARNING_MSG("SS_IO", "No io_uring for this thread, using synchronous I/O");
+        }
+        pthread_setspecific(ring_key, ring ? ring : &ring_unavailable);
+    }
+    return (ring == &ring_unavailable) ? NULL : ring;
+}
+
+// fdatasync every file of a group sync, a ring's worth per submission
+static void flush_data_uring(io_ring_t* ring, sync_waiter_t* batch) {
+    while (batch != NULL) {
+        int* errors[SS_IO_MAX_BATCH];
+        io_batch_t ops;
+        ops.count = 0;
+        for (; batch != NULL && ops.count + 2 <= SS_IO_MAX_BATCH; batch = batch->next) {
+            for (int f = 0; f < 2; f++) {
+                if (batch->fds[f] >= 0) {
+                    errors[ops.count] = &batch->errors[f];
+                    struct io_uring_sqe* sqe = batch_add(&ops, IORING_OP_FSYNC, batch->fds[f], 0);
+                    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                }
+            }
+        }
+        run_batch(ring, &ops);
+        for (int i = 0; i < ops.count; i++) {
+            *errors[i] = (ops.results[i] < 0) ? -ops.results[i] : 0;
+        }
+    }
+}
+
+#endif // SS_IO_HAVE_URING
+
+/*
+ * Group commit. Callers queue on a group; if nobody is flushing, the caller
+ * becomes the leader, takes the whole queue and flushes it outside the lock.
+ * Everyone arriving meanwhile queues for the next round, so under load a
+ * flush serves every commit that came in while the previous one ran, with
+ * no added delay when a commit is alone.
+ */
+typedef struct {
+    sync_waiter_t* queue;       // Waiting for the next flush
+    int flushing;               // A leader is flushing
+    unsigned long requests;
+    unsigned long flushes;
+} sync_group_t;
+
+static sync_group_t data_group;
+static sync_group_t dir_group;
+static pthread_mutex_t group_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t group_done = PTHREAD_COND_INITIALIZER;
+
+static void flush_data(sync_waiter_t* batch) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        flush_data_uring(ring, batch);
+        return;
+    }
+#endif
+    for (sync_waiter_t* waiter = batch; waiter != NULL; waiter = waiter->next) {
+        for (int f = 0; f < 2; f++) {
+            if (waiter->fds[f] >= 0) {
+                waiter->errors[f] = (fdatasync(waiter->fds[f]) == 0) ? 0 : errno;
+            }
+        }
+    }
+}
+
+// Sync each distinct directory once
+static void flush_dirs(sync_waiter_t* batch) {
+    for (sync_waiter_t* waiter = batch; waiter != NULL; waiter = waiter->next) {
+        sync_waiter_t* same = batch;
+        while (same != waiter && strcmp(same->dir, waiter->dir) != 0) {
+            same = same->next;
+        }
+        if (same != waiter) {
+            waiter->errors[0] = same->errors[0];
+            continue;
+        }
+
+        int fd = open(waiter->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        waiter->errors[0] = (fd >= 0 && fsync(fd) == 0) ? 0 : errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+static int group_sync(sync_group_t* group, sync_waiter_t* self, void (*flush)(sync_waiter_t*)) {
+    pthread_mutex_lock(&group_mutex);
+    self->errors[0] = self->errors[1] = 0;
+    self->done = 0;
+    self->next = group->queue;
+    group->queue = self;
+    group->requests++;
+
+    while (!self->done) {
+        if (group->flushing) {
+            pthread_cond_wait(&group_done, &group_mutex);
+            continue;
+        }
+
+        sync_waiter_t* batch = group->queue;
+        group->queue = NULL;
+        group->flushing = 1;
+        group->flushes++;
+        pthread_mutex_unlock(&group_mutex);
+
+        flush(batch);
+
+        pthread_mutex_lock(&group_mutex);
+        while (batch != NULL) {
+            sync_waiter_t* next = batch->next;  // The waiter may return once done
+            batch->done = 1;
+            batch = next;
+        }
+        group->flushing = 0;
+        pthread_cond_broadcast(&group_done);
+    }
+    pthread_mutex_unlock(&group_mutex);
+
+    if (self->errors[0] != 0 || self->errors[1] != 0) {
+        errno = (self->errors[0] != 0) ? self->errors[0] : self->errors[1];
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * ss_io_init - Choose the disk I/O backend
+ * @wanted: SS_IO_URING to try io_uring first, SS_IO_SYNC for plain calls
+ *
+ * Returns: The backend in use
+ */
+ss_io_backend_t ss_io_init(ss_io_backend_t wanted) {
+    io_backend = SS_IO_SYNC;
+#ifdef SS_IO_HAVE_URING
+    // The calling thread's ring doubles as the probe for kernel support
+    if (wanted == SS_IO_URING) {
+        io_backend = SS_IO_URING;
+        if (thread_ring() == NULL) {
+            LOG_WARNING_MSG("SS_IO", "io_uring unavailable, using synchronous I/O");
+            io_backend = SS_IO_SYNC;
+        }
+    }
+#else
+    (void)wanted;
+#endif
+    LOG_INFO_MSG("SS_IO", "Disk I/O backend: %s", ss_io_backend_name());
+    return io_backend;
+}
+
+const char* ss_io_backend_name(void) {
+    return (io_backend == SS_IO_URING) ? "io_uring" : "sync";
+}
+
+ssize_t ss_io_pread(int fd, char* buffer, size_t length, off_t offset) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return pread_uring(ring, fd, buffer, length, offset);
+    }
+#endif
+    return pread_sync(fd, buffer, length, offset);
+}
+
+// Read a whole file into a malloc'd, NUL-terminated buffer
+int ss_io_read_file(const char* path, char** data, size_t* length) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return read_file_uring(ring, path, data, length);
+    }
+#endif
+    return read_file_sync(path, data, length);
+}
+
+// Create or replace a file with the given content (see SS_IO_EXCL/SS_IO_DATASYNC)
+int ss_io_write_file(const char* path, const char* data, size_t length, int flags) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return write_file_uring(ring, path, data, length, flags);
+    }
+#endif
+    return write_file_sync(path, data, length, flags);
+}
+
+int ss_io_rename(const char* from, const char* to) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return path_op_uring(ring, IORING_OP_RENAMEAT, from, to);
+    }
+#endif
+    return rename(from, to);
+}
+
+int ss_io_unlink(const char* path) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return path_op_uring(ring, IORING_OP_UNLINKAT, path, NULL);
+    }
+#endif
+    return unlink(path);
+}
+
+static int write_version(int fd, int meta_fd, ss_io_commit_t* commit) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return write_version_uring(ring, fd, meta_fd, commit);
+    }
+#endif
+    return write_version_sync(fd, meta_fd, commit);
+}
+
+static int install_version(ss_io_commit_t* commit, const char* temp, const char* meta_temp,
+                           const char* backup_temp) {
+#ifdef SS_IO_HAVE_URING
+    io_ring_t* ring = thread_ring();
+    if (ring != NULL) {
+        return install_version_uring(ring, commit, temp, meta_temp, backup_temp);
+    }
+#endif
+    return install_version_sync(commit, temp, meta_temp, backup_temp);
+}
+
+// Sync the directory entries a commit renamed; the new version is already in place
+static void sync_commit_dir(const char* path) {
+    char dir[MAX_PATH_LEN];
+    dir_path_for(path, dir, sizeof(dir));
+    sync_waiter_t waiter = { .fds = {-1, -1}, .dir = dir };
+    if (group_sync(&dir_group, &waiter, flush_dirs) != 0) {
+        LOG_WARNING_MSG("SS_IO", "Failed to sync directory %s: %s", dir, strerror(errno));
+    }
+}
+
+/**
+ * ss_io_commit - Replace a document, and its .meta if given
+ * @commit: Paths and content in; the failed step out
+ *
+ * temp writes -> data sync -> [link(doc, .bak)] -> rename(.meta temp, .meta)
+ * -> rename(temp, doc) -> dir sync. On failure the document is left as it
+ * was; only a failed document rename leaves the new .meta behind.
+ *
+ * Returns: 0 once the new content is durable under the document's name, or
+ *          -1 (errno set)
+ */
+int ss_io_commit(ss_io_commit_t* commit) {
+    commit->failed_step = NULL;
+
+    char temp[MAX_PATH_LEN];
+    char meta_temp[MAX_PATH_LEN];
+    char backup_temp[MAX_PATH_LEN];
+    temp_path_for(commit->path, temp, sizeof(temp));
+    temp_path_for(commit->meta_path != NULL ? commit->meta_path : commit->path,
+                  meta_temp, sizeof(meta_temp));
+    temp_path_for(commit->backup_path != NULL ? commit->backup_path : commit->path,
+                  backup_temp, sizeof(backup_temp));
+
+    // New version and .meta into temp files, synced together before any
+    // name points at them
+    int fd = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    int meta_fd = -1;
+    if (fd >= 0 && commit->meta_path != NULL) {
+        meta_fd = open(meta_temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    }
+    int result = -1;
+    if (fd < 0 || (commit->meta_path != NULL && meta_fd < 0)) {
+        commit->failed_step = (fd < 0) ? "write" : "metadata";
+    } else {
+        result = write_version(fd, meta_fd, commit);
+    }
+    if (result == 0) {
+        sync_waiter_t waiter = { .fds = {fd, meta_fd}, .dir = NULL };
+        result = group_sync(&data_group, &waiter, flush_data);
+        if (result != 0) {
+            commit->failed_step = (waiter.errors[0] != 0) ? "write" : "metadata";
+        }
+    }
+    int saved_errno = errno;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (meta_fd >= 0) {
+        close(meta_fd);
+    }
+    if (result != 0) {
+        if (fd >= 0) {
+            unlink(temp);
+        }
+        if (meta_fd >= 0) {
+            unlink(meta_temp);
+        }
+        errno = saved_errno;
+        return -1;
+    }
+
+    // Current version becomes the backup, the .meta moves ahead, then the
+    // new version takes the name
+    if (install_version(commit, temp, meta_temp, backup_temp) != 0) {
+        saved_errno = errno;
+        unlink(backup_temp);
+        if (commit->meta_path != NULL) {
+            unlink(meta_temp);
+        }
+        unlink(temp);
+        errno = saved_errno;
+        return -1;
+    }
+
+    // Make the renames durable
+    sync_commit_dir(commit->path);
+    if (commit->meta_path != NULL) {
+        char dir[MAX_PATH_LEN];
+        char meta_dir[MAX_PATH_LEN];
+        dir_path_for(commit->path, dir, sizeof(dir));
+        dir_path_for(commit->meta_path, meta_dir, sizeof(meta_dir));
+        if (strcmp(dir, meta_dir) != 0) {
+            sync_commit_dir(commit->meta_path);
+        }
+    }
+    return 0;
+}
+
+/**
+ * ss_io_sync_data - fdatasync a file alongside the commits in flight
+ * @fd: The file
+ *
+ * Joins the same group sync as ss_io_commit, so a log appended next to a
+ * commit costs no flush of its own under load.
+ *
+ * Returns: 0, or -1 (errno set)
+ */
+int ss_io_sync_data(int fd) {
+    sync_waiter_t waiter = { .fds = {fd, -1}, .dir = NULL };
+    return group_sync(&data_group, &waiter, flush_data);
+}
+
+// Data syncs requested and flushes that served them since startup
+void ss_io_sync_stats(unsigned long* syncs, unsigned long* flushes) {
+    pthread_mutex_lock(&group_mutex);
+    *syncs = data_group.requests;
+    *flushes = data_group.flushes;
+    pthread_mutex_unlock(&group_mutex);
+}
+
+/**
+ * ss_io_remove_temp_files - Delete temp files left by an interrupted write
+ * @dir_path: Directory to clean
+ *
+ * Returns: Number of files removed
+ */
+int ss_io_remove_temp_files(const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int removed = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' && length > 5 &&
+            strcmp(entry->d_name + length - 4, ".tmp") == 0) {
+            char path[MAX_PATH_LEN];
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            if (unlink(path) == 0) {
+                removed++;
+            }
+        }
+    }
+    closedir(dir);
+    return removed;
+}
@@ -0,0 +1,470 @@
+/*
+ * Storage Server Sentence Lock Table Implementation
+ * Each file with held locks has one lock object, found through a hash map
+ * whose buckets are split across SS_LOCK_STRIPES mutexes. A lock object
+ * hashes its locked sentences by index, so taking or dropping a lock touches
+ * one file bucket and one sentence bucket under one stripe mutex. Memory
+ * is allocated before a stripe is locked, and a lock object is freed once
+ * its last lock is dropped.
+ *
+ * A locked sentence keeps a set of word ranges; a whole-sentence lock is
+ * the range 0..SS_LOCK_LAST_WORD. Ranges of different users never overlap.
+ *
+ * A lock is a lease: it lapses SS_LOCK_LEASE_SECONDS after the holder last
+ * renewed it and is dropped as soon as another writer needs its words.
+ * Writers that wait queue on the sentence in FIFO order. A waiter is granted
+ * its range once no holder and no earlier waiter overlaps it, so writers
+ * waiting for different words of a sentence do not hold each other up.
+ */
+
+#include "../../include/ss_lock_table.h"
+#include "../../include/logging.h"
+
+// One holder's word range
+typedef struct ss_range_lock {
+    int first_word;
+    int last_word;
+    char user[MAX_USERNAME_LEN];
+    uint64_t expires_ms;            // Lease end (monotonic clock)
+    struct ss_range_lock* next;
+} ss_range_lock_t;
+
+// A WRITE blocked on busy words (lives on the waiting thread's stack)
+typedef struct ss_lock_waiter {
+    ss_range_lock_t* range;         // Joins the holders when granted
+    pthread_cond_t wake;
+    int granted;
+    struct ss_lock_waiter* next;
+} ss_lock_waiter_t;
+
+typedef struct ss_sentence_lock {
+    int sentence;
+    ss_range_lock_t* holders;
+    ss_lock_waiter_t* waiters;      // FIFO
+    ss_lock_waiter_t* waiters_tail;
+    struct ss_sentence_lock* next;
+} ss_sentence_lock_t;
+
+typedef struct ss_file_locks {
+    char filename[MAX_FILENAME_LEN];
+    int held;                       // Sentences with holders or waiters
+    ss_sentence_lock_t* slots[SS_LOCK_FILE_SLOTS];
+    struct ss_file_locks* hash_next;
+} ss_file_locks_t;
+
+static ss_file_locks_t* lock_table[SS_LOCK_BUCKETS];
+static pthread_mutex_t stripe_locks[SS_LOCK_STRIPES];
+static int held_locks = 0;      // Updated atomically (stripes run in parallel)
+
+static unsigned int file_bucket(const char* filename) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash % SS_LOCK_BUCKETS;
+}
+
+static pthread_mutex_t* stripe_for(unsigned int bucket) {
+    return &stripe_locks[bucket % SS_LOCK_STRIPES];
+}
+
+static ss_sentence_lock_t** sentence_slot(ss_file_locks_t* files, int sentence) {
+    return &files->slots[(unsigned int)sentence % SS_LOCK_FILE_SLOTS];
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Two ranges collide when they share a word and belong to different users
+static int ranges_conflict(const ss_range_lock_t* a, const ss_range_lock_t* b) {
+    return a->first_word <= b->last_word && b->first_word <= a->last_word &&
+           strcmp(a->user, b->user) != 0;
+}
+
+static void renew(ss_range_lock_t* range) {
+    range->expires_ms = now_ms() + SS_LOCK_LEASE_SECONDS * 1000ULL;
+}
+
+// Table helpers (the bucket's stripe mutex held)
+static ss_file_locks_t* find_file(unsigned int bucket, const char* filename) {
+    ss_file_locks_t* files = lock_table[bucket];
+    while (files != NULL && strcmp(files->filename, filename) != 0) {
+        files = files->hash_next;
+    }
+    return files;
+}
+
+static void remove_file(unsigned int bucket, ss_file_locks_t* files) {
+    ss_file_locks_t** link = &lock_table[bucket];
+    while (*link != NULL && *link != files) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == files) {
+        *link = files->hash_next;
+    }
+}
+
+static ss_sentence_lock_t* find_sentence(ss_file_locks_t* files, int sentence) {
+    ss_sentence_lock_t* lock = *sentence_slot(files, sentence);
+    while (lock != NULL && lock->sentence != sentence) {
+        lock = lock->next;
+    }
+    return lock;
+}
+
+static ss_range_lock_t** find_holder(ss_sentence_lock_t* lock, int first_word, int last_word,
+                                     const char* user) {
+    ss_range_lock_t** link = &lock->holders;
+    while (*link != NULL &&
+           ((*link)->first_word != first_word || (*link)->last_word != last_word ||
+            strcmp((*link)->user, user) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// User of the first holder, or of a waiter queued before @stop, that
+// @range collides with (NULL if none)
+static const char* find_conflict(ss_sentence_lock_t* lock, const ss_range_lock_t* range,
+                                 const ss_lock_waiter_t* stop) {
+    for (ss_range_lock_t* holder = lock->holders; holder != NULL; holder = holder->next) {
+        if (ranges_conflict(holder, range)) {
+            return holder->user;
+        }
+    }
+    for (ss_lock_waiter_t* waiter = lock->waiters; waiter != stop; waiter = waiter->next) {
+        if (ranges_conflict(waiter->range, range)) {
+            return waiter->range->user;
+        }
+    }
+    return NULL;
+}
+
+static void add_holder(ss_sentence_lock_t* lock, ss_range_lock_t* range) {
+    renew(range);
+    range->next = lock->holders;
+    lock->holders = range;
+    __atomic_add_fetch(&held_locks, 1, __ATOMIC_RELAXED);
+}
+
+// Grant, in queue order, every waiter no holder or earlier waiter overlaps
+static void grant_waiters(ss_sentence_lock_t* lock) {
+    ss_lock_waiter_t** link = &lock->waiters;
+    ss_lock_waiter_t* prev = NULL;
+    while (*link != NULL) {
+        ss_lock_waiter_t* waiter = *link;
+        if (find_conflict(lock, waiter->range, waiter) != NULL) {
+            prev = waiter;
+            link = &waiter->next;
+            continue;
+        }
+        *link = waiter->next;
+        if (lock->waiters_tail == waiter) {
+            lock->waiters_tail = prev;
+        }
+        add_holder(lock, waiter->range);
+        waiter->granted = 1;
+        pthread_cond_signal(&waiter->wake);
+    }
+}
+
+// Drop holders whose lease lapsed and let the waiters behind them in
+static void reclaim_lapsed(ss_sentence_lock_t* lock, const char* filename) {
+    uint64_t now = now_ms();
+    ss_range_lock_t** link = &lock->holders;
+    int dropped = 0;
+    while (*link != NULL) {
+        ss_range_lock_t* holder = *link;
+        if (holder->expires_ms > now) {
+            link = &holder->next;
+            continue;
+        }
+        LOG_INFO_MSG("LOCKS", "Lease of '%s' on sentence %d of '%s' lapsed",
+                     holder->user, lock->sentence, filename);
+        *link = holder->next;
+        free(holder);
+        __atomic_sub_fetch(&held_locks, 1, __ATOMIC_RELAXED);
+        dropped = 1;
+    }
+    if (dropped) {
+        grant_waiters(lock);
+    }
+}
+
+// Earliest lease end among the holders @range collides with
+static uint64_t next_expiry(ss_sentence_lock_t* lock, const ss_range_lock_t* range) {
+    uint64_t earliest = UINT64_MAX;
+    for (ss_range_lock_t* holder = lock->holders; holder != NULL; holder = holder->next) {
+        if (ranges_conflict(holder, range) && holder->expires_ms < earliest) {
+            earliest = holder->expires_ms;
+        }
+    }
+    return earliest;
+}
+
+// Queue for busy words until they are granted (on a release or a lapsed
+// lease) or @wait_ms passes. Returns 1 once @range is held.
+static int wait_for_range(pthread_mutex_t* stripe, ss_sentence_lock_t* lock,
+                          const char* filename, ss_range_lock_t* range, int wait_ms) {
+    ss_lock_waiter_t waiter;
+    memset(&waiter, 0, sizeof(waiter));
+    waiter.range = range;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&waiter.wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (lock->waiters_tail != NULL) {
+        lock->waiters_tail->next = &waiter;
+    } else {
+        lock->waiters = &waiter;
+    }
+    lock->waiters_tail = &waiter;
+
+    uint64_t deadline = now_ms() + (uint64_t)wait_ms;
+    while (!waiter.granted) {
+        reclaim_lapsed(lock, filename);
+        if (waiter.granted) {
+            break;
+        }
+        if (now_ms() >= deadline) {
+            ss_lock_waiter_t** link = &lock->waiters;
+            ss_lock_waiter_t* prev = NULL;
+            while (*link != &waiter) {
+                prev = *link;
+                link = &(*link)->next;
+            }
+            *link = waiter.next;
+            if (lock->waiters_tail == &waiter) {
+                lock->waiters_tail = prev;
+            }
+            grant_waiters(lock);    // Those queued only behind us may go now
+            break;
+        }
+
+        uint64_t wake_at = next_expiry(lock, range);
+        if (deadline < wake_at) {
+            wake_at = deadline;
+        }
+        struct timespec ts;
+        ts.tv_sec = wake_at / 1000;
+        ts.tv_nsec = (wake_at % 1000) * 1000000;
+        pthread_cond_timedwait(&waiter.wake, stripe, &ts);
+    }
+
+    pthread_cond_destroy(&waiter.wake);
+    return waiter.granted;
+}
+
+// Unlink a sentence nobody holds or waits for; returns its file's lock
+// object when that was the file's last sentence (both to be freed)
+static ss_file_locks_t* drop_if_idle(unsigned int bucket, ss_file_locks_t* files,
+                                     ss_sentence_lock_t* lock, ss_sentence_lock_t** idle) {
+    if (lock->holders != NULL || lock->waiters != NULL) {
+        return NULL;
+    }
+    ss_sentence_lock_t** link = sentence_slot(files, lock->sentence);
+    while (*link != lock) {
+        link = &(*link)->next;
+    }
+    *link = lock->next;
+    *idle = lock;
+    if (--files->held == 0) {
+        remove_file(bucket, files);
+        return files;
+    }
+    return NULL;
+}
+
+/**
+ * ss_lock_table_init - Set up the stripe mutexes
+ */
+void ss_lock_table_init(void) {
+    for (int i = 0; i < SS_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&stripe_locks[i], NULL);
+    }
+}
+
+/**
+ * ss_lock_acquire - Lock words of a sentence of a file for a user
+ * @filename: The file
+ * @sentence: 0-based sentence index
+ * @first_word: First locked word (0 for the whole sentence)
+ * @last_word: Last locked word (SS_LOCK_LAST_WORD for the whole sentence)
+ * @user: The user taking the lock
+ * @wait_ms: How long to queue for busy words (0 to fail at once)
+ * @holder: Receives the conflicting holder's name when the words are taken
+ *
+ * Returns: 1 if @user holds the range, 0 if someone else holds part of it,
+ *          -1 on allocation failure
+ */
+int ss_lock_acquire(const char* filename, int sentence, int first_word, int last_word,
+                    const char* user, int wait_ms, char* holder) {
+    unsigned int bucket = file_bucket(filename);
+    pthread_mutex_t* stripe = stripe_for(bucket);
+
+    ss_range_lock_t* range = calloc(1, sizeof(ss_range_lock_t));
+    ss_sentence_lock_t* entry = calloc(1, sizeof(ss_sentence_lock_t));
+    if (range == NULL || entry == NULL) {
+        free(range);
+        free(entry);
+        return -1;
+    }
+    range->first_word = first_word;
+    range->last_word = last_word;
+    strncpy(range->user, user, MAX_USERNAME_LEN - 1);
+    entry->sentence = sentence;
+
+    ss_file_locks_t* spare = NULL;
+    pthread_mutex_lock(stripe);
+    ss_file_locks_t* files = find_file(bucket, filename);
+    if (files == NULL) {
+        // First lock of this file: allocate its lock object unlocked, then
+        // look again in case another writer added one meanwhile
+        pthread_mutex_unlock(stripe);
+        spare = calloc(1, sizeof(ss_file_locks_t));
+        if (spare == NULL) {
+            free(range);
+            free(entry);
+            return -1;
+        }
+        strncpy(spare->filename, filename, MAX_FILENAME_LEN - 1);
+
+        pthread_mutex_lock(stripe);
+        files = find_file(bucket, filename);
+        if (files == NULL) {
+            files = spare;
+            spare = NULL;
+            files->hash_next = lock_table[bucket];
+            lock_table[bucket] = files;
+        }
+    }
+
+    ss_sentence_lock_t* lock = find_sentence(files, sentence);
+    if (lock == NULL) {
+        ss_sentence_lock_t** slot = sentence_slot(files, sentence);
+        lock = entry;
+        entry = NULL;
+        lock->next = *slot;
+        *slot = lock;
+        files->held++;
+    }
+
+    int result = 1;
+    ss_range_lock_t** existing = find_holder(lock, first_word, last_word, user);
+    if (*existing != NULL) {
+        renew(*existing);
+    } else {
+        reclaim_lapsed(lock, filename);
+        if (find_conflict(lock, range, NULL) == NULL) {
+            add_holder(lock, range);
+            range = NULL;
+        } else if (wait_ms > 0 && wait_for_range(stripe, lock, filename, range, wait_ms)) {
+            range = NULL;
+        } else {
+            if (holder != NULL) {
+                const char* blocker = find_conflict(lock, range, NULL);
+                snprintf(holder, MAX_USERNAME_LEN, "%s", blocker ? blocker : "");
+            }
+            result = 0;
+        }
+    }
+
+    ss_sentence_lock_t* idle = NULL;
+    ss_file_locks_t* emptied = drop_if_idle(bucket, files, lock, &idle);
+    pthread_mutex_unlock(stripe);
+
+    free(range);
+    free(entry);
+    free(idle);
+    free(emptied);
+    free(spare);
+    return result;
+}
+
+/**
+ * ss_lock_release - Drop a word range lock held by a user and let in the
+ * writers waiting for its words
+ * @filename: The file
+ * @sentence: 0-based sentence index
+ * @first_word: First word of the range as locked
+ * @last_word: Last word of the range as locked
+ * @user: The user holding the lock
+ *
+ * Returns: 0, or -1 if @user does not hold that lock
+ */
+int ss_lock_release(const char* filename, int sentence, int first_word, int last_word,
+                    const char* user) {
+    unsigned int bucket = file_bucket(filename);
+    pthread_mutex_t* stripe = stripe_for(bucket);
+    ss_range_lock_t* released = NULL;
+    ss_sentence_lock_t* idle = NULL;
+    ss_file_locks_t* emptied = NULL;
+
+    pthread_mutex_lock(stripe);
+    ss_file_locks_t* files = find_file(bucket, filename);
+    ss_sentence_lock_t* lock = files ? find_sentence(files, sentence) : NULL;
+    if (lock != NULL) {
+        ss_range_lock_t** link = find_holder(lock, first_word, last_word, user);
+        if (*link != NULL) {
+            released = *link;
+            *link = released->next;
+            __atomic_sub_fetch(&held_locks, 1, __ATOMIC_RELAXED);
+            grant_waiters(lock);
+            emptied = drop_if_idle(bucket, files, lock, &idle);
+        }
+    }
+    pthread_mutex_unlock(stripe);
+
+    int result = released != NULL ? 0 : -1;
+    free(released);
+    free(idle);
+    free(emptied);
+    return result;
+}
+
+/**
+ * ss_lock_renew - Extend the lease of a held lock
+ * @filename: The file
+ * @sentence: 0-based sentence index
+ * @first_word: First word of the range as locked
+ * @last_word: Last word of the range as locked
+ * @user: The user holding the lock
+ *
+ * Returns: 0, or -1 if @user no longer holds the lock
+ */
+int ss_lock_renew(const char* filename, int sentence, int first_word, int last_word,
+                  const char* user) {
+    unsigned int bucket = file_bucket(filename);
+    pthread_mutex_t* stripe = stripe_for(bucket);
+    int result = -1;
+
+    pthread_mutex_lock(stripe);
+    ss_file_locks_t* files = find_file(bucket, filename);
+    ss_sentence_lock_t* lock = files ? find_sentence(files, sentence) : NULL;
+    if (lock != NULL) {
+        ss_range_lock_t** link = find_holder(lock, first_word, last_word, user);
+        if (*link != NULL) {
+            renew(*link);
+            result = 0;
+        }
+    }
+    pthread_mutex_unlock(stripe);
+
+    return result;
+}
+
+/**
+ * ss_lock_count - Number of locks (word ranges) held across all files
+ */
+int ss_lock_count(void) {
+    return __atomic_load_n(&held_locks, __ATOMIC_RELAXED);
+}
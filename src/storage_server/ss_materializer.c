@@ -0,0 +1,262 @@
+/*
+ * Storage Server Document Materializer Implementation
+ * In early-ack mode ETIRW publishes the merged document in the document
+ * cache, logs it as a commit and answers once the log is synced. This
+ * thread then writes the document file and records the revision. Queued
+ * writes are kept one per file: a newer commit takes over the one still
+ * waiting, so a burst of commits costs one file write. Every version in
+ * it still gets its revision afterwards, oldest first, and its log record
+ * ends only then, so a crash replays exactly the versions without one.
+ * Each write waits SS_MATERIALIZE_DELAY_MS for such a burst unless someone
+ * drains the queue.
+ */
+
+#include "../../include/ss_materializer.h"
+#include "../../include/ss_wal.h"
+#include "../../include/logging.h"
+
+// One early-acked version, held until its revision is recorded
+typedef struct logged_version {
+    cached_doc_t* doc;              // Published version (reference held)
+    uint64_t log_id;
+    struct logged_version* next;
+} logged_version_t;
+
+typedef struct pending_write {
+    cached_doc_t* base;             // Version the oldest one replaced (reference held)
+    logged_version_t* versions;     // Oldest first; the newest is written
+    logged_version_t* newest;
+    char user[MAX_USERNAME_LEN];
+    struct timespec due;            // Written no earlier than this
+    struct pending_write* next;
+} pending_write_t;
+
+static pending_write_t* queue_head = NULL;     // Oldest first, one per file
+static pending_write_t* queue_tail = NULL;
+static char writing[MAX_FILENAME_LEN];         // File being written ("" if none)
+static int drains_waiting = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_written = PTHREAD_COND_INITIALIZER;
+static int (*write_fn)(const cached_doc_t* doc, const char* user) = NULL;
+static void (*revision_fn)(const cached_doc_t* previous, const cached_doc_t* doc) = NULL;
+
+// Queued write of a file (queue_mutex held)
+static pending_write_t* find_pending(const char* filename) {
+    for (pending_write_t* entry = queue_head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->newest->doc->filename, filename) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void append_pending(pending_write_t* entry) {
+    entry->next = NULL;
+    if (queue_tail != NULL) {
+        queue_tail->next = entry;
+    } else {
+        queue_head = entry;
+    }
+    queue_tail = entry;
+}
+
+static void set_due(struct timespec* due) {
+    clock_gettime(CLOCK_REALTIME, due);
+    long nsec = due->tv_nsec + (SS_MATERIALIZE_DELAY_MS % 1000) * 1000000L;
+    due->tv_sec += SS_MATERIALIZE_DELAY_MS / 1000 + nsec / 1000000000L;
+    due->tv_nsec = nsec % 1000000000L;
+}
+
+static int is_due(const struct timespec* due) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec > due->tv_sec ||
+           (now.tv_sec == due->tv_sec && now.tv_nsec >= due->tv_nsec);
+}
+
+// Record the revision of each version now in its file, oldest first, ending
+// its log record right after; frees the list and drops @base
+static void retire_versions(cached_doc_t* base, logged_version_t* versions) {
+    cached_doc_t* previous = base;
+    while (versions != NULL) {
+        logged_version_t* next = versions->next;
+        revision_fn(previous, versions->doc);
+        ss_wal_end(versions->log_id, 1);
+        doc_cache_release(previous);
+        previous = versions->doc;
+        free(versions);
+        versions = next;
+    }
+    doc_cache_release(previous);
+}
+
+// Write the newest version and retire them all; returns 0 or -1 (entry
+// kept for a retry)
+static int write_pending(pending_write_t* entry) {
+    cached_doc_t* doc = entry->newest->doc;
+    if (write_fn(doc, entry->user) != 0) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to write committed '%s': %s",
+                      doc->filename, strerror(errno));
+        return -1;
+    }
+    doc_cache_mark_written(doc);
+    retire_versions(entry->base, entry->versions);
+    free(entry);
+    return 0;
+}
+
+static void* materializer_thread(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&queue_mutex);
+    while (1) {
+        if (queue_head == NULL) {
+            pthread_cond_wait(&queue_wake, &queue_mutex);
+            continue;
+        }
+        if (drains_waiting == 0 && !is_due(&queue_head->due)) {
+            pthread_cond_timedwait(&queue_wake, &queue_mutex, &queue_head->due);
+            continue;
+        }
+
+        pending_write_t* entry = queue_head;
+        queue_head = entry->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        strncpy(writing, entry->newest->doc->filename, sizeof(writing) - 1);
+        pthread_mutex_unlock(&queue_mutex);
+
+        int result = write_pending(entry);
+
+        pthread_mutex_lock(&queue_mutex);
+        if (result != 0) {
+            // Retry later, unless a newer version was queued meanwhile: its
+            // write covers these, which go ahead of it for their revisions
+            pending_write_t* newer = find_pending(entry->newest->doc->filename);
+            if (newer != NULL) {
+                doc_cache_release(newer->base);
+                newer->base = entry->base;
+                entry->newest->next = newer->versions;
+                newer->versions = entry->versions;
+                free(entry);
+            } else {
+                set_due(&entry->due);
+                append_pending(entry);
+            }
+        }
+        writing[0] = '\0';
+        pthread_cond_broadcast(&queue_written);
+    }
+    return NULL;
+}
+
+/**
+ * ss_materializer_init - Start the background document writer
+ * @write_document: Writes a version to its file
+ * @record_revision: Appends a written version to the revision log
+ *
+ * Returns: 0 on success, -1 if the thread could not be started
+ */
+int ss_materializer_init(int (*write_document)(const cached_doc_t* doc, const char* user),
+                         void (*record_revision)(const cached_doc_t* previous,
+                                                 const cached_doc_t* doc)) {
+    write_fn = write_document;
+    revision_fn = record_revision;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, materializer_thread, NULL) != 0) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to start document materializer");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+/**
+ * ss_materializer_queue - Queue a published version for writing
+ * @doc: The version (the caller's reference is taken over)
+ * @previous: The version it replaced (a reference is taken)
+ * @user: Committer, passed on to @write_document
+ * @log_id: The commit's edit log ID
+ */
+void ss_materializer_queue(cached_doc_t* doc, cached_doc_t* previous, const char* user,
+                           uint64_t log_id) {
+    logged_version_t* version = calloc(1, sizeof(logged_version_t));
+    pending_write_t* entry = calloc(1, sizeof(pending_write_t));
+    if (version != NULL) {
+        version->doc = doc;
+        version->log_id = log_id;
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    pending_write_t* queued = find_pending(doc->filename);
+    if (queued != NULL && version != NULL) {
+        // Coalesce: the waiting version is never written, only logged
+        queued->newest->next = version;
+        queued->newest = version;
+        strncpy(queued->user, user, sizeof(queued->user) - 1);
+        pthread_mutex_unlock(&queue_mutex);
+        free(entry);
+        return;
+    }
+    if (entry != NULL && version != NULL) {
+        doc_cache_retain(previous);
+        entry->base = previous;
+        entry->versions = entry->newest = version;
+        strncpy(entry->user, user, sizeof(entry->user) - 1);
+        set_due(&entry->due);
+        append_pending(entry);
+        pthread_cond_signal(&queue_wake);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (entry == NULL || version == NULL) {
+        // No memory to queue it: write it now, after any earlier version
+        free(entry);
+        free(version);
+        ss_materializer_drain(doc->filename);
+        if (write_fn(doc, user) == 0) {
+            doc_cache_mark_written(doc);
+            revision_fn(previous, doc);
+            ss_wal_end(log_id, 1);
+        } else {
+            LOG_ERROR_MSG("STORAGE_SERVER", "Failed to write committed '%s': %s",
+                          doc->filename, strerror(errno));
+        }
+        doc_cache_release(doc);
+    }
+}
+
+/**
+ * ss_materializer_drain - Wait until a file holds its latest committed version
+ * @filename: The file
+ */
+void ss_materializer_drain(const char* filename) {
+    pthread_mutex_lock(&queue_mutex);
+    drains_waiting++;
+    pthread_cond_signal(&queue_wake);
+    while (find_pending(filename) != NULL || strcmp(writing, filename) == 0) {
+        pthread_cond_wait(&queue_written, &queue_mutex);
+    }
+    drains_waiting--;
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+/**
+ * ss_materializer_drain_all - Wait until every queued version is written
+ */
+void ss_materializer_drain_all(void) {
+    if (write_fn == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&queue_mutex);
+    drains_waiting++;
+    pthread_cond_signal(&queue_wake);
+    while (queue_head != NULL || writing[0] != '\0') {
+        pthread_cond_wait(&queue_written, &queue_mutex);
+    }
+    drains_waiting--;
+    pthread_mutex_unlock(&queue_mutex);
+}
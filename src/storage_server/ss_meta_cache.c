@@ -0,0 +1,577 @@
+/*
+ * Storage Server Metadata Cache Implementation
+ * Every document's .meta is parsed once at startup into a hash map guarded
+ * by a reader-writer lock, so READ/WRITE/STREAM permission checks, DELETE's
+ * ownership check and INFO take a read lock instead of reading a file.
+ * The map is the authority while the server runs. What must survive a
+ * crash is written through and synced before the request is answered: a
+ * new document's owner, an access list change, and a commit's version,
+ * whose .meta the content commit replaces in its own synced step (see
+ * ss_meta_prepare_version). The rest of a commit - sizes, counts and access
+ * times - only queues the file's name; a writer thread serializes the
+ * entry as it is by then and replaces the .meta, so a burst of commits to
+ * one file costs one write, and a crash can lose at most those statistics.
+ */
+
+#include "../../include/ss_meta_cache.h"
+#include "../../include/ss_io.h"
+#include "../../include/logging.h"
+
+typedef struct meta_entry {
+    file_metadata_t meta;
+    uint32_t committing;        // Version on its way to disk with the content, or 0
+    struct meta_entry* next;
+} meta_entry_t;
+
+typedef struct dirty_meta {
+    char filename[MAX_FILENAME_LEN];
+    struct dirty_meta* next;
+} dirty_meta_t;
+
+static char meta_root[MAX_PATH_LEN];
+static meta_entry_t* meta_table[SS_META_BUCKETS];
+static pthread_rwlock_t table_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static dirty_meta_t* dirty_head = NULL;    // Oldest first, one per file
+static dirty_meta_t* dirty_tail = NULL;
+static int writing = 0;                    // The writer holds a popped name
+static int writer_running = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_idle = PTHREAD_COND_INITIALIZER;
+// Held across serialize + write, so a removal cannot be undone by a write
+static pthread_mutex_t write_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int meta_bucket(const char* filename) {
+    unsigned int hash = 5381;
+    for (const char* p = filename; *p != '\0'; p++) {
+        hash = ((hash << 5) + hash) + (unsigned char)*p;
+    }
+    return hash % SS_META_BUCKETS;
+}
+
+// Entry of a file (table_lock held)
+static meta_entry_t* find_entry(const char* filename) {
+    for (meta_entry_t* entry = meta_table[meta_bucket(filename)]; entry != NULL;
+         entry = entry->next) {
+        if (strcmp(entry->meta.filename, filename) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void meta_path(char* path, size_t size, const char* filename) {
+    snprintf(path, size, "%s/%s.meta", meta_root, filename);
+}
+
+static const char* permission_name(int permissions) {
+    if (permissions & ACCESS_WRITE) {
+        return "RW";                    // Write implies read
+    }
+    return (permissions & ACCESS_READ) ? "R" : "-";
+}
+
+// .meta text of an entry (table_lock held); malloc'd, or NULL. A version
+// being committed is written already, so a .meta is never behind its file.
+static char* serialize_meta(const meta_entry_t* entry, size_t* length) {
+    const file_metadata_t* meta = &entry->meta;
+    uint32_t version = (entry->committing > meta->version) ? entry->committing : meta->version;
+    char* text = NULL;
+    FILE* out = open_memstream(&text, length);
+    if (out == NULL) {
+        return NULL;
+    }
+    fprintf(out, "owner=%s\n", meta->owner);
+    fprintf(out, "created=%ld\n", (long)meta->created);
+    fprintf(out, "modified=%ld\n", (long)meta->last_modified);
+    fprintf(out, "accessed=%ld\n", (long)meta->last_accessed);
+    fprintf(out, "accessed_by=%s\n", meta->last_accessed_by);
+    fprintf(out, "size=%zu\n", meta->size);
+    fprintf(out, "word_count=%d\n", meta->word_count);
+    fprintf(out, "char_count=%d\n", meta->char_count);
+    fprintf(out, "version=%u\n", version);
+    fprintf(out, "access_count=%d\n", meta->access_count);
+    for (int i = 0; i < meta->access_count; i++) {
+        fprintf(out, "access_%d=%s:%s\n", i, meta->access_list[i],
+                permission_name(meta->access_permissions[i]));
+    }
+    fclose(out);
+    return text;
+}
+
+// Write a file's entry as it is now to its .meta (skipped once removed);
+// @flags are ss_io_write_file's. 0, or -1 if the write failed.
+static int write_meta(const char* filename, int flags) {
+    char path[MAX_PATH_LEN];
+    meta_path(path, sizeof(path), filename);
+
+    pthread_mutex_lock(&write_mutex);
+    pthread_rwlock_rdlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    size_t length = 0;
+    char* text = (entry != NULL) ? serialize_meta(entry, &length) : NULL;
+    int found = (entry != NULL);
+    pthread_rwlock_unlock(&table_lock);
+
+    int result = 0;
+    if (text != NULL && ss_io_write_file(path, text, length, flags) != 0) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to write metadata %s: %s", path, strerror(errno));
+        result = -1;
+    } else if (found && text == NULL) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to serialize metadata of '%s'", filename);
+        errno = ENOMEM;
+        result = -1;
+    }
+    int saved_errno = errno;
+    pthread_mutex_unlock(&write_mutex);
+    free(text);
+    errno = saved_errno;
+    return result;
+}
+
+// Queued name of a file (queue_mutex held)
+static dirty_meta_t* find_dirty(const char* filename) {
+    for (dirty_meta_t* dirty = dirty_head; dirty != NULL; dirty = dirty->next) {
+        if (strcmp(dirty->filename, filename) == 0) {
+            return dirty;
+        }
+    }
+    return NULL;
+}
+
+// Queue a write of a file's .meta, or write it now without a writer
+static void mark_dirty(const char* filename) {
+    dirty_meta_t* dirty = calloc(1, sizeof(dirty_meta_t));
+
+    pthread_mutex_lock(&queue_mutex);
+    if (writer_running && find_dirty(filename) != NULL) {
+        // Still queued: that write picks up this change too
+        pthread_mutex_unlock(&queue_mutex);
+        free(dirty);
+        return;
+    }
+    int queued = (writer_running && dirty != NULL);
+    if (queued) {
+        strncpy(dirty->filename, filename, sizeof(dirty->filename) - 1);
+        if (dirty_tail != NULL) {
+            dirty_tail->next = dirty;
+        } else {
+            dirty_head = dirty;
+        }
+        dirty_tail = dirty;
+        pthread_cond_signal(&queue_wake);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (!queued) {
+        free(dirty);
+        write_meta(filename, 0);
+    }
+}
+
+static void* meta_writer_thread(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&queue_mutex);
+    while (1) {
+        if (dirty_head == NULL) {
+            pthread_cond_wait(&queue_wake, &queue_mutex);
+            continue;
+        }
+        dirty_meta_t* dirty = dirty_head;
+        dirty_head = dirty->next;
+        if (dirty_head == NULL) {
+            dirty_tail = NULL;
+        }
+        writing = 1;
+        pthread_mutex_unlock(&queue_mutex);
+
+        write_meta(dirty->filename, 0);
+        free(dirty);
+
+        pthread_mutex_lock(&queue_mutex);
+        writing = 0;
+        if (dirty_head == NULL) {
+            pthread_cond_broadcast(&queue_idle);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * ss_meta_init - Set up the metadata cache and start its writer
+ * @storage_path: Directory holding the documents and their .meta files
+ *
+ * Returns: 0 on success, -1 if the writer could not be started
+ */
+int ss_meta_init(const char* storage_path) {
+    strncpy(meta_root, storage_path, sizeof(meta_root) - 1);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, meta_writer_thread, NULL) != 0) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to start metadata writer; writing .meta directly");
+        return -1;
+    }
+    pthread_detach(tid);
+    writer_running = 1;
+    return 0;
+}
+
+/**
+ * ss_meta_load - Parse a document's .meta into the cache
+ * @filename: The document
+ *
+ * Returns: 0 on success, -1 if it has no readable .meta
+ */
+int ss_meta_load(const char* filename) {
+    char path[MAX_PATH_LEN];
+    meta_path(path, sizeof(path), filename);
+
+    char* text = NULL;
+    size_t length = 0;
+    if (ss_io_read_file(path, &text, &length) != 0) {
+        return -1;
+    }
+    meta_entry_t* entry = calloc(1, sizeof(meta_entry_t));
+    FILE* in = (entry != NULL) ? fmemopen(text, length, "r") : NULL;
+    if (in == NULL) {
+        free(entry);
+        free(text);
+        return -1;
+    }
+
+    file_metadata_t* meta = &entry->meta;
+    strncpy(meta->filename, filename, sizeof(meta->filename) - 1);
+    char line[512];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        long value = 0;
+        char user[MAX_USERNAME_LEN];
+        char perms[8];
+        if (sscanf(line, "owner=%63s", meta->owner) == 1 ||
+            sscanf(line, "accessed_by=%63s", meta->last_accessed_by) == 1 ||
+            sscanf(line, "size=%zu", &meta->size) == 1 ||
+            sscanf(line, "word_count=%d", &meta->word_count) == 1 ||
+            sscanf(line, "char_count=%d", &meta->char_count) == 1 ||
+            sscanf(line, "version=%u", &meta->version) == 1) {
+            continue;
+        }
+        if (sscanf(line, "created=%ld", &value) == 1) {
+            meta->created = (time_t)value;
+        } else if (sscanf(line, "modified=%ld", &value) == 1) {
+            meta->last_modified = (time_t)value;
+        } else if (sscanf(line, "accessed=%ld", &value) == 1) {
+            meta->last_accessed = (time_t)value;
+        } else if (sscanf(line, "access_%*d=%63[^:]:%7s", user, perms) == 2 &&
+                   meta->access_count < MAX_CLIENTS) {
+            // Entries are renumbered in order; access_count is implied
+            int bits = ACCESS_NONE;
+            if (strchr(perms, 'R') != NULL) bits |= ACCESS_READ;
+            if (strchr(perms, 'W') != NULL) bits |= ACCESS_WRITE | ACCESS_READ;
+            strncpy(meta->access_list[meta->access_count], user, MAX_USERNAME_LEN - 1);
+            meta->access_permissions[meta->access_count] = bits;
+            meta->access_count++;
+        }
+    }
+    fclose(in);
+    free(text);
+
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t* old = find_entry(filename);
+    if (old != NULL) {
+        old->meta = entry->meta;
+        free(entry);
+    } else {
+        unsigned int bucket = meta_bucket(filename);
+        entry->next = meta_table[bucket];
+        meta_table[bucket] = entry;
+    }
+    pthread_rwlock_unlock(&table_lock);
+    return 0;
+}
+
+/**
+ * ss_meta_get - Copy a document's metadata
+ * @filename: The document
+ * @meta: Output
+ *
+ * Returns: 0 on success, -1 if the document has no metadata
+ */
+int ss_meta_get(const char* filename, file_metadata_t* meta) {
+    pthread_rwlock_rdlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    if (entry != NULL) {
+        *meta = entry->meta;
+    }
+    pthread_rwlock_unlock(&table_lock);
+    return (entry != NULL) ? 0 : -1;
+}
+
+uint32_t ss_meta_version(const char* filename) {
+    pthread_rwlock_rdlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    uint32_t version = (entry != NULL) ? entry->meta.version : 0;
+    pthread_rwlock_unlock(&table_lock);
+    return version;
+}
+
+/**
+ * ss_meta_check_access - Check a user's access to a document
+ * @filename: The document
+ * @username: The requesting user
+ * @access: ACCESS_READ or ACCESS_WRITE
+ *
+ * Returns: 1 if allowed, 0 if denied, -1 if the document has no metadata
+ */
+int ss_meta_check_access(const char* filename, const char* username, int access) {
+    pthread_rwlock_rdlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    int result = -1;
+    if (entry != NULL) {
+        result = (strcmp(entry->meta.owner, username) == 0);
+        for (int i = 0; i < entry->meta.access_count && !result; i++) {
+            if (strcmp(entry->meta.access_list[i], username) == 0 &&
+                (entry->meta.access_permissions[i] & access) == access) {
+                result = 1;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&table_lock);
+    return result;
+}
+
+/**
+ * ss_meta_create - Add the metadata of a new, empty document
+ * @filename: The document
+ * @owner: Its owner (given read/write access)
+ *
+ * Returns: 0 on success, -1 on allocation failure or if the .meta could
+ *          not be written (the entry is kept; remove it)
+ */
+int ss_meta_create(const char* filename, const char* owner) {
+    meta_entry_t* entry = calloc(1, sizeof(meta_entry_t));
+    if (entry == NULL) {
+        return -1;
+    }
+    file_metadata_t* meta = &entry->meta;
+    time_t now = time(NULL);
+    strncpy(meta->filename, filename, sizeof(meta->filename) - 1);
+    strncpy(meta->owner, owner, sizeof(meta->owner) - 1);
+    strncpy(meta->last_accessed_by, owner, sizeof(meta->last_accessed_by) - 1);
+    meta->created = meta->last_modified = meta->last_accessed = now;
+    strncpy(meta->access_list[0], owner, MAX_USERNAME_LEN - 1);
+    meta->access_permissions[0] = ACCESS_BOTH;
+    meta->access_count = 1;
+
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t* old = find_entry(filename);
+    if (old != NULL) {
+        // Left behind by a document removed outside the server
+        old->meta = entry->meta;
+        free(entry);
+    } else {
+        unsigned int bucket = meta_bucket(filename);
+        entry->next = meta_table[bucket];
+        meta_table[bucket] = entry;
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    return write_meta(filename, SS_IO_DATASYNC);
+}
+
+/**
+ * ss_meta_set_acl - Replace a document's access list
+ * @filename: The document
+ * @acl: Metadata holding the new access list
+ *
+ * The .meta is synced before it returns; if that fails the old list is
+ * put back.
+ *
+ * Returns: 0 on success, -1 with errno ENOENT if the document has no
+ *          metadata, or -1 if the .meta could not be written
+ */
+int ss_meta_set_acl(const char* filename, const file_metadata_t* acl) {
+    file_metadata_t previous;
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    if (entry != NULL) {
+        previous = entry->meta;
+        int count = (acl->access_count < MAX_CLIENTS) ? acl->access_count : MAX_CLIENTS;
+        memcpy(entry->meta.access_list, acl->access_list, sizeof(acl->access_list[0]) * count);
+        memcpy(entry->meta.access_permissions, acl->access_permissions,
+               sizeof(acl->access_permissions[0]) * count);
+        entry->meta.access_count = count;
+        entry->meta.last_modified = time(NULL);
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    if (entry == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (write_meta(filename, SS_IO_DATASYNC) != 0) {
+        int saved_errno = errno;
+        pthread_rwlock_wrlock(&table_lock);
+        entry = find_entry(filename);
+        if (entry != NULL) {
+            memcpy(entry->meta.access_list, previous.access_list, sizeof(previous.access_list));
+            memcpy(entry->meta.access_permissions, previous.access_permissions,
+                   sizeof(previous.access_permissions));
+            entry->meta.access_count = previous.access_count;
+        }
+        pthread_rwlock_unlock(&table_lock);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * ss_meta_record_commit - Record a commit's statistics and version
+ * @filename: The document
+ * @word_count: Words in the committed content
+ * @char_count: Characters in it
+ * @size: Its size in bytes
+ * @user: The committing user
+ * @version: The document's new version
+ *
+ * Returns: 0 on success, -1 if the document has no metadata
+ */
+int ss_meta_record_commit(const char* filename, int word_count, int char_count, size_t size,
+                          const char* user, uint32_t version) {
+    time_t now = time(NULL);
+
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    if (entry != NULL) {
+        entry->meta.word_count = word_count;
+        entry->meta.char_count = char_count;
+        entry->meta.size = size;
+        entry->meta.version = version;
+        entry->meta.last_modified = entry->meta.last_accessed = now;
+        strncpy(entry->meta.last_accessed_by, user, sizeof(entry->meta.last_accessed_by) - 1);
+    }
+    pthread_rwlock_unlock(&table_lock);
+
+    if (entry == NULL) {
+        return -1;
+    }
+    mark_dirty(filename);
+    return 0;
+}
+
+// End a commit's hold on its version: raise the version if the content is
+// in place, and forget the version in flight either way
+static void end_version_commit(const char* filename, uint32_t version, int committed) {
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    if (entry != NULL) {
+        if (committed && version > entry->meta.version) {
+            entry->meta.version = version;
+        }
+        if (entry->committing == version) {
+            entry->committing = 0;
+        }
+    }
+    pthread_rwlock_unlock(&table_lock);
+}
+
+/**
+ * ss_meta_prepare_version - The .meta a commit installs with its content
+ * @filename: The document
+ * @version: The version its content is about to become
+ * @prepared: Output; pass to ss_meta_finish_version after the commit
+ *
+ * The text carries @version, and so does every background write of the
+ * file from now on: write_mutex is taken first, so no write serialized
+ * before this can land after the commit's .meta. After a crash the version
+ * on disk is never behind the file, so no number is handed out twice for
+ * different content.
+ *
+ * Returns: 0 on success (prepared->text is NULL if the document has no
+ *          metadata), -1 if the entry could not be serialized
+ */
+int ss_meta_prepare_version(const char* filename, uint32_t version,
+                            ss_meta_commit_t* prepared) {
+    memset(prepared, 0, sizeof(*prepared));
+    meta_path(prepared->path, sizeof(prepared->path), filename);
+    prepared->version = version;
+
+    pthread_mutex_lock(&write_mutex);
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t* entry = find_entry(filename);
+    if (entry != NULL) {
+        entry->committing = version;
+        prepared->text = serialize_meta(entry, &prepared->length);
+    }
+    pthread_rwlock_unlock(&table_lock);
+    pthread_mutex_unlock(&write_mutex);
+
+    if (entry != NULL && prepared->text == NULL) {
+        end_version_commit(filename, version, 0);
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to serialize metadata of '%s'", filename);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * ss_meta_finish_version - Settle a prepared version once its commit is done
+ * @filename: The document
+ * @prepared: From ss_meta_prepare_version; its text is freed
+ * @committed: 1 if the content (and so the .meta) was installed
+ *
+ * A failed commit may have left the new version in the .meta, from the
+ * commit itself or a background write; the old one is put back and synced.
+ */
+void ss_meta_finish_version(const char* filename, ss_meta_commit_t* prepared, int committed) {
+    if (prepared->text == NULL) {
+        return;
+    }
+    free(prepared->text);
+    prepared->text = NULL;
+
+    end_version_commit(filename, prepared->version, committed);
+    if (!committed) {
+        write_meta(filename, SS_IO_DATASYNC);
+    }
+}
+
+/**
+ * ss_meta_remove - Forget a deleted document and remove its .meta
+ * @filename: The document
+ */
+void ss_meta_remove(const char* filename) {
+    pthread_rwlock_wrlock(&table_lock);
+    meta_entry_t** link = &meta_table[meta_bucket(filename)];
+    while (*link != NULL && strcmp((*link)->meta.filename, filename) != 0) {
+        link = &(*link)->next;
+    }
+    meta_entry_t* entry = *link;
+    if (entry != NULL) {
+        *link = entry->next;
+    }
+    pthread_rwlock_unlock(&table_lock);
+    free(entry);
+
+    // A write already past its lookup finishes before the unlink
+    char path[MAX_PATH_LEN];
+    meta_path(path, sizeof(path), filename);
+    pthread_mutex_lock(&write_mutex);
+    if (ss_io_unlink(path) != 0 && errno != ENOENT) {
+        LOG_WARNING_MSG("STORAGE_SERVER", "Failed to delete metadata file: %s", path);
+    }
+    pthread_mutex_unlock(&write_mutex);
+}
+
+/**
+ * ss_meta_flush - Wait until every queued .meta write is done
+ */
+void ss_meta_flush(void) {
+    pthread_mutex_lock(&queue_mutex);
+    while (dirty_head != NULL || writing) {
+        pthread_cond_wait(&queue_idle, &queue_mutex);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+}
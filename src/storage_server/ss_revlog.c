@@ -0,0 +1,457 @@
+/*
+ * Storage Server Revision Log Implementation
+ * Each commit appends the new version of a document to ".<name>.rev" as a
+ * delta against the version it replaced: the changed span between the
+ * common prefix and suffix, widened to whole words, so an edit to one
+ * sentence costs about that sentence on disk. A full copy (checkpoint) is
+ * written for the first revision and whenever the deltas since the last
+ * one exceed SS_REVLOG_CHAIN_LIMIT records or the document's own size, so
+ * rebuilding any revision reads one checkpoint and a bounded run of deltas.
+ * ".<name>.revidx" holds the log offset of each revision's record, and
+ * every record points back at the checkpoint its chain starts from.
+ *
+ * Dot files are not listed as documents. A record is synced before its
+ * index entry is written and is only reachable through it, so a crash
+ * mid-append loses that revision and nothing else; a head left unreadable
+ * anyway is cut back to the last revision that still reads.
+ */
+
+#include "../../include/ss_revlog.h"
+#include "../../include/logging.h"
+#include "../../include/ss_io.h"
+#include <ctype.h>
+#include <stdint.h>
+
+#define REVLOG_MAGIC 0x52455631        // "REV1"
+#define REVLOG_FULL 1
+#define REVLOG_DELTA 2
+
+// Record header; the payload (full content or inserted text) follows it
+typedef struct {
+    uint32_t magic;
+    uint32_t revision;
+    uint32_t undo_to;           // Revision an UNDO from here returns to (0: none)
+    uint32_t kind;              // REVLOG_FULL or REVLOG_DELTA
+    uint64_t checkpoint;        // Log offset of the full record this chain starts at
+    uint32_t chain_length;      // Deltas since that checkpoint
+    uint32_t reserved;
+    uint64_t chain_bytes;       // Delta payload bytes since that checkpoint
+    uint64_t prefix;            // Delta: bytes kept from the start of the previous revision
+    uint64_t suffix;            // Delta: bytes kept from its end
+    uint64_t payload;           // Bytes following the header
+    uint64_t length;            // Length of this revision's content
+    uint64_t hash;              // FNV-1a of this revision's content
+    int64_t timestamp;
+} rev_record_t;
+
+#define REVLOG_PATH_LEN (MAX_PATH_LEN + MAX_FILENAME_LEN)   // Storage path + "/.<file>.revidx"
+
+static char revlog_root[MAX_PATH_LEN];
+
+void ss_revlog_init(const char* storage_path) {
+    strncpy(revlog_root, storage_path, sizeof(revlog_root) - 1);
+}
+
+static void log_paths(const char* filename, char* log_path, char* index_path) {
+    snprintf(log_path, REVLOG_PATH_LEN, "%s/.%s.rev", revlog_root, filename);
+    snprintf(index_path, REVLOG_PATH_LEN, "%s/.%s.revidx", revlog_root, filename);
+}
+
+static uint64_t content_hash(const char* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int pwrite_all(int fd, const void* data, size_t length, off_t offset) {
+    const char* bytes = data;
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = pwrite(fd, bytes + done, length - done, offset + (off_t)done);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (n > 0) {
+            done += n;
+        }
+    }
+    return 0;
+}
+
+static int index_count(const char* index_path) {
+    struct stat st;
+    if (stat(index_path, &st) != 0) {
+        return 0;
+    }
+    return (int)(st.st_size / sizeof(uint64_t));
+}
+
+static int index_lookup(int index_fd, int revision, uint64_t* offset) {
+    off_t position = (off_t)(revision - 1) * (off_t)sizeof(uint64_t);
+    if (ss_io_pread(index_fd, (char*)offset, sizeof(*offset), position) != sizeof(*offset)) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int read_record(int log_fd, uint64_t offset, rev_record_t* record) {
+    if (ss_io_pread(log_fd, (char*)record, sizeof(*record), (off_t)offset) != sizeof(*record) ||
+        record->magic != REVLOG_MAGIC) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Header of one revision, looked up through the index
+static int find_record(const char* filename, int revision, rev_record_t* record, uint64_t* offset) {
+    char log_path[REVLOG_PATH_LEN];
+    char index_path[REVLOG_PATH_LEN];
+    log_paths(filename, log_path, index_path);
+
+    int index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    int log_fd = open(log_path, O_RDONLY | O_CLOEXEC);
+    int result = -1;
+    uint64_t position;
+    if (index_fd >= 0 && log_fd >= 0 && index_lookup(index_fd, revision, &position) == 0 &&
+        read_record(log_fd, position, record) == 0 && record->revision == (uint32_t)revision) {
+        if (offset != NULL) {
+            *offset = position;
+        }
+        result = 0;
+    }
+    if (index_fd >= 0) close(index_fd);
+    if (log_fd >= 0) close(log_fd);
+    return result;
+}
+
+int ss_revlog_head(const char* filename) {
+    char log_path[REVLOG_PATH_LEN];
+    char index_path[REVLOG_PATH_LEN];
+    log_paths(filename, log_path, index_path);
+    return index_count(index_path);
+}
+
+/**
+ * ss_revlog_undo_target - Follow the UNDO chain back from the head
+ * @filename: The document
+ * @steps: Number of UNDOs (at least 1)
+ *
+ * An edit undoes to the revision it replaced; a restored revision undoes
+ * to whatever the revision it restored would have, so repeated UNDOs keep
+ * walking back instead of toggling between two versions.
+ *
+ * Returns: Target revision, or -1 if the history is not that long
+ */
+int ss_revlog_undo_target(const char* filename, int steps) {
+    int revision = ss_revlog_head(filename);
+
+    while (steps-- > 0 && revision > 0) {
+        rev_record_t record;
+        if (find_record(filename, revision, &record, NULL) != 0) {
+            return -1;
+        }
+        revision = (int)record.undo_to;
+    }
+    return (revision > 0) ? revision : -1;
+}
+
+// new = old[0, prefix) + inserted + old[old_length - suffix, old_length)
+static char* apply_delta(const char* old, size_t old_length, const rev_record_t* record,
+                         const char* inserted) {
+    if (record->prefix + record->suffix > old_length ||
+        record->prefix + record->payload + record->suffix != record->length) {
+        errno = EIO;
+        return NULL;
+    }
+
+    char* content = malloc(record->length + 1);
+    if (content == NULL) {
+        return NULL;
+    }
+    memcpy(content, old, record->prefix);
+    memcpy(content + record->prefix, inserted, record->payload);
+    memcpy(content + record->prefix + record->payload, old + old_length - record->suffix,
+           record->suffix);
+    content[record->length] = '\0';
+    return content;
+}
+
+/**
+ * ss_revlog_read - Rebuild one revision of a document
+ * @filename: The document
+ * @revision: Revision number (1 to the head)
+ * @content: Output buffer (malloc'd, NUL-terminated, caller frees)
+ * @length: Output content length
+ *
+ * Reads the revision's checkpoint and applies the deltas after it in log
+ * order, which is revision order.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int ss_revlog_read(const char* filename, int revision, char** content, size_t* length) {
+    rev_record_t target;
+    uint64_t target_offset;
+    if (revision < 1 || find_record(filename, revision, &target, &target_offset) != 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    char log_path[REVLOG_PATH_LEN];
+    char index_path[REVLOG_PATH_LEN];
+    log_paths(filename, log_path, index_path);
+    int log_fd = open(log_path, O_RDONLY | O_CLOEXEC);
+    if (log_fd < 0) {
+        return -1;
+    }
+
+    char* current = NULL;
+    size_t current_length = 0;
+    uint64_t offset = target.checkpoint;
+    int result = -1;
+    while (1) {
+        rev_record_t record;
+        char* payload = NULL;
+        if (read_record(log_fd, offset, &record) != 0 ||
+            (payload = malloc(record.payload + 1)) == NULL ||
+            ss_io_pread(log_fd, payload, record.payload,
+                        (off_t)(offset + sizeof(record))) != (ssize_t)record.payload) {
+            free(payload);
+            break;
+        }
+
+        char* next = payload;
+        if (record.kind == REVLOG_FULL) {
+            payload[record.payload] = '\0';
+            payload = NULL;
+        } else if (current == NULL ||
+                   (next = apply_delta(current, current_length, &record, payload)) == NULL) {
+            free(payload);
+            break;
+        }
+        free(payload);
+        free(current);
+        current = next;
+        current_length = record.length;
+
+        if (offset == target_offset) {
+            result = 0;
+            break;
+        }
+        offset += sizeof(record) + record.payload;
+        if (offset > target_offset) {
+            errno = EIO;
+            break;
+        }
+    }
+    close(log_fd);
+
+    if (result != 0 || content_hash(current, current_length) != target.hash) {
+        free(current);
+        errno = EIO;
+        return -1;
+    }
+    *content = current;
+    *length = current_length;
+    return 0;
+}
+
+// Changed span between old and new, widened to whole words
+static void delta_bounds(const char* old, size_t old_length, const char* content, size_t length,
+                         size_t* prefix, size_t* suffix) {
+    size_t limit = (old_length < length) ? old_length : length;
+    size_t front = 0;
+    while (front < limit && old[front] == content[front]) {
+        front++;
+    }
+    while (front > 0 && !isspace((unsigned char)old[front - 1])) {
+        front--;
+    }
+
+    size_t back = 0;
+    while (back < limit - front && old[old_length - 1 - back] == content[length - 1 - back]) {
+        back++;
+    }
+    while (back > 0 && !isspace((unsigned char)old[old_length - back])) {
+        back--;
+    }
+
+    *prefix = front;
+    *suffix = back;
+}
+
+// Write one record at @offset and publish it as revision record->revision
+// (the record is on disk before the index points at it; its sync is shared
+// with the commits in flight)
+static int write_record(int log_fd, int index_fd, uint64_t offset, rev_record_t* record,
+                        const char* payload) {
+    record->magic = REVLOG_MAGIC;
+    record->timestamp = (int64_t)time(NULL);
+    if (pwrite_all(log_fd, record, sizeof(*record), (off_t)offset) != 0 ||
+        pwrite_all(log_fd, payload, record->payload, (off_t)(offset + sizeof(*record))) != 0 ||
+        ss_io_sync_data(log_fd) != 0) {
+        return -1;
+    }
+    off_t position = (off_t)(record->revision - 1) * (off_t)sizeof(uint64_t);
+    if (pwrite_all(index_fd, &offset, sizeof(offset), position) != 0 ||
+        ftruncate(index_fd, position + (off_t)sizeof(offset)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Newest revision up to @head whose record is intact (0 if none)
+static int last_readable(int log_fd, int index_fd, int head, rev_record_t* record,
+                         uint64_t* offset) {
+    struct stat st;
+    if (fstat(log_fd, &st) != 0) {
+        return 0;
+    }
+    for (int revision = head; revision > 0; revision--) {
+        if (index_lookup(index_fd, revision, offset) == 0 &&
+            read_record(log_fd, *offset, record) == 0 &&
+            record->revision == (uint32_t)revision &&
+            *offset + sizeof(*record) + record->payload <= (uint64_t)st.st_size) {
+            return revision;
+        }
+    }
+    return 0;
+}
+
+static void full_record(rev_record_t* record, uint64_t offset, size_t length, uint64_t hash) {
+    record->kind = REVLOG_FULL;
+    record->checkpoint = offset;
+    record->chain_length = 0;
+    record->chain_bytes = 0;
+    record->prefix = 0;
+    record->suffix = 0;
+    record->payload = length;
+    record->length = length;
+    record->hash = hash;
+}
+
+/**
+ * ss_revlog_append - Record a committed version of a document
+ * @filename: The document
+ * @previous: Content the commit replaced (NULL if unknown)
+ * @previous_length: Its length
+ * @content: Committed content
+ * @length: Its length
+ * @restores: Revision brought back by UNDO/REVERT, or 0 for an edit
+ *
+ * The delta is taken against @previous. If that is not the log's head
+ * (the file changed without being logged), the new revision is written as
+ * a checkpoint instead so no chain is built on the wrong base.
+ *
+ * Returns: The new revision number, or -1
+ */
+int ss_revlog_append(const char* filename, const char* previous, size_t previous_length,
+                     const char* content, size_t length, int restores) {
+    char log_path[REVLOG_PATH_LEN];
+    char index_path[REVLOG_PATH_LEN];
+    log_paths(filename, log_path, index_path);
+
+    int log_fd = open(log_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    int index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (log_fd < 0 || index_fd < 0) {
+        if (log_fd >= 0) close(log_fd);
+        if (index_fd >= 0) close(index_fd);
+        return -1;
+    }
+
+    int head = index_count(index_path);
+    rev_record_t head_record;
+    uint64_t head_offset = 0;
+    int readable = last_readable(log_fd, index_fd, head, &head_record, &head_offset);
+    int result = 0;
+    if (readable == 0 && head > 0) {
+        LOG_WARNING_MSG("REVLOG", "History of '%s' is unreadable, starting a new one", filename);
+    } else if (readable < head) {
+        // Keep the revisions that still read; drop the damaged tail
+        LOG_WARNING_MSG("REVLOG", "History of '%s' is unreadable after revision %d, dropping %d",
+                        filename, readable, head - readable);
+        if (ftruncate(index_fd, (off_t)readable * (off_t)sizeof(uint64_t)) != 0 ||
+            ftruncate(log_fd, (off_t)(head_offset + sizeof(rev_record_t) +
+                                      head_record.payload)) != 0) {
+            result = -1;
+        }
+    }
+    head = readable;
+
+    uint64_t offset = 0;
+    uint64_t previous_hash = (previous != NULL) ? content_hash(previous, previous_length) : 0;
+    if (head == 0) {
+        // First logged commit: the version it replaced becomes revision 1
+        if (ftruncate(log_fd, 0) != 0 || ftruncate(index_fd, 0) != 0) {
+            result = -1;
+        } else if (previous != NULL) {
+            memset(&head_record, 0, sizeof(head_record));
+            head_record.revision = 1;
+            full_record(&head_record, 0, previous_length, previous_hash);
+            result = write_record(log_fd, index_fd, 0, &head_record, previous);
+            head = 1;
+        }
+    }
+    if (head > 0) {
+        offset = head_offset + sizeof(rev_record_t) + head_record.payload;
+    }
+
+    rev_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.revision = (uint32_t)head + 1;
+    record.undo_to = (uint32_t)head;
+    if (restores > 0) {
+        rev_record_t restored;
+        record.undo_to = (find_record(filename, restores, &restored, NULL) == 0) ? restored.undo_to : 0;
+    }
+
+    uint64_t hash = content_hash(content, length);
+    const char* payload = content;
+    full_record(&record, offset, length, hash);
+    if (head > 0 && previous != NULL && previous_hash == head_record.hash) {
+        size_t prefix, suffix;
+        delta_bounds(previous, previous_length, content, length, &prefix, &suffix);
+        size_t inserted = length - prefix - suffix;
+        if (head_record.chain_length < SS_REVLOG_CHAIN_LIMIT &&
+            head_record.chain_bytes + inserted <= length) {
+            record.kind = REVLOG_DELTA;
+            record.checkpoint = head_record.checkpoint;
+            record.chain_length = head_record.chain_length + 1;
+            record.chain_bytes = head_record.chain_bytes + inserted;
+            record.prefix = prefix;
+            record.suffix = suffix;
+            record.payload = inserted;
+            payload = content + prefix;
+        }
+    }
+
+    if (result == 0) {
+        result = write_record(log_fd, index_fd, offset, &record, payload);
+    }
+    int saved_errno = errno;
+    close(log_fd);
+    close(index_fd);
+
+    if (result != 0) {
+        LOG_ERROR_MSG("REVLOG", "Failed to record revision %u of '%s': %s",
+                      record.revision, filename, strerror(saved_errno));
+        return -1;
+    }
+    LOG_INFO_MSG("REVLOG", "'%s' revision %u (%s, %llu bytes)", filename, record.revision,
+                 record.kind == REVLOG_FULL ? "checkpoint" : "delta",
+                 (unsigned long long)record.payload);
+    return (int)record.revision;
+}
+
+void ss_revlog_remove(const char* filename) {
+    char log_path[REVLOG_PATH_LEN];
+    char index_path[REVLOG_PATH_LEN];
+    log_paths(filename, log_path, index_path);
+    unlink(index_path);
+    unlink(log_path);
+}
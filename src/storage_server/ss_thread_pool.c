@@ -0,0 +1,151 @@
+/*
+ * Storage Server Thread Pool Implementation
+ * Workers block on a condition variable until a task is queued. Submission
+ * never blocks: a full queue is reported to the caller, which answers the
+ * client with a busy status instead of spawning another thread.
+ */
+
+#include "../../include/ss_thread_pool.h"
+#include "../../include/logging.h"
+#include <limits.h>
+
+static void* ss_worker_main(void* arg) {
+    ss_thread_pool_t* pool = (ss_thread_pool_t*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->count == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->not_empty, &pool->mutex);
+        }
+        if (pool->count == 0 && pool->shutdown) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+
+        ss_task_t task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task.fn(task.arg);
+    }
+}
+
+/**
+ * ss_thread_pool_create - Start a fixed set of worker threads
+ * @worker_count: Number of workers
+ * @queue_depth: Maximum number of queued (not yet running) tasks
+ * @stack_size: Worker stack size in bytes, 0 for the system default
+ *
+ * Returns: The pool, or NULL if it could not be set up
+ */
+ss_thread_pool_t* ss_thread_pool_create(int worker_count, int queue_depth, size_t stack_size) {
+    if (worker_count <= 0 || queue_depth <= 0) {
+        return NULL;
+    }
+
+    ss_thread_pool_t* pool = calloc(1, sizeof(ss_thread_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->tasks = calloc(queue_depth, sizeof(ss_task_t));
+    pool->workers = calloc(worker_count, sizeof(pthread_t));
+    if (pool->tasks == NULL || pool->workers == NULL) {
+        free(pool->tasks);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pool->capacity = queue_depth;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (stack_size > 0) {
+        if (stack_size < (size_t)PTHREAD_STACK_MIN) {
+            stack_size = PTHREAD_STACK_MIN;
+        }
+        if (pthread_attr_setstacksize(&attr, stack_size) != 0) {
+            LOG_WARNING_MSG("THREAD_POOL", "Invalid stack size %zu, using default", stack_size);
+        }
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&pool->workers[i], &attr, ss_worker_main, pool) != 0) {
+            LOG_ERROR_MSG("THREAD_POOL", "Failed to start worker %d: %s", i, strerror(errno));
+            break;
+        }
+        pool->worker_count++;
+    }
+    pthread_attr_destroy(&attr);
+
+    if (pool->worker_count == 0) {
+        ss_thread_pool_destroy(pool);
+        return NULL;
+    }
+
+    LOG_INFO_MSG("THREAD_POOL", "Started %d workers (queue depth %d, stack %zu KB)",
+                 pool->worker_count, queue_depth, stack_size / 1024);
+    return pool;
+}
+
+/**
+ * ss_thread_pool_destroy - Stop the workers once the queue drains
+ * @pool: The pool (may be NULL)
+ */
+void ss_thread_pool_destroy(ss_thread_pool_t* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->not_empty);
+    free(pool->tasks);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * ss_thread_pool_submit - Queue a task for the next free worker
+ * @pool: The pool
+ * @fn: Task function
+ * @arg: Argument passed to fn (ownership moves to the task on success)
+ *
+ * Returns: 0 if queued, -1 if the queue is full or the pool is stopping
+ */
+int ss_thread_pool_submit(ss_thread_pool_t* pool, ss_task_fn fn, void* arg) {
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->count == pool->capacity || pool->shutdown) {
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+
+    pool->tasks[pool->tail].fn = fn;
+    pool->tasks[pool->tail].arg = arg;
+    pool->tail = (pool->tail + 1) % pool->capacity;
+    pool->count++;
+
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+// Number of tasks waiting for a worker
+int ss_thread_pool_pending(ss_thread_pool_t* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    int pending = pool->count;
+    pthread_mutex_unlock(&pool->mutex);
+    return pending;
+}
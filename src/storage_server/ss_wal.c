@@ -0,0 +1,874 @@
+/*
+ * Storage Server Edit Log Implementation
+ * Every WRITE session's start, word updates and end are appended to a log
+ * under ".wal" in the storage path. Appends only copy the record into a
+ * buffer; a flusher thread writes the buffer out and fdatasyncs it every
+ * SS_WAL_FLUSH_MS (sooner once SS_WAL_BUFFER_BYTES are pending), so one
+ * sync covers every edit of the interval and no request waits for the disk.
+ * An edit acknowledged in the last interval before a crash can be lost.
+ *
+ * The log is a run of numbered segments. A new segment starts at the first
+ * session begun after the current one passed SS_WAL_SEGMENT_BYTES, so
+ * session IDs rise from segment to segment, and a segment is deleted once
+ * every session begun in it or before it has ended: all its records are
+ * then dead.
+ *
+ * At startup the segments are replayed. Sessions that never ended are kept
+ * for their users: they are logged again into a fresh segment (the old ones
+ * are deleted) and get their sentence locks back. A user's next WRITE of
+ * the same words resumes the session with its word updates reapplied; a
+ * session not resumed within SS_LOCK_LEASE_SECONDS is rolled back and its
+ * lock released.
+ *
+ * Phase 7: With early-ack commits an ETIRW is acknowledged once its merged
+ * document is in the log as a commit record; the document file is written
+ * later and the commit ended once its revision is recorded too. Commits
+ * not ended when the server stopped are handed back at startup in order;
+ * the latest one of each file is written out.
+ */
+
+#include "../../include/ss_wal.h"
+#include "../../include/ss_lock_table.h"
+#include "../../include/logging.h"
+
+#define WAL_MAGIC 0x57414c31           // "WAL1"
+#define WAL_BEGIN 1
+#define WAL_EDIT 2
+#define WAL_END 3
+#define WAL_COMMIT 4
+#define WAL_MAX_PAYLOAD (16 * 1024 * 1024)
+
+// Record header; the payload follows it
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;
+    uint64_t session;
+    int32_t sentence;           // BEGIN
+    int32_t first_word;         // BEGIN
+    int32_t last_word;          // BEGIN
+    int32_t value;              // BEGIN: 1 if appending, EDIT: word index, END: 1 if committed,
+                                // COMMIT: the document's new version
+    uint32_t name_length;       // BEGIN: payload is the filename, the user, then the
+    uint32_t user_length;       // sentence as locked. COMMIT: the filename, the user, then the document
+    uint64_t payload;           // Bytes following the header
+    uint64_t hash;              // FNV-1a of the payload
+    int64_t timestamp;
+} wal_record_t;
+
+typedef struct wal_edit {
+    int word_index;
+    char* content;
+    struct wal_edit* next;
+} wal_edit_t;
+
+// A session found open in the log at startup
+typedef struct recovered_session {
+    uint64_t id;
+    char filename[MAX_FILENAME_LEN];
+    char user[MAX_USERNAME_LEN];
+    int sentence;
+    int first_word;
+    int last_word;
+    int appending;
+    char* base;
+    size_t base_length;
+    wal_edit_t* edits;
+    wal_edit_t* edits_tail;
+    int edit_count;
+    struct recovered_session* next;
+} recovered_session_t;
+
+// A document commit found unwritten in the log at startup
+typedef struct recovered_commit {
+    uint64_t id;
+    char filename[MAX_FILENAME_LEN];
+    char user[MAX_USERNAME_LEN];
+    char* content;
+    size_t length;
+    uint32_t version;
+    struct recovered_commit* next;
+} recovered_commit_t;
+
+typedef struct {
+    uint64_t seq;
+    uint64_t first_id;          // Sessions begun here have IDs from this one up
+    int open;                   // Sessions begun here that have not ended
+} wal_segment_t;
+
+#define WAL_PATH_LEN (MAX_PATH_LEN + sizeof("/18446744073709551615.wal"))   // Log directory + "/<seq>.wal"
+
+static char wal_root[MAX_PATH_LEN];
+static pthread_mutex_t wal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wal_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t wal_flushed = PTHREAD_COND_INITIALIZER;
+static int wal_ready = 0;
+
+// Appended records not yet written (wal_mutex)
+static char* pending = NULL;
+static size_t pending_length = 0;
+static size_t pending_capacity = 0;
+static size_t boundary = SIZE_MAX;      // Where the next segment starts in pending
+static uint64_t next_id = 1;
+static uint64_t segment_bytes = 0;      // Appended to the newest segment so far
+static uint64_t flush_requests = 0;
+static uint64_t flushes_done = 0;
+
+static wal_segment_t* segments = NULL;  // Oldest first (wal_mutex)
+static int segment_count = 0;
+static int segment_capacity = 0;
+
+// Flusher state
+static int wal_fd = -1;
+static uint64_t write_seq = 0;
+
+static recovered_session_t* recovered = NULL;
+static time_t recovered_at = 0;
+static pthread_mutex_t recovered_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t payload_hash(const char* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void segment_path(uint64_t seq, char* path) {
+    snprintf(path, WAL_PATH_LEN, "%s/%08llu.wal", wal_root, (unsigned long long)seq);
+}
+
+static int write_all(int fd, const char* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, data + done, length - done);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (n > 0) {
+            done += n;
+        }
+    }
+    return 0;
+}
+
+// Create a segment and make its directory entry durable
+static int open_segment(uint64_t seq) {
+    char path[WAL_PATH_LEN];
+    segment_path(seq, path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR_MSG("WAL", "Failed to create %s: %s", path, strerror(errno));
+        return -1;
+    }
+    int dir = open(wal_root, O_RDONLY | O_DIRECTORY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    return fd;
+}
+
+static int add_segment(uint64_t seq, uint64_t first_id, int open) {
+    if (segment_count == segment_capacity) {
+        int capacity = segment_capacity ? segment_capacity * 2 : 8;
+        wal_segment_t* grown = realloc(segments, capacity * sizeof(wal_segment_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        segments = grown;
+        segment_capacity = capacity;
+    }
+    segments[segment_count].seq = seq;
+    segments[segment_count].first_id = first_id;
+    segments[segment_count].open = open;
+    segment_count++;
+    return 0;
+}
+
+// Segment a session began in (wal_mutex held)
+static wal_segment_t* segment_of(uint64_t id) {
+    for (int i = segment_count - 1; i >= 0; i--) {
+        if (segments[i].first_id <= id) {
+            return &segments[i];
+        }
+    }
+    return segment_count > 0 ? &segments[0] : NULL;
+}
+
+// ID of a new session or commit (wal_mutex held). A new segment starts
+// at a session boundary once the current one is full.
+static uint64_t take_id(void) {
+    uint64_t id = next_id++;
+    if (segment_bytes >= SS_WAL_SEGMENT_BYTES && boundary == SIZE_MAX &&
+        add_segment(segments[segment_count - 1].seq + 1, id, 0) == 0) {
+        boundary = pending_length;
+        segment_bytes = 0;
+    }
+    return id;
+}
+
+// Copy a record into the pending buffer (wal_mutex held)
+static int queue_record(wal_record_t* header, const char* const* parts, const size_t* lengths,
+                        int count) {
+    size_t payload = 0;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < count; i++) {
+        payload += lengths[i];
+        for (size_t j = 0; j < lengths[i]; j++) {
+            hash ^= (unsigned char)parts[i][j];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    header->magic = WAL_MAGIC;
+    header->payload = payload;
+    header->hash = hash;
+    header->timestamp = time(NULL);
+
+    size_t needed = pending_length + sizeof(*header) + payload;
+    if (needed > pending_capacity) {
+        size_t capacity = pending_capacity ? pending_capacity : SS_WAL_BUFFER_BYTES;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char* grown = realloc(pending, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        pending = grown;
+        pending_capacity = capacity;
+    }
+
+    memcpy(pending + pending_length, header, sizeof(*header));
+    pending_length += sizeof(*header);
+    for (int i = 0; i < count; i++) {
+        memcpy(pending + pending_length, parts[i], lengths[i]);
+        pending_length += lengths[i];
+    }
+    segment_bytes += sizeof(*header) + payload;
+
+    if (pending_length >= SS_WAL_BUFFER_BYTES) {
+        pthread_cond_signal(&wal_wake);
+    }
+    return 0;
+}
+
+static void free_recovered(recovered_session_t* session) {
+    wal_edit_t* edit = session->edits;
+    while (edit != NULL) {
+        wal_edit_t* next = edit->next;
+        free(edit->content);
+        free(edit);
+        edit = next;
+    }
+    free(session->base);
+    free(session);
+}
+
+// Queue a recovered session's BEGIN and word updates again (wal_mutex held)
+static int queue_recovered(const recovered_session_t* session) {
+    wal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.kind = WAL_BEGIN;
+    header.session = session->id;
+    header.sentence = session->sentence;
+    header.first_word = session->first_word;
+    header.last_word = session->last_word;
+    header.value = session->appending;
+    header.name_length = strlen(session->filename);
+    header.user_length = strlen(session->user);
+    const char* parts[3] = { session->filename, session->user, session->base ? session->base : "" };
+    size_t lengths[3] = { header.name_length, header.user_length, session->base_length };
+    if (queue_record(&header, parts, lengths, 3) != 0) {
+        return -1;
+    }
+
+    for (const wal_edit_t* edit = session->edits; edit != NULL; edit = edit->next) {
+        memset(&header, 0, sizeof(header));
+        header.kind = WAL_EDIT;
+        header.session = session->id;
+        header.value = edit->word_index;
+        const char* content = edit->content;
+        size_t length = strlen(content);
+        if (queue_record(&header, &content, &length, 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Apply one segment's records to the table of open sessions and the list
+// of unwritten commits (oldest first)
+static void replay_segment(const char* path, recovered_session_t** open_sessions,
+                           recovered_commit_t** commits) {
+    FILE* log = fopen(path, "rb");
+    if (log == NULL) {
+        return;
+    }
+
+    wal_record_t header;
+    while (fread(&header, sizeof(header), 1, log) == 1) {
+        if (header.magic != WAL_MAGIC || header.kind < WAL_BEGIN || header.kind > WAL_COMMIT ||
+            header.payload > WAL_MAX_PAYLOAD) {
+            break;
+        }
+        char* payload = malloc(header.payload + 1);
+        if (payload == NULL ||
+            (header.payload > 0 && fread(payload, header.payload, 1, log) != 1) ||
+            payload_hash(payload, header.payload) != header.hash) {
+            free(payload);
+            break;      // Torn tail: the record never finished writing
+        }
+        payload[header.payload] = '\0';
+        if (header.session >= next_id) {
+            next_id = header.session + 1;
+        }
+
+        recovered_session_t** link = open_sessions;
+        while (*link != NULL && (*link)->id != header.session) {
+            link = &(*link)->next;
+        }
+
+        if (header.kind == WAL_BEGIN && *link == NULL &&
+            (uint64_t)header.name_length + header.user_length <= header.payload &&
+            header.name_length < MAX_FILENAME_LEN && header.user_length < MAX_USERNAME_LEN) {
+            recovered_session_t* session = calloc(1, sizeof(recovered_session_t));
+            size_t base_length = header.payload - header.name_length - header.user_length;
+            if (session != NULL && (session->base = malloc(base_length + 1)) != NULL) {
+                session->id = header.session;
+                memcpy(session->filename, payload, header.name_length);
+                memcpy(session->user, payload + header.name_length, header.user_length);
+                memcpy(session->base, payload + header.name_length + header.user_length,
+                       base_length);
+                session->base[base_length] = '\0';
+                session->base_length = base_length;
+                session->sentence = header.sentence;
+                session->first_word = header.first_word;
+                session->last_word = header.last_word;
+                session->appending = header.value;
+                *link = session;
+            } else {
+                free(session);
+            }
+        } else if (header.kind == WAL_EDIT && *link != NULL) {
+            wal_edit_t* edit = malloc(sizeof(wal_edit_t));
+            if (edit != NULL) {
+                edit->word_index = header.value;
+                edit->content = payload;
+                edit->next = NULL;
+                payload = NULL;
+                if ((*link)->edits_tail != NULL) {
+                    (*link)->edits_tail->next = edit;
+                } else {
+                    (*link)->edits = edit;
+                }
+                (*link)->edits_tail = edit;
+                (*link)->edit_count++;
+            }
+        } else if (header.kind == WAL_END && *link != NULL) {
+            recovered_session_t* ended = *link;
+            *link = ended->next;
+            free_recovered(ended);
+        } else if (header.kind == WAL_END) {
+            recovered_commit_t** commit = commits;
+            while (*commit != NULL && (*commit)->id != header.session) {
+                commit = &(*commit)->next;
+            }
+            if (*commit != NULL) {
+                recovered_commit_t* written = *commit;
+                *commit = written->next;
+                free(written->content);
+                free(written);
+            }
+        } else if (header.kind == WAL_COMMIT && header.name_length < MAX_FILENAME_LEN &&
+                   header.user_length < MAX_USERNAME_LEN &&
+                   (uint64_t)header.name_length + header.user_length <= header.payload) {
+            recovered_commit_t* commit = calloc(1, sizeof(recovered_commit_t));
+            size_t length = header.payload - header.name_length - header.user_length;
+            if (commit != NULL && (commit->content = malloc(length + 1)) != NULL) {
+                commit->id = header.session;
+                memcpy(commit->filename, payload, header.name_length);
+                memcpy(commit->user, payload + header.name_length, header.user_length);
+                memcpy(commit->content, payload + header.name_length + header.user_length, length);
+                commit->content[length] = '\0';
+                commit->length = length;
+                commit->version = (uint32_t)header.value;
+                recovered_commit_t** tail = commits;
+                while (*tail != NULL) {
+                    tail = &(*tail)->next;
+                }
+                *tail = commit;
+            } else {
+                free(commit);
+            }
+        }
+        free(payload);
+    }
+    fclose(log);
+}
+
+static int compare_seq(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Sequence numbers of the segments on disk, oldest first (malloc'd)
+static int list_segments(uint64_t** seqs) {
+    DIR* dir = opendir(wal_root);
+    if (dir == NULL) {
+        return -1;
+    }
+    uint64_t* list = NULL;
+    int count = 0;
+    int capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned long long seq;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%llu.%7s", &seq, suffix) != 2 || strcmp(suffix, "wal") != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            uint64_t* grown = realloc(list, capacity * sizeof(uint64_t));
+            if (grown == NULL) {
+                break;
+            }
+            list = grown;
+        }
+        list[count++] = seq;
+    }
+    closedir(dir);
+    qsort(list, count, sizeof(uint64_t), compare_seq);
+    *seqs = list;
+    return count;
+}
+
+// Roll back recovered sessions nobody resumed in time
+static void expire_recovered(void) {
+    pthread_mutex_lock(&recovered_mutex);
+    recovered_session_t* expired = NULL;
+    if (recovered != NULL && time(NULL) >= recovered_at + SS_LOCK_LEASE_SECONDS) {
+        expired = recovered;
+        recovered = NULL;
+    }
+    pthread_mutex_unlock(&recovered_mutex);
+
+    while (expired != NULL) {
+        recovered_session_t* next = expired->next;
+        LOG_WARNING_MSG("WAL", "Rolled back %d unsaved word updates of '%s' on '%s' sentence %d",
+                        expired->edit_count, expired->user, expired->filename, expired->sentence);
+        ss_lock_release(expired->filename, expired->sentence, expired->first_word,
+                        expired->last_word, expired->user);
+        ss_wal_end(expired->id, 0);
+        free_recovered(expired);
+        expired = next;
+    }
+}
+
+static void* wal_flusher(void* arg) {
+    (void)arg;
+    char* batch = NULL;
+    size_t batch_capacity = 0;
+
+    pthread_mutex_lock(&wal_mutex);
+    while (1) {
+        if (pending_length < SS_WAL_BUFFER_BYTES && flush_requests == flushes_done) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += SS_WAL_FLUSH_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&wal_wake, &wal_mutex, &ts);
+        }
+
+        // Take the pending records, leaving our empty buffer for new appends
+        char* taken = pending;
+        size_t taken_capacity = pending_capacity;
+        size_t length = pending_length;
+        size_t split = boundary == SIZE_MAX ? length : boundary;
+        uint64_t request = flush_requests;
+        pending = batch;
+        pending_capacity = batch_capacity;
+        pending_length = 0;
+        boundary = SIZE_MAX;
+        batch = taken;
+        batch_capacity = taken_capacity;
+        pthread_mutex_unlock(&wal_mutex);
+
+        if (length > 0) {
+            if (wal_fd < 0 || write_all(wal_fd, batch, split) != 0 || fdatasync(wal_fd) != 0) {
+                LOG_ERROR_MSG("WAL", "Failed to write edit log: %s", strerror(errno));
+            }
+            if (split < length) {
+                close(wal_fd);
+                wal_fd = open_segment(++write_seq);
+                if (wal_fd < 0 || write_all(wal_fd, batch + split, length - split) != 0 ||
+                    fdatasync(wal_fd) != 0) {
+                    LOG_ERROR_MSG("WAL", "Failed to write edit log: %s", strerror(errno));
+                }
+            }
+        }
+
+        expire_recovered();
+
+        pthread_mutex_lock(&wal_mutex);
+        flushes_done = request;
+        pthread_cond_broadcast(&wal_flushed);
+
+        // Segments whose sessions have all ended hold only dead records
+        while (segment_count > 1 && segments[0].open == 0 && segments[0].seq < write_seq) {
+            char path[WAL_PATH_LEN];
+            segment_path(segments[0].seq, path);
+            unlink(path);
+            memmove(&segments[0], &segments[1], (segment_count - 1) * sizeof(wal_segment_t));
+            segment_count--;
+        }
+    }
+    return NULL;
+}
+
+// Hand back every unended commit, oldest first, flagging the latest of
+// each file; returns how many were written out
+static int restore_commits(recovered_commit_t* commits,
+                           int (*restore)(const char* filename, const char* user,
+                                          const char* content, size_t length,
+                                          uint32_t version, int latest)) {
+    int restored = 0;
+    while (commits != NULL) {
+        recovered_commit_t* commit = commits;
+        commits = commit->next;
+
+        int superseded = 0;
+        for (recovered_commit_t* later = commits; later != NULL; later = later->next) {
+            if (strcmp(later->filename, commit->filename) == 0) {
+                superseded = 1;
+                break;
+            }
+        }
+        if (restore(commit->filename, commit->user, commit->content, commit->length,
+                    commit->version, !superseded) != 0) {
+            LOG_ERROR_MSG("WAL", "Failed to write out commit of '%s': %s",
+                          commit->filename, strerror(errno));
+        } else if (!superseded) {
+            LOG_INFO_MSG("WAL", "Wrote out unwritten commit of '%s' (%zu bytes)",
+                         commit->filename, commit->length);
+            restored++;
+        }
+        free(commit->content);
+        free(commit);
+    }
+    return restored;
+}
+
+/**
+ * ss_wal_init - Replay the edit log and start the flusher
+ * @storage_path: Storage server's root directory
+ * @restore: Records a logged commit's revision and writes out the latest of a file
+ *
+ * Returns: Number of sessions recovered, or -1 on failure
+ */
+int ss_wal_init(const char* storage_path,
+                int (*restore)(const char* filename, const char* user,
+                               const char* content, size_t length, uint32_t version,
+                               int latest)) {
+    snprintf(wal_root, sizeof(wal_root), "%s/%s", storage_path, SS_WAL_DIR);
+    if (mkdir(wal_root, 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR_MSG("WAL", "Failed to create %s: %s", wal_root, strerror(errno));
+        return -1;
+    }
+
+    uint64_t* seqs = NULL;
+    int seq_count = list_segments(&seqs);
+    if (seq_count < 0) {
+        return -1;
+    }
+    char path[WAL_PATH_LEN];
+    recovered_commit_t* commits = NULL;
+    for (int i = 0; i < seq_count; i++) {
+        segment_path(seqs[i], path);
+        replay_segment(path, &recovered, &commits);
+    }
+
+    // Committed documents go to their files before the log that holds them
+    // is dropped, and before any session is resumed against them
+    int restored = restore_commits(commits, restore);
+    if (restored > 0) {
+        LOG_INFO_MSG("WAL", "Wrote out %d acknowledged commits", restored);
+    }
+
+    // Start over in a fresh segment holding only the sessions still open
+    write_seq = seq_count > 0 ? seqs[seq_count - 1] + 1 : 1;
+    int count = 0;
+    uint64_t first_id = next_id;
+    pthread_mutex_lock(&wal_mutex);
+    for (recovered_session_t* session = recovered; session != NULL; session = session->next) {
+        if (queue_recovered(session) != 0) {
+            pthread_mutex_unlock(&wal_mutex);
+            free(seqs);
+            return -1;
+        }
+        if (session->id < first_id) {
+            first_id = session->id;
+        }
+        count++;
+    }
+    int failed = add_segment(write_seq, first_id, count) != 0;
+    wal_fd = open_segment(write_seq);
+    if (!failed && wal_fd >= 0 && pending_length > 0 &&
+        (write_all(wal_fd, pending, pending_length) != 0 || fdatasync(wal_fd) != 0)) {
+        failed = 1;
+    }
+    pending_length = 0;
+    segment_bytes = 0;
+    pthread_mutex_unlock(&wal_mutex);
+
+    if (failed || wal_fd < 0) {
+        LOG_ERROR_MSG("WAL", "Failed to start edit log segment: %s", strerror(errno));
+        free(seqs);
+        return -1;
+    }
+    for (int i = 0; i < seq_count; i++) {
+        segment_path(seqs[i], path);
+        unlink(path);
+    }
+    free(seqs);
+
+    // Hold the recovered sessions' words for their users
+    for (recovered_session_t* session = recovered; session != NULL; session = session->next) {
+        ss_lock_acquire(session->filename, session->sentence, session->first_word,
+                        session->last_word, session->user, 0, NULL);
+        LOG_INFO_MSG("WAL", "Recovered WRITE session of '%s' on '%s' sentence %d (%d word updates)",
+                     session->user, session->filename, session->sentence, session->edit_count);
+    }
+    recovered_at = time(NULL);
+
+    pthread_t flusher;
+    if (pthread_create(&flusher, NULL, wal_flusher, NULL) != 0) {
+        LOG_ERROR_MSG("WAL", "Failed to start edit log flusher");
+        return -1;
+    }
+    pthread_detach(flusher);
+    wal_ready = 1;
+    return count;
+}
+
+/**
+ * ss_wal_flush - Wait until every record appended so far is on disk
+ */
+void ss_wal_flush(void) {
+    if (!wal_ready) {
+        return;
+    }
+    pthread_mutex_lock(&wal_mutex);
+    uint64_t request = ++flush_requests;
+    pthread_cond_signal(&wal_wake);
+    while (flushes_done < request) {
+        pthread_cond_wait(&wal_flushed, &wal_mutex);
+    }
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+/**
+ * ss_wal_begin - Log the start of a WRITE session
+ * @filename: The file
+ * @sentence: 0-based sentence index
+ * @first_word: First locked word
+ * @last_word: Last locked word
+ * @user: The writer
+ * @base: The sentence as locked (NULL when appending a sentence)
+ * @base_length: Its length
+ *
+ * Returns: The session's log ID, or 0 if it could not be logged
+ */
+uint64_t ss_wal_begin(const char* filename, int sentence, int first_word, int last_word,
+                      const char* user, const char* base, size_t base_length) {
+    if (!wal_ready) {
+        return 0;
+    }
+
+    wal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.kind = WAL_BEGIN;
+    header.sentence = sentence;
+    header.first_word = first_word;
+    header.last_word = last_word;
+    header.value = base == NULL;
+    header.name_length = strlen(filename);
+    header.user_length = strlen(user);
+    const char* parts[3] = { filename, user, base ? base : "" };
+    size_t lengths[3] = { header.name_length, header.user_length, base ? base_length : 0 };
+
+    pthread_mutex_lock(&wal_mutex);
+    uint64_t id = take_id();
+    header.session = id;
+    if (queue_record(&header, parts, lengths, 3) != 0) {
+        id = 0;
+    } else {
+        segments[segment_count - 1].open++;
+    }
+    pthread_mutex_unlock(&wal_mutex);
+
+    return id;
+}
+
+/**
+ * ss_wal_edit - Log a word update
+ * @id: The session's log ID
+ * @word_index: Position the words were inserted at
+ * @content: The words
+ */
+void ss_wal_edit(uint64_t id, int word_index, const char* content) {
+    if (id == 0) {
+        return;
+    }
+
+    wal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.kind = WAL_EDIT;
+    header.session = id;
+    header.value = word_index;
+    size_t length = strlen(content);
+
+    pthread_mutex_lock(&wal_mutex);
+    if (queue_record(&header, &content, &length, 1) != 0) {
+        LOG_WARNING_MSG("WAL", "Word update of session %llu not logged", (unsigned long long)id);
+    }
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+/**
+ * ss_wal_commit - Log a committed document ahead of its file
+ * @filename: The file
+ * @user: The committer
+ * @content: The whole new document
+ * @length: Its length
+ * @version: The document's version as of this commit
+ *
+ * The commit counts as open until ss_wal_end once its file is written.
+ * ss_wal_flush makes it durable.
+ *
+ * Returns: The commit's log ID, or 0 if it could not be logged
+ */
+uint64_t ss_wal_commit(const char* filename, const char* user, const char* content,
+                       size_t length, uint32_t version) {
+    if (!wal_ready || length > WAL_MAX_PAYLOAD - MAX_FILENAME_LEN - MAX_USERNAME_LEN) {
+        return 0;
+    }
+
+    wal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.kind = WAL_COMMIT;
+    header.value = (int32_t)version;
+    header.name_length = strlen(filename);
+    header.user_length = strlen(user);
+    const char* parts[3] = { filename, user, content };
+    size_t lengths[3] = { header.name_length, header.user_length, length };
+
+    pthread_mutex_lock(&wal_mutex);
+    uint64_t id = take_id();
+    header.session = id;
+    if (queue_record(&header, parts, lengths, 3) != 0) {
+        id = 0;
+    } else {
+        segments[segment_count - 1].open++;
+    }
+    pthread_mutex_unlock(&wal_mutex);
+
+    return id;
+}
+
+/**
+ * ss_wal_end - Log the end of a WRITE session (or a commit's write-out)
+ * @id: The session's or commit's log ID
+ * @committed: 1 if its edits were committed, 0 if they were dropped
+ */
+void ss_wal_end(uint64_t id, int committed) {
+    if (id == 0) {
+        return;
+    }
+
+    wal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.kind = WAL_END;
+    header.session = id;
+    header.value = committed;
+
+    pthread_mutex_lock(&wal_mutex);
+    // An unlogged end only costs a rolled-back session at the next restart
+    queue_record(&header, NULL, NULL, 0);
+    wal_segment_t* segment = segment_of(id);
+    if (segment != NULL && segment->open > 0) {
+        segment->open--;
+    }
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+/**
+ * ss_wal_resume - Hand a recovered session back to its user
+ * @filename: The file
+ * @sentence: 0-based sentence index
+ * @first_word: First locked word
+ * @last_word: Last locked word
+ * @user: The writer
+ * @base: The sentence as locked now (NULL when appending a sentence)
+ * @base_length: Its length
+ * @apply: Called with each logged word update, in order
+ * @ctx: Passed to @apply
+ * @id: Receives the resumed session's log ID
+ *
+ * Returns: Word updates replayed, or -1 if @apply failed
+ */
+int ss_wal_resume(const char* filename, int sentence, int first_word, int last_word,
+                  const char* user, const char* base, size_t base_length,
+                  int (*apply)(void* ctx, int word_index, const char* content), void* ctx,
+                  uint64_t* id) {
+    pthread_mutex_lock(&recovered_mutex);
+    recovered_session_t** link = &recovered;
+    while (*link != NULL &&
+           ((*link)->sentence != sentence || (*link)->first_word != first_word ||
+            (*link)->last_word != last_word || strcmp((*link)->filename, filename) != 0 ||
+            strcmp((*link)->user, user) != 0)) {
+        link = &(*link)->next;
+    }
+    recovered_session_t* session = *link;
+    if (session != NULL) {
+        *link = session->next;
+    }
+    pthread_mutex_unlock(&recovered_mutex);
+
+    if (session == NULL) {
+        return 0;
+    }
+
+    // The updates only apply to the sentence they were made to
+    int same = session->appending ? base == NULL :
+               base != NULL && base_length == session->base_length &&
+               memcmp(base, session->base, base_length) == 0;
+    if (!same) {
+        LOG_WARNING_MSG("WAL", "Rolled back %d unsaved word updates of '%s' on '%s' sentence %d "
+                        "(sentence changed)", session->edit_count, user, filename, sentence);
+        ss_wal_end(session->id, 0);
+        free_recovered(session);
+        return 0;
+    }
+
+    int replayed = 0;
+    for (const wal_edit_t* edit = session->edits; edit != NULL; edit = edit->next) {
+        if (apply(ctx, edit->word_index, edit->content) != 0) {
+            ss_wal_end(session->id, 0);
+            free_recovered(session);
+            return -1;
+        }
+        replayed++;
+    }
+
+    LOG_INFO_MSG("WAL", "Resumed WRITE session of '%s' on '%s' sentence %d (%d word updates)",
+                 user, filename, sentence, replayed);
+    *id = session->id;
+    free_recovered(session);
+    return replayed;
+}
@@ -9,10 +9,26 @@
 #include "../../include/logging.h"
 #include "../../include/errors.h"
 #include "../../include/file_ops.h"
+#include "../../include/capability.h"
+#include "../../include/ss_thread_pool.h"
+#include "../../include/ss_doc_cache.h"
+#include "../../include/ss_io.h"
+#include "../../include/ss_revlog.h"
+#include "../../include/ss_cas.h"
+#include "../../include/ss_lock_table.h"
+#include "../../include/ss_wal.h"
+#include "../../include/ss_materializer.h"
+#include "../../include/ss_meta_cache.h"
+#include "../../include/text_scan.h"
 #include <signal.h>
+#include <ctype.h>
 #include <dirent.h>
+#include <limits.h>
 #include <sys/select.h>
 #include <netdb.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
 
 // Global state
 static char storage_path[MAX_PATH_LEN];
@@ -21,23 +37,97 @@ static int nm_port;
 static int client_port;
 static int nm_socket = -1;
 static int client_server_socket = -1;
+// Phase 7: Signals only write the signal number here; the main loop shuts down
+static int shutdown_pipe[2] = {-1, -1};
 // static file_lock_t* active_locks = NULL;  // TODO: Implement in Phase 1
 
 // Phase 2: File discovery
 static char discovered_files[MAX_FILES_PER_SERVER][MAX_FILENAME_LEN];
 static int discovered_file_count = 0;
 
-// Phase 5.3: Sentence-level locking for WRITE operations
-static sentence_lock_t* global_lock_list = NULL;
-static pthread_mutex_t lock_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Phase 7: Commits of one document (ETIRW, UNDO, REVERT) are serialized so
+// its revision log sees them in order; other documents commit in parallel
+#define COMMIT_LOCK_STRIPES 64
+static pthread_mutex_t commit_locks[COMMIT_LOCK_STRIPES];
+
+// Phase 7: Location lease floors - a client lease older than its file's floor is stale
+#define LEASE_TABLE_SIZE 256
+typedef struct lease_floor {
+    char filename[MAX_FILENAME_LEN];
+    uint32_t version;
+    struct lease_floor* next;
+} lease_floor_t;
+static lease_floor_t* lease_floors[LEASE_TABLE_SIZE];
+static uint32_t default_lease_floor = 0;  // Floor for files listed at SS_INIT
+static pthread_mutex_t lease_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Phase 7: Per-connection state. Between requests a connection waits in the
+// client reactor (epoll, one-shot) and holds no worker thread.
+typedef struct {
+    int sock;
+    
+    // Phase 5.3: WRITE session state. Only the locked sentence is copied at
+    // WRITE and edited in place; ETIRW splices it into the current document.
+    file_content_t* document;   // Holds the locked sentence (none yet when appending)
+    char* base_sentence;        // Its text when locked (NULL when appending)
+    size_t base_length;
+    char filename[MAX_FILENAME_LEN];
+    int sentence;
+    int first_word;             // Phase 7: Locked words (0..SS_LOCK_LAST_WORD: all)
+    int last_word;
+    int base_words;             // Words in the sentence when locked
+    char user[MAX_USERNAME_LEN];
+    uint64_t wal_id;            // Phase 7: Edit log ID (0: edits not logged)
+    int64_t expected_version;   // Phase 7: WRITE ... IFVERSION <v> (-1: none)
+} client_session_t;
+
+#define CLIENT_REACTOR_BATCH 64
+#define SS_SENDFILE_CHUNK (256 * 1024)  // READ/STREAM chunk if SO_SNDBUF is unknown
+static int client_epoll_fd = -1;
+
+// Phase 7: Worker pool serving client requests
+static ss_thread_pool_t* client_pool = NULL;
+// One single-worker queue per stripe: NM commands for one file run in order
+static ss_thread_pool_t* control_pools[SS_CONTROL_WORKERS];
+static pthread_mutex_t nm_send_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int pool_workers = SS_DEFAULT_WORKERS;
+static int pool_queue_depth = SS_DEFAULT_QUEUE_DEPTH;
+static size_t pool_stack_size = SS_DEFAULT_STACK_KB * 1024;
+// Phase 7: A WRITE waiting for a busy lock holds its worker, so only a share
+// of the workers may wait at once; the rest are refused at once instead
+#define SS_LOCK_WAITER_SHARE 4          // At most 1/4 of the client workers
+static int lock_waiters = 0;
+static pthread_mutex_t lock_waiters_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Phase 7: Disk I/O backend (io_uring unless "sync" is given on the command line)
+static ss_io_backend_t io_backend = SS_IO_URING;
+
+// Phase 7: Early-ack commits ("early" on the command line): ETIRW answers
+// once the merged document is synced in the edit log, and the materializer
+// writes the file afterwards. Readers get it from the doc cache.
+static int early_ack_commits = 0;
+
+// Phase 7: Capability key shared with the Name Server at SS_INIT
+static uint8_t capability_key[CAPABILITY_KEY_LEN];
+static int has_capability_key = 0;
+
+typedef enum {
+    CLIENT_AUTH_REJECTED = 0,   // A reply has already been sent
+    CLIENT_AUTH_UNVERIFIED,     // No usable capability - check the metadata cache
+    CLIENT_AUTH_VERIFIED        // Capability grants the access
+} client_auth_t;
 
 // Function prototypes
 void register_with_name_server();
 void initialize_storage_server(const char* path, int c_port);
-void handle_nm_commands();
+void* nm_control_thread(void* arg);
+void handle_nm_request(void* arg);
+int send_nm_response(const request_packet_t* req, response_packet_t* response);
 void handle_client_connections();
 void scan_existing_files();
 void cleanup_and_exit(int signal);
+void request_shutdown(int signal);
 int create_file_on_disk(const char* filename, const char* username);
 int read_file_from_disk(const char* filename, char* content, size_t max_size);
 int write_file_to_disk(const char* filename, const char* content);
@@ -52,22 +142,67 @@ void send_ss_init_packet();
 void handle_create_request(request_packet_t* req);
 void handle_delete_request(request_packet_t* req);
 void handle_update_acl_request(request_packet_t* req);
-int create_file_metadata(const char* filename, const char* owner);
+void handle_undo_request(request_packet_t* req);
+void handle_checkpoint_request(request_packet_t* req);
+void handle_info_request(request_packet_t* req);
+pthread_mutex_t* commit_lock_for(const char* filename);
+ss_thread_pool_t* control_pool_for(const request_packet_t* req);
+int commit_document_file(const char* filename, const char* content, size_t length,
+                         uint32_t version, const char** failed_step);
+int write_published_document(const cached_doc_t* doc, const char* user);
+void record_published_revision(const cached_doc_t* previous, const cached_doc_t* doc);
+int restore_logged_commit(const char* filename, const char* user, const char* content,
+                          size_t length, uint32_t version, int latest);
+int log_early_commit(client_session_t* session, cached_doc_t* previous, char* content,
+                     size_t length, uint32_t version, const char* user);
+int publish_committed(const char* filename, char* content, size_t length, uint32_t version);
+int count_document_words(const char* content, size_t length);
+void reply_version_mismatch(int sock, const char* filename, uint32_t current, uint32_t expected);
 
 // ACL helpers
 char* serialize_acl_from_meta(const file_metadata_t* meta);
 int parse_acl_into_meta(file_metadata_t* meta, const char* acl_str);
 
 // Phase 5.3: Sentence lock management
-int acquire_lock(const char* file, int index, const char* user);
-void release_lock(const char* file, int index, const char* user);
+int acquire_lock(const char* file, int index, int first_word, int last_word, const char* user,
+                 int wait_seconds);
+void release_lock(const char* file, int index, int first_word, int last_word, const char* user);
+int renew_lock(const char* file, int index, int first_word, int last_word, const char* user);
+void describe_lock(char* out, size_t size, int index, int first_word, int last_word);
+
+// Phase 5.1: Client request handling
+// Phase 7: Sessions are parked in an epoll reactor and each ready request
+// is queued on the worker pool
+int serve_client_request(client_session_t* session);
+void client_request_task(void* arg);
+void* client_reactor_thread(void* arg);
+int add_client_session(int client_socket);
+int arm_client_session(client_session_t* session, int op);
+void destroy_client_session(client_session_t* session);
+void free_session_document(client_session_t* session);
+int apply_session_word(client_session_t* session, int word_index, const char* word);
+int replay_session_word(void* ctx, int word_index, const char* word);
+int merge_session_sentence(const client_session_t* session, const cached_doc_t* current,
+                           char** merged, size_t* merged_length, int* word_count);
+int collect_word_spans(const char* text, size_t length, word_span_t** spans);
+int find_word_run(const char* text, size_t length, const char* pattern,
+                  const word_span_t* words, int count, int near, word_span_t* run);
+void reject_busy_client(int client_socket);
+int send_document(int sock, uint32_t request_id, const cached_doc_t* doc);
+void log_send_failure(const char* filename);
 
-// Phase 5.1: Thread-based client handler
-void* client_connection_thread(void* arg);
+// Phase 7: Location lease validation
+void set_lease_floor(const char* file, uint32_t version);
+void remove_lease_floor(const char* file);
+void reset_lease_floors(uint32_t floor);
+int lease_is_stale(const char* file, uint32_t version);
+client_auth_t authorize_client_request(int sock, request_packet_t* req, const char* filename,
+                                       int access);
 
 int main(int argc, char* argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <nm_ip> <nm_port> <storage_path> <client_port>\n", argv[0]);
+    if (argc < 5 || argc > 10) {
+        fprintf(stderr, "Usage: %s <nm_ip> <nm_port> <storage_path> <client_port> "
+                        "[workers] [queue_depth] [stack_kb] [uring|sync] [direct|early]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
     
@@ -88,6 +223,31 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
     
+    // Phase 7: Optional worker pool sizing
+    if (argc > 5) pool_workers = atoi(argv[5]);
+    if (argc > 6) pool_queue_depth = atoi(argv[6]);
+    if (argc > 7) pool_stack_size = (size_t)atoi(argv[7]) * 1024;
+    if (pool_workers <= 0 || pool_queue_depth <= 0 || (argc > 7 && pool_stack_size == 0)) {
+        fprintf(stderr, "Error: Invalid worker pool settings\n");
+        exit(EXIT_FAILURE);
+    }
+    if (argc > 8) {
+        if (strcmp(argv[8], "sync") == 0) {
+            io_backend = SS_IO_SYNC;
+        } else if (strcmp(argv[8], "uring") != 0) {
+            fprintf(stderr, "Error: I/O backend must be 'uring' or 'sync'\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc > 9) {
+        if (strcmp(argv[9], "early") == 0) {
+            early_ack_commits = 1;
+        } else if (strcmp(argv[9], "direct") != 0) {
+            fprintf(stderr, "Error: Commit mode must be 'direct' or 'early'\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
     printf("Storage Server starting...\n");
     printf("Name Server: %s:%d\n", nm_ip, nm_port);
     printf("Storage Path: %s\n", storage_path);
@@ -98,24 +258,91 @@ int main(int argc, char* argv[]) {
     LOG_INFO_MSG("STORAGE_SERVER", "Starting Storage Server - NM: %s:%d, Path: %s, Client Port: %d",
                  nm_ip, nm_port, storage_path, client_port);
     
-    // Set up signal handlers
-    signal(SIGINT, cleanup_and_exit);
-    signal(SIGTERM, cleanup_and_exit);
+    // Set up signal handlers (Phase 7: they wake the main loop, which shuts down)
+    if (pipe2(shutdown_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        LOG_CRITICAL_MSG("STORAGE_SERVER", "Failed to create shutdown pipe: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGINT, request_shutdown);
+    signal(SIGTERM, request_shutdown);
+    // Phase 7: sendfile has no MSG_NOSIGNAL; a client gone mid-transfer
+    // must come back as EPIPE, not end the server
+    signal(SIGPIPE, SIG_IGN);
     
     // Phase 2: Initialize storage and discover files
     initialize_storage_server(storage_path, client_port);
+    io_backend = ss_io_init(io_backend);
+    printf("Disk I/O: %s\n", ss_io_backend_name());
+    int stale_temps = ss_io_remove_temp_files(storage_path);
+    if (stale_temps > 0) {
+        LOG_WARNING_MSG("STORAGE_SERVER", "Removed %d temp files of interrupted writes", stale_temps);
+    }
+    ss_meta_init(storage_path);
     discover_local_files();
+    doc_cache_init(storage_path, SS_DOC_CACHE_BUDGET);
+    ss_revlog_init(storage_path);
+    ss_cas_init(storage_path);
+    ss_lock_table_init();
+    int recovered_sessions = ss_wal_init(storage_path, restore_logged_commit);
+    if (recovered_sessions < 0) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Edit log unavailable; open WRITE sessions will not survive a restart");
+    } else if (recovered_sessions > 0) {
+        LOG_INFO_MSG("STORAGE_SERVER", "Recovered %d unfinished WRITE sessions from the edit log",
+                     recovered_sessions);
+    }
+    for (int i = 0; i < COMMIT_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&commit_locks[i], NULL);
+    }
+    if (early_ack_commits && (recovered_sessions < 0 ||
+                              ss_materializer_init(write_published_document,
+                                                   record_published_revision) != 0)) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Early-ack commits unavailable; ETIRW writes files directly");
+        early_ack_commits = 0;
+    }
+    printf("Commits: %s\n", early_ack_commits ? "early ack (edit log)" : "direct");
     
     // Connect to Name Server and send initialization
     register_with_name_server();
     
-    // Main server loop using select
+    // Phase 7: Fixed worker pool instead of a thread per connection
+    client_pool = ss_thread_pool_create(pool_workers, pool_queue_depth, pool_stack_size);
+    if (client_pool == NULL) {
+        LOG_CRITICAL_MSG("STORAGE_SERVER", "Failed to start client worker pool");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Phase 7: Reactor that hands ready client connections to the pool
+    client_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    pthread_t reactor_tid;
+    if (client_epoll_fd == -1 ||
+        pthread_create(&reactor_tid, NULL, client_reactor_thread, NULL) != 0) {
+        LOG_CRITICAL_MSG("STORAGE_SERVER", "Failed to start client reactor: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(reactor_tid);
+    
+    // Phase 7: NM commands run on their own thread and worker queues
+    for (int i = 0; i < SS_CONTROL_WORKERS; i++) {
+        control_pools[i] = ss_thread_pool_create(1, SS_CONTROL_QUEUE_DEPTH, pool_stack_size);
+        if (control_pools[i] == NULL) {
+            LOG_CRITICAL_MSG("STORAGE_SERVER", "Failed to start NM control workers");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_t control_tid;
+    if (pthread_create(&control_tid, NULL, nm_control_thread, NULL) != 0) {
+        LOG_CRITICAL_MSG("STORAGE_SERVER", "Failed to start NM control handler");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(control_tid);
+    
+    // Main server loop using select (Phase 7: clients only, NM traffic has its own thread)
     fd_set master_fds, read_fds;
     FD_ZERO(&master_fds);
-    FD_SET(nm_socket, &master_fds);
     FD_SET(client_server_socket, &master_fds);
+    FD_SET(shutdown_pipe[0], &master_fds);
     
-    int max_fd = (nm_socket > client_server_socket) ? nm_socket : client_server_socket;
+    int max_fd = (client_server_socket > shutdown_pipe[0]) ? client_server_socket : shutdown_pipe[0];
     
     LOG_INFO_MSG("STORAGE_SERVER", "Server initialized, waiting for connections...");
     
@@ -123,13 +350,18 @@ int main(int argc, char* argv[]) {
         read_fds = master_fds;
         
         if (select(max_fd + 1, &read_fds, NULL, NULL, NULL) == -1) {
-            LOG_ERROR_MSG("STORAGE_SERVER", "Select error: %s", strerror(errno));
+            if (errno != EINTR) {
+                LOG_ERROR_MSG("STORAGE_SERVER", "Select error: %s", strerror(errno));
+            }
             continue;
         }
         
-        // Handle Name Server communications
-        if (FD_ISSET(nm_socket, &read_fds)) {
-            handle_nm_commands();
+        // Phase 7: A shutdown was requested (signal number in the pipe)
+        if (FD_ISSET(shutdown_pipe[0], &read_fds)) {
+            unsigned char signal_number = 0;
+            if (read(shutdown_pipe[0], &signal_number, 1) == 1) {
+                cleanup_and_exit(signal_number);
+            }
         }
         
         // Handle new client connections
@@ -142,20 +374,13 @@ int main(int argc, char* argv[]) {
                 LOG_INFO_MSG("STORAGE_SERVER", "New client connection from %s:%d",
                             inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
                 
-                // Phase 5.1: Spawn a detached thread to handle this client
-                int* sock_ptr = malloc(sizeof(int));
-                if (sock_ptr == NULL) {
-                    LOG_ERROR_MSG("STORAGE_SERVER", "Failed to allocate memory for client socket");
+                // Phase 7: Park the connection in the reactor; refuse it when
+                // the worker queue is already full
+                if (ss_thread_pool_pending(client_pool) >= pool_queue_depth) {
+                    reject_busy_client(client_socket);
+                } else if (add_client_session(client_socket) != 0) {
+                    LOG_ERROR_MSG("STORAGE_SERVER", "Failed to register client socket %d", client_socket);
                     close(client_socket);
-                } else {
-                    *sock_ptr = client_socket;
-                    pthread_t tid;
-                    if (pthread_create(&tid, NULL, client_connection_thread, (void*)sock_ptr) != 0) {
-                        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to create thread for client");
-                        free(sock_ptr);
-                        close(client_socket);
-                    }
-                    // Thread created successfully; it will handle the client
                 }
             }
         }
@@ -174,6 +399,13 @@ void initialize_storage_server(const char* path, int c_port) {
         }
     }
     
+    // Phase 7: Queued connections each hold an fd - raise the soft limit
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
     // Initialize client server socket
     client_server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (client_server_socket == -1) {
@@ -195,7 +427,8 @@ void initialize_storage_server(const char* path, int c_port) {
         exit(EXIT_FAILURE);
     }
     
-    if (listen(client_server_socket, BACKLOG) == -1) {
+    // Deep kernel backlog so connection bursts wait for the pool instead of SYN retries
+    if (listen(client_server_socket, SOMAXCONN) == -1) {
         LOG_CRITICAL_MSG("STORAGE_SERVER", "Client socket listen failed: %s", strerror(errno));
         exit(EXIT_FAILURE);
     }
@@ -265,73 +498,123 @@ void scan_existing_files() {
     LOG_INFO_MSG("STORAGE_SERVER", "Scanned %d existing files", file_count);
 }
 
-void handle_nm_commands() {
-    request_packet_t request;
-    if (recv_request(nm_socket, &request) <= 0) {
-        LOG_WARNING_MSG("STORAGE_SERVER", "Lost connection to Name Server");
-        return;
-    }
+// Phase 7: NM control channel. A dedicated thread reads commands off the NM
+// socket and queues them on a small control pool, so accepting clients never
+// waits on control-plane work. Replies carry the request's request_id and
+// may complete out of order; sends are serialized by nm_send_mutex.
+void* nm_control_thread(void* arg) {
+    (void)arg;
     
-    // Validate packet integrity
-    if (!validate_packet_integrity(&request, sizeof(request))) {
-        LOG_ERROR_MSG("STORAGE_SERVER", "Received corrupted packet from Name Server");
-        return;
+    while (1) {
+        request_packet_t* req = malloc(sizeof(request_packet_t));
+        if (req == NULL) {
+            LOG_ERROR_MSG("STORAGE_SERVER", "Failed to allocate NM request");
+            sleep(1);
+            continue;
+        }
+        
+        if (recv_request(nm_socket, req) <= 0) {
+            // Phase 7: Without the NM no command arrives and the NM's view of
+            // this server is gone; shut down cleanly so it can be restarted
+            // and registered again
+            LOG_CRITICAL_MSG("STORAGE_SERVER", "Lost connection to Name Server; shutting down");
+            free(req);
+            request_shutdown(0);
+            return NULL;
+        }
+        
+        // Validate packet integrity
+        if (!validate_packet_integrity(req, sizeof(*req))) {
+            LOG_ERROR_MSG("STORAGE_SERVER", "Received corrupted packet from Name Server");
+            free(req);
+            continue;
+        }
+        
+        if (ss_thread_pool_submit(control_pool_for(req), handle_nm_request, req) != 0) {
+            response_packet_t response;
+            memset(&response, 0, sizeof(response));
+            response.magic = PROTOCOL_MAGIC;
+            response.status = STATUS_ERROR_SERVER_BUSY;
+            snprintf(response.data, sizeof(response.data), "Storage server control queue full");
+            send_nm_response(req, &response);
+            free(req);
+        }
     }
+}
+
+// Send a reply on the NM channel, tagged with the request it answers
+int send_nm_response(const request_packet_t* req, response_packet_t* response) {
+    response->request_id = req->request_id;
+    
+    pthread_mutex_lock(&nm_send_mutex);
+    int result = send_response(nm_socket, response);
+    pthread_mutex_unlock(&nm_send_mutex);
+    
+    return result;
+}
+
+// Process one NM command on a control pool worker (takes ownership of arg)
+void handle_nm_request(void* arg) {
+    request_packet_t* req = (request_packet_t*)arg;
     
     // Enhanced logging with command details
     const char* cmd_name = "UNKNOWN";
-    switch (request.command) {
+    switch (req->command) {
         case CMD_CREATE: cmd_name = "CREATE"; break;
         case CMD_DELETE: cmd_name = "DELETE"; break;
         case CMD_READ: cmd_name = "READ"; break;
         case CMD_UNDO: cmd_name = "UNDO"; break;
+        case CMD_REVERT: cmd_name = "REVERT"; break;
+        case CMD_CHECKPOINT: cmd_name = "CHECKPOINT"; break;
+        case CMD_LISTCHECKPOINTS: cmd_name = "LISTCHECKPOINTS"; break;
         case CMD_UPDATE_ACL: cmd_name = "UPDATE_ACL"; break;
+        case CMD_INFO: cmd_name = "INFO"; break;
         default: break;
     }
     
     printf("[SS] REQUEST from NM | Command: %s | User: %s | Args: %s\n", 
-           cmd_name, request.username, request.args);
+           cmd_name, req->username, req->args);
     LOG_INFO_MSG("REQUEST", "From Name Server | Command: %s | User: %s | Args: %s", 
-                 cmd_name, request.username, request.args);
+                 cmd_name, req->username, req->args);
     
     // Handle different command types from Name Server
-    switch (request.command) {
+    switch (req->command) {
         case CMD_CREATE:
-            handle_create_request(&request);
+            handle_create_request(req);
             break;
         case CMD_DELETE:
-            handle_delete_request(&request);
+            handle_delete_request(req);
             break;
         case CMD_UPDATE_ACL:
-            handle_update_acl_request(&request);
+            handle_update_acl_request(req);
             break;
         case CMD_READ:
             // Phase 5.4: Handle READ request from Name Server (for EXEC)
             // This is different from client CMD_READ - NM has already checked permissions
             {
                 char filename[MAX_FILENAME_LEN];
-                sscanf(request.args, "%s", filename);
-                
-                char filepath[MAX_PATH_LEN];
-                snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
+                sscanf(req->args, "%s", filename);
                 
                 response_packet_t response;
                 memset(&response, 0, sizeof(response));
                 response.magic = PROTOCOL_MAGIC;
                 
-                // Open and read the file
-                FILE* fp = fopen(filepath, "r");
-                if (fp == NULL) {
+                // Read the file through the shared document cache
+                cached_doc_t* doc = doc_cache_acquire(filename);
+                if (doc == NULL) {
                     response.status = STATUS_ERROR_NOT_FOUND;
                     snprintf(response.data, sizeof(response.data),
                             "File not found: %s", filename);
                     LOG_ERROR_MSG("STORAGE_SERVER", "NM requested file not found: %s", filename);
                 } else {
-                    // Read entire file content into response.data
-                    size_t bytes_read = fread(response.data, 1, 
-                                             sizeof(response.data) - 1, fp);
+                    // Copy as much content as fits into response.data
+                    size_t bytes_read = doc->length;
+                    if (bytes_read > sizeof(response.data) - 1) {
+                        bytes_read = sizeof(response.data) - 1;
+                    }
+                    memcpy(response.data, doc->content, bytes_read);
                     response.data[bytes_read] = '\0';
-                    fclose(fp);
+                    doc_cache_release(doc);
                     
                     response.status = STATUS_OK;
                     LOG_INFO_MSG("STORAGE_SERVER", 
@@ -341,53 +624,22 @@ void handle_nm_commands() {
                 
                 response.checksum = calculate_checksum(&response,
                                                        sizeof(response) - sizeof(uint32_t));
-                send_response(nm_socket, &response);
+                send_nm_response(req, &response);
             }
             break;
         case CMD_UNDO:
-            // Handle UNDO: restore file from backup
-            {
-                char filename[MAX_FILENAME_LEN];
-                sscanf(request.args, "%s", filename);
-                
-                char filepath[MAX_PATH_LEN];
-                char backup_filepath[MAX_PATH_LEN];
-                snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-                snprintf(backup_filepath, sizeof(backup_filepath), "%s/%s.bak", storage_path, filename);
-                
-                response_packet_t response;
-                memset(&response, 0, sizeof(response));
-                response.magic = PROTOCOL_MAGIC;
-                
-                // Check if backup exists
-                if (access(backup_filepath, F_OK) != 0) {
-                    response.status = STATUS_ERROR_NOT_FOUND;
-                    snprintf(response.data, sizeof(response.data), 
-                            "No backup found for '%s'", filename);
-                    LOG_WARNING_MSG("STORAGE_SERVER", "UNDO failed: no backup for '%s'", filename);
-                } else {
-                    // Rename backup to original file
-                    if (rename(backup_filepath, filepath) == 0) {
-                        response.status = STATUS_OK;
-                        snprintf(response.data, sizeof(response.data), 
-                                "File '%s' restored from backup", filename);
-                        LOG_INFO_MSG("STORAGE_SERVER", "UNDO successful: restored '%s'", filename);
-                    } else {
-                        response.status = STATUS_ERROR_INTERNAL;
-                        snprintf(response.data, sizeof(response.data), 
-                                "Failed to restore '%s': %s", filename, strerror(errno));
-                        LOG_ERROR_MSG("STORAGE_SERVER", "UNDO failed: rename error for '%s': %s",
-                                     filename, strerror(errno));
-                    }
-                }
-                
-                response.checksum = calculate_checksum(&response, 
-                                                       sizeof(response) - sizeof(uint32_t));
-                send_response(nm_socket, &response);
-            }
+        case CMD_REVERT:
+            handle_undo_request(req);
+            break;
+        case CMD_CHECKPOINT:
+        case CMD_LISTCHECKPOINTS:
+            handle_checkpoint_request(req);
+            break;
+        case CMD_INFO:
+            handle_info_request(req);
             break;
         default:
-            LOG_WARNING_MSG("STORAGE_SERVER", "Unknown command from NM: %d", request.command);
+            LOG_WARNING_MSG("STORAGE_SERVER", "Unknown command from NM: %d", req->command);
             
             // Send error response
             response_packet_t error_response;
@@ -395,524 +647,442 @@ void handle_nm_commands() {
             error_response.magic = PROTOCOL_MAGIC;
             error_response.status = STATUS_ERROR_INVALID_OPERATION;
             snprintf(error_response.data, sizeof(error_response.data), 
-                    "Unknown command: %d", request.command);
+                    "Unknown command: %d", req->command);
             error_response.checksum = calculate_checksum(&error_response, 
                                                          sizeof(error_response) - sizeof(uint32_t));
-            send_response(nm_socket, &error_response);
+            send_nm_response(req, &error_response);
             break;
     }
+    
+    free(req);
 }
 
-// Phase 5.1: Thread handler for client connections
-void* client_connection_thread(void* arg) {
-    // Get the socket from the argument and free the allocated memory
-    int sock = *(int*)arg;
-    free(arg);
+// Phase 5.1: Client request handler
+// Phase 7: Runs on a pool worker for exactly one request, then the
+// connection goes back to the reactor until the client sends the next one.
+// Returns 1 to keep the connection, 0 once it should be closed.
+int serve_client_request(client_session_t* session) {
+    int sock = session->sock;
     
-    // Make this thread detached so it cleans up automatically
-    pthread_detach(pthread_self());
+    request_packet_t request;
+    int bytes = recv_request(sock, &request);
     
-    LOG_INFO_MSG("STORAGE_SERVER", "Client thread started for socket %d", sock);
+    if (bytes <= 0) {
+        // Client disconnected or error
+        LOG_INFO_MSG("STORAGE_SERVER", "Client disconnected from socket %d", sock);
+        return 0;
+    }
     
-    // Phase 5.3: Thread-local state for WRITE sessions
-    char* file_buffer = NULL;
-    size_t file_buffer_size = 0;
-    char session_filename[MAX_FILENAME_LEN] = "";
-    int session_sentence = -1;
-    char session_user[MAX_USERNAME_LEN] = "";
+    // Validate packet integrity
+    if (!validate_packet_integrity(&request, sizeof(request))) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Received corrupted packet from client socket %d", sock);
+        return 1;
+    }
     
-    // Main client handling loop
-    while (1) {
-        request_packet_t request;
-        int bytes = recv_request(sock, &request);
-        
-        if (bytes <= 0) {
-            // Client disconnected or error
-            LOG_INFO_MSG("STORAGE_SERVER", "Client disconnected from socket %d", sock);
-            close(sock);
-            return NULL;
-        }
-        
-        // Validate packet integrity
-        if (!validate_packet_integrity(&request, sizeof(request))) {
-            LOG_ERROR_MSG("STORAGE_SERVER", "Received corrupted packet from client socket %d", sock);
-            continue;
-        }
-        
-        // Get client address for logging
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        char client_ip[INET_ADDRSTRLEN];
-        int client_port = 0;
-        
-        if (getpeername(sock, (struct sockaddr*)&client_addr, &addr_len) == 0) {
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-            client_port = ntohs(client_addr.sin_port);
-        } else {
-            strcpy(client_ip, "unknown");
-        }
-        
-        const char* cmd_name = "UNKNOWN";
-        switch (request.command) {
-            case CMD_READ: cmd_name = "READ"; break;
-            case CMD_WRITE: cmd_name = "WRITE"; break;
-            case CMD_STREAM: cmd_name = "STREAM"; break;
-            default: break;
-        }
-        
-        printf("[SS] CLIENT_REQUEST from %s@%s:%d | Command: %s | Args: %s\n", 
-               request.username, client_ip, client_port, cmd_name, request.args);
-        LOG_INFO_MSG("CLIENT_REQUEST", "From %s@%s:%d (sock=%d) | Command: %s | Args: %s", 
-                     request.username, client_ip, client_port, sock, cmd_name, request.args);
-        
-        // Handle different client-facing commands
-        switch (request.command) {
-            case CMD_READ:
-                // Phase 5.2: Read file and send content to client
-                LOG_INFO_MSG("STORAGE_SERVER", "Processing READ request for '%s' by user '%s'",
-                            request.args, request.username);
-                {
-                    char filename[MAX_FILENAME_LEN];
-                    sscanf(request.args, "%s", filename);
+    // Get client address for logging
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    char client_ip[INET_ADDRSTRLEN];
+    int client_port = 0;
+    
+    if (getpeername(sock, (struct sockaddr*)&client_addr, &addr_len) == 0) {
+        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
+        client_port = ntohs(client_addr.sin_port);
+    } else {
+        strcpy(client_ip, "unknown");
+    }
+    
+    const char* cmd_name = "UNKNOWN";
+    switch (request.command) {
+        case CMD_READ: cmd_name = "READ"; break;
+        case CMD_WRITE: cmd_name = "WRITE"; break;
+        case CMD_STREAM: cmd_name = "STREAM"; break;
+        default: break;
+    }
+    
+    printf("[SS] CLIENT_REQUEST from %s@%s:%d | Command: %s | Args: %s\n", 
+           request.username, client_ip, client_port, cmd_name, request.args);
+    LOG_INFO_MSG("CLIENT_REQUEST", "From %s@%s:%d (sock=%d) | Command: %s | Args: %s", 
+                 request.username, client_ip, client_port, sock, cmd_name, request.args);
+    
+    // Handle different client-facing commands
+    switch (request.command) {
+        case CMD_READ:
+            // Phase 5.2: Read file and send content to client
+            LOG_INFO_MSG("STORAGE_SERVER", "Processing READ request for '%s' by user '%s'",
+                        request.args, request.username);
+            {
+                char filename[MAX_FILENAME_LEN];
+                client_auth_t auth = authorize_client_request(sock, &request, NULL, ACCESS_READ);
+                if (auth == CLIENT_AUTH_REJECTED) {
+                    return 0;
+                }
+                sscanf(request.args, "%s", filename);
+                
+                // Build file path
+                char filepath[MAX_PATH_LEN];
+                snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
+                
+                // Phase 7: A verified capability skips the metadata cache lookup
+                int has_access = (auth == CLIENT_AUTH_VERIFIED) ? 1 :
+                                 ss_meta_check_access(filename, request.username, ACCESS_READ);
+                if (has_access < 0) {
+                    LOG_ERROR_MSG("STORAGE_SERVER", "Metadata file not found for '%s'", filename);
+                    response_packet_t response;
+                    memset(&response, 0, sizeof(response));
+                    response.magic = PROTOCOL_MAGIC;
+                    response.status = STATUS_ERROR_NOT_FOUND;
+                    snprintf(response.data, sizeof(response.data), 
+                            "File metadata not found");
+                    response.checksum = calculate_checksum(&response, 
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                if (!has_access) {
+                    LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' denied read access to '%s'",
+                                   request.username, filename);
+                    response_packet_t response;
+                    memset(&response, 0, sizeof(response));
+                    response.magic = PROTOCOL_MAGIC;
+                    response.status = STATUS_ERROR_READ_PERMISSION;
+                    snprintf(response.data, sizeof(response.data), 
+                            "Permission denied");
+                    response.checksum = calculate_checksum(&response, 
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                // Phase 7: Serve from the shared document cache
+                cached_doc_t* doc = doc_cache_acquire(filename);
+                if (doc == NULL) {
+                    LOG_ERROR_MSG("STORAGE_SERVER", "Failed to open file: %s", filepath);
+                    response_packet_t response;
+                    memset(&response, 0, sizeof(response));
+                    response.magic = PROTOCOL_MAGIC;
+                    response.status = STATUS_ERROR_NOT_FOUND;
+                    snprintf(response.data, sizeof(response.data), 
+                            "File not found");
+                    response.checksum = calculate_checksum(&response, 
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                LOG_INFO_MSG("STORAGE_SERVER", "Sending file '%s' to client", filename);
+                
+                if (send_document(sock, request.request_id, doc) != 0) {
+                    log_send_failure(filename);
+                } else {
+                    LOG_INFO_MSG("STORAGE_SERVER", "Finished sending file '%s'", filename);
+                }
+                
+                doc_cache_release(doc);
+                return 0;
+            }
+            break;
+            
+        case CMD_WRITE:
+            // Phase 5.3: Stateful WRITE handler with locking
+            LOG_INFO_MSG("STORAGE_SERVER", "Processing WRITE request: '%s' by user '%s'",
+                        request.args, request.username);
+            {
+                
+                response_packet_t response;
+                memset(&response, 0, sizeof(response));
+                response.magic = PROTOCOL_MAGIC;
+                
+                // Check if this is initial WRITE or word update
+                char filename[MAX_FILENAME_LEN];
+                int sentence_num = -1;
+                int word_index = -1;
+                char word_content[MAX_WORD_LEN];
+                
+                // Try parsing as initial request (filename sentence_num)
+                if (sscanf(request.args, "%s %d", filename, &sentence_num) == 2) {
+                    // This is initial WRITE request - acquire lock
+                    
+                    // Phase 7: Refuse stale leases; a valid capability skips the ACL check
+                    client_auth_t auth = authorize_client_request(sock, &request, filename,
+                                                                  ACCESS_WRITE);
+                    if (auth == CLIENT_AUTH_REJECTED) {
+                        break;
+                    }
+                    
+                    // Phase 7: "IFVERSION <v>" - edit only if the document is still at v
+                    uint32_t if_version = 0;
+                    int conditional = extract_version_condition(request.args, &if_version);
+                    if (conditional < 0) {
+                        response.status = STATUS_ERROR_INVALID_ARGS;
+                        snprintf(response.data, sizeof(response.data),
+                                "Invalid IFVERSION (use IFVERSION <version>)");
+                        response.checksum = calculate_checksum(&response,
+                                                               sizeof(response) - sizeof(uint32_t));
+                        send_response(sock, &response);
+                        break;
+                    }
+                    
+                    // Check if already have active session
+                    if (session->document != NULL) {
+                        response.status = STATUS_ERROR_INTERNAL;
+                        snprintf(response.data, sizeof(response.data),
+                                "Session already active for %s", session->filename);
+                        response.checksum = calculate_checksum(&response,
+                                                               sizeof(response) - sizeof(uint32_t));
+                        send_response(sock, &response);
+                        break;
+                    }
                     
-                    // Build file paths
+                    // Build file path
                     char filepath[MAX_PATH_LEN];
-                    char metapath[MAX_PATH_LEN];
                     snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-                    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
                     
-                    // Check if .meta file exists and verify permissions
-                    FILE* meta_fp = fopen(metapath, "r");
-                    if (meta_fp == NULL) {
-                        LOG_ERROR_MSG("STORAGE_SERVER", "Metadata file not found: %s", metapath);
-                        response_packet_t response;
-                        memset(&response, 0, sizeof(response));
-                        response.magic = PROTOCOL_MAGIC;
+                    // Check metadata for write permissions
+                    int has_write_access = (auth == CLIENT_AUTH_VERIFIED) ? 1 :
+                                           ss_meta_check_access(filename, request.username, ACCESS_WRITE);
+                    if (has_write_access < 0) {
                         response.status = STATUS_ERROR_NOT_FOUND;
-                        snprintf(response.data, sizeof(response.data), 
+                        snprintf(response.data, sizeof(response.data),
                                 "File metadata not found");
-                        response.checksum = calculate_checksum(&response, 
+                        response.checksum = calculate_checksum(&response,
+                                                               sizeof(response) - sizeof(uint32_t));
+                        send_response(sock, &response);
+                        break;
+                    }
+                    
+                    if (!has_write_access) {
+                        response.status = STATUS_ERROR_WRITE_PERMISSION;
+                        snprintf(response.data, sizeof(response.data),
+                                "Permission denied");
+                        response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
-                        close(sock);
-                        return NULL;
+                        LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' denied write access to '%s'",
+                                       request.username, filename);
+                        break;
                     }
                     
-                    // Parse metadata to check access permissions
-                    int has_access = 0;
-                    char owner[MAX_USERNAME_LEN] = "";
-                    char line[512];
+                    // Try to acquire lock
+                    // Phase 7: "WRITE <file> <sentence> <seconds>" queues for
+                    // a busy lock for up to that long instead of failing at once,
+                    // and "<sentence>:<first>-<last>" locks only those words
+                    char target_arg[32] = "";
+                    int wait_seconds = 0;
+                    int first_word = 0;
+                    int last_word = SS_LOCK_LAST_WORD;
+                    sscanf(request.args, "%*s %31s %d", target_arg, &wait_seconds);
+                    if (strchr(target_arg, ':') != NULL &&
+                        (sscanf(target_arg, "%*d:%d-%d", &first_word, &last_word) != 2 ||
+                         first_word < 0 || last_word < first_word)) {
+                        response.status = STATUS_ERROR_INVALID_ARGS;
+                        snprintf(response.data, sizeof(response.data),
+                                "Invalid word range '%s' (use <sentence>:<first>-<last>)", target_arg);
+                        response.checksum = calculate_checksum(&response,
+                                                               sizeof(response) - sizeof(uint32_t));
+                        send_response(sock, &response);
+                        break;
+                    }
+                    int ranged = last_word != SS_LOCK_LAST_WORD;
                     
-                    while (fgets(line, sizeof(line), meta_fp) != NULL) {
-                        if (strncmp(line, "owner=", 6) == 0) {
-                            sscanf(line + 6, "%s", owner);
-                            if (strcmp(owner, request.username) == 0) {
-                                has_access = 1;
-                            }
-                        } else if (strstr(line, "access_") == line) {
-                            // Parse ACL entry: access_N=user:PERM
-                            char acl_user[MAX_USERNAME_LEN];
-                            char perms[8];
-                            if (sscanf(line, "access_%*d=%[^:]:%s", acl_user, perms) == 2) {
-                                if (strcmp(acl_user, request.username) == 0) {
-                                    // Check if user has read permission
-                                    if (strchr(perms, 'R') != NULL) {
-                                        has_access = 1;
-                                    }
-                                }
-                            }
+                    // Phase 7: A stale version fails before waiting for the lock
+                    if (conditional) {
+                        cached_doc_t* current = doc_cache_acquire(filename);
+                        uint32_t current_version = (current != NULL) ? current->version : 0;
+                        doc_cache_release(current);
+                        if (current != NULL && current_version != if_version) {
+                            reply_version_mismatch(sock, filename, current_version, if_version);
+                            break;
                         }
                     }
-                    fclose(meta_fp);
                     
-                    if (!has_access) {
-                        LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' denied read access to '%s'",
-                                       request.username, filename);
-                        response_packet_t response;
-                        memset(&response, 0, sizeof(response));
-                        response.magic = PROTOCOL_MAGIC;
-                        response.status = STATUS_ERROR_READ_PERMISSION;
-                        snprintf(response.data, sizeof(response.data), 
-                                "Permission denied");
-                        response.checksum = calculate_checksum(&response, 
+                    if (!acquire_lock(filename, sentence_num, first_word, last_word,
+                                      request.username, wait_seconds)) {
+                        response.status = STATUS_ERROR_LOCKED;
+                        if (ranged) {
+                            snprintf(response.data, sizeof(response.data),
+                                    "Words %d-%d of sentence %d are locked by another user",
+                                    first_word, last_word, sentence_num);
+                        } else {
+                            snprintf(response.data, sizeof(response.data),
+                                    "Sentence %d is locked by another user", sentence_num); // Show 0-based to user
+                        }
+                        response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
-                        close(sock);
-                        return NULL;
+                        LOG_WARNING_MSG("STORAGE_SERVER", "Lock denied for '%s' sentence %d",
+                                       filename, sentence_num);
+                        break;
                     }
                     
-                    // Open and read the file
-                    FILE* fp = fopen(filepath, "r");
-                    if (fp == NULL) {
-                        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to open file: %s", filepath);
-                        response_packet_t response;
-                        memset(&response, 0, sizeof(response));
-                        response.magic = PROTOCOL_MAGIC;
+                    // Phase 7: Copy only the locked sentence; the rest of the file
+                    // is taken as it stands at ETIRW, so other writers' commits survive
+                    cached_doc_t* doc = doc_cache_acquire(filename);
+                    if (doc == NULL) {
+                        release_lock(filename, sentence_num, first_word, last_word, request.username);
                         response.status = STATUS_ERROR_NOT_FOUND;
-                        snprintf(response.data, sizeof(response.data), 
+                        snprintf(response.data, sizeof(response.data),
                                 "File not found");
-                        response.checksum = calculate_checksum(&response, 
+                        response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
-                        close(sock);
-                        return NULL;
+                        break;
                     }
                     
-                    // Send file content in chunks
-                    char buffer[4096];
-                    size_t bytes_read;
-                    
-                    LOG_INFO_MSG("STORAGE_SERVER", "Sending file '%s' to client", filename);
-                    
-                    while ((bytes_read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-                        ssize_t sent = send(sock, buffer, bytes_read, 0);
-                        if (sent < 0) {
-                            LOG_ERROR_MSG("STORAGE_SERVER", "Failed to send data to client");
-                            break;
-                        }
+                    // ...or after it, if a commit got in while we waited
+                    if (conditional && doc->version != if_version) {
+                        uint32_t current_version = doc->version;
+                        doc_cache_release(doc);
+                        release_lock(filename, sentence_num, first_word, last_word, request.username);
+                        reply_version_mismatch(sock, filename, current_version, if_version);
+                        break;
                     }
                     
-                    fclose(fp);
-                    close(sock);
-                    LOG_INFO_MSG("STORAGE_SERVER", "Finished sending file '%s'", filename);
-                    return NULL;
-                }
-                break;
-                
-            case CMD_WRITE:
-                // Phase 5.3: Stateful WRITE handler with locking
-                LOG_INFO_MSG("STORAGE_SERVER", "Processing WRITE request: '%s' by user '%s'",
-                            request.args, request.username);
-                {
-                    
-                    response_packet_t response;
-                    memset(&response, 0, sizeof(response));
-                    response.magic = PROTOCOL_MAGIC;
-                    
-                    // Check if this is initial WRITE or word update
-                    char filename[MAX_FILENAME_LEN];
-                    int sentence_num = -1;
-                    int word_index = -1;
-                    char word_content[MAX_WORD_LEN];
+                    size_t file_size = doc->length;
+                    int sentence_count = doc->sentence_count;
                     
-                    // Try parsing as initial request (filename sentence_num)
-                    if (sscanf(request.args, "%s %d", filename, &sentence_num) == 2) {
-                        // This is initial WRITE request - acquire lock
-                        
-                        // Check if already have active session
-                        if (file_buffer != NULL) {
+                    // Validate sentence index before starting session
+                    if (file_size == 0) {
+                        // Empty file - only allow sentence 0
+                        if (sentence_num != 0) {
+                            doc_cache_release(doc);
+                            release_lock(filename, sentence_num, first_word, last_word, request.username);
                             response.status = STATUS_ERROR_INTERNAL;
                             snprintf(response.data, sizeof(response.data),
-                                    "Session already active for %s", session_filename);
+                                    "Invalid sentence index %d (empty file, use sentence 0)", sentence_num);
                             response.checksum = calculate_checksum(&response,
                                                                    sizeof(response) - sizeof(uint32_t));
                             send_response(sock, &response);
                             break;
                         }
-                        
-                        // Build file paths
-                        char filepath[MAX_PATH_LEN];
-                        char metapath[MAX_PATH_LEN];
-                        snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-                        snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
-                        
-                        // Check metadata for write permissions
-                        FILE* meta_fp = fopen(metapath, "r");
-                        if (meta_fp == NULL) {
-                            response.status = STATUS_ERROR_NOT_FOUND;
-                            snprintf(response.data, sizeof(response.data),
-                                    "File metadata not found");
+                    } else {
+                        // Check if sentence index is valid (allow 0 to n for n sentences)
+                        if (sentence_num < 0 || sentence_num > sentence_count) {
+                            doc_cache_release(doc);
+                            release_lock(filename, sentence_num, first_word, last_word, request.username);
+                            response.status = STATUS_ERROR_INTERNAL;
+                            if (sentence_count == 0) {
+                                snprintf(response.data, sizeof(response.data),
+                                        "Invalid sentence index %d (file is empty, use sentence 0)", sentence_num);
+                            } else {
+                                snprintf(response.data, sizeof(response.data),
+                                        "Invalid sentence index %d (valid range: 0-%d to edit existing, %d to append new sentence)", 
+                                        sentence_num, sentence_count - 1, sentence_count);
+                            }
                             response.checksum = calculate_checksum(&response,
                                                                    sizeof(response) - sizeof(uint32_t));
                             send_response(sock, &response);
                             break;
                         }
-                        
-                        int has_write_access = 0;
-                        char owner[MAX_USERNAME_LEN] = "";
-                        char line[512];
-                        
-                        while (fgets(line, sizeof(line), meta_fp) != NULL) {
-                            if (strncmp(line, "owner=", 6) == 0) {
-                                sscanf(line + 6, "%s", owner);
-                                if (strcmp(owner, request.username) == 0) {
-                                    has_write_access = 1;
-                                }
-                            } else if (strstr(line, "access_") == line) {
-                                char acl_user[MAX_USERNAME_LEN];
-                                char perms[8];
-                                if (sscanf(line, "access_%*d=%[^:]:%s", acl_user, perms) == 2) {
-                                    if (strcmp(acl_user, request.username) == 0) {
-                                        if (strchr(perms, 'W') != NULL) {
-                                            has_write_access = 1;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                        fclose(meta_fp);
-                        
-                        if (!has_write_access) {
-                            response.status = STATUS_ERROR_WRITE_PERMISSION;
-                            snprintf(response.data, sizeof(response.data),
-                                    "Permission denied");
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' denied write access to '%s'",
-                                           request.username, filename);
-                            break;
-                        }
-                        
-                        // Try to acquire lock
-                        if (!acquire_lock(filename, sentence_num, request.username)) {
-                            response.status = STATUS_ERROR_LOCKED;
-                            snprintf(response.data, sizeof(response.data),
-                                    "Sentence %d is locked by another user", sentence_num); // Show 0-based to user
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            LOG_WARNING_MSG("STORAGE_SERVER", "Lock denied for '%s' sentence %d",
-                                           filename, sentence_num);
-                            break;
-                        }
-                        
-                        // Load file into memory
-                        FILE* fp = fopen(filepath, "r");
-                        if (fp == NULL) {
-                            release_lock(filename, sentence_num, request.username);
-                            response.status = STATUS_ERROR_NOT_FOUND;
-                            snprintf(response.data, sizeof(response.data),
-                                    "File not found");
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            break;
-                        }
-                        
-                        // Get file size
-                        fseek(fp, 0, SEEK_END);
-                        long file_size = ftell(fp);
-                        fseek(fp, 0, SEEK_SET);
-                        
-                        // Allocate buffer and read file
-                        file_buffer_size = file_size + 1;
-                        file_buffer = (char*)malloc(file_buffer_size);
-                        if (file_buffer == NULL) {
-                            fclose(fp);
-                            release_lock(filename, sentence_num, request.username);
-                            response.status = STATUS_ERROR_INTERNAL;
-                            snprintf(response.data, sizeof(response.data),
-                                    "Memory allocation failed");
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            break;
-                        }
-                        
-                        size_t bytes_read = fread(file_buffer, 1, file_size, fp);
-                        file_buffer[bytes_read] = '\0';
-                        fclose(fp);
-                        
-                        // Validate sentence index before starting session
-                        file_content_t validation_content;
-                        if (file_size == 0) {
-                            // Empty file - only allow sentence 0
-                            if (sentence_num != 0) {
-                                free(file_buffer);
-                                file_buffer = NULL;
-                                release_lock(filename, sentence_num, request.username);
-                                response.status = STATUS_ERROR_INTERNAL;
-                                snprintf(response.data, sizeof(response.data),
-                                        "Invalid sentence index %d (empty file, use sentence 0)", sentence_num);
-                                response.checksum = calculate_checksum(&response,
-                                                                       sizeof(response) - sizeof(uint32_t));
-                                send_response(sock, &response);
-                                break;
-                            }
-                            // Initialize empty content for empty file
-                            strcpy(file_buffer, "");
-                        } else {
-                            // Non-empty file - parse and validate sentence exists
-                            if (parse_file_into_sentences(file_buffer, &validation_content) != 0) {
-                                free(file_buffer);
-                                file_buffer = NULL;
-                                release_lock(filename, sentence_num, request.username);
-                                response.status = STATUS_ERROR_INTERNAL;
-                                snprintf(response.data, sizeof(response.data),
-                                        "Failed to parse file content");
-                                response.checksum = calculate_checksum(&response,
-                                                                       sizeof(response) - sizeof(uint32_t));
-                                send_response(sock, &response);
-                                break;
-                            }
-                            
-                            // Check if sentence index is valid (allow 0 to n for n sentences)
-                            if (sentence_num < 0 || sentence_num > validation_content.sentence_count) {
-                                free(file_buffer);
-                                file_buffer = NULL;
-                                release_lock(filename, sentence_num, request.username);
-                                response.status = STATUS_ERROR_INTERNAL;
-                                if (validation_content.sentence_count == 0) {
-                                    snprintf(response.data, sizeof(response.data),
-                                            "Invalid sentence index %d (file is empty, use sentence 0)", sentence_num);
-                                } else {
-                                    snprintf(response.data, sizeof(response.data),
-                                            "Invalid sentence index %d (valid range: 0-%d to edit existing, %d to append new sentence)", 
-                                            sentence_num, validation_content.sentence_count - 1, validation_content.sentence_count);
-                                }
-                                response.checksum = calculate_checksum(&response,
-                                                                       sizeof(response) - sizeof(uint32_t));
-                                send_response(sock, &response);
-                                break;
-                            }
-                        }
-                        
-                        // Store session info
-                        strncpy(session_filename, filename, MAX_FILENAME_LEN - 1);
-                        session_sentence = sentence_num;
-                        strncpy(session_user, request.username, MAX_USERNAME_LEN - 1);
-                        
-                        // Send success response
-                        response.status = STATUS_OK;
+                    }
+                    
+                    // Phase 7: A word range must lie inside an existing sentence
+                    if (ranged && (sentence_num >= sentence_count ||
+                                   last_word >= doc->sentences[sentence_num].word_count)) {
+                        int words = sentence_num < sentence_count ?
+                                    doc->sentences[sentence_num].word_count : 0;
+                        doc_cache_release(doc);
+                        release_lock(filename, sentence_num, first_word, last_word, request.username);
+                        response.status = STATUS_ERROR_WORD_OUT_OF_RANGE;
                         snprintf(response.data, sizeof(response.data),
-                                "Lock acquired for sentence %d", sentence_num); // Show 0-based to user
+                                "Invalid word range %d-%d (sentence %d has %d words)",
+                                first_word, last_word, sentence_num, words);
                         response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
-                        
-                        LOG_INFO_MSG("STORAGE_SERVER", "WRITE session started: '%s' sentence %d by '%s'",
-                                    filename, sentence_num, request.username);
-                        
-                    } else if (sscanf(request.args, "%d %s", &word_index, word_content) == 2) {
-                        // This is word update request
-                        
-                        if (file_buffer == NULL) {
-                            response.status = STATUS_ERROR_INTERNAL;
-                            snprintf(response.data, sizeof(response.data),
-                                    "No active WRITE session");
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            break;
-                        }
-                        
-                        // Parse file content into sentences
-                        file_content_t content;
-                        if (parse_file_into_sentences(file_buffer, &content) != 0) {
-                            response.status = STATUS_ERROR_INTERNAL;
-                            snprintf(response.data, sizeof(response.data),
-                                    "Failed to parse file content");
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            break;
-                        }
-                        
-                        // Handle empty files: if file is empty and trying to access sentence 0
-                        if (content.sentence_count == 0 && session_sentence == 0) {
-                            // Create first sentence for empty file
-                            content.sentence_count = 1;
-                            memset(&content.sentences[0], 0, sizeof(sentence_t));
-                            strcpy(content.sentences[0].content, ""); // Start with empty sentence
-                            content.sentences[0].word_count = 0;
-                        }
-                        
-                        // Handle appending new sentence: if session_sentence == content.sentence_count
-                        if (session_sentence == content.sentence_count) {
-                            // Create new sentence for appending
-                            if (content.sentence_count >= 1000) { // Max sentences check
-                                response.status = STATUS_ERROR_INTERNAL;
-                                snprintf(response.data, sizeof(response.data),
-                                        "Maximum number of sentences reached");
-                                response.checksum = calculate_checksum(&response,
-                                                                       sizeof(response) - sizeof(uint32_t));
-                                send_response(sock, &response);
-                                break;
-                            }
-                            content.sentence_count++;
-                            memset(&content.sentences[session_sentence], 0, sizeof(sentence_t));
-                            strcpy(content.sentences[session_sentence].content, ""); // Start with empty sentence
-                            content.sentences[session_sentence].word_count = 0;
-                        }
-                        
-                        // Sentence index already validated at session start
-                        
-                        // Replace the word in the locked sentence
-                        if (replace_word_at_position(&content.sentences[session_sentence], 
-                                                    word_index, word_content) != 0) {
-                            response.status = STATUS_ERROR_INTERNAL;
-                            snprintf(response.data, sizeof(response.data),
-                                    "Failed to replace word at position %d", word_index); // Show 0-based to user
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            break;
-                        }
-                        
-                        // Serialize back to buffer
-                        char new_buffer[MAX_CONTENT_LEN];
-                        if (serialize_sentences_to_content(&content, new_buffer, 
-                                                          sizeof(new_buffer)) != 0) {
-                            response.status = STATUS_ERROR_INTERNAL;
-                            snprintf(response.data, sizeof(response.data),
-                                    "Failed to serialize content");
-                            response.checksum = calculate_checksum(&response,
-                                                                   sizeof(response) - sizeof(uint32_t));
-                            send_response(sock, &response);
-                            break;
-                        }
-                        
-                        // Check if we need to realloc file_buffer
-                        size_t new_size = strlen(new_buffer) + 1;
-                        if (new_size > file_buffer_size) {
-                            char* new_ptr = realloc(file_buffer, new_size);
-                            if (new_ptr == NULL) {
-                                response.status = STATUS_ERROR_INTERNAL;
-                                snprintf(response.data, sizeof(response.data),
-                                        "Memory allocation failed");
-                                response.checksum = calculate_checksum(&response,
-                                                                       sizeof(response) - sizeof(uint32_t));
-                                send_response(sock, &response);
-                                break;
-                            }
-                            file_buffer = new_ptr;
-                            file_buffer_size = new_size;
+                        break;
+                    }
+                    
+                    int load_failed = 0;
+                    session->document = calloc(1, sizeof(file_content_t));
+                    if (session->document == NULL) {
+                        load_failed = 1;
+                    } else if (sentence_num < sentence_count) {
+                        const doc_sentence_t* span = &doc->sentences[sentence_num];
+                        session->base_sentence = malloc(span->length + 1);
+                        if (session->base_sentence == NULL) {
+                            load_failed = 1;
+                        } else {
+                            memcpy(session->base_sentence, doc->content + span->offset, span->length);
+                            session->base_sentence[span->length] = '\0';
+                            session->base_length = span->length;
+                            session->base_words = span->word_count;
+                            load_failed = insert_sentence(session->document, 0,
+                                                          session->base_sentence) != 0;
                         }
-                        
-                        // Update the file buffer with new content
-                        strcpy(file_buffer, new_buffer);
-                        
-                        response.status = STATUS_OK;
+                    }
+                    doc_cache_release(doc);
+                    
+                    if (load_failed) {
+                        free_session_document(session);
+                        release_lock(filename, sentence_num, first_word, last_word, request.username);
+                        response.status = STATUS_ERROR_INTERNAL;
                         snprintf(response.data, sizeof(response.data),
-                                "Word %d updated to '%s'", word_index, word_content); // Show 0-based to user
+                                "Failed to load sentence %d", sentence_num);
                         response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
-                        
-                        LOG_INFO_MSG("STORAGE_SERVER", "Word %d updated in '%s'",
-                                    word_index, session_filename);
-                        
-                    } else {
-                        response.status = STATUS_ERROR_INVALID_OPERATION;
+                        break;
+                    }
+                    
+                    // Store session info
+                    strncpy(session->filename, filename, MAX_FILENAME_LEN - 1);
+                    session->sentence = sentence_num;
+                    session->first_word = first_word;
+                    session->last_word = last_word;
+                    strncpy(session->user, request.username, MAX_USERNAME_LEN - 1);
+                    session->expected_version = conditional ? (int64_t)if_version : -1;
+                    
+                    // Phase 7: Pick up the word updates of a session this user
+                    // had open when the server stopped, else log a new one
+                    int resumed = ss_wal_resume(filename, sentence_num, first_word, last_word,
+                                                request.username, session->base_sentence,
+                                                session->base_length, replay_session_word,
+                                                session, &session->wal_id);
+                    if (resumed < 0) {
+                        free_session_document(session);
+                        release_lock(filename, sentence_num, first_word, last_word, request.username);
+                        response.status = STATUS_ERROR_INTERNAL;
                         snprintf(response.data, sizeof(response.data),
-                                "Invalid WRITE args format");
+                                "Failed to resume unsaved edits of sentence %d", sentence_num);
                         response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
+                        break;
                     }
-                }
-                break;
-                
-            case CMD_ETIRW:
-                // Phase 5.3: Finalize WRITE session
-                LOG_INFO_MSG("STORAGE_SERVER", "Processing ETIRW request");
-                {
-                    response_packet_t response;
-                    memset(&response, 0, sizeof(response));
-                    response.magic = PROTOCOL_MAGIC;
+                    if (session->wal_id == 0) {
+                        session->wal_id = ss_wal_begin(filename, sentence_num, first_word, last_word,
+                                                       request.username, session->base_sentence,
+                                                       session->base_length);
+                    }
+                    
+                    // Send success response
+                    response.status = STATUS_OK;
+                    if (ranged) {
+                        snprintf(response.data, sizeof(response.data),
+                                "Lock acquired for words %d-%d of sentence %d",
+                                first_word, last_word, sentence_num);
+                    } else {
+                        snprintf(response.data, sizeof(response.data),
+                                "Lock acquired for sentence %d", sentence_num); // Show 0-based to user
+                    }
+                    if (resumed > 0) {
+                        size_t used = strlen(response.data);
+                        snprintf(response.data + used, sizeof(response.data) - used,
+                                "; resumed %d unsaved word updates", resumed);
+                    }
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    
+                    LOG_INFO_MSG("STORAGE_SERVER", "WRITE session started: '%s' sentence %d by '%s'",
+                                filename, sentence_num, request.username);
+                    
+                } else if (sscanf(request.args, "%d %s", &word_index, word_content) == 2) {
+                    // This is word update request
                     
-                    if (file_buffer == NULL) {
+                    if (session->document == NULL) {
                         response.status = STATUS_ERROR_INTERNAL;
                         snprintf(response.data, sizeof(response.data),
                                 "No active WRITE session");
@@ -922,226 +1092,801 @@ void* client_connection_thread(void* arg) {
                         break;
                     }
                     
-                    // Build file paths
-                    char filepath[MAX_PATH_LEN];
-                    char backup_path[MAX_PATH_LEN];
-                    snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, session_filename);
-                    snprintf(backup_path, sizeof(backup_path), "%s/%s.bak", storage_path, session_filename);
-                    
-                    // Create backup
-                    if (rename(filepath, backup_path) != 0) {
-                        response.status = STATUS_ERROR_INTERNAL;
+                    // Phase 7: Every word update renews the session's lock lease
+                    if (!renew_lock(session->filename, session->sentence, session->first_word,
+                                    session->last_word, session->user)) {
+                        response.status = STATUS_ERROR_TIMEOUT;
                         snprintf(response.data, sizeof(response.data),
-                                "Failed to create backup: %s", strerror(errno));
+                                "Lock on sentence %d expired and was taken over", session->sentence);
                         response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
-                        LOG_ERROR_MSG("STORAGE_SERVER", "Backup creation failed for '%s'",
-                                     session_filename);
+                        free_session_document(session);
+                        session->filename[0] = '\0';
+                        session->sentence = -1;
+                        session->user[0] = '\0';
                         break;
                     }
                     
-                    // Write buffer to file
-                    FILE* fp = fopen(filepath, "w");
-                    if (fp == NULL) {
-                        // Restore from backup
-                        rename(backup_path, filepath);
-                        response.status = STATUS_ERROR_INTERNAL;
+                    // Sentence index already validated at session start
+                    
+                    // Phase 7: A range session edits only its words; words it
+                    // inserted so far widen the range
+                    sentence_t* target = get_sentence(session->document, 0);
+                    if (target != NULL && session->last_word != SS_LOCK_LAST_WORD &&
+                        (word_index < session->first_word ||
+                         word_index > session->last_word + 1 +
+                                      (target->word_count - session->base_words))) {
+                        response.status = STATUS_ERROR_WORD_OUT_OF_RANGE;
                         snprintf(response.data, sizeof(response.data),
-                                "Failed to open file for writing");
+                                "Word %d is outside the locked words %d-%d", word_index,
+                                session->first_word,
+                                session->last_word + (target->word_count - session->base_words));
                         response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
                         break;
                     }
                     
-                    size_t written = fwrite(file_buffer, 1, strlen(file_buffer), fp);
-                    fclose(fp);
-                    
-                    if (written != strlen(file_buffer)) {
-                        // Restore from backup
-                        rename(backup_path, filepath);
+                    // Replace the word in the locked sentence, in place
+                    if (apply_session_word(session, word_index, word_content) != 0) {
                         response.status = STATUS_ERROR_INTERNAL;
-                        snprintf(response.data, sizeof(response.data),
-                                "Failed to write file completely");
+                        if (errno == ENOMEM) {
+                            snprintf(response.data, sizeof(response.data),
+                                    "Memory allocation failed");
+                        } else {
+                            snprintf(response.data, sizeof(response.data),
+                                    "Failed to replace word at position %d", word_index); // Show 0-based to user
+                        }
                         response.checksum = calculate_checksum(&response,
                                                                sizeof(response) - sizeof(uint32_t));
                         send_response(sock, &response);
                         break;
                     }
                     
-                    // Release lock
-                    release_lock(session_filename, session_sentence, session_user);
-                    
-                    // Update file metadata after modification
-                    char metapath[MAX_PATH_LEN];
-                    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, session_filename);
-                    
-                    // Calculate new file statistics
-                    int word_count = 0, char_count = 0;
-                    size_t file_size = 0;
-                    calculate_file_stats(filepath, &word_count, &char_count, &file_size);
-                    
-                    // Update metadata file
-                    update_metadata_stats(metapath, word_count, char_count, file_size, request.username);
-                    
-                    // Free buffer and reset session
-                    free(file_buffer);
-                    file_buffer = NULL;
-                    session_filename[0] = '\0';
-                    session_sentence = -1;
-                    session_user[0] = '\0';
+                    // Phase 7: Logged before the reply; the flusher syncs it
+                    ss_wal_edit(session->wal_id, word_index, word_content);
                     
-                    // Send success response
                     response.status = STATUS_OK;
                     snprintf(response.data, sizeof(response.data),
-                            "File saved successfully");
+                            "Word %d updated to '%s'", word_index, word_content); // Show 0-based to user
                     response.checksum = calculate_checksum(&response,
                                                            sizeof(response) - sizeof(uint32_t));
                     send_response(sock, &response);
                     
-                    LOG_INFO_MSG("STORAGE_SERVER", "ETIRW completed for '%s'",
-                                filepath);
+                    LOG_INFO_MSG("STORAGE_SERVER", "Word %d updated in '%s'",
+                                word_index, session->filename);
                     
-                    // Close connection after ETIRW
-                    close(sock);
-                    return NULL;
+                } else {
+                    response.status = STATUS_ERROR_INVALID_OPERATION;
+                    snprintf(response.data, sizeof(response.data),
+                            "Invalid WRITE args format");
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
                 }
-                break;
+            }
+            break;
+            
+        case CMD_ETIRW:
+            // Phase 5.3: Finalize WRITE session
+            LOG_INFO_MSG("STORAGE_SERVER", "Processing ETIRW request");
+            {
+                response_packet_t response;
+                memset(&response, 0, sizeof(response));
+                response.magic = PROTOCOL_MAGIC;
                 
-            case CMD_STREAM:
-                // Phase 5.2: Stream file (same as READ, permissions checked from .meta)
-                LOG_INFO_MSG("STORAGE_SERVER", "Processing STREAM request for '%s' by user '%s'",
-                            request.args, request.username);
-                {
-                    char filename[MAX_FILENAME_LEN];
-                    sscanf(request.args, "%s", filename);
-                    
-                    // Build file paths
-                    char filepath[MAX_PATH_LEN];
-                    char metapath[MAX_PATH_LEN];
-                    snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-                    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
+                if (session->document == NULL) {
+                    response.status = STATUS_ERROR_INTERNAL;
+                    snprintf(response.data, sizeof(response.data),
+                            "No active WRITE session");
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    break;
+                }
+                
+                // Build file path
+                char filepath[MAX_PATH_LEN];
+                snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, session->filename);
+                
+                // Phase 7: A session whose lease lapsed may not commit
+                if (!renew_lock(session->filename, session->sentence, session->first_word,
+                                session->last_word, session->user)) {
+                    response.status = STATUS_ERROR_TIMEOUT;
+                    snprintf(response.data, sizeof(response.data),
+                            "Lock on sentence %d expired and was taken over", session->sentence);
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    free_session_document(session);
+                    session->filename[0] = '\0';
+                    session->sentence = -1;
+                    session->user[0] = '\0';
+                    break;
+                }
+                
+                // Phase 7: "ETIRW IFVERSION <v>" (or WRITE's) - commit only
+                // if no one else committed since the version the client read
+                uint32_t if_version = 0;
+                int64_t expected_version = session->expected_version;
+                if (extract_version_condition(request.args, &if_version) > 0) {
+                    expected_version = if_version;
+                }
+                
+                // Phase 7: Commits of a file queue here, so the sentence is
+                // merged into the version no other commit can replace meanwhile
+                // (which is also the revision log's base for this commit's delta)
+                pthread_mutex_t* commit_lock = commit_lock_for(session->filename);
+                pthread_mutex_lock(commit_lock);
+                cached_doc_t* previous = doc_cache_acquire(session->filename);
+                
+                if (previous != NULL && expected_version >= 0 &&
+                    previous->version != (uint32_t)expected_version) {
+                    uint32_t current_version = previous->version;
+                    doc_cache_release(previous);
+                    pthread_mutex_unlock(commit_lock);
+                    reply_version_mismatch(sock, session->filename, current_version,
+                                           (uint32_t)expected_version);
+                    LOG_WARNING_MSG("STORAGE_SERVER", "ETIRW of '%s' refused: version %u, expected %u",
+                                   session->filename, current_version, (uint32_t)expected_version);
                     
-                    // Check if .meta file exists and verify permissions
-                    FILE* meta_fp = fopen(metapath, "r");
-                    if (meta_fp == NULL) {
-                        LOG_ERROR_MSG("STORAGE_SERVER", "Metadata file not found: %s", metapath);
-                        response_packet_t response;
-                        memset(&response, 0, sizeof(response));
-                        response.magic = PROTOCOL_MAGIC;
-                        response.status = STATUS_ERROR_NOT_FOUND;
-                        snprintf(response.data, sizeof(response.data), 
-                                "File metadata not found");
-                        response.checksum = calculate_checksum(&response, 
-                                                               sizeof(response) - sizeof(uint32_t));
-                        send_response(sock, &response);
-                        close(sock);
-                        return NULL;
+                    // The edit was conditional on a version that is gone; end the session
+                    release_lock(session->filename, session->sentence, session->first_word,
+                                 session->last_word, session->user);
+                    ss_wal_end(session->wal_id, 0);
+                    session->wal_id = 0;
+                    free_session_document(session);
+                    session->filename[0] = '\0';
+                    session->sentence = -1;
+                    session->user[0] = '\0';
+                    break;
+                }
+                
+                char* file_buffer = NULL;
+                size_t content_length = 0;
+                int word_count = 0;
+                if (merge_session_sentence(session, previous, &file_buffer, &content_length,
+                                           &word_count) != 0) {
+                    int stale = (errno == ESTALE || errno == ENOENT);
+                    doc_cache_release(previous);
+                    pthread_mutex_unlock(commit_lock);
+                    response.status = stale ? STATUS_ERROR_CONCURRENT_WRITE : STATUS_ERROR_INTERNAL;
+                    snprintf(response.data, sizeof(response.data), !stale ?
+                            "Failed to merge sentence %d" :
+                            session->last_word != SS_LOCK_LAST_WORD ?
+                            "The locked words of sentence %d were changed by another writer" :
+                            "Sentence %d no longer exists in the file", session->sentence);
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    LOG_WARNING_MSG("STORAGE_SERVER", "ETIRW of '%s' sentence %d could not be merged",
+                                   session->filename, session->sentence);
+                    if (stale) {
+                        // The edit can never apply; end the session
+                        release_lock(session->filename, session->sentence, session->first_word,
+                                     session->last_word, session->user);
+                        free_session_document(session);
+                        session->filename[0] = '\0';
+                        session->sentence = -1;
+                        session->user[0] = '\0';
                     }
+                    break;
+                }
+                
+                // Phase 7: Early ack - the log holds the commit and the
+                // materializer writes the file and records the revision
+                // (the buffer goes to the cache)
+                int revision = -1;
+                uint32_t version = previous->version + 1;
+                if (early_ack_commits &&
+                    log_early_commit(session, previous, file_buffer, content_length, version,
+                                     request.username) == 0) {
+                    doc_cache_release(previous);
+                    pthread_mutex_unlock(commit_lock);
                     
-                    // Parse metadata to check access permissions
-                    int has_access = 0;
-                    char owner[MAX_USERNAME_LEN] = "";
-                    char line[512];
-                    
-                    while (fgets(line, sizeof(line), meta_fp) != NULL) {
-                        if (strncmp(line, "owner=", 6) == 0) {
-                            sscanf(line + 6, "%s", owner);
-                            if (strcmp(owner, request.username) == 0) {
-                                has_access = 1;
-                            }
-                        } else if (strstr(line, "access_") == line) {
-                            // Parse ACL entry: access_N=user:PERM
-                            char acl_user[MAX_USERNAME_LEN];
-                            char perms[8];
-                            if (sscanf(line, "access_%*d=%[^:]:%s", acl_user, perms) == 2) {
-                                if (strcmp(acl_user, request.username) == 0) {
-                                    // Check if user has read permission
-                                    if (strchr(perms, 'R') != NULL) {
-                                        has_access = 1;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    fclose(meta_fp);
+                    release_lock(session->filename, session->sentence, session->first_word,
+                                 session->last_word, session->user);
+                    ss_wal_end(session->wal_id, 1);
+                    session->wal_id = 0;
+                    LOG_INFO_MSG("STORAGE_SERVER", "ETIRW of '%s' acknowledged from the edit log",
+                                session->filename);
                     
-                    if (!has_access) {
-                        LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' denied stream access to '%s'",
-                                       request.username, filename);
-                        response_packet_t response;
-                        memset(&response, 0, sizeof(response));
-                        response.magic = PROTOCOL_MAGIC;
-                        response.status = STATUS_ERROR_READ_PERMISSION;
-                        snprintf(response.data, sizeof(response.data), 
-                                "Permission denied");
-                        response.checksum = calculate_checksum(&response, 
-                                                               sizeof(response) - sizeof(uint32_t));
-                        send_response(sock, &response);
-                        close(sock);
-                        return NULL;
-                    }
+                    free_session_document(session);
+                    session->filename[0] = '\0';
+                    session->sentence = -1;
+                    session->user[0] = '\0';
                     
-                    // Open and stream the file
-                    FILE* fp = fopen(filepath, "r");
-                    if (fp == NULL) {
-                        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to open file: %s", filepath);
-                        response_packet_t response;
-                        memset(&response, 0, sizeof(response));
-                        response.magic = PROTOCOL_MAGIC;
-                        response.status = STATUS_ERROR_NOT_FOUND;
-                        snprintf(response.data, sizeof(response.data), 
-                                "File not found");
-                        response.checksum = calculate_checksum(&response, 
-                                                               sizeof(response) - sizeof(uint32_t));
-                        send_response(sock, &response);
-                        close(sock);
-                        return NULL;
+                    // The revision number is only known once it is recorded
+                    response.status = STATUS_OK;
+                    snprintf(response.data, sizeof(response.data),
+                            "File saved successfully (version %u)", version);
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                // Phase 7: Crash-safe replace, with the new version in the
+                // .meta. History lives in the revision log, so no .bak is
+                // kept; early-acked versions still queued go first.
+                ss_materializer_drain(session->filename);
+                const char* failed_step = NULL;
+                int commit_result = commit_document_file(session->filename, file_buffer,
+                                                         content_length, version, &failed_step);
+                if (commit_result == 0) {
+                    revision = ss_revlog_append(session->filename,
+                                                previous->content, previous->length,
+                                                file_buffer, content_length, 0);
+                    // Update the cached metadata (written to .meta in the
+                    // background). File statistics come from the merge: the
+                    // current document's totals with the locked sentence's
+                    // swapped for the edited one. Recorded before the commit
+                    // lock is released so the next commit's version follows it.
+                    ss_meta_record_commit(session->filename, word_count, (int)content_length,
+                                          content_length, request.username, version);
+                    // Phase 7: Swap in the new version; readers holding the
+                    // old one finish with it
+                    if (publish_committed(session->filename, file_buffer, content_length,
+                                          version)) {
+                        file_buffer = NULL;
                     }
-                    
-                    // Send file content in chunks (same as READ)
-                    char buffer[4096];
-                    size_t bytes_read;
-                    
-                    LOG_INFO_MSG("STORAGE_SERVER", "Streaming file '%s' to client", filename);
-                    
-                    while ((bytes_read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-                        ssize_t sent = send(sock, buffer, bytes_read, 0);
-                        if (sent < 0) {
-                            LOG_ERROR_MSG("STORAGE_SERVER", "Failed to send data to client");
-                            break;
-                        }
+                }
+                doc_cache_release(previous);
+                pthread_mutex_unlock(commit_lock);
+                free(file_buffer);
+                
+                if (commit_result != 0) {
+                    response.status = STATUS_ERROR_INTERNAL;
+                    if (strcmp(failed_step, "backup") == 0) {
+                        snprintf(response.data, sizeof(response.data),
+                                "Failed to create backup: %s", strerror(errno));
+                    } else if (strcmp(failed_step, "metadata") == 0) {
+                        snprintf(response.data, sizeof(response.data),
+                                "Failed to record version %u: %s", version, strerror(errno));
+                    } else {
+                        snprintf(response.data, sizeof(response.data),
+                                "Failed to write file completely: %s", strerror(errno));
                     }
-                    
-                    fclose(fp);
-                    close(sock);
+                    response.checksum = calculate_checksum(&response,
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    LOG_ERROR_MSG("STORAGE_SERVER", "Commit of '%s' failed (%s step)",
+                                 session->filename, failed_step);
+                    break;
+                }
+                
+                // Release lock
+                release_lock(session->filename, session->sentence, session->first_word,
+                             session->last_word, session->user);
+                ss_wal_end(session->wal_id, 1);
+                session->wal_id = 0;
+                
+                // Free document and reset session
+                free_session_document(session);
+                session->filename[0] = '\0';
+                session->sentence = -1;
+                session->user[0] = '\0';
+                
+                // Send success response
+                response.status = STATUS_OK;
+                if (revision > 0) {
+                    snprintf(response.data, sizeof(response.data),
+                            "File saved successfully (revision %d, version %u)", revision, version);
+                } else {
+                    snprintf(response.data, sizeof(response.data),
+                            "File saved successfully (version %u)", version);
+                }
+                response.checksum = calculate_checksum(&response,
+                                                       sizeof(response) - sizeof(uint32_t));
+                send_response(sock, &response);
+                
+                LOG_INFO_MSG("STORAGE_SERVER", "ETIRW completed for '%s'",
+                            filepath);
+                
+                // Close connection after ETIRW
+                return 0;
+            }
+            break;
+            
+        case CMD_STREAM:
+            // Phase 5.2: Stream file (same as READ, permissions checked from metadata)
+            LOG_INFO_MSG("STORAGE_SERVER", "Processing STREAM request for '%s' by user '%s'",
+                        request.args, request.username);
+            {
+                char filename[MAX_FILENAME_LEN];
+                client_auth_t auth = authorize_client_request(sock, &request, NULL, ACCESS_READ);
+                if (auth == CLIENT_AUTH_REJECTED) {
+                    return 0;
+                }
+                sscanf(request.args, "%s", filename);
+                
+                // Build file path
+                char filepath[MAX_PATH_LEN];
+                snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
+                
+                // Phase 7: A verified capability skips the metadata cache lookup
+                int has_access = (auth == CLIENT_AUTH_VERIFIED) ? 1 :
+                                 ss_meta_check_access(filename, request.username, ACCESS_READ);
+                if (has_access < 0) {
+                    LOG_ERROR_MSG("STORAGE_SERVER", "Metadata file not found for '%s'", filename);
+                    response_packet_t response;
+                    memset(&response, 0, sizeof(response));
+                    response.magic = PROTOCOL_MAGIC;
+                    response.status = STATUS_ERROR_NOT_FOUND;
+                    snprintf(response.data, sizeof(response.data), 
+                            "File metadata not found");
+                    response.checksum = calculate_checksum(&response, 
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                if (!has_access) {
+                    LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' denied stream access to '%s'",
+                                   request.username, filename);
+                    response_packet_t response;
+                    memset(&response, 0, sizeof(response));
+                    response.magic = PROTOCOL_MAGIC;
+                    response.status = STATUS_ERROR_READ_PERMISSION;
+                    snprintf(response.data, sizeof(response.data), 
+                            "Permission denied");
+                    response.checksum = calculate_checksum(&response, 
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                // Open and stream the file
+                cached_doc_t* doc = doc_cache_acquire(filename);
+                if (doc == NULL) {
+                    LOG_ERROR_MSG("STORAGE_SERVER", "Failed to open file: %s", filepath);
+                    response_packet_t response;
+                    memset(&response, 0, sizeof(response));
+                    response.magic = PROTOCOL_MAGIC;
+                    response.status = STATUS_ERROR_NOT_FOUND;
+                    snprintf(response.data, sizeof(response.data), 
+                            "File not found");
+                    response.checksum = calculate_checksum(&response, 
+                                                           sizeof(response) - sizeof(uint32_t));
+                    send_response(sock, &response);
+                    return 0;
+                }
+                
+                // Send file content (same as READ)
+                LOG_INFO_MSG("STORAGE_SERVER", "Streaming file '%s' to client", filename);
+                
+                if (send_document(sock, request.request_id, doc) != 0) {
+                    log_send_failure(filename);
+                } else {
                     LOG_INFO_MSG("STORAGE_SERVER", "Finished streaming file '%s'", filename);
-                    return NULL;
                 }
-                break;
                 
-            default:
-                LOG_WARNING_MSG("STORAGE_SERVER", "Unknown command %d from client socket %d", 
-                               request.command, sock);
-                {
-                    response_packet_t error_response;
-                    memset(&error_response, 0, sizeof(error_response));
-                    error_response.magic = PROTOCOL_MAGIC;
-                    error_response.status = STATUS_ERROR_INVALID_OPERATION;
-                    snprintf(error_response.data, sizeof(error_response.data), 
-                            "Unknown command: %d", request.command);
-                    error_response.checksum = calculate_checksum(&error_response, 
-                                                                 sizeof(error_response) - sizeof(uint32_t));
-                    send_response(sock, &error_response);
+                doc_cache_release(doc);
+                return 0;
+            }
+            break;
+            
+        default:
+            LOG_WARNING_MSG("STORAGE_SERVER", "Unknown command %d from client socket %d", 
+                           request.command, sock);
+            {
+                response_packet_t error_response;
+                memset(&error_response, 0, sizeof(error_response));
+                error_response.magic = PROTOCOL_MAGIC;
+                error_response.status = STATUS_ERROR_INVALID_OPERATION;
+                snprintf(error_response.data, sizeof(error_response.data), 
+                        "Unknown command: %d", request.command);
+                error_response.checksum = calculate_checksum(&error_response, 
+                                                             sizeof(error_response) - sizeof(uint32_t));
+                send_response(sock, &error_response);
+            }
+            break;
+    }
+    
+    return 1;
+}
+
+// Phase 7: Pool task - serve one request, then hand the connection back
+void client_request_task(void* arg) {
+    client_session_t* session = (client_session_t*)arg;
+    
+    if (!serve_client_request(session) ||
+        arm_client_session(session, EPOLL_CTL_MOD) != 0) {
+        destroy_client_session(session);
+    }
+}
+
+/**
+ * client_reactor_thread - Wait for client requests and queue them
+ *
+ * Sessions are registered one-shot, so a connection is owned either by the
+ * reactor or by exactly one worker. If the queue is full the session is
+ * re-armed and picked up again on a later pass.
+ */
+void* client_reactor_thread(void* arg) {
+    (void)arg;
+    struct epoll_event events[CLIENT_REACTOR_BATCH];
+    
+    while (1) {
+        int ready = epoll_wait(client_epoll_fd, events, CLIENT_REACTOR_BATCH, -1);
+        if (ready == -1) {
+            if (errno != EINTR) {
+                LOG_ERROR_MSG("STORAGE_SERVER", "Client reactor epoll_wait failed: %s", strerror(errno));
+            }
+            continue;
+        }
+        
+        int deferred = 0;
+        for (int i = 0; i < ready; i++) {
+            client_session_t* session = (client_session_t*)events[i].data.ptr;
+            if (ss_thread_pool_submit(client_pool, client_request_task, session) != 0) {
+                if (arm_client_session(session, EPOLL_CTL_MOD) != 0) {
+                    destroy_client_session(session);
                 }
-                break;
+                deferred = 1;
+            }
+        }
+        
+        // Let the workers drain the queue before retrying deferred sessions
+        if (deferred) {
+            usleep(1000);
         }
     }
     
     return NULL;
 }
 
+// Create a session for a freshly accepted client and start watching it
+int add_client_session(int client_socket) {
+    client_session_t* session = calloc(1, sizeof(client_session_t));
+    if (session == NULL) {
+        return -1;
+    }
+    session->sock = client_socket;
+    session->sentence = -1;
+    
+    if (arm_client_session(session, EPOLL_CTL_ADD) != 0) {
+        free(session);
+        return -1;
+    }
+    return 0;
+}
+
+// (Re-)arm a session for its next request
+int arm_client_session(client_session_t* session, int op) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = session;
+    return epoll_ctl(client_epoll_fd, op, session->sock, &event);
+}
+
+// Close a client connection and drop any unfinished WRITE buffer
+void destroy_client_session(client_session_t* session) {
+    if (session->document != NULL) {
+        LOG_WARNING_MSG("STORAGE_SERVER", "Client left WRITE session on '%s' without ETIRW",
+                        session->filename);
+        // Phase 7: Its sentence lock goes to the next waiting writer
+        release_lock(session->filename, session->sentence, session->first_word,
+                     session->last_word, session->user);
+        free_session_document(session);
+    }
+    close(session->sock);
+    free(session);
+}
+
+// Drop a WRITE session's working copy of its sentence (and, unless it
+// was committed, log that its edits were abandoned)
+void free_session_document(client_session_t* session) {
+    ss_wal_end(session->wal_id, 0);
+    session->wal_id = 0;
+    free_file_content(session->document);
+    free(session->document);
+    session->document = NULL;
+    free(session->base_sentence);
+    session->base_sentence = NULL;
+    session->base_length = 0;
+}
+
+// Apply a word update to a WRITE session's sentence. Empty files and
+// appended sentences start from an empty sentence.
+// Returns 0, or -1 (errno ENOMEM when out of memory)
+int apply_session_word(client_session_t* session, int word_index, const char* word) {
+    file_content_t* content = session->document;
+    if (content->sentence_count == 0 && insert_sentence(content, 0, "") != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    sentence_t* target = get_sentence(content, 0);
+    errno = 0;
+    if (target == NULL || replace_word_at_position(target, word_index, word) != 0) {
+        return -1;
+    }
+    refresh_sentence_totals(content, 0);
+    return 0;
+}
+
+// Phase 7: Edit log replay of a resumed session's word updates
+int replay_session_word(void* ctx, int word_index, const char* word) {
+    return apply_session_word((client_session_t*)ctx, word_index, word);
+}
+
+// Phase 7: Splice a WRITE session's edited sentence into the document as it
+// stands now. The sentence is looked up at its locked index or, when commits
+// that split or added sentences moved it, at the nearest sentence that still
+// reads as it did at WRITE. An appended sentence goes after the current end.
+// A word range session replaces only its words, found as the nearest run
+// that still reads as the locked words did, so edits of other ranges of the
+// sentence survive.
+// Returns 0, or -1 with errno ENOENT/ESTALE (file, sentence or words gone)
+// or ENOMEM.
+int merge_session_sentence(const client_session_t* session, const cached_doc_t* current,
+                           char** merged, size_t* merged_length, int* word_count) {
+    if (current == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    
+    const char* text = "";
+    size_t text_length = 0;
+    int text_words = 0;
+    sentence_t* edited = get_sentence(session->document, 0);
+    if (edited != NULL) {
+        text = edited->content;
+        text_length = edited->length;
+        text_words = edited->word_count;
+    }
+    
+    // Bytes of the current document the sentence replaces
+    size_t replace_at = current->length;
+    size_t replace_length = 0;
+    int replaced_words = 0;
+    const char* separator = "";
+    
+    // A range session's locked words, as they read at WRITE
+    int ranged = session->last_word != SS_LOCK_LAST_WORD;
+    word_span_t* base_words = NULL;
+    int locked_words = 0;
+    if (ranged) {
+        int count = collect_word_spans(session->base_sentence, session->base_length, &base_words);
+        word_span_t* edited_words = NULL;
+        int edited_count = edited ? collect_word_spans(text, text_length, &edited_words) : 0;
+        int growth = edited_count - count;
+        if (count < 0 || edited_count < 0) {
+            free(base_words);
+            free(edited_words);
+            errno = ENOMEM;
+            return -1;
+        }
+        if (session->last_word >= count || session->last_word + growth >= edited_count) {
+            free(base_words);
+            free(edited_words);
+            errno = ESTALE;
+            return -1;
+        }
+        locked_words = session->last_word - session->first_word + 1;
+        
+        // The edited words replace the locked ones
+        const word_span_t* first = &edited_words[session->first_word];
+        const word_span_t* last = &edited_words[session->last_word + growth];
+        text += first->offset;
+        text_length = last->offset + last->length - first->offset;
+        text_words = locked_words + growth;
+        free(edited_words);
+    }
+    
+    if (session->base_sentence == NULL) {
+        if (current->length > 0 && text_length > 0) {
+            separator = " ";
+        }
+    } else {
+        int found = -1;
+        word_span_t run = {0, 0};
+        for (int distance = 0; found < 0 && distance < current->sentence_count; distance++) {
+            int candidates[2] = { session->sentence - distance, session->sentence + distance };
+            for (int i = 0; i < (distance ? 2 : 1) && found < 0; i++) {
+                int index = candidates[i];
+                if (index < 0 || index >= current->sentence_count) {
+                    continue;
+                }
+                const doc_sentence_t* span = &current->sentences[index];
+                if (ranged) {
+                    int matched = find_word_run(current->content + span->offset, span->length,
+                                                session->base_sentence,
+                                                base_words + session->first_word, locked_words,
+                                                session->first_word, &run);
+                    if (matched < 0) {
+                        free(base_words);
+                        errno = ENOMEM;
+                        return -1;
+                    }
+                    if (matched) {
+                        run.offset += span->offset;
+                        found = index;
+                    }
+                } else if (span->length == session->base_length &&
+                           memcmp(current->content + span->offset, session->base_sentence,
+                                  span->length) == 0) {
+                    run.offset = span->offset;
+                    run.length = span->length;
+                    found = index;
+                }
+            }
+        }
+        free(base_words);
+        if (found < 0) {
+            errno = ESTALE;
+            return -1;
+        }
+        replace_at = run.offset;
+        replace_length = run.length;
+        replaced_words = ranged ? locked_words : current->sentences[found].word_count;
+    }
+    
+    size_t separator_length = strlen(separator);
+    size_t length = current->length - replace_length + separator_length + text_length;
+    char* buffer = malloc(length + 1);
+    if (buffer == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    size_t tail = replace_at + replace_length;
+    memcpy(buffer, current->content, replace_at);
+    memcpy(buffer + replace_at, separator, separator_length);
+    memcpy(buffer + replace_at + separator_length, text, text_length);
+    memcpy(buffer + replace_at + separator_length + text_length,
+           current->content + tail, current->length - tail);
+    buffer[length] = '\0';
+    
+    *merged = buffer;
+    *merged_length = length;
+    *word_count = current->word_count - replaced_words + text_words;
+    return 0;
+}
+
+// Phase 7: The words of @text as spans, in a malloc'd array; returns their
+// number (@spans NULL when there are none) or -1 on allocation failure
+int collect_word_spans(const char* text, size_t length, word_span_t** spans) {
+    word_span_t* list = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t cursor = 0;
+    word_span_t word;
+    
+    while (next_word_span(text, length, &cursor, &word)) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            word_span_t* grown = realloc(list, capacity * sizeof(word_span_t));
+            if (grown == NULL) {
+                free(list);
+                return -1;
+            }
+            list = grown;
+        }
+        list[count++] = word;
+    }
+    
+    *spans = list;
+    return count;
+}
+
+// Phase 7: Find @count words of @pattern (given as spans into it) running
+// in @text, choosing the run that starts nearest word @near. Its bytes,
+// first word to last, go to @run.
+// Returns 1 if found, 0 if not, -1 on allocation failure
+int find_word_run(const char* text, size_t length, const char* pattern,
+                  const word_span_t* words, int count, int near, word_span_t* run) {
+    word_span_t* spans = NULL;
+    int total = collect_word_spans(text, length, &spans);
+    if (total < 0) {
+        return -1;
+    }
+    
+    int best = -1;
+    for (int start = 0; start + count <= total; start++) {
+        int matches = 1;
+        for (int i = 0; i < count && matches; i++) {
+            const word_span_t* have = &spans[start + i];
+            matches = have->length == words[i].length &&
+                      memcmp(text + have->offset, pattern + words[i].offset, have->length) == 0;
+        }
+        if (matches && (best < 0 || abs(start - near) < abs(best - near))) {
+            best = start;
+        }
+    }
+    
+    if (best >= 0) {
+        run->offset = spans[best].offset;
+        run->length = spans[best + count - 1].offset + spans[best + count - 1].length -
+                      spans[best].offset;
+    }
+    free(spans);
+    return best >= 0;
+}
+
+// Phase 7: Backpressure - answer a connection the pool has no room for
+void reject_busy_client(int client_socket) {
+    LOG_WARNING_MSG("STORAGE_SERVER", "Worker queue full, rejecting client socket %d", client_socket);
+    
+    // Drain whatever request already arrived so close() does not reset the
+    // connection before the client reads our reply
+    char discard[sizeof(request_packet_t)];
+    while (recv(client_socket, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+    
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    response.status = STATUS_ERROR_SERVER_BUSY;
+    snprintf(response.data, sizeof(response.data), "Storage server busy, try again shortly");
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_response(client_socket, &response);
+    close(client_socket);
+}
+
+// Phase 7: Send a cached document (READ and STREAM): a header frame with the
+// status and length, then the content. The bytes go from the file the cache
+// entry was loaded from straight to the socket with sendfile, in chunks the
+// size of the socket send buffer; memory is the fallback.
+int send_document(int sock, uint32_t request_id, const cached_doc_t* doc) {
+    if (send_content_header(sock, request_id, doc->length, doc->version) != 0) {
+        return -1;
+    }
+    
+    int sndbuf = 0;
+    socklen_t optlen = sizeof(sndbuf);
+    size_t chunk = SS_SENDFILE_CHUNK;
+    if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) == 0 && sndbuf > 0) {
+        chunk = (size_t)sndbuf;
+    }
+    
+    // Phase 7: An early-acked version gets its fd once the file is written
+    int fd = __atomic_load_n(&doc->fd, __ATOMIC_ACQUIRE);
+    off_t offset = 0;
+    while (fd >= 0 && (size_t)offset < doc->length) {
+        size_t want = doc->length - (size_t)offset;
+        ssize_t n = sendfile(sock, fd, &offset, want < chunk ? want : chunk);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            break;  // Not supported for this file; send the rest from memory
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;  // File shorter than the cached copy; should not happen
+        }
+    }
+    
+    size_t sent = (size_t)offset;
+    while (sent < doc->length) {
+        ssize_t n = send(sock, doc->content + sent, doc->length - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    return 0;
+}
+
+// Phase 7: A failed send_document; a client that hung up is no error
+void log_send_failure(const char* filename) {
+    if (errno == EPIPE || errno == ECONNRESET) {
+        LOG_INFO_MSG("STORAGE_SERVER", "Client disconnected while receiving '%s'", filename);
+    } else {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to send '%s' to client: %s", filename,
+                     strerror(errno));
+    }
+}
+
 void stream_file_to_client(int client_socket, const char* filename) {
     char filepath[MAX_PATH_LEN + 256]; // Extra space to prevent truncation
     int ret = snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
@@ -1203,6 +1948,12 @@ void discover_local_files() {
             discovered_files[discovered_file_count][MAX_FILENAME_LEN - 1] = '\0';
             discovered_file_count++;
             printf("Discovered file: %s\n", entry->d_name);
+            
+            // Phase 7: Parse its .meta once; requests use the cached copy
+            size_t name_len = strlen(entry->d_name);
+            if (name_len < 5 || strcmp(entry->d_name + name_len - 5, ".meta") != 0) {
+                ss_meta_load(entry->d_name);
+            }
         }
     }
     
@@ -1246,6 +1997,22 @@ void send_ss_init_packet() {
     }
     
     if (response.status == STATUS_OK) {
+        // Phase 7: Leases issued before this registration are no longer
+        // valid, and floors set by an earlier NM (whose registry versions
+        // may have started over since) no longer apply
+        uint32_t registration_floor = 0;
+        extract_lease_token(response.data, &registration_floor);
+        reset_lease_floors(registration_floor);
+        
+        // Phase 7: Key for verifying client capabilities
+        char* key_field = strstr(response.data, " key=");
+        if (key_field != NULL && decode_capability_key(key_field + 5, capability_key) == 0) {
+            has_capability_key = 1;
+            *key_field = '\0';
+        } else {
+            LOG_WARNING_MSG("STORAGE_SERVER", "No capability key from NM, checking metadata ACLs for every request");
+        }
+        
         printf("SS initialization successful: %s\n", response.data);
     } else {
         printf("SS initialization failed: %s\n", response.data);
@@ -1253,8 +2020,30 @@ void send_ss_init_packet() {
     }
 }
 
+// Phase 7: Signal handler - only async-signal-safe calls; the main loop
+// reads the signal number (0: NM connection lost) and runs cleanup_and_exit
+void request_shutdown(int signal) {
+    int saved_errno = errno;
+    unsigned char signal_number = (unsigned char)signal;
+    if (write(shutdown_pipe[1], &signal_number, 1) < 0) {
+        // Pipe full: a shutdown is already pending
+    }
+    errno = saved_errno;
+}
+
+// Flush state and exit (main loop only, never from a signal handler)
 void cleanup_and_exit(int signal) {
-    printf("\nReceived signal %d, shutting down gracefully...\n", signal);
+    if (signal == 0) {
+        printf("\nName Server connection lost, shutting down gracefully...\n");
+    } else {
+        printf("\nReceived signal %d, shutting down gracefully...\n", signal);
+    }
+    
+    // Phase 7: Open WRITE sessions resume from the edit log after a restart
+    // (and early-acked commits not yet written are written out then)
+    ss_materializer_drain_all();
+    ss_wal_flush();
+    ss_meta_flush();
     
     if (nm_socket != -1) {
         close(nm_socket);
@@ -1275,15 +2064,15 @@ void handle_create_request(request_packet_t* req) {
     memset(&response, 0, sizeof(response));
     response.magic = PROTOCOL_MAGIC;
     
-    // Extract filename from args
+    // Extract filename (and the NM's lease version) from args
+    uint32_t lease_version = 0;
+    int has_lease = extract_lease_token(req->args, &lease_version);
     char filename[MAX_FILENAME_LEN];
     sscanf(req->args, "%s", filename);
     
-    // Construct file paths
+    // Construct file path
     char filepath[MAX_PATH_LEN];
-    char metapath[MAX_PATH_LEN];
     snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
     
     // Check if file already exists
     if (access(filepath, F_OK) == 0) {
@@ -1297,40 +2086,44 @@ void handle_create_request(request_packet_t* req) {
         LOG_WARNING_MSG("RESPONSE", "To Name Server | Command: CREATE | Status: ERROR | File: %s | User: %s | Message: %s", 
                         filename, req->username, response.data);
         
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
     
     // Create empty file
-    FILE* fp = fopen(filepath, "w");
-    if (fp == NULL) {
+    if (ss_io_write_file(filepath, "", 0, 0) != 0) {
         LOG_ERROR_MSG("STORAGE_SERVER", "Failed to create file: %s (errno: %d - %s)", 
                      filepath, errno, strerror(errno));
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to create file: %s", strerror(errno));
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
-    fclose(fp);
+    doc_cache_invalidate(filename);
     
     LOG_INFO_MSG("STORAGE_SERVER", "Created file: %s", filepath);
     
-    // Create metadata file
-    if (create_file_metadata(filename, req->username) < 0) {
-        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to create metadata file: %s", metapath);
-        unlink(filepath);  // Rollback: delete the data file
+    // Phase 7: Create its metadata (the .meta is synced before the reply)
+    if (ss_meta_create(filename, req->username) < 0) {
+        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to create metadata for: %s", filename);
+        ss_meta_remove(filename);
+        ss_io_unlink(filepath);  // Rollback: delete the data file
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to create metadata file");
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
     
     LOG_INFO_MSG("STORAGE_SERVER", "Successfully created file and metadata: %s", filename);
     
+    if (has_lease) {
+        set_lease_floor(filename, lease_version);
+    }
+    
     // Send success response
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), 
@@ -1342,7 +2135,7 @@ void handle_create_request(request_packet_t* req) {
     LOG_INFO_MSG("RESPONSE", "To Name Server | Command: CREATE | Status: SUCCESS | File: %s | User: %s | Message: %s", 
                  filename, req->username, response.data);
     
-    send_response(nm_socket, &response);
+    send_nm_response(req, &response);
 }
 
 // Phase 3: Handle DELETE file request from Name Server
@@ -1360,88 +2153,83 @@ void handle_delete_request(request_packet_t* req) {
     
     // Construct file paths
     char filepath[MAX_PATH_LEN];
-    char metapath[MAX_PATH_LEN];
     char backuppath[MAX_PATH_LEN];
     snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
     snprintf(backuppath, sizeof(backuppath), "%s/%s.bak", storage_path, filename);
     
+    // Phase 7: Under the commit lock, so no commit recreates the file (or
+    // its history) between the checks below and the removal
+    pthread_mutex_t* commit_lock = commit_lock_for(filename);
+    pthread_mutex_lock(commit_lock);
+    
     // Check if file exists
     if (access(filepath, F_OK) != 0) {
+        pthread_mutex_unlock(commit_lock);
         LOG_WARNING_MSG("STORAGE_SERVER", "File does not exist: %s", filepath);
         response.status = STATUS_ERROR_NOT_FOUND;
         snprintf(response.data, sizeof(response.data), 
                 "File not found on storage");
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
     
-    // Check ownership by reading metadata file
-    if (access(metapath, F_OK) == 0) {
-        FILE* meta_fp = fopen(metapath, "r");
-        if (meta_fp != NULL) {
-            char owner[MAX_USERNAME_LEN] = {0};
-            char line[256];
-            
-            // Read metadata file line by line
-            while (fgets(line, sizeof(line), meta_fp) != NULL) {
-                if (strncmp(line, "owner=", 6) == 0) {
-                    sscanf(line, "owner=%s", owner);
-                    break;
-                }
-            }
-            fclose(meta_fp);
-            
-            // Verify ownership
-            if (strlen(owner) > 0 && strcmp(owner, req->username) != 0) {
-                LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' attempted to delete file owned by '%s'", 
-                               req->username, owner);
-                response.status = STATUS_ERROR_OWNER_REQUIRED;
-                snprintf(response.data, sizeof(response.data), 
-                        "Only the owner can delete this file");
-                response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-                send_response(nm_socket, &response);
-                return;
-            }
-            
-            LOG_INFO_MSG("STORAGE_SERVER", "Ownership verified: user '%s' owns file '%s'", 
-                        req->username, filename);
+    // Check ownership (Phase 7: from the metadata cache)
+    file_metadata_t meta;
+    if (ss_meta_get(filename, &meta) == 0) {
+        // Verify ownership
+        if (strlen(meta.owner) > 0 && strcmp(meta.owner, req->username) != 0) {
+            LOG_WARNING_MSG("STORAGE_SERVER", "User '%s' attempted to delete file owned by '%s'", 
+                           req->username, meta.owner);
+            pthread_mutex_unlock(commit_lock);
+            response.status = STATUS_ERROR_OWNER_REQUIRED;
+            snprintf(response.data, sizeof(response.data), 
+                    "Only the owner can delete this file");
+            response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+            send_nm_response(req, &response);
+            return;
         }
+        
+        LOG_INFO_MSG("STORAGE_SERVER", "Ownership verified: user '%s' owns file '%s'", 
+                    req->username, filename);
     }
     
+    // Phase 7: An early-acked commit still being written would recreate it
+    ss_materializer_drain(filename);
+    
     // Delete main file
-    if (unlink(filepath) != 0) {
+    if (ss_io_unlink(filepath) != 0) {
+        pthread_mutex_unlock(commit_lock);
         LOG_ERROR_MSG("STORAGE_SERVER", "Failed to delete file: %s (errno: %d - %s)", 
                      filepath, errno, strerror(errno));
         response.status = STATUS_ERROR_INTERNAL;
         snprintf(response.data, sizeof(response.data), 
                 "Failed to delete file: %s", strerror(errno));
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
     
+    doc_cache_invalidate(filename);
     LOG_INFO_MSG("STORAGE_SERVER", "Deleted file: %s", filepath);
     
-    // Delete metadata file (ignore errors if it doesn't exist)
-    if (access(metapath, F_OK) == 0) {
-        if (unlink(metapath) != 0) {
-            LOG_WARNING_MSG("STORAGE_SERVER", "Failed to delete metadata file: %s", metapath);
-        } else {
-            LOG_INFO_MSG("STORAGE_SERVER", "Deleted metadata file: %s", metapath);
-        }
-    }
+    // Delete metadata (and its file, if it has one)
+    ss_meta_remove(filename);
     
     // Delete backup file if exists (ignore errors)
     if (access(backuppath, F_OK) == 0) {
-        if (unlink(backuppath) != 0) {
+        if (ss_io_unlink(backuppath) != 0) {
             LOG_WARNING_MSG("STORAGE_SERVER", "Failed to delete backup file: %s", backuppath);
         } else {
             LOG_INFO_MSG("STORAGE_SERVER", "Deleted backup file: %s", backuppath);
         }
     }
     
+    ss_revlog_remove(filename);
+    ss_cas_remove(filename);
+    pthread_mutex_unlock(commit_lock);
+    remove_lease_floor(filename);
+    
     LOG_INFO_MSG("STORAGE_SERVER", "Successfully deleted file: %s", filename);
     
     // Send success response
@@ -1449,113 +2237,427 @@ void handle_delete_request(request_packet_t* req) {
     snprintf(response.data, sizeof(response.data), 
             "File deleted from storage");
     response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-    send_response(nm_socket, &response);
+    send_nm_response(req, &response);
 }
 
-// Update metadata file with new statistics
-void update_metadata_stats(const char* metapath, int word_count, int char_count, size_t size, const char* accessed_by) {
-    // Read existing metadata
-    char owner[MAX_USERNAME_LEN] = "";
-    long created = 0;
-    
-    FILE* mf = fopen(metapath, "r");
-    if (mf != NULL) {
-        char line[512];
-        while (fgets(line, sizeof(line), mf) != NULL) {
-            if (strncmp(line, "owner=", 6) == 0) {
-                sscanf(line + 6, "%63s", owner);
-            } else if (strncmp(line, "created=", 8) == 0) {
-                sscanf(line + 8, "%ld", &created);
-            }
-        }
-        fclose(mf);
+// Phase 7: Commit lock of a document (see COMMIT_LOCK_STRIPES)
+pthread_mutex_t* commit_lock_for(const char* filename) {
+    unsigned int hash = 5381;
+    int c;
+    
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
     }
     
-    // Write updated metadata
-    FILE* out = fopen(metapath, "w");
-    if (out != NULL) {
-        time_t now = time(NULL);
-        
-        fprintf(out, "owner=%s\n", owner);
-        fprintf(out, "created=%ld\n", created);
-        fprintf(out, "modified=%ld\n", now);
-        fprintf(out, "accessed=%ld\n", now);
-        fprintf(out, "accessed_by=%s\n", accessed_by);
-        fprintf(out, "size=%zu\n", size);
-        fprintf(out, "word_count=%d\n", word_count);
-        fprintf(out, "char_count=%d\n", char_count);
-        
-        fclose(out);
+    return &commit_locks[hash % COMMIT_LOCK_STRIPES];
+}
+
+// Phase 7: Control queue of an NM command, by the file it names (its first
+// argument), so commands for one file are handled in the order sent
+ss_thread_pool_t* control_pool_for(const request_packet_t* req) {
+    unsigned int hash = 5381;
+    
+    for (const char* p = req->args; *p != '\0' && !isspace((unsigned char)*p); p++) {
+        hash = ((hash << 5) + hash) + (unsigned char)*p;
     }
+    
+    return control_pools[hash % SS_CONTROL_WORKERS];
 }
 
-// Calculate word and character counts from file content
-void calculate_file_stats(const char* filepath, int* word_count, int* char_count, size_t* size) {
-    *word_count = 0;
-    *char_count = 0;
-    *size = 0;
+// Phase 5.3: Handle UNDO/REVERT request from Name Server
+// Phase 7: "UNDO <file> [n]" steps n revisions back along the revision
+// log, "REVERT <file> <rev>" restores any revision and "REVERT <file> <tag>"
+// a checkpoint; the restored content is committed as a new revision, so it
+// can be undone too. Files without history fall back to their .bak.
+void handle_undo_request(request_packet_t* req) {
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
     
-    FILE* file = fopen(filepath, "r");
-    if (file == NULL) {
+    char filename[MAX_FILENAME_LEN] = {0};
+    char which[SS_CAS_MAX_TAG_LEN] = {0};
+    sscanf(req->args, "%255s %63s", filename, which);
+    const char* tag = (req->command == CMD_REVERT && isalpha((unsigned char)which[0])) ? which : NULL;
+    
+    // A step count (UNDO, default 1) or revision number (REVERT) is a
+    // whole number from 1; anything else is refused before the lock
+    int number = (req->command == CMD_UNDO && which[0] == '\0') ? 1 : 0;
+    if (tag == NULL && which[0] != '\0') {
+        char* end = NULL;
+        errno = 0;
+        long value = strtol(which, &end, 10);
+        if (end != which && *end == '\0' && errno == 0 && value >= 1 && value <= INT_MAX) {
+            number = (int)value;
+        }
+    }
+    if (tag == NULL && number < 1) {
+        response.status = STATUS_ERROR_INVALID_ARGS;
+        if (req->command == CMD_UNDO) {
+            snprintf(response.data, sizeof(response.data),
+                    "Invalid UNDO step count '%s' (a whole number from 1)", which);
+        } else {
+            snprintf(response.data, sizeof(response.data),
+                    "Invalid revision '%s' (a whole number from 1, or a checkpoint tag)", which);
+        }
+        response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+        send_nm_response(req, &response);
         return;
     }
     
-    int in_word = 0;
-    int ch;
+    char filepath[MAX_PATH_LEN + MAX_FILENAME_LEN];
+    char backup_filepath[MAX_PATH_LEN + MAX_FILENAME_LEN + sizeof(".bak")];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
+    snprintf(backup_filepath, sizeof(backup_filepath), "%s/%s.bak", storage_path, filename);
+    
+    pthread_mutex_t* commit_lock = commit_lock_for(filename);
+    pthread_mutex_lock(commit_lock);
+    // Phase 7: The file must hold the latest commit before it is replaced
+    ss_materializer_drain(filename);
+    
+    int head = ss_revlog_head(filename);
+    int target = -1;
+    if (head > 0 && tag == NULL) {
+        target = (req->command == CMD_UNDO) ? ss_revlog_undo_target(filename, number) : number;
+    }
     
-    while ((ch = fgetc(file)) != EOF) {
-        (*char_count)++;
-        (*size)++;
+    char* content = NULL;
+    size_t length = 0;
+    // Legacy single-step undo from the backup, committed like any other version
+    int from_backup = tag == NULL && head == 0 && req->command == CMD_UNDO && number == 1 &&
+                      access(backup_filepath, F_OK) == 0;
+    if (from_backup && ss_io_read_file(backup_filepath, &content, &length) != 0) {
+        response.status = STATUS_ERROR_INTERNAL;
+        snprintf(response.data, sizeof(response.data), 
+                "Failed to restore '%s': %s", filename, strerror(errno));
+        LOG_ERROR_MSG("STORAGE_SERVER", "UNDO failed: cannot read backup of '%s': %s",
+                     filename, strerror(errno));
+    } else if (tag != NULL && ss_cas_read(filename, tag, &content, &length) != 0) {
+        int missing = (errno == ENOENT);
+        response.status = missing ? STATUS_ERROR_NOT_FOUND : STATUS_ERROR_INTERNAL;
+        snprintf(response.data, sizeof(response.data),
+                missing ? "No checkpoint '%s' for '%s'" : "Failed to rebuild checkpoint '%s' of '%s'",
+                tag, filename);
+        LOG_WARNING_MSG("STORAGE_SERVER", "REVERT of '%s' to checkpoint '%s' failed: %s",
+                       filename, tag, strerror(errno));
+    } else if (tag == NULL && !from_backup && (target < 1 || target > head)) {
+        response.status = STATUS_ERROR_UNDO_NOT_AVAILABLE;
+        if (req->command == CMD_UNDO) {
+            snprintf(response.data, sizeof(response.data),
+                    "No earlier version of '%s' to undo to", filename);
+        } else {
+            snprintf(response.data, sizeof(response.data),
+                    "Revision %d of '%s' does not exist (latest is %d)", number, filename, head);
+        }
+        LOG_WARNING_MSG("STORAGE_SERVER", "UNDO/REVERT of '%s' not available (target %d, head %d)",
+                       filename, target, head);
+    } else if (tag == NULL && !from_backup &&
+               ss_revlog_read(filename, target, &content, &length) != 0) {
+        response.status = STATUS_ERROR_INTERNAL;
+        snprintf(response.data, sizeof(response.data),
+                "Failed to rebuild revision %d of '%s'", target, filename);
+        LOG_ERROR_MSG("STORAGE_SERVER", "Revision %d of '%s' is unreadable: %s",
+                     target, filename, strerror(errno));
+    } else {
+        cached_doc_t* previous = doc_cache_acquire(filename);
+        // Phase 7: Restoring old content is still a new version
+        uint32_t version = (previous != NULL ? previous->version : 0) + 1;
+        int word_count = count_document_words(content, length);
         
-        // Count words (sequences of non-space characters)
-        if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r') {
-            if (!in_word) {
-                (*word_count)++;
-                in_word = 1;
+        if (word_count < 0 ||
+            commit_document_file(filename, content, length, version, NULL) != 0) {
+            response.status = STATUS_ERROR_INTERNAL;
+            snprintf(response.data, sizeof(response.data),
+                    "Failed to restore '%s': %s", filename, strerror(errno));
+            LOG_ERROR_MSG("STORAGE_SERVER", "UNDO/REVERT of '%s' failed: %s",
+                         filename, strerror(errno));
+        } else {
+            // A checkpoint is restored like an edit: UNDO returns to the
+            // version it replaced
+            int revision = from_backup ? 0 :
+                           ss_revlog_append(filename, previous ? previous->content : NULL,
+                                            previous ? previous->length : 0,
+                                            content, length, (tag != NULL) ? 0 : target);
+            ss_meta_record_commit(filename, word_count, (int)length, length, req->username,
+                                  version);
+            if (publish_committed(filename, content, length, version)) {
+                content = NULL;
+            }
+            response.status = STATUS_OK;
+            if (from_backup) {
+                ss_io_unlink(backup_filepath);
+                snprintf(response.data, sizeof(response.data), 
+                        "File '%s' restored from backup (version %u)", filename, version);
+                LOG_INFO_MSG("STORAGE_SERVER", "UNDO successful: restored '%s'", filename);
+            } else if (tag != NULL) {
+                snprintf(response.data, sizeof(response.data),
+                        "File '%s' restored to checkpoint '%s' (now revision %d, version %u)",
+                        filename, tag, revision, version);
+            } else {
+                snprintf(response.data, sizeof(response.data),
+                        "File '%s' restored to revision %d (now revision %d, version %u)",
+                        filename, target, revision, version);
+            }
+            if (tag != NULL) {
+                LOG_INFO_MSG("STORAGE_SERVER", "Restored '%s' to checkpoint %s as revision %d",
+                            filename, tag, revision);
+            } else if (!from_backup) {
+                LOG_INFO_MSG("STORAGE_SERVER", "Restored '%s' to revision %d as revision %d",
+                            filename, target, revision);
             }
+        }
+        doc_cache_release(previous);
+    }
+    free(content);
+    
+    pthread_mutex_unlock(commit_lock);
+    
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_nm_response(req, &response);
+}
+
+// Phase 7: Handle CHECKPOINT/LISTCHECKPOINTS request from Name Server
+void handle_checkpoint_request(request_packet_t* req) {
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    
+    char filename[MAX_FILENAME_LEN] = {0};
+    char tag[SS_CAS_MAX_TAG_LEN] = {0};
+    sscanf(req->args, "%255s %63s", filename, tag);
+    
+    if (req->command == CMD_LISTCHECKPOINTS) {
+        int count = ss_cas_list(filename, response.data, sizeof(response.data));
+        response.status = STATUS_OK;
+        if (count == 0) {
+            snprintf(response.data, sizeof(response.data), "No checkpoints for '%s'", filename);
+        }
+    } else if (!ss_cas_valid_tag(tag)) {
+        response.status = STATUS_ERROR_INVALID_ARGS;
+        snprintf(response.data, sizeof(response.data),
+                "Invalid checkpoint tag '%s' (start with a letter; letters, digits, '_', '-', '.')",
+                tag);
+    } else {
+        // The committed version, not one being edited
+        pthread_mutex_t* commit_lock = commit_lock_for(filename);
+        pthread_mutex_lock(commit_lock);
+        cached_doc_t* doc = doc_cache_acquire(filename);
+        int total_chunks = 0;
+        int new_chunks = 0;
+        int result = (doc != NULL) ?
+                     ss_cas_checkpoint(filename, tag, req->username, doc, &total_chunks, &new_chunks) : -1;
+        int error = (doc != NULL) ? errno : ENOENT;
+        doc_cache_release(doc);
+        pthread_mutex_unlock(commit_lock);
+        
+        if (result == 0) {
+            response.status = STATUS_OK;
+            snprintf(response.data, sizeof(response.data),
+                    "Checkpoint '%s' of '%s' created (%d chunks, %d new)",
+                    tag, filename, total_chunks, new_chunks);
+        } else if (error == EEXIST) {
+            response.status = STATUS_ERROR_FILE_EXISTS;
+            snprintf(response.data, sizeof(response.data),
+                    "Checkpoint '%s' of '%s' already exists", tag, filename);
         } else {
-            in_word = 0;
+            response.status = (error == ENOENT) ? STATUS_ERROR_NOT_FOUND : STATUS_ERROR_INTERNAL;
+            snprintf(response.data, sizeof(response.data),
+                    "Failed to checkpoint '%s': %s", filename, strerror(error));
+            LOG_ERROR_MSG("STORAGE_SERVER", "Checkpoint '%s' of '%s' failed: %s",
+                         tag, filename, strerror(error));
         }
     }
     
-    fclose(file);
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_nm_response(req, &response);
+}
+
+// Phase 7: Handle INFO request from Name Server - the committed version's
+// statistics as "version= size= words= chars= modified= accessed= accessed_by=",
+// all from the metadata cache
+void handle_info_request(request_packet_t* req) {
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    
+    char filename[MAX_FILENAME_LEN] = {0};
+    sscanf(req->args, "%255s", filename);
+    
+    file_metadata_t meta;
+    if (ss_meta_get(filename, &meta) != 0) {
+        response.status = STATUS_ERROR_NOT_FOUND;
+        snprintf(response.data, sizeof(response.data), "File not found: %s", filename);
+    } else {
+        response.status = STATUS_OK;
+        snprintf(response.data, sizeof(response.data),
+                "version=%u size=%zu words=%d chars=%d modified=%ld accessed=%ld accessed_by=%s",
+                meta.version, meta.size, meta.word_count, meta.char_count,
+                (long)meta.last_modified, (long)meta.last_accessed,
+                meta.last_accessed_by[0] ? meta.last_accessed_by : "-");
+    }
+    
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_nm_response(req, &response);
 }
 
-// Phase 3: Create file metadata in .meta file
-int create_file_metadata(const char* filename, const char* owner) {
-    char metapath[MAX_PATH_LEN];
-    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
+// Phase 7: Write a committed document to its file (crash-safe replace).
+// Its .meta, carrying @version, is replaced in the same synced step, so a
+// crash cannot leave the file ahead of the version recorded for it; on
+// failure the old version is put back. The rest of its metadata is
+// recorded by the caller. 0, or -1 with *failed_step (if given) set.
+int commit_document_file(const char* filename, const char* content, size_t length,
+                         uint32_t version, const char** failed_step) {
+    char filepath[MAX_PATH_LEN + MAX_FILENAME_LEN];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
     
-    FILE* meta_fp = fopen(metapath, "w");
-    if (meta_fp == NULL) {
-        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to create metadata file: %s", metapath);
+    ss_meta_commit_t meta;
+    if (ss_meta_prepare_version(filename, version, &meta) != 0) {
+        if (failed_step != NULL) {
+            *failed_step = "metadata";
+        }
         return -1;
     }
     
-    time_t now = time(NULL);
+    ss_io_commit_t commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.path = filepath;
+    commit.backup_path = NULL;
+    commit.data = content;
+    commit.length = length;
+    if (meta.text != NULL) {
+        commit.meta_path = meta.path;
+        commit.meta = meta.text;
+        commit.meta_length = meta.length;
+    }
     
-    // Calculate file statistics
-    char filepath[MAX_PATH_LEN];
-    snprintf(filepath, sizeof(filepath), "%s/%s", storage_path, filename);
-    int word_count = 0, char_count = 0;
-    size_t file_size = 0;
-    calculate_file_stats(filepath, &word_count, &char_count, &file_size);
-    
-    // Write metadata in key=value format
-    fprintf(meta_fp, "owner=%s\n", owner);
-    fprintf(meta_fp, "created=%ld\n", now);
-    fprintf(meta_fp, "modified=%ld\n", now);
-    fprintf(meta_fp, "accessed=%ld\n", now);
-    fprintf(meta_fp, "accessed_by=%s\n", owner);
-    fprintf(meta_fp, "size=%zu\n", file_size);
-    fprintf(meta_fp, "word_count=%d\n", word_count);
-    fprintf(meta_fp, "char_count=%d\n", char_count);
-    fprintf(meta_fp, "access_count=1\n");
-    fprintf(meta_fp, "access_0=%s:RW\n", owner);  // Owner has read/write
-    
-    fclose(meta_fp);
-    LOG_INFO_MSG("STORAGE_SERVER", "Created metadata file: %s", metapath);
+    int result = ss_io_commit(&commit);
+    int saved_errno = errno;
+    ss_meta_finish_version(filename, &meta, result == 0);
+    if (result != 0 && failed_step != NULL) {
+        *failed_step = commit.failed_step;
+    }
+    errno = saved_errno;
+    return result;
+}
+
+// Phase 7: Materializer callback - the version's metadata was recorded when
+// it was committed, so only the file is written (with the version in its
+// .meta, as the edit log entry holding it ends once the file is)
+int write_published_document(const cached_doc_t* doc, const char* user) {
+    (void)user;
+    return commit_document_file(doc->filename, doc->content, doc->length, doc->version, NULL);
+}
+
+// Phase 7: Materializer callback - a written version's revision, taken
+// against the version it replaced
+void record_published_revision(const cached_doc_t* previous, const cached_doc_t* doc) {
+    if (ss_revlog_append(doc->filename, previous ? previous->content : NULL,
+                         previous ? previous->length : 0, doc->content, doc->length, 0) < 0) {
+        LOG_WARNING_MSG("STORAGE_SERVER", "Failed to record version %u of '%s' in its history",
+                       doc->version, doc->filename);
+    }
+}
+
+// Phase 7: Revision of a commit replayed from the edit log. The
+// materializer may have recorded it just before the crash; then it is the
+// head already.
+static void record_logged_revision(const char* filename, const char* content, size_t length) {
+    char* head = NULL;
+    size_t head_length = 0;
+    int revision = ss_revlog_head(filename);
+    if (revision > 0 && ss_revlog_read(filename, revision, &head, &head_length) != 0) {
+        head = NULL;
+        head_length = 0;
+    }
+    if (head == NULL || head_length != length || memcmp(head, content, length) != 0) {
+        ss_revlog_append(filename, head, head_length, content, length, 0);
+    }
+    free(head);
+}
+
+// Phase 7: Edit log recovery callback for a commit acknowledged but never
+// retired: a superseded one only gets its revision, the latest of its file
+// is also written out
+int restore_logged_commit(const char* filename, const char* user, const char* content,
+                          size_t length, uint32_t version, int latest) {
+    if (!latest) {
+        record_logged_revision(filename, content, length);
+        return 0;
+    }
+    
+    int word_count = count_document_words(content, length);
+    if (word_count < 0) {
+        return -1;
+    }
     
+    int result = commit_document_file(filename, content, length, version, NULL);
+    if (result == 0) {
+        record_logged_revision(filename, content, length);
+        ss_meta_record_commit(filename, word_count, (int)length, length, user, version);
+    }
+    doc_cache_invalidate(filename);
+    return result;
+}
+
+// Phase 7: Refuse a WRITE/ETIRW whose IFVERSION no longer holds
+void reply_version_mismatch(int sock, const char* filename, uint32_t current, uint32_t expected) {
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    response.status = STATUS_ERROR_VERSION_MISMATCH;
+    snprintf(response.data, sizeof(response.data),
+            "'%s' is at version %u, not %u; read it again", filename, current, expected);
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_response(sock, &response);
+}
+
+// Phase 7: Words in a whole document, as the doc cache counts them; -1 if
+// it could not be indexed
+int count_document_words(const char* content, size_t length) {
+    doc_sentence_t* sentences = NULL;
+    int word_count = 0;
+    if (index_document_sentences(content, length, &sentences, &word_count) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    free(sentences);
+    return word_count;
+}
+
+// Phase 7: Make a version just committed to its file the one readers get
+// (commit lock held). @content is taken over if 1 is returned; on 0 the
+// cached version was dropped instead and the next reader loads the file.
+int publish_committed(const char* filename, char* content, size_t length, uint32_t version) {
+    cached_doc_t* published = doc_cache_publish(filename, content, length, version, 1);
+    if (published == NULL) {
+        doc_cache_invalidate(filename);
+        return 0;
+    }
+    doc_cache_release(published);
+    return 1;
+}
+
+// Phase 7: Early-ack commit of a merged document (commit lock held): log
+// it, publish it to readers once the log is synced and queue it for the
+// materializer, which also records its revision (the log holds the
+// content until then). @content is taken over on success.
+// Returns 0, or -1 if the commit must be written directly instead.
+int log_early_commit(client_session_t* session, cached_doc_t* previous, char* content,
+                     size_t length, uint32_t version, const char* user) {
+    uint64_t log_id = ss_wal_commit(session->filename, user, content, length, version);
+    if (log_id == 0) {
+        return -1;
+    }
+    // No reader may see a version a crash could still take back
+    ss_wal_flush();
+    cached_doc_t* published = doc_cache_publish(session->filename, content, length, version, 0);
+    if (published == NULL) {
+        ss_wal_end(log_id, 0);
+        return -1;
+    }
+    // Metadata is current at once; only the document file waits
+    ss_meta_record_commit(session->filename, published->word_count, (int)length, length,
+                          user, version);
+    ss_materializer_queue(published, previous, user, log_id);
     return 0;
 }
 
@@ -1658,13 +2760,17 @@ void handle_update_acl_request(request_packet_t* req) {
     char args_copy[MAX_ARGS_LEN];
     strncpy(args_copy, req->args, sizeof(args_copy) - 1);
     args_copy[sizeof(args_copy) - 1] = '\0';
+    
+    // Phase 7: Strip the lease version the NM appended for this ACL change
+    uint32_t lease_version = 0;
+    int has_lease = extract_lease_token(args_copy, &lease_version);
 
     char* first_space = strchr(args_copy, ' ');
     if (first_space == NULL) {
         response.status = STATUS_ERROR_INVALID_ARGS;
         snprintf(response.data, sizeof(response.data), "Invalid args for UPDATE_ACL");
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
 
@@ -1672,98 +2778,33 @@ void handle_update_acl_request(request_packet_t* req) {
     char* filename = args_copy;
     char* acl_str = first_space + 1;
 
-    // Build meta path
-    char metapath[MAX_PATH_LEN];
-    snprintf(metapath, sizeof(metapath), "%s/%s.meta", storage_path, filename);
-
-    // Check meta exists
-    if (access(metapath, F_OK) != 0) {
-        response.status = STATUS_ERROR_NOT_FOUND;
-        snprintf(response.data, sizeof(response.data), "Metadata for '%s' not found", filename);
-        response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
-        return;
-    }
-
-    // Read current metadata fields (non-ACL) to preserve them
-    char owner[MAX_USERNAME_LEN] = "";
-    long created = 0, modified = 0, accessed = 0;
-    char accessed_by[MAX_USERNAME_LEN] = "";
-    size_t size_val = 0;
-    int word_count = 0, char_count = 0;
-
-    FILE* mf = fopen(metapath, "r");
-    if (mf != NULL) {
-        char line[512];
-        while (fgets(line, sizeof(line), mf) != NULL) {
-            if (strncmp(line, "owner=", 6) == 0) {
-                sscanf(line + 6, "%63s", owner);
-            } else if (strncmp(line, "created=", 8) == 0) {
-                sscanf(line + 8, "%ld", &created);
-            } else if (strncmp(line, "modified=", 9) == 0) {
-                sscanf(line + 9, "%ld", &modified);
-            } else if (strncmp(line, "accessed=", 9) == 0) {
-                sscanf(line + 9, "%ld", &accessed);
-            } else if (strncmp(line, "accessed_by=", 12) == 0) {
-                sscanf(line + 12, "%63s", accessed_by);
-            } else if (strncmp(line, "size=", 5) == 0) {
-                sscanf(line + 5, "%zu", &size_val);
-            } else if (strncmp(line, "word_count=", 11) == 0) {
-                sscanf(line + 11, "%d", &word_count);
-            } else if (strncmp(line, "char_count=", 11) == 0) {
-                sscanf(line + 11, "%d", &char_count);
-            }
-        }
-        fclose(mf);
-    }
-
     // Parse the new ACL into a metadata struct
     file_metadata_t tmp_meta;
     memset(&tmp_meta, 0, sizeof(tmp_meta));
-    // Keep owner in metadata too
-    if (strlen(owner) > 0) strncpy(tmp_meta.owner, owner, sizeof(tmp_meta.owner) - 1);
     parse_acl_into_meta(&tmp_meta, acl_str);
 
-    // Write the metadata file (overwrite)
-    FILE* out = fopen(metapath, "w");
-    if (out == NULL) {
-        LOG_ERROR_MSG("STORAGE_SERVER", "Failed to open metadata for writing: %s", metapath);
-        response.status = STATUS_ERROR_INTERNAL;
-        snprintf(response.data, sizeof(response.data), "Failed to write metadata");
+    // Phase 7: Swap it into the cached metadata; the owner and statistics
+    // are kept and the .meta is synced before the reply
+    if (ss_meta_set_acl(filename, &tmp_meta) != 0) {
+        int missing = (errno == ENOENT);
+        response.status = missing ? STATUS_ERROR_NOT_FOUND : STATUS_ERROR_INTERNAL;
+        snprintf(response.data, sizeof(response.data),
+                missing ? "Metadata for '%s' not found" : "Failed to save the ACL of '%s'",
+                filename);
         response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-        send_response(nm_socket, &response);
+        send_nm_response(req, &response);
         return;
     }
-
-    fprintf(out, "owner=%s\n", owner);
-    fprintf(out, "created=%ld\n", created > 0 ? created : time(NULL));
-    fprintf(out, "modified=%ld\n", time(NULL));
-    fprintf(out, "accessed=%ld\n", accessed > 0 ? accessed : time(NULL));
-    fprintf(out, "accessed_by=%s\n", accessed_by[0] ? accessed_by : owner);
-    fprintf(out, "size=%zu\n", size_val);
-    fprintf(out, "word_count=%d\n", word_count);
-    fprintf(out, "char_count=%d\n", char_count);
-    fprintf(out, "access_count=%d\n", tmp_meta.access_count);
-    for (int i = 0; i < tmp_meta.access_count; i++) {
-        int p = tmp_meta.access_permissions[i];
-        if ((p & ACCESS_READ) && (p & ACCESS_WRITE)) {
-            fprintf(out, "access_%d=%s:RW\n", i, tmp_meta.access_list[i]);
-        } else if (p & ACCESS_READ) {
-            fprintf(out, "access_%d=%s:R\n", i, tmp_meta.access_list[i]);
-        } else if (p & ACCESS_WRITE) {
-            fprintf(out, "access_%d=%s:RW\n", i, tmp_meta.access_list[i]);
-        } else {
-            fprintf(out, "access_%d=%s:-\n", i, tmp_meta.access_list[i]);
-        }
+    
+    if (has_lease) {
+        set_lease_floor(filename, lease_version);
     }
 
-    fclose(out);
-
     // Send success response back to Name Server
     response.status = STATUS_OK;
     snprintf(response.data, sizeof(response.data), "ACL updated on storage");
     response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
-    send_response(nm_socket, &response);
+    send_nm_response(req, &response);
 
     LOG_INFO_MSG("STORAGE_SERVER", "Updated ACL for file '%s' successfully", filename);
 }
@@ -1773,57 +2814,73 @@ void handle_update_acl_request(request_packet_t* req) {
  * These functions manage sentence-level locks for concurrent WRITE operations
  */
 
+// Phase 7: "sentence 3" or "words 2-5 of sentence 3", for log lines
+void describe_lock(char* out, size_t size, int index, int first_word, int last_word) {
+    if (last_word == SS_LOCK_LAST_WORD) {
+        snprintf(out, size, "sentence %d", index);
+    } else {
+        snprintf(out, size, "words %d-%d of sentence %d", first_word, last_word, index);
+    }
+}
+
 /**
  * acquire_lock - Attempt to acquire a sentence lock for a file
  * @file: The filename to lock
  * @index: The sentence index to lock
+ * @first_word: First word to lock (0 for the whole sentence)
+ * @last_word: Last word to lock (SS_LOCK_LAST_WORD for the whole sentence)
  * @user: The username acquiring the lock
+ * @wait_seconds: How long to queue if someone else holds it (0: do not wait)
  *
  * Returns: 1 if lock acquired, 0 if lock is already held by someone else
  */
-int acquire_lock(const char* file, int index, const char* user) {
-    pthread_mutex_lock(&lock_list_mutex);
-    
-    // Check if lock already exists for this file and sentence
-    sentence_lock_t* current = global_lock_list;
-    while (current != NULL) {
-        if (strcmp(current->filename, file) == 0 && 
-            current->sentence_index == index) {
-            // Lock exists - check if it's held by a different user
-            if (strcmp(current->username, user) != 0) {
-                pthread_mutex_unlock(&lock_list_mutex);
-                LOG_INFO_MSG("STORAGE_SERVER", 
-                    "Lock denied: sentence %d of '%s' held by '%s'", 
-                    index, file, current->username);
-                return 0;  // Lock held by someone else
-            }
-            // Same user already holds the lock
-            pthread_mutex_unlock(&lock_list_mutex);
-            return 1;
+int acquire_lock(const char* file, int index, int first_word, int last_word, const char* user,
+                 int wait_seconds) {
+    // Phase 7: Locks live in the striped per-file lock table as leases;
+    // waiting ties up a worker, so the wait is capped, and so is the number
+    // of workers waiting (past that, a busy lock is refused without waiting)
+    if (wait_seconds > SS_LOCK_MAX_WAIT_SECONDS) {
+        wait_seconds = SS_LOCK_MAX_WAIT_SECONDS;
+    }
+    int waiting = 0;
+    if (wait_seconds > 0) {
+        int max_waiters = pool_workers / SS_LOCK_WAITER_SHARE;
+        pthread_mutex_lock(&lock_waiters_mutex);
+        if (lock_waiters < (max_waiters > 0 ? max_waiters : 1)) {
+            lock_waiters++;
+            waiting = 1;
         }
-        current = current->next;
+        pthread_mutex_unlock(&lock_waiters_mutex);
+        if (!waiting) {
+            LOG_WARNING_MSG("STORAGE_SERVER", "Too many WRITEs waiting for locks; not waiting for '%s'",
+                           file);
+        }
+    }
+    char holder[MAX_USERNAME_LEN];
+    int result = ss_lock_acquire(file, index, first_word, last_word, user,
+                                 waiting ? wait_seconds * 1000 : 0, holder);
+    if (waiting) {
+        pthread_mutex_lock(&lock_waiters_mutex);
+        lock_waiters--;
+        pthread_mutex_unlock(&lock_waiters_mutex);
     }
+    char what[64];
+    describe_lock(what, sizeof(what), index, first_word, last_word);
     
-    // Lock is available - create new lock entry
-    sentence_lock_t* new_lock = (sentence_lock_t*)malloc(sizeof(sentence_lock_t));
-    if (new_lock == NULL) {
-        pthread_mutex_unlock(&lock_list_mutex);
+    if (result < 0) {
         LOG_ERROR_MSG("STORAGE_SERVER", "Failed to allocate memory for lock");
         return 0;
     }
+    if (result == 0) {
+        LOG_INFO_MSG("STORAGE_SERVER", 
+            "Lock denied: %s of '%s' held by '%s'", 
+            what, file, holder);
+        return 0;  // Lock held by someone else
+    }
     
-    strncpy(new_lock->filename, file, MAX_FILENAME_LEN - 1);
-    new_lock->filename[MAX_FILENAME_LEN - 1] = '\0';
-    new_lock->sentence_index = index;
-    strncpy(new_lock->username, user, MAX_USERNAME_LEN - 1);
-    new_lock->username[MAX_USERNAME_LEN - 1] = '\0';
-    new_lock->next = global_lock_list;
-    global_lock_list = new_lock;
-    
-    pthread_mutex_unlock(&lock_list_mutex);
     LOG_INFO_MSG("STORAGE_SERVER", 
-        "Lock acquired: sentence %d of '%s' by '%s'", 
-        index, file, user);
+        "Lock acquired: %s of '%s' by '%s'", 
+        what, file, user);
     return 1;
 }
 
@@ -1831,39 +2888,261 @@ int acquire_lock(const char* file, int index, const char* user) {
  * release_lock - Release a sentence lock held by a user
  * @file: The filename to unlock
  * @index: The sentence index to unlock
+ * @first_word: First word of the lock
+ * @last_word: Last word of the lock
  * @user: The username releasing the lock
  */
-void release_lock(const char* file, int index, const char* user) {
-    pthread_mutex_lock(&lock_list_mutex);
+void release_lock(const char* file, int index, int first_word, int last_word, const char* user) {
+    char what[64];
+    describe_lock(what, sizeof(what), index, first_word, last_word);
+    if (ss_lock_release(file, index, first_word, last_word, user) != 0) {
+        LOG_WARNING_MSG("STORAGE_SERVER", 
+            "Attempted to release non-existent lock: %s of '%s' by '%s'", 
+            what, file, user);
+        return;
+    }
+    
+    LOG_INFO_MSG("STORAGE_SERVER", 
+        "Lock released: %s of '%s' by '%s'", 
+        what, file, user);
+}
+
+/**
+ * renew_lock - Extend the lease of a WRITE session's sentence lock
+ * @file: The locked filename
+ * @index: The locked sentence index
+ * @first_word: First word of the lock
+ * @last_word: Last word of the lock
+ * @user: The username holding the lock
+ *
+ * Returns: 1 if the lock is still held, 0 if its lease lapsed and another
+ *          writer took it over
+ */
+int renew_lock(const char* file, int index, int first_word, int last_word, const char* user) {
+    if (ss_lock_renew(file, index, first_word, last_word, user) != 0) {
+        char what[64];
+        describe_lock(what, sizeof(what), index, first_word, last_word);
+        LOG_WARNING_MSG("STORAGE_SERVER", 
+            "Lease lapsed: %s of '%s' is no longer held by '%s'", 
+            what, file, user);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Phase 7: Location lease validation
+ * The NM stamps every location it hands out with the file's registry version.
+ * Clients cache that location and send the version back; once the NM has
+ * changed the file's placement or ACL (and told us the new floor), older
+ * leases are refused so the client goes back to the NM for a fresh answer.
+ */
+
+static unsigned int lease_hash(const char* filename) {
+    unsigned int hash = 5381;
+    int c;
+    
+    while ((c = *filename++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    
+    return hash % LEASE_TABLE_SIZE;
+}
+
+/**
+ * set_lease_floor - Record the oldest lease version still valid for a file
+ * @file: The filename
+ * @version: Registry version of the file's latest placement/ACL change
+ */
+void set_lease_floor(const char* file, uint32_t version) {
+    unsigned int index = lease_hash(file);
+    
+    pthread_mutex_lock(&lease_mutex);
+    
+    lease_floor_t* current = lease_floors[index];
+    while (current != NULL) {
+        if (strcmp(current->filename, file) == 0) {
+            if (version > current->version) {
+                current->version = version;
+            }
+            pthread_mutex_unlock(&lease_mutex);
+            return;
+        }
+        current = current->next;
+    }
+    
+    lease_floor_t* entry = (lease_floor_t*)malloc(sizeof(lease_floor_t));
+    if (entry != NULL) {
+        strncpy(entry->filename, file, MAX_FILENAME_LEN - 1);
+        entry->filename[MAX_FILENAME_LEN - 1] = '\0';
+        entry->version = version;
+        entry->next = lease_floors[index];
+        lease_floors[index] = entry;
+    }
+    
+    pthread_mutex_unlock(&lease_mutex);
+}
+
+/**
+ * remove_lease_floor - Forget a deleted file's lease floor
+ * @file: The filename
+ */
+void remove_lease_floor(const char* file) {
+    unsigned int index = lease_hash(file);
     
-    sentence_lock_t* current = global_lock_list;
-    sentence_lock_t* prev = NULL;
+    pthread_mutex_lock(&lease_mutex);
     
+    lease_floor_t* current = lease_floors[index];
+    lease_floor_t* prev = NULL;
     while (current != NULL) {
-        if (strcmp(current->filename, file) == 0 && 
-            current->sentence_index == index &&
-            strcmp(current->username, user) == 0) {
-            // Found the lock - remove it
+        if (strcmp(current->filename, file) == 0) {
             if (prev == NULL) {
-                global_lock_list = current->next;
+                lease_floors[index] = current->next;
             } else {
                 prev->next = current->next;
             }
-            
-            LOG_INFO_MSG("STORAGE_SERVER", 
-                "Lock released: sentence %d of '%s' by '%s'", 
-                index, file, user);
             free(current);
-            pthread_mutex_unlock(&lock_list_mutex);
-            return;
+            break;
         }
         prev = current;
         current = current->next;
     }
     
-    // Lock not found
-    pthread_mutex_unlock(&lock_list_mutex);
-    LOG_WARNING_MSG("STORAGE_SERVER", 
-        "Attempted to release non-existent lock: sentence %d of '%s' by '%s'", 
-        index, file, user);
-}
\ No newline at end of file
+    pthread_mutex_unlock(&lease_mutex);
+}
+
+/**
+ * reset_lease_floors - Drop every per-file floor at (re)registration
+ * @floor: Registry version of the registration, the new floor of all files
+ */
+void reset_lease_floors(uint32_t floor) {
+    pthread_mutex_lock(&lease_mutex);
+    
+    for (int i = 0; i < LEASE_TABLE_SIZE; i++) {
+        while (lease_floors[i] != NULL) {
+            lease_floor_t* next = lease_floors[i]->next;
+            free(lease_floors[i]);
+            lease_floors[i] = next;
+        }
+    }
+    default_lease_floor = floor;
+    
+    pthread_mutex_unlock(&lease_mutex);
+}
+
+/**
+ * lease_is_stale - Check a client's lease against the file's floor
+ * @file: The filename
+ * @version: Lease version presented by the client
+ *
+ * Returns: 1 if the lease predates the file's last change, 0 otherwise
+ */
+int lease_is_stale(const char* file, uint32_t version) {
+    unsigned int index = lease_hash(file);
+    
+    pthread_mutex_lock(&lease_mutex);
+    
+    uint32_t floor = default_lease_floor;
+    
+    lease_floor_t* current = lease_floors[index];
+    while (current != NULL) {
+        if (strcmp(current->filename, file) == 0) {
+            floor = current->version;
+            break;
+        }
+        current = current->next;
+    }
+    
+    pthread_mutex_unlock(&lease_mutex);
+    
+    return version < floor;
+}
+
+// Answer a client whose lease or capability has to be renewed at the NM
+static void send_lease_redirect(int sock, const char* filename) {
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    response.status = STATUS_ERROR_LEASE_EXPIRED;
+    snprintf(response.data, sizeof(response.data),
+            "REDIRECT: location lease for '%s' is stale, ask the Name Server", filename);
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_response(sock, &response);
+}
+
+/**
+ * authorize_client_request - Strip the lease and capability tokens from a
+ * client request and check them
+ * @sock: Client socket (rejections are answered here)
+ * @req: The request; its args lose the trailing tokens
+ * @filename: Filename to check, or NULL to take the first token of args
+ * @access: ACCESS_READ or ACCESS_WRITE
+ *
+ * A stale lease or expired capability gets a redirect to the NM. A forged or
+ * insufficient capability is refused outright.
+ *
+ * Returns: CLIENT_AUTH_VERIFIED if the capability grants the access,
+ *          CLIENT_AUTH_UNVERIFIED if the caller must check the ACL itself,
+ *          CLIENT_AUTH_REJECTED if a reply was already sent
+ */
+client_auth_t authorize_client_request(int sock, request_packet_t* req, const char* filename,
+                                       int access) {
+    uint32_t lease_version = 0;
+    if (!extract_lease_token(req->args, &lease_version)) {
+        return CLIENT_AUTH_UNVERIFIED;  // No lease presented (NM-routed or legacy client)
+    }
+    char token[MAX_CAPABILITY_LEN];
+    int has_token = extract_capability_token(req->args, token, sizeof(token));
+    
+    char name[MAX_FILENAME_LEN] = "";
+    if (filename == NULL) {
+        sscanf(req->args, "%255s", name);
+        filename = name;
+    }
+    
+    if (lease_is_stale(filename, lease_version)) {
+        LOG_INFO_MSG("STORAGE_SERVER", "Stale lease %u from '%s' for '%s', redirecting to NM",
+                     lease_version, req->username, filename);
+        send_lease_redirect(sock, filename);
+        return CLIENT_AUTH_REJECTED;
+    }
+    
+    if (!has_token || !has_capability_key) {
+        return CLIENT_AUTH_UNVERIFIED;
+    }
+    
+    capability_status_t status = verify_capability(capability_key, token, req->username,
+                                                   filename, access, lease_version, time(NULL));
+    if (status == CAPABILITY_OK) {
+        return CLIENT_AUTH_VERIFIED;
+    }
+    if (status == CAPABILITY_EXPIRED) {
+        LOG_INFO_MSG("STORAGE_SERVER", "Expired capability from '%s' for '%s', redirecting to NM",
+                     req->username, filename);
+        send_lease_redirect(sock, filename);
+        return CLIENT_AUTH_REJECTED;
+    }
+    
+    LOG_WARNING_MSG("STORAGE_SERVER", "%s capability from '%s' for '%s'",
+                    status == CAPABILITY_DENIED ? "Insufficient" : "Invalid",
+                    req->username, filename);
+    
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    if (status == CAPABILITY_DENIED) {
+        response.status = (access & ACCESS_WRITE) ? STATUS_ERROR_WRITE_PERMISSION
+                                                  : STATUS_ERROR_READ_PERMISSION;
+        snprintf(response.data, sizeof(response.data),
+                "Access denied: capability does not grant %s access to '%s'",
+                (access & ACCESS_WRITE) ? "write" : "read", filename);
+    } else {
+        response.status = STATUS_ERROR_UNAUTHORIZED;
+        snprintf(response.data, sizeof(response.data),
+                "Access denied: invalid capability for '%s'", filename);
+    }
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    send_response(sock, &response);
+    
+    return CLIENT_AUTH_REJECTED;
+}
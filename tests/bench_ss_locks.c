@@ -0,0 +1,155 @@
+/*
+ * Storage Server Sentence Lock Benchmark
+ * Threads take and drop sentence locks of their own files while many other
+ * locks are held, once through a single mutex-guarded global list (the
+ * table the storage server used to keep) and once through the striped
+ * per-file lock table, and reports lock/unlock pairs per second.
+ *
+ * Usage: bench_ss_locks [threads] [held_locks] [pairs_per_thread]
+ */
+
+#include "../include/ss_lock_table.h"
+#include <sys/time.h>
+
+static int pairs_per_thread = 100000;
+
+// The old table: one list of every held lock behind one mutex
+static sentence_lock_t* list_head = NULL;
+static pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int list_acquire(const char* file, int index, const char* user) {
+    pthread_mutex_lock(&list_mutex);
+    for (sentence_lock_t* current = list_head; current != NULL; current = current->next) {
+        if (strcmp(current->filename, file) == 0 && current->sentence_index == index) {
+            int mine = strcmp(current->username, user) == 0;
+            pthread_mutex_unlock(&list_mutex);
+            return mine;
+        }
+    }
+    sentence_lock_t* lock = malloc(sizeof(sentence_lock_t));
+    if (lock == NULL) {
+        pthread_mutex_unlock(&list_mutex);
+        return 0;
+    }
+    strncpy(lock->filename, file, MAX_FILENAME_LEN - 1);
+    lock->filename[MAX_FILENAME_LEN - 1] = '\0';
+    lock->sentence_index = index;
+    strncpy(lock->username, user, MAX_USERNAME_LEN - 1);
+    lock->username[MAX_USERNAME_LEN - 1] = '\0';
+    lock->next = list_head;
+    list_head = lock;
+    pthread_mutex_unlock(&list_mutex);
+    return 1;
+}
+
+static void list_release(const char* file, int index, const char* user) {
+    pthread_mutex_lock(&list_mutex);
+    sentence_lock_t** link = &list_head;
+    while (*link != NULL) {
+        sentence_lock_t* current = *link;
+        if (strcmp(current->filename, file) == 0 && current->sentence_index == index &&
+            strcmp(current->username, user) == 0) {
+            *link = current->next;
+            free(current);
+            break;
+        }
+        link = &current->next;
+    }
+    pthread_mutex_unlock(&list_mutex);
+}
+
+static int table_acquire(const char* file, int index, const char* user) {
+    return ss_lock_acquire(file, index, 0, SS_LOCK_LAST_WORD, user, 0, NULL) == 1;
+}
+
+static void table_release(const char* file, int index, const char* user) {
+    ss_lock_release(file, index, 0, SS_LOCK_LAST_WORD, user);
+}
+
+typedef struct {
+    int (*acquire)(const char* file, int index, const char* user);
+    void (*release)(const char* file, int index, const char* user);
+    int index;
+    int failed;
+} bench_thread_t;
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void* lock_thread(void* arg) {
+    bench_thread_t* thread = (bench_thread_t*)arg;
+    char file[MAX_FILENAME_LEN], user[MAX_USERNAME_LEN];
+    snprintf(file, sizeof(file), "writer_%d.txt", thread->index);
+    snprintf(user, sizeof(user), "user_%d", thread->index);
+
+    for (int i = 0; i < pairs_per_thread; i++) {
+        int sentence = i % 32;
+        if (!thread->acquire(file, sentence, user)) {
+            thread->failed++;
+            continue;
+        }
+        thread->release(file, sentence, user);
+    }
+    return NULL;
+}
+
+static void run_table(const char* name,
+                      int (*acquire)(const char*, int, const char*),
+                      void (*release)(const char*, int, const char*),
+                      int threads, int held) {
+    // Locks of idle sessions on other files, ten sentences per file
+    char file[MAX_FILENAME_LEN];
+    for (int i = 0; i < held; i++) {
+        snprintf(file, sizeof(file), "held_%d.txt", i / 10);
+        acquire(file, i % 10, "idle");
+    }
+
+    pthread_t* tids = calloc(threads, sizeof(pthread_t));
+    bench_thread_t* state = calloc(threads, sizeof(bench_thread_t));
+    double start = now_seconds();
+    for (int t = 0; t < threads; t++) {
+        state[t].acquire = acquire;
+        state[t].release = release;
+        state[t].index = t;
+        pthread_create(&tids[t], NULL, lock_thread, &state[t]);
+    }
+    int failed = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        failed += state[t].failed;
+    }
+    double elapsed = now_seconds() - start;
+
+    long pairs = (long)threads * pairs_per_thread;
+    printf("%-6s %8.0f lock/unlock pairs/s  %6.2f us/pair  (%d failed)\n",
+           name, pairs / elapsed, elapsed * 1e6 / pairs, failed);
+
+    for (int i = 0; i < held; i++) {
+        snprintf(file, sizeof(file), "held_%d.txt", i / 10);
+        release(file, i % 10, "idle");
+    }
+    free(tids);
+    free(state);
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int held = argc > 2 ? atoi(argv[2]) : 1000;
+    if (argc > 3) {
+        pairs_per_thread = atoi(argv[3]);
+    }
+    if (threads <= 0 || held < 0 || pairs_per_thread <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [held_locks] [pairs_per_thread]\n", argv[0]);
+        return 1;
+    }
+
+    ss_lock_table_init();
+    printf("%d threads, %d locks held on other files, %d pairs per thread\n",
+           threads, held, pairs_per_thread);
+    run_table("list", list_acquire, list_release, threads, held);
+    run_table("table", table_acquire, table_release, threads, held);
+    return 0;
+}
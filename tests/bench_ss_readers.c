@@ -0,0 +1,224 @@
+/*
+ * Storage Server Reader Benchmark
+ * Opens N concurrent direct READ connections against one storage server and
+ * reports the latency distribution. Used to check that latency stays flat
+ * with thousands of concurrent readers on the worker pool, and, with a
+ * large file, the transfer throughput and server CPU cost per GB.
+ *
+ * Usage: bench_ss_readers <ss_ip> <ss_port> <filename> <username> [readers] [rounds]
+ * The file must already exist and be readable by <username>. Set SS_PID to
+ * the storage server's pid to report its CPU time per GB served.
+ */
+
+#include "../include/protocol.h"
+#include "../include/common.h"
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_DEFAULT_READERS 5000
+#define BENCH_STACK_SIZE (64 * 1024)
+
+typedef struct {
+    int index;
+    long latency_us;
+    int ok;
+    int busy;
+    size_t bytes;
+} reader_result_t;
+
+static const char* ss_ip;
+static int ss_port;
+static const char* filename;
+static const char* username;
+static pthread_barrier_t start_barrier;
+
+static long now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+// One reader: connect, send READ, drain the reply until the SS closes
+static void* reader_main(void* arg) {
+    reader_result_t* result = (reader_result_t*)arg;
+    pthread_barrier_wait(&start_barrier);
+
+    long start = now_us();
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(ss_port);
+    inet_pton(AF_INET, ss_ip, &addr.sin_addr);
+
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (sock >= 0) close(sock);
+        result->latency_us = now_us() - start;
+        return NULL;
+    }
+
+    request_packet_t request;
+    memset(&request, 0, sizeof(request));
+    request.magic = PROTOCOL_MAGIC;
+    request.command = CMD_READ;
+    strncpy(request.username, username, sizeof(request.username) - 1);
+    strncpy(request.args, filename, sizeof(request.args) - 1);
+    request.checksum = calculate_checksum(&request, sizeof(request) - sizeof(uint32_t));
+
+    if (send(sock, &request, sizeof(request), MSG_NOSIGNAL) == (ssize_t)sizeof(request)) {
+        char buffer[16 * 1024];
+        ssize_t n;
+        size_t total = 0;
+        content_header_t header;  // Or the start of an error response
+        memset(&header, 0, sizeof(header));
+        while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+            if (total < sizeof(header)) {
+                size_t take = sizeof(header) - total < (size_t)n ? sizeof(header) - total : (size_t)n;
+                memcpy((char*)&header + total, buffer, take);
+            }
+            total += n;
+        }
+        if (header.magic == PROTOCOL_MAGIC && header.status != STATUS_OK) {
+            result->busy = (header.status == STATUS_ERROR_SERVER_BUSY);
+        } else if (header.magic == PROTOCOL_MAGIC) {
+            result->bytes = total - sizeof(header);
+            result->ok = (n == 0 && result->bytes == header.length);
+        } else {
+            // Servers before the content header sent raw bytes
+            result->bytes = total;
+            result->ok = (n == 0 && total > 0);
+        }
+    }
+    close(sock);
+
+    result->latency_us = now_us() - start;
+    return NULL;
+}
+
+static int compare_latency(const void* a, const void* b) {
+    long la = ((const reader_result_t*)a)->latency_us;
+    long lb = ((const reader_result_t*)b)->latency_us;
+    return (la > lb) - (la < lb);
+}
+
+static long percentile(reader_result_t* sorted, int count, double p) {
+    int index = (int)(p * (count - 1));
+    return sorted[index].latency_us;
+}
+
+// CPU seconds (user + system) used so far by a process, or -1
+static double process_cpu_seconds(const char* pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%s/stat", pid);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    // Fields 14 and 15 (utime, stime) follow the ")" closing the command name
+    char line[1024];
+    double seconds = -1;
+    if (fgets(line, sizeof(line), fp) != NULL) {
+        char* rest = strrchr(line, ')');
+        unsigned long utime, stime;
+        if (rest != NULL &&
+            sscanf(rest + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                   &utime, &stime) == 2) {
+            seconds = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+        }
+    }
+    fclose(fp);
+    return seconds;
+}
+
+static void run_round(int round, int readers) {
+    reader_result_t* results = calloc(readers, sizeof(reader_result_t));
+    pthread_t* threads = calloc(readers, sizeof(pthread_t));
+    if (results == NULL || threads == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, BENCH_STACK_SIZE);
+    pthread_barrier_init(&start_barrier, NULL, readers + 1);
+
+    for (int i = 0; i < readers; i++) {
+        results[i].index = i;
+        if (pthread_create(&threads[i], &attr, reader_main, &results[i]) != 0) {
+            fprintf(stderr, "Failed to start reader %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const char* ss_pid = getenv("SS_PID");
+    double cpu_start = ss_pid ? process_cpu_seconds(ss_pid) : -1;
+    long start = now_us();
+    pthread_barrier_wait(&start_barrier);
+    for (int i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    long elapsed = now_us() - start;
+    double cpu_used = (cpu_start >= 0) ? process_cpu_seconds(ss_pid) - cpu_start : -1;
+
+    int ok = 0, busy = 0;
+    double bytes = 0;
+    for (int i = 0; i < readers; i++) {
+        ok += results[i].ok;
+        busy += results[i].busy;
+        bytes += results[i].bytes;
+    }
+    qsort(results, readers, sizeof(reader_result_t), compare_latency);
+
+    printf("round %d: readers=%d ok=%d busy=%d failed=%d wall=%.1fms "
+           "p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms\n",
+           round, readers, ok, busy, readers - ok - busy, elapsed / 1000.0,
+           percentile(results, readers, 0.50) / 1000.0,
+           percentile(results, readers, 0.90) / 1000.0,
+           percentile(results, readers, 0.99) / 1000.0,
+           results[readers - 1].latency_us / 1000.0);
+    printf("         transferred=%.1fMB throughput=%.2fGB/s", bytes / 1e6, bytes / elapsed / 1e3);
+    if (cpu_used >= 0 && bytes > 0) {
+        printf(" server_cpu=%.2fs (%.2fs per GB)", cpu_used, cpu_used / (bytes / 1e9));
+    }
+    printf("\n");
+
+    pthread_barrier_destroy(&start_barrier);
+    pthread_attr_destroy(&attr);
+    free(results);
+    free(threads);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5 || argc > 7) {
+        fprintf(stderr, "Usage: %s <ss_ip> <ss_port> <filename> <username> [readers] [rounds]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ss_ip = argv[1];
+    ss_port = atoi(argv[2]);
+    filename = argv[3];
+    username = argv[4];
+    int readers = (argc > 5) ? atoi(argv[5]) : BENCH_DEFAULT_READERS;
+    int rounds = (argc > 6) ? atoi(argv[6]) : 3;
+    if (ss_port <= 0 || readers <= 0 || rounds <= 0) {
+        fprintf(stderr, "Error: Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    // Every reader holds a socket
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    for (int round = 1; round <= rounds; round++) {
+        run_round(round, readers);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/*
+ * Text Scanning Kernel Benchmark
+ * Measures sentence splitting and word counting throughput (GB/s) of each
+ * available kernel on a large synthetic document.
+ *
+ * Usage: bench_text_scan [size_mb] [rounds]
+ */
+
+#include "../include/text_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define BENCH_DEFAULT_MB 64
+
+static const char* kernel_names[] = {"scalar", "sse2", "avx2"};
+
+static double now_seconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Prose-like text: words of 1-10 letters, a sentence every 5-20 words
+static char* make_document(size_t size) {
+    char* text = malloc(size + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    unsigned int seed = 12345;
+    size_t i = 0;
+    int words_left = 0;
+    while (i < size) {
+        if (words_left == 0) {
+            words_left = 5 + rand_r(&seed) % 16;
+        }
+        int letters = 1 + rand_r(&seed) % 10;
+        for (int k = 0; k < letters && i < size; k++) {
+            text[i++] = 'a' + rand_r(&seed) % 26;
+        }
+        if (--words_left == 0 && i < size) {
+            text[i++] = ".!?"[rand_r(&seed) % 3];
+        }
+        if (i < size) {
+            text[i++] = (rand_r(&seed) % 16 == 0) ? '\n' : ' ';
+        }
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// Walk the document sentence by sentence, as the parsers do
+static size_t split_sentences(const char* text, size_t length) {
+    size_t sentences = 0;
+    size_t start = 0;
+    while (start < length) {
+        size_t end = start + text_find_delimiter(text + start, length - start);
+        start = end + 1;
+        sentences++;
+    }
+    return sentences;
+}
+
+int main(int argc, char* argv[]) {
+    size_t size_mb = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_DEFAULT_MB;
+    int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+    if (size_mb == 0 || rounds <= 0) {
+        fprintf(stderr, "Usage: %s [size_mb] [rounds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t size = size_mb * 1024 * 1024;
+    char* text = make_document(size);
+    if (text == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("document: %zu MB, %d rounds (best round reported)\n", size_mb, rounds);
+    for (size_t k = 0; k < sizeof(kernel_names) / sizeof(kernel_names[0]); k++) {
+        if (text_scan_use(kernel_names[k]) != 0) {
+            printf("%-7s not supported on this CPU\n", kernel_names[k]);
+            continue;
+        }
+
+        double best_split = 1e9, best_count = 1e9;
+        size_t sentences = 0, words = 0;
+        for (int r = 0; r < rounds; r++) {
+            double start = now_seconds();
+            sentences = split_sentences(text, size);
+            double split_time = now_seconds() - start;
+
+            start = now_seconds();
+            int in_word = 0;
+            words = text_count_words(text, size, &in_word);
+            double count_time = now_seconds() - start;
+
+            if (split_time < best_split) best_split = split_time;
+            if (count_time < best_count) best_count = count_time;
+        }
+
+        printf("%-7s split: %6.2f GB/s (%zu sentences)   words: %6.2f GB/s (%zu words)\n",
+               kernel_names[k], size / best_split / 1e9, sentences,
+               size / best_count / 1e9, words);
+    }
+
+    free(text);
+    return EXIT_SUCCESS;
+}
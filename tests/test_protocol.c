@@ -5,7 +5,12 @@
 
 #include "../include/protocol.h"
 #include "../include/common.h"
+#include "../include/sha256.h"
+#include "../include/capability.h"
+#include "../include/file_ops.h"
+#include "../include/text_scan.h"
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -209,6 +214,9 @@ void test_string_conversions() {
     assert(string_to_command("VIEW") == CMD_VIEW);
     assert(string_to_command("READ") == CMD_READ);
     assert(string_to_command("CREATE") == CMD_CREATE);
+    assert(string_to_command("REVERT") == CMD_REVERT);
+    assert(strcmp(command_to_string(CMD_REVERT), "REVERT") == 0);
+    assert(string_to_command("listcheckpoints") == CMD_LISTCHECKPOINTS);
     
     // Case insensitive test
     assert(string_to_command("view") == CMD_VIEW);
@@ -245,6 +253,309 @@ void test_edge_cases() {
     printf("✓ Edge cases test passed\n");
 }
 
+// Test location lease token helpers
+void test_lease_tokens() {
+    printf("Testing location lease tokens...\n");
+    
+    char args[MAX_ARGS_LEN] = "doc.txt 3";
+    uint32_t version = 0;
+    
+    // No token present
+    assert(extract_lease_token(args, &version) == 0);
+    assert(strcmp(args, "doc.txt 3") == 0);
+    
+    // Round trip strips the token and leaves the original args intact
+    assert(append_lease_token(args, sizeof(args), 42) == 0);
+    assert(strcmp(args, "doc.txt 3 lease=42") == 0);
+    assert(extract_lease_token(args, &version) == 1);
+    assert(version == 42);
+    assert(strcmp(args, "doc.txt 3") == 0);
+    
+    // Token on an ACL update payload
+    char acl_args[MAX_ARGS_LEN] = "doc.txt alice:RW,bob:R lease=7";
+    assert(extract_lease_token(acl_args, &version) == 1);
+    assert(version == 7);
+    assert(strcmp(acl_args, "doc.txt alice:RW,bob:R") == 0);
+    
+    // Overflow is reported without corrupting args
+    char small[12] = "doc.txt";
+    assert(append_lease_token(small, sizeof(small), 123456) == -1);
+    assert(strcmp(small, "doc.txt") == 0);
+    
+    printf("✓ Lease token test passed\n");
+}
+
+// Test IFVERSION conditions of WRITE/ETIRW
+void test_version_conditions() {
+    printf("Testing version conditions...\n");
+    
+    uint32_t version = 0;
+    
+    // No condition present
+    char plain[MAX_ARGS_LEN] = "doc.txt 3 10";
+    assert(extract_version_condition(plain, &version) == 0);
+    assert(strcmp(plain, "doc.txt 3 10") == 0);
+    
+    // Condition in the middle keeps the options after it
+    char write_args[MAX_ARGS_LEN] = "doc.txt 3 IFVERSION 12 10";
+    assert(extract_version_condition(write_args, &version) == 1);
+    assert(version == 12);
+    assert(strcmp(write_args, "doc.txt 3 10") == 0);
+    
+    // ETIRW form, with the lease token behind it
+    char etirw_args[MAX_ARGS_LEN] = "doc.txt IFVERSION 0 lease=4";
+    assert(extract_version_condition(etirw_args, &version) == 1);
+    assert(version == 0);
+    assert(strcmp(etirw_args, "doc.txt lease=4") == 0);
+    
+    // Missing or negative versions are malformed
+    char missing[MAX_ARGS_LEN] = "doc.txt IFVERSION";
+    assert(extract_version_condition(missing, &version) == -1);
+    char negative[MAX_ARGS_LEN] = "doc.txt IFVERSION -1";
+    assert(extract_version_condition(negative, &version) == -1);
+    
+    printf("✓ Version condition test passed\n");
+}
+
+// Test capability signing and verification
+void test_capabilities() {
+    printf("Testing capability tokens...\n");
+    
+    // SHA-256 known answer ("abc", FIPS 180-2 appendix B.1)
+    uint8_t digest[SHA256_DIGEST_LEN];
+    const uint8_t expected_abc[4] = {0xba, 0x78, 0x16, 0xbf};
+    sha256("abc", 3, digest);
+    assert(memcmp(digest, expected_abc, sizeof(expected_abc)) == 0);
+    assert(digest[31] == 0xad);
+    
+    uint8_t key[CAPABILITY_KEY_LEN];
+    memset(key, 0x5a, sizeof(key));
+    char hex[CAPABILITY_KEY_LEN * 2 + 1];
+    uint8_t decoded[CAPABILITY_KEY_LEN];
+    encode_capability_key(key, hex, sizeof(hex));
+    assert(decode_capability_key(hex, decoded) == 0);
+    assert(memcmp(key, decoded, sizeof(key)) == 0);
+    
+    time_t now = 1000;
+    char read_cap[MAX_CAPABILITY_LEN];
+    char write_cap[MAX_CAPABILITY_LEN];
+    assert(issue_capability(key, "alice", "doc.txt", ACCESS_READ, now + 30, 5,
+                            read_cap, sizeof(read_cap)) == 0);
+    assert(issue_capability(key, "alice", "doc.txt", ACCESS_WRITE, now + 30, 5,
+                            write_cap, sizeof(write_cap)) == 0);
+    assert(read_cap[0] == 'R' && write_cap[0] == 'W');
+    
+    // Genuine grants
+    assert(verify_capability(key, read_cap, "alice", "doc.txt", ACCESS_READ, 5, now) == CAPABILITY_OK);
+    assert(verify_capability(key, write_cap, "alice", "doc.txt", ACCESS_READ, 5, now) == CAPABILITY_OK);
+    assert(verify_capability(key, write_cap, "alice", "doc.txt", ACCESS_WRITE, 5, now) == CAPABILITY_OK);
+    
+    // A read grant does not cover writes
+    assert(verify_capability(key, read_cap, "alice", "doc.txt", ACCESS_WRITE, 5, now) == CAPABILITY_DENIED);
+    
+    // Bound to user, file and lease
+    assert(verify_capability(key, read_cap, "bob", "doc.txt", ACCESS_READ, 5, now) == CAPABILITY_INVALID);
+    assert(verify_capability(key, read_cap, "alice", "other.txt", ACCESS_READ, 5, now) == CAPABILITY_INVALID);
+    assert(verify_capability(key, read_cap, "alice", "doc.txt", ACCESS_READ, 6, now) == CAPABILITY_INVALID);
+    
+    // Upgrading the permission letter breaks the MAC
+    char forged[MAX_CAPABILITY_LEN];
+    strcpy(forged, read_cap);
+    forged[0] = 'W';
+    assert(verify_capability(key, forged, "alice", "doc.txt", ACCESS_WRITE, 5, now) == CAPABILITY_INVALID);
+    assert(verify_capability(key, "garbage", "alice", "doc.txt", ACCESS_READ, 5, now) == CAPABILITY_INVALID);
+    
+    // Expiry
+    assert(verify_capability(key, read_cap, "alice", "doc.txt", ACCESS_READ, 5, now + 31) == CAPABILITY_EXPIRED);
+    
+    // Args round trip alongside the lease token
+    char args[MAX_ARGS_LEN] = "doc.txt";
+    char token[MAX_CAPABILITY_LEN];
+    uint32_t version = 0;
+    assert(append_capability_token(args, sizeof(args), read_cap) == 0);
+    assert(append_lease_token(args, sizeof(args), 5) == 0);
+    assert(extract_lease_token(args, &version) == 1 && version == 5);
+    assert(extract_capability_token(args, token, sizeof(token)) == 1);
+    assert(strcmp(token, read_cap) == 0);
+    assert(strcmp(args, "doc.txt") == 0);
+    assert(extract_capability_token(args, token, sizeof(token)) == 0);
+    
+    printf("✓ Capability token test passed\n");
+}
+
+// Test the sentence rope beyond the old 1000-sentence / 4 KB limits
+void test_document_model() {
+    printf("Testing document model...\n");
+    
+    // 3000 sentences, about 40 KB
+    size_t capacity = 64 * 1024;
+    char* text = malloc(capacity);
+    size_t len = 0;
+    for (int i = 0; i < 3000; i++) {
+        len += snprintf(text + len, capacity - len, "%sSentence number %d.", i ? " " : "", i);
+    }
+    
+    file_content_t content;
+    assert(parse_file_into_sentences(text, &content) == 0);
+    assert(content.sentence_count == 3000);
+    assert(serialized_content_length(&content) == len);
+    assert(content_word_count(&content) == 3000 * 3);
+    assert(strcmp(get_sentence(&content, 2999)->content, "Sentence number 2999.") == 0);
+    assert(get_sentence(&content, 3000) == NULL);
+    
+    // Round trip
+    char* out = malloc(len + 1);
+    assert(serialize_sentences_to_content(&content, out, len + 1) == 0);
+    assert(strcmp(out, text) == 0);
+    assert(serialize_sentences_to_content(&content, out, len) == -1);
+    free(out);
+    
+    // Edit in the middle; totals follow the edit
+    sentence_t* s = get_sentence(&content, 1500);
+    assert(replace_word_at_position(s, 1, "index") == 0);
+    refresh_sentence_totals(&content, 1500);
+    assert(strcmp(get_sentence(&content, 1500)->content, "Sentence index number 1500.") == 0);
+    assert(serialized_content_length(&content) == len + 6);
+    assert(content_word_count(&content) == 3000 * 3 + 1);
+    
+    // Insert, append and remove sentences
+    assert(insert_sentence(&content, 0, "First.") == 0);
+    assert(insert_sentence(&content, content.sentence_count, "") == 0);
+    assert(content.sentence_count == 3002);
+    assert(strcmp(get_sentence(&content, 0)->content, "First.") == 0);
+    assert(strcmp(get_sentence(&content, 1501)->content, "Sentence index number 1500.") == 0);
+    assert(remove_sentence(&content, 0) == 0);
+    assert(remove_sentence(&content, content.sentence_count - 1) == 0);
+    assert(content.sentence_count == 3000);
+    free_file_content(&content);
+    
+    // A single sentence longer than the old 1 KB sentence buffer
+    char* long_text = malloc(8192);
+    size_t long_len = 0;
+    for (int i = 0; i < 90; i++) {
+        long_len += snprintf(long_text + long_len, 8192 - long_len, "%sword%02d", i ? " " : "", i);
+    }
+    assert(parse_file_into_sentences(long_text, &content) == 0);
+    assert(content.sentence_count == 1);
+    assert(get_sentence(&content, 0)->length == long_len);
+    assert(get_sentence(&content, 0)->word_count == 90);
+    free_file_content(&content);
+    
+    free(long_text);
+    free(text);
+    printf("✓ Document model test passed\n");
+}
+
+// Test span-based word editing (no 100-word cap, whitespace preserved)
+void test_word_editing() {
+    printf("Testing word editing...\n");
+    
+    sentence_t sentence;
+    memset(&sentence, 0, sizeof(sentence));
+    assert(set_sentence_content(&sentence, "Hello  world.", 13) == 0);
+    
+    size_t cursor = 0;
+    word_span_t span;
+    assert(next_word_span(sentence.content, sentence.length, &cursor, &span) == 1);
+    assert(span.offset == 0 && span.length == 5);
+    assert(next_word_span(sentence.content, sentence.length, &cursor, &span) == 1);
+    assert(span.offset == 7 && span.length == 6);
+    assert(next_word_span(sentence.content, sentence.length, &cursor, &span) == 0);
+    
+    // Insert before, append after, reject gaps
+    assert(replace_word_at_position(&sentence, 1, "big") == 0);
+    assert(strcmp(sentence.content, "Hello  big world.") == 0);
+    assert(replace_word_at_position(&sentence, 3, "Bye") == 0);
+    assert(strcmp(sentence.content, "Hello  big world. Bye") == 0);
+    assert(replace_word_at_position(&sentence, 5, "gap") == -1);
+    assert(replace_word_at_position(&sentence, 0, "  ") == -1);
+    assert(sentence.word_count == 4);
+    
+    // Delete takes the neighbouring whitespace
+    assert(delete_word_at_position(&sentence, 0) == 0);
+    assert(strcmp(sentence.content, "big world. Bye") == 0);
+    assert(delete_word_at_position(&sentence, 2) == 0);
+    assert(strcmp(sentence.content, "big world.") == 0);
+    assert(delete_word_at_position(&sentence, 2) == -1);
+    assert(insert_word_at_position(&sentence, 1, "new") == 0);
+    assert(strcmp(sentence.content, "big new world.") == 0);
+    
+    // Words past the 100th are editable
+    assert(set_sentence_content(&sentence, "", 0) == 0);
+    for (int i = 0; i < 150; i++) {
+        char word[16];
+        snprintf(word, sizeof(word), "w%d", i);
+        assert(replace_word_at_position(&sentence, i, word) == 0);
+    }
+    assert(sentence.word_count == 150);
+    assert(count_words_in_sentence(sentence.content) == 150);
+    assert(delete_word_at_position(&sentence, 140) == 0);
+    assert(insert_word_at_position(&sentence, 149, "last") == 0);
+    assert(strstr(sentence.content, "w139 w141") != NULL);
+    assert(strcmp(sentence.content + sentence.length - 9, "w149 last") == 0);
+    
+    free(sentence.content);
+    printf("✓ Word editing test passed\n");
+}
+
+// Test that every available scanning kernel agrees with the scalar one
+void test_text_scan() {
+    printf("Testing text scan kernels...\n");
+    
+    // Mixed text with all whitespace kinds and delimiters near block edges
+    char text[1000];
+    unsigned int seed = 7;
+    const char alphabet[] = "abc .!?\t\n\r\v\fxyz";
+    for (size_t i = 0; i < sizeof(text) - 1; i++) {
+        text[i] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+    }
+    text[sizeof(text) - 1] = '\0';
+    
+    const char* kernels[] = {"scalar", "sse2", "avx2"};
+    assert(text_scan_use("scalar") == 0);
+    assert(text_scan_use("no-such-kernel") == -1);
+    
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (text_scan_use(kernels[k]) != 0) {
+            continue;  // Not supported on this CPU
+        }
+        for (size_t start = 0; start < 70; start++) {
+            for (size_t len = 0; len + start < sizeof(text) - 1; len += 37) {
+                // Reference: plain isspace()/delimiter loops
+                size_t expected_delim = len;
+                size_t expected_words = 0;
+                int word = 0;
+                for (size_t i = 0; i < len; i++) {
+                    char c = text[start + i];
+                    if (expected_delim == len && is_sentence_delimiter(c)) {
+                        expected_delim = i;
+                    }
+                    if (isspace((unsigned char)c)) {
+                        word = 0;
+                    } else if (!word) {
+                        word = 1;
+                        expected_words++;
+                    }
+                }
+                
+                assert(text_find_delimiter(text + start, len) == expected_delim);
+                int in_word = 0;
+                assert(text_count_words(text + start, len, &in_word) == expected_words);
+                assert(in_word == word);
+            }
+        }
+        
+        // Counting in blocks matches counting in one pass
+        int in_word = 0;
+        size_t words = text_count_words(text, 333, &in_word);
+        words += text_count_words(text + 333, sizeof(text) - 1 - 333, &in_word);
+        in_word = 0;
+        assert(words == text_count_words(text, sizeof(text) - 1, &in_word));
+    }
+    
+    printf("✓ Text scan test passed\n");
+}
+
 // Main test function
 int main() {
     printf("=== Docs++ Protocol Test Suite ===\n\n");
@@ -255,6 +566,12 @@ int main() {
     test_command_parsing();
     test_string_conversions();
     test_edge_cases();
+    test_lease_tokens();
+    test_version_conditions();
+    test_capabilities();
+    test_document_model();
+    test_word_editing();
+    test_text_scan();
     
     printf("\n=== All Protocol Tests Passed! ===\n");
     printf("The protocol implementation is working correctly.\n");
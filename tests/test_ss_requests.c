@@ -0,0 +1,601 @@
+/*
+ * Storage Server Request Test - Runs the storage server binary against a
+ * stand-in Name Server and checks its answers to NM commands and to
+ * direct client requests
+ * The stand-in hands the server its capability key at SS_INIT, so the test
+ * can issue (and forge) the tokens a real NM would give clients
+ *
+ * Usage: test_ss_requests [storage_server binary]
+ */
+
+#include "../include/common.h"
+#include "../include/capability.h"
+#include "../include/protocol.h"
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_TIMEOUT_SECONDS 60
+
+static char storage_dir[] = "/tmp/test_ss_requests.XXXXXX";
+static const char* server_binary = "bin/storage_server";
+static uint8_t capability_key[CAPABILITY_KEY_LEN];
+static int nm_listener = -1;
+static int nm_port = 0;
+static int nm_sock = -1;        // The storage server's connection to the stand-in NM
+static int client_port = 0;
+static pid_t server_pid = -1;
+static uint32_t next_request_id = 1;
+
+// Listen on a free loopback port
+static int listen_on_free_port(int* port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(listen(sock, 4) == 0);
+
+    socklen_t length = sizeof(addr);
+    assert(getsockname(sock, (struct sockaddr*)&addr, &length) == 0);
+    *port = ntohs(addr.sin_port);
+    return sock;
+}
+
+// Start the storage server and accept its SS_INIT; @floor is the lease
+// version the stand-in NM registers it at
+static void start_server(uint32_t floor) {
+    fflush(stdout);
+    server_pid = fork();
+    assert(server_pid >= 0);
+    if (server_pid == 0) {
+        char nm_port_arg[16], client_port_arg[16];
+        snprintf(nm_port_arg, sizeof(nm_port_arg), "%d", nm_port);
+        snprintf(client_port_arg, sizeof(client_port_arg), "%d", client_port);
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        execl(server_binary, server_binary, "127.0.0.1", nm_port_arg, storage_dir,
+              client_port_arg, "4", (char*)NULL);
+        _exit(127);
+    }
+
+    nm_sock = accept(nm_listener, NULL, NULL);
+    assert(nm_sock >= 0);
+
+    request_packet_t init;
+    assert(recv_request(nm_sock, &init) > 0);
+    assert(init.command == CMD_SS_INIT);
+
+    char key_hex[CAPABILITY_KEY_LEN * 2 + 1];
+    encode_capability_key(capability_key, key_hex, sizeof(key_hex));
+
+    response_packet_t response;
+    memset(&response, 0, sizeof(response));
+    response.magic = PROTOCOL_MAGIC;
+    response.status = STATUS_OK;
+    response.request_id = init.request_id;
+    snprintf(response.data, sizeof(response.data), "SS registered: 0 files key=%s lease=%u",
+             key_hex, floor);
+    response.checksum = calculate_checksum(&response, sizeof(response) - sizeof(uint32_t));
+    assert(send_response(nm_sock, &response) > 0);
+}
+
+// Stop the storage server (it flushes its state on SIGTERM)
+static void stop_server(void) {
+    assert(kill(server_pid, SIGTERM) == 0);
+    int status;
+    assert(waitpid(server_pid, &status, 0) == server_pid);
+    close(nm_sock);
+    nm_sock = -1;
+    server_pid = -1;
+}
+
+// Send a command as the NM and wait for its reply; returns the reply status
+static int nm_command(command_t command, const char* user, const char* args,
+                      response_packet_t* response) {
+    request_packet_t request;
+    memset(&request, 0, sizeof(request));
+    request.command = command;
+    request.request_id = next_request_id++;
+    strncpy(request.username, user, sizeof(request.username) - 1);
+    strncpy(request.args, args, sizeof(request.args) - 1);
+    assert(send_packet(nm_sock, &request) > 0);
+
+    assert(recv_packet(nm_sock, response) > 0);
+    assert(response->request_id == request.request_id);
+    return response->status;
+}
+
+// Connect to the storage server as a client
+static int connect_client(void) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(client_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    return sock;
+}
+
+// Send a client request on @sock without waiting for its reply
+static void send_request(int sock, command_t command, const char* user, const char* args) {
+    request_packet_t request;
+    memset(&request, 0, sizeof(request));
+    request.command = command;
+    request.request_id = next_request_id++;
+    strncpy(request.username, user, sizeof(request.username) - 1);
+    strncpy(request.args, args, sizeof(request.args) - 1);
+    assert(send_packet(sock, &request) > 0);
+}
+
+// Send a client request on @sock and wait for its reply; returns the reply status
+static int client_command(int sock, command_t command, const char* user, const char* args,
+                          response_packet_t* response) {
+    send_request(sock, command, user, args);
+    assert(recv_packet(sock, response) > 0);
+    return response->status;
+}
+
+// Open a WRITE session on a connection of its own; returns the socket
+static int begin_write(const char* user, const char* args) {
+    response_packet_t response;
+    int sock = connect_client();
+    assert(client_command(sock, CMD_WRITE, user, args, &response) == STATUS_OK);
+    return sock;
+}
+
+// Apply one "<index> <word>" update to an open WRITE session
+static void write_word(int sock, const char* user, const char* update) {
+    response_packet_t response;
+    assert(client_command(sock, CMD_WRITE, user, update, &response) == STATUS_OK);
+}
+
+// End a WRITE session with ETIRW; returns the reply status
+static int end_write(int sock, const char* user, const char* args,
+                     response_packet_t* response) {
+    int status = client_command(sock, CMD_ETIRW, user, args, response);
+    close(sock);
+    return status;
+}
+
+// One whole WRITE session of a single word update; returns the ETIRW status
+static int save_word(const char* user, const char* args, const char* update) {
+    response_packet_t response;
+    int sock = begin_write(user, args);
+    write_word(sock, user, update);
+    return end_write(sock, user, "", &response);
+}
+
+// READ a file directly; returns the reply status. On STATUS_OK @content
+// holds the document and @version its version.
+static int read_document(const char* user, const char* args, char* content, size_t size,
+                         uint32_t* version) {
+    int sock = connect_client();
+
+    request_packet_t request;
+    memset(&request, 0, sizeof(request));
+    request.command = CMD_READ;
+    request.request_id = next_request_id++;
+    strncpy(request.username, user, sizeof(request.username) - 1);
+    strncpy(request.args, args, sizeof(request.args) - 1);
+    assert(send_packet(sock, &request) > 0);
+
+    response_packet_t error;
+    uint64_t length = 0;
+    uint32_t read_version = 0;
+    int result = recv_content_header(sock, &error, &length, &read_version);
+    assert(result >= 0);
+    if (result > 0) {
+        close(sock);
+        return error.status;
+    }
+
+    assert(length < size);
+    size_t received = 0;
+    while (received < length) {
+        ssize_t n = recv(sock, content + received, length - received, 0);
+        assert(n > 0);
+        received += n;
+    }
+    content[length] = '\0';
+    if (version != NULL) {
+        *version = read_version;
+    }
+    close(sock);
+    return STATUS_OK;
+}
+
+// Test that direct requests carrying a lease older than the file's last
+// placement or ACL change are sent back to the NM
+void test_lease_floors() {
+    printf("Testing location lease floors...\n");
+
+    response_packet_t response;
+    char content[256];
+
+    start_server(5);
+    assert(nm_command(CMD_CREATE, "alice", "lease.txt lease=7", &response) == STATUS_OK);
+
+    // The CREATE raised the file's floor above the registration's
+    assert(read_document("alice", "lease.txt lease=6", content, sizeof(content), NULL) ==
+           STATUS_ERROR_LEASE_EXPIRED);
+    assert(read_document("alice", "lease.txt lease=7", content, sizeof(content), NULL) ==
+           STATUS_OK);
+
+    // Other files are held to the registration's floor
+    assert(read_document("alice", "other.txt lease=4", content, sizeof(content), NULL) ==
+           STATUS_ERROR_LEASE_EXPIRED);
+    assert(read_document("alice", "other.txt lease=5", content, sizeof(content), NULL) ==
+           STATUS_ERROR_NOT_FOUND);
+
+    // An ACL change invalidates the leases issued before it
+    assert(nm_command(CMD_UPDATE_ACL, "alice", "lease.txt bob:R lease=9", &response) ==
+           STATUS_OK);
+    assert(read_document("bob", "lease.txt lease=8", content, sizeof(content), NULL) ==
+           STATUS_ERROR_LEASE_EXPIRED);
+    assert(read_document("bob", "lease.txt lease=9", content, sizeof(content), NULL) ==
+           STATUS_OK);
+
+    // Requests routed through the NM carry no lease and are not redirected
+    assert(read_document("bob", "lease.txt", content, sizeof(content), NULL) == STATUS_OK);
+
+    // Registering again starts over: a restarted NM numbers from 2, and
+    // the old floor of 9 must not lock its clients out
+    stop_server();
+    start_server(2);
+    assert(read_document("bob", "lease.txt lease=3", content, sizeof(content), NULL) ==
+           STATUS_OK);
+    assert(read_document("bob", "lease.txt lease=1", content, sizeof(content), NULL) ==
+           STATUS_ERROR_LEASE_EXPIRED);
+    stop_server();
+
+    printf("✓ Location lease floor test passed\n");
+}
+
+// Direct request args: @request followed by the capability the NM would
+// issue @user for @filename, and the lease it was issued with
+static void sign_args(char* args, size_t size, const char* request, const char* user,
+                      const char* filename, int access, time_t expiry, uint32_t lease) {
+    char token[MAX_CAPABILITY_LEN];
+    assert(issue_capability(capability_key, user, filename, access, expiry, lease,
+                            token, sizeof(token)) == 0);
+    snprintf(args, size, "%s", request);
+    assert(append_capability_token(args, size, token) == 0);
+    assert(append_lease_token(args, size, lease) == 0);
+}
+
+// Test that a valid capability stands in for the ACL, and that forged,
+// foreign, insufficient or expired ones are refused
+void test_capabilities() {
+    printf("Testing capability checks...\n");
+
+    response_packet_t response;
+    char content[256];
+    char args[MAX_ARGS_LEN];
+    time_t expiry = time(NULL) + 60;
+
+    start_server(1);
+    assert(nm_command(CMD_CREATE, "alice", "cap.txt lease=2", &response) == STATUS_OK);
+
+    // carol is not on the ACL, so without a capability the ACL refuses her
+    assert(read_document("carol", "cap.txt lease=2", content, sizeof(content), NULL) ==
+           STATUS_ERROR_READ_PERMISSION);
+
+    // ...but the NM's capability lets her read, and a W one lets her write
+    sign_args(args, sizeof(args), "cap.txt", "carol", "cap.txt", ACCESS_READ, expiry, 2);
+    assert(read_document("carol", args, content, sizeof(content), NULL) == STATUS_OK);
+
+    int sock = connect_client();
+    sign_args(args, sizeof(args), "cap.txt 0", "carol", "cap.txt", ACCESS_WRITE, expiry, 2);
+    assert(client_command(sock, CMD_WRITE, "carol", args, &response) == STATUS_OK);
+    assert(client_command(sock, CMD_WRITE, "carol", "0 Signed.", &response) == STATUS_OK);
+    assert(client_command(sock, CMD_ETIRW, "carol", "", &response) == STATUS_OK);
+    close(sock);
+    assert(read_document("alice", "cap.txt", content, sizeof(content), NULL) == STATUS_OK);
+    assert(strcmp(content, "Signed.") == 0);
+
+    // A reader cannot turn its token into a writer's: the MAC covers the permission
+    sign_args(args, sizeof(args), "cap.txt 0", "carol", "cap.txt", ACCESS_READ, expiry, 2);
+    char* perm = strstr(args, "cap=R") + 4;
+    *perm = 'W';
+    sock = connect_client();
+    assert(client_command(sock, CMD_WRITE, "carol", args, &response) ==
+           STATUS_ERROR_UNAUTHORIZED);
+    close(sock);
+
+    // A damaged MAC
+    sign_args(args, sizeof(args), "cap.txt", "carol", "cap.txt", ACCESS_READ, expiry, 2);
+    char* mac_end = strstr(args, " lease=") - 1;
+    *mac_end = (*mac_end == '0') ? '1' : '0';
+    assert(read_document("carol", args, content, sizeof(content), NULL) ==
+           STATUS_ERROR_UNAUTHORIZED);
+
+    // Another user's token, or one for another file
+    sign_args(args, sizeof(args), "cap.txt", "carol", "cap.txt", ACCESS_READ, expiry, 2);
+    assert(read_document("dave", args, content, sizeof(content), NULL) ==
+           STATUS_ERROR_UNAUTHORIZED);
+    sign_args(args, sizeof(args), "cap.txt", "carol", "other.txt", ACCESS_READ, expiry, 2);
+    assert(read_document("carol", args, content, sizeof(content), NULL) ==
+           STATUS_ERROR_UNAUTHORIZED);
+
+    // A genuine R token does not grant writes
+    sign_args(args, sizeof(args), "cap.txt 0", "carol", "cap.txt", ACCESS_READ, expiry, 2);
+    sock = connect_client();
+    assert(client_command(sock, CMD_WRITE, "carol", args, &response) ==
+           STATUS_ERROR_WRITE_PERMISSION);
+    close(sock);
+
+    // An expired token is sent back to the NM for a new one
+    sign_args(args, sizeof(args), "cap.txt", "carol", "cap.txt", ACCESS_READ,
+              time(NULL) - 1, 2);
+    assert(read_document("carol", args, content, sizeof(content), NULL) ==
+           STATUS_ERROR_LEASE_EXPIRED);
+    stop_server();
+
+    printf("✓ Capability check test passed\n");
+}
+
+// Test that ETIRW merges only the locked sentence into the file as it
+// stands, so writers of other sentences keep their commits
+void test_sentence_merge() {
+    printf("Testing sentence merge at ETIRW...\n");
+
+    response_packet_t response;
+    char content[256];
+
+    start_server(1);
+    assert(nm_command(CMD_CREATE, "alice", "merge.txt", &response) == STATUS_OK);
+    assert(nm_command(CMD_UPDATE_ACL, "alice", "merge.txt bob:RW", &response) == STATUS_OK);
+    assert(save_word("alice", "merge.txt 0", "0 One.") == STATUS_OK);
+    assert(save_word("alice", "merge.txt 1", "0 Two.") == STATUS_OK);
+
+    // Both writers lock before either commits; neither loses its edit
+    int first = begin_write("alice", "merge.txt 0");
+    int second = begin_write("bob", "merge.txt 1");
+    write_word(first, "alice", "0 Big");
+    write_word(second, "bob", "0 Small");
+    assert(end_write(second, "bob", "", &response) == STATUS_OK);
+    assert(end_write(first, "alice", "", &response) == STATUS_OK);
+    assert(read_document("alice", "merge.txt", content, sizeof(content), NULL) == STATUS_OK);
+    assert(strcmp(content, "Big One. Small Two.") == 0);
+
+    // A commit that splits an earlier sentence moves the locked one; it is
+    // found again by its text
+    first = begin_write("alice", "merge.txt 1");
+    assert(save_word("bob", "merge.txt 0", "0 Zero.") == STATUS_OK);
+    write_word(first, "alice", "0 Very");
+    assert(end_write(first, "alice", "", &response) == STATUS_OK);
+    assert(read_document("alice", "merge.txt", content, sizeof(content), NULL) == STATUS_OK);
+    assert(strcmp(content, "Zero. Big One. Very Small Two.") == 0);
+
+    // A sentence that no longer reads as it did at WRITE cannot be merged
+    first = begin_write("alice", "merge.txt 2");
+    assert(nm_command(CMD_UNDO, "alice", "merge.txt", &response) == STATUS_OK);
+    write_word(first, "alice", "0 Lost");
+    assert(end_write(first, "alice", "", &response) == STATUS_ERROR_CONCURRENT_WRITE);
+    assert(read_document("alice", "merge.txt", content, sizeof(content), NULL) == STATUS_OK);
+    assert(strcmp(content, "Zero. Big One. Small Two.") == 0);
+    stop_server();
+
+    printf("✓ Sentence merge test passed\n");
+}
+
+// Test sentence locks as clients see them: one writer per sentence, other
+// sentences free, and a lock passed on when its holder commits or leaves
+void test_sentence_locks() {
+    printf("Testing sentence locks...\n");
+
+    response_packet_t response;
+    char content[256];
+
+    start_server(1);
+    assert(nm_command(CMD_CREATE, "alice", "lock.txt", &response) == STATUS_OK);
+    assert(nm_command(CMD_UPDATE_ACL, "alice", "lock.txt bob:RW", &response) == STATUS_OK);
+    assert(save_word("alice", "lock.txt 0", "0 One.") == STATUS_OK);
+    assert(save_word("alice", "lock.txt 1", "0 Two.") == STATUS_OK);
+
+    // A locked sentence is refused; another sentence of the file is not
+    int holder = begin_write("alice", "lock.txt 0");
+    int other = connect_client();
+    assert(client_command(other, CMD_WRITE, "bob", "lock.txt 0", &response) ==
+           STATUS_ERROR_LOCKED);
+    assert(client_command(other, CMD_WRITE, "bob", "lock.txt 1", &response) == STATUS_OK);
+    assert(end_write(other, "bob", "", &response) == STATUS_OK);
+
+    // A writer queued for the lock gets it once the holder commits
+    int waiter = connect_client();
+    send_request(waiter, CMD_WRITE, "bob", "lock.txt 0 5");
+    usleep(200000);
+    write_word(holder, "alice", "0 First");
+    assert(end_write(holder, "alice", "", &response) == STATUS_OK);
+    assert(recv_packet(waiter, &response) > 0 && response.status == STATUS_OK);
+    write_word(waiter, "bob", "0 Then");
+    assert(end_write(waiter, "bob", "", &response) == STATUS_OK);
+    assert(read_document("alice", "lock.txt", content, sizeof(content), NULL) == STATUS_OK);
+    assert(strcmp(content, "Then First One. Two.") == 0);
+
+    // A client that leaves without ETIRW gives its lock up
+    holder = begin_write("alice", "lock.txt 1");
+    close(holder);
+    usleep(200000);
+    assert(save_word("bob", "lock.txt 1", "0 Last") == STATUS_OK);
+    stop_server();
+
+    printf("✓ Sentence lock test passed\n");
+}
+
+// Test that commits number the document's versions, that IFVERSION writes
+// fail once another commit got in, and that INFO reports the version and
+// statistics of the content
+void test_versions() {
+    printf("Testing document versions...\n");
+
+    response_packet_t response;
+    char content[256];
+    uint32_t version = 0;
+
+    start_server(1);
+    assert(nm_command(CMD_CREATE, "alice", "ver.txt", &response) == STATUS_OK);
+    assert(nm_command(CMD_UPDATE_ACL, "alice", "ver.txt bob:RW", &response) == STATUS_OK);
+    assert(read_document("alice", "ver.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 0);
+
+    // ETIRW and READ report the new version
+    int sock = begin_write("alice", "ver.txt 0");
+    write_word(sock, "alice", "0 One.");
+    assert(end_write(sock, "alice", "", &response) == STATUS_OK);
+    assert(strstr(response.data, "version 1)") != NULL);
+    assert(read_document("alice", "ver.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 1);
+
+    // A WRITE conditional on an older version is refused before the lock
+    sock = connect_client();
+    assert(client_command(sock, CMD_WRITE, "alice", "ver.txt 0 IFVERSION 0", &response) ==
+           STATUS_ERROR_VERSION_MISMATCH);
+    assert(strstr(response.data, "at version 1, not 0") != NULL);
+    assert(client_command(sock, CMD_WRITE, "alice", "ver.txt 0 IFVERSION one", &response) ==
+           STATUS_ERROR_INVALID_ARGS);
+    close(sock);
+
+    // ...and at ETIRW, if another commit got in after the lock; the
+    // session ends and the file keeps the other commit
+    sock = begin_write("alice", "ver.txt 0 IFVERSION 1");
+    assert(save_word("bob", "ver.txt 1", "0 Two.") == STATUS_OK);
+    write_word(sock, "alice", "0 Stale");
+    assert(client_command(sock, CMD_ETIRW, "alice", "", &response) ==
+           STATUS_ERROR_VERSION_MISMATCH);
+    assert(strstr(response.data, "at version 2, not 1") != NULL);
+    assert(client_command(sock, CMD_ETIRW, "alice", "", &response) == STATUS_ERROR_INTERNAL);
+    close(sock);
+    assert(read_document("alice", "ver.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 2 && strcmp(content, "One. Two.") == 0);
+
+    // "ETIRW IFVERSION" makes an unconditional session conditional
+    sock = begin_write("alice", "ver.txt 0");
+    write_word(sock, "alice", "0 Now");
+    assert(end_write(sock, "alice", "IFVERSION 2", &response) == STATUS_OK);
+    assert(strstr(response.data, "version 3)") != NULL);
+    sock = begin_write("alice", "ver.txt 0");
+    write_word(sock, "alice", "0 Late");
+    assert(end_write(sock, "alice", "IFVERSION 2", &response) ==
+           STATUS_ERROR_VERSION_MISMATCH);
+
+    // INFO reports the version and the statistics of the content
+    unsigned int info_version = 0;
+    size_t size = 0;
+    int words = 0, chars = 0;
+    assert(nm_command(CMD_INFO, "alice", "ver.txt", &response) == STATUS_OK);
+    assert(sscanf(response.data, "version=%u size=%zu words=%d chars=%d",
+                  &info_version, &size, &words, &chars) == 4);
+    assert(read_document("alice", "ver.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(strcmp(content, "Now One. Two.") == 0);
+    assert(info_version == 3 && version == 3);
+    assert(size == strlen(content) && chars == (int)strlen(content) && words == 3);
+
+    // Versions survive a restart
+    stop_server();
+    start_server(1);
+    assert(read_document("alice", "ver.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 3);
+    assert(nm_command(CMD_INFO, "alice", "ver.txt", &response) == STATUS_OK);
+    assert(strncmp(response.data, "version=3 ", 10) == 0);
+    stop_server();
+
+    printf("✓ Document version test passed\n");
+}
+
+// Test that UNDO step counts and REVERT revisions must be whole numbers
+// from 1, and that refused commands leave the file as it was
+void test_undo_arguments() {
+    printf("Testing UNDO/REVERT arguments...\n");
+
+    static const char* bad_undo[] = { "abc", "0", "-2", "2x", "99999999999" };
+    static const char* bad_revert[] = { "0", "-1", "3junk", "" };
+    response_packet_t response;
+    char args[MAX_ARGS_LEN];
+    char content[256];
+    uint32_t version = 0;
+
+    start_server(1);
+    assert(nm_command(CMD_CREATE, "alice", "undo.txt", &response) == STATUS_OK);
+    assert(save_word("alice", "undo.txt 0", "0 One.") == STATUS_OK);
+    assert(save_word("alice", "undo.txt 1", "0 Two.") == STATUS_OK);
+
+    for (size_t i = 0; i < sizeof(bad_undo) / sizeof(bad_undo[0]); i++) {
+        snprintf(args, sizeof(args), "undo.txt %s", bad_undo[i]);
+        assert(nm_command(CMD_UNDO, "alice", args, &response) == STATUS_ERROR_INVALID_ARGS);
+        assert(strstr(response.data, "Invalid UNDO step count") != NULL);
+    }
+    for (size_t i = 0; i < sizeof(bad_revert) / sizeof(bad_revert[0]); i++) {
+        snprintf(args, sizeof(args), "undo.txt %s", bad_revert[i]);
+        assert(nm_command(CMD_REVERT, "alice", args, &response) == STATUS_ERROR_INVALID_ARGS);
+        assert(strstr(response.data, "Invalid revision") != NULL);
+    }
+    assert(read_document("alice", "undo.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 2 && strcmp(content, "One. Two.") == 0);
+
+    // Well-formed, but past the history or naming no checkpoint
+    assert(nm_command(CMD_UNDO, "alice", "undo.txt 99", &response) ==
+           STATUS_ERROR_UNDO_NOT_AVAILABLE);
+    assert(nm_command(CMD_REVERT, "alice", "undo.txt 99", &response) ==
+           STATUS_ERROR_UNDO_NOT_AVAILABLE);
+    assert(nm_command(CMD_REVERT, "alice", "undo.txt nosuch", &response) ==
+           STATUS_ERROR_NOT_FOUND);
+
+    // UNDO steps back one commit by default; REVERT takes a revision
+    // number (revision 1 is the empty file from CREATE)
+    assert(nm_command(CMD_UNDO, "alice", "undo.txt", &response) == STATUS_OK);
+    assert(read_document("alice", "undo.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 3 && strcmp(content, "One.") == 0);
+    assert(nm_command(CMD_REVERT, "alice", "undo.txt +3", &response) == STATUS_OK);
+    assert(strstr(response.data, "restored to revision 3") != NULL);
+    assert(read_document("alice", "undo.txt", content, sizeof(content), &version) == STATUS_OK);
+    assert(version == 4 && strcmp(content, "One. Two.") == 0);
+    stop_server();
+
+    printf("✓ UNDO/REVERT argument test passed\n");
+}
+
+int main(int argc, char* argv[]) {
+    printf("=== Docs++ Storage Server Request Test Suite ===\n\n");
+
+    if (argc > 1) {
+        server_binary = argv[1];
+    }
+    alarm(TEST_TIMEOUT_SECONDS);
+    signal(SIGPIPE, SIG_IGN);
+
+    assert(generate_capability_key(capability_key) == 0);
+    assert(mkdtemp(storage_dir) != NULL);
+    nm_listener = listen_on_free_port(&nm_port);
+
+    // A free port for the server's clients
+    int probe = listen_on_free_port(&client_port);
+    close(probe);
+
+    test_lease_floors();
+    test_capabilities();
+    test_sentence_merge();
+    test_sentence_locks();
+    test_versions();
+    test_undo_arguments();
+
+    close(nm_listener);
+    char cleanup[sizeof(storage_dir) + 16];
+    snprintf(cleanup, sizeof(cleanup), "rm -rf %s", storage_dir);
+    assert(system(cleanup) == 0);
+
+    printf("\n=== All Storage Server Request Tests Passed! ===\n");
+
+    return 0;
+}
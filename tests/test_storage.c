@@ -0,0 +1,1025 @@
+/*
+ * Storage Server Test - Exercises the storage server's modules directly
+ * Sentence locks, the edit log, the document cache and writer, the
+ * metadata cache, the revision log and the chunk store, without a Name
+ * Server or clients
+ * Built with a one second lock lease so lapsed leases can be observed
+ */
+
+#include "../include/common.h"
+#include "../include/logging.h"
+#include "../include/ss_cas.h"
+#include "../include/ss_doc_cache.h"
+#include "../include/ss_io.h"
+#include "../include/ss_lock_table.h"
+#include "../include/ss_materializer.h"
+#include "../include/ss_meta_cache.h"
+#include "../include/ss_revlog.h"
+#include "../include/ss_wal.h"
+#include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char test_root[] = "/tmp/test_storage.XXXXXX";
+
+// Run @body in a child process, as one lifetime of the storage server
+static void run_server(void (*body)(void)) {
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        body();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// A WRITE session blocked on a busy lock, run on its own thread
+typedef struct {
+    const char* filename;
+    const char* user;
+    int sentence;
+    int result;
+} lock_waiter_args_t;
+
+static pthread_mutex_t grant_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char* grant_order[4];
+static int grant_count = 0;
+
+static void* wait_for_lock(void* arg) {
+    lock_waiter_args_t* waiter = (lock_waiter_args_t*)arg;
+    waiter->result = ss_lock_acquire(waiter->filename, waiter->sentence, 0, SS_LOCK_LAST_WORD,
+                                     waiter->user, 5000, NULL);
+    pthread_mutex_lock(&grant_mutex);
+    grant_order[grant_count++] = waiter->user;
+    pthread_mutex_unlock(&grant_mutex);
+    return NULL;
+}
+
+static int granted_so_far() {
+    pthread_mutex_lock(&grant_mutex);
+    int count = grant_count;
+    pthread_mutex_unlock(&grant_mutex);
+    return count;
+}
+
+// Test word range locks of different users
+void test_lock_ranges() {
+    printf("Testing sentence lock ranges...\n");
+
+    char holder[MAX_USERNAME_LEN];
+    int held = ss_lock_count();
+
+    // Disjoint word ranges of one sentence belong to different users
+    assert(ss_lock_acquire("ranges.txt", 0, 0, 2, "alice", 0, NULL) == 1);
+    assert(ss_lock_acquire("ranges.txt", 0, 3, 5, "bob", 0, NULL) == 1);
+
+    // An overlapping range is refused and names the holder
+    holder[0] = '\0';
+    assert(ss_lock_acquire("ranges.txt", 0, 2, 4, "carol", 0, holder) == 0);
+    assert(strcmp(holder, "alice") == 0 || strcmp(holder, "bob") == 0);
+    assert(ss_lock_acquire("ranges.txt", 0, 0, SS_LOCK_LAST_WORD, "carol", 0, NULL) == 0);
+
+    // The same user may take a range they already hold
+    assert(ss_lock_acquire("ranges.txt", 0, 1, 2, "alice", 0, NULL) == 1);
+
+    // Other sentences and other files are independent
+    assert(ss_lock_acquire("ranges.txt", 1, 0, SS_LOCK_LAST_WORD, "carol", 0, NULL) == 1);
+    assert(ss_lock_acquire("other.txt", 0, 0, SS_LOCK_LAST_WORD, "carol", 0, NULL) == 1);
+
+    // Only the holder may renew or release a lock
+    assert(ss_lock_renew("ranges.txt", 0, 3, 5, "alice") == -1);
+    assert(ss_lock_release("ranges.txt", 0, 3, 5, "alice") == -1);
+    assert(ss_lock_renew("ranges.txt", 0, 3, 5, "bob") == 0);
+
+    // Releasing bob's range frees the words carol wanted
+    assert(ss_lock_release("ranges.txt", 0, 3, 5, "bob") == 0);
+    assert(ss_lock_acquire("ranges.txt", 0, 3, 5, "carol", 0, NULL) == 1);
+
+    assert(ss_lock_release("ranges.txt", 0, 3, 5, "carol") == 0);
+    assert(ss_lock_release("ranges.txt", 1, 0, SS_LOCK_LAST_WORD, "carol") == 0);
+    assert(ss_lock_release("other.txt", 0, 0, SS_LOCK_LAST_WORD, "carol") == 0);
+    assert(ss_lock_release("ranges.txt", 0, 0, 2, "alice") == 0);
+    assert(ss_lock_release("ranges.txt", 0, 1, 2, "alice") == 0);
+    assert(ss_lock_count() == held);
+
+    printf("✓ Sentence lock range test passed\n");
+}
+
+// Test that waiters for a busy lock are granted in arrival order
+void test_lock_fifo() {
+    printf("Testing sentence lock waiter order...\n");
+
+    lock_waiter_args_t bob = {"fifo.txt", "bob", 0, -2};
+    lock_waiter_args_t carol = {"fifo.txt", "carol", 0, -2};
+    pthread_t bob_thread, carol_thread;
+
+    assert(ss_lock_acquire("fifo.txt", 0, 0, SS_LOCK_LAST_WORD, "alice", 0, NULL) == 1);
+
+    // bob queues first, carol behind him
+    assert(pthread_create(&bob_thread, NULL, wait_for_lock, &bob) == 0);
+    usleep(100000);
+    assert(pthread_create(&carol_thread, NULL, wait_for_lock, &carol) == 0);
+    usleep(100000);
+    assert(granted_so_far() == 0);
+
+    // alice's release grants bob only; carol still conflicts with him
+    assert(ss_lock_release("fifo.txt", 0, 0, SS_LOCK_LAST_WORD, "alice") == 0);
+    pthread_join(bob_thread, NULL);
+    assert(bob.result == 1);
+    usleep(100000);
+    assert(granted_so_far() == 1);
+
+    assert(ss_lock_release("fifo.txt", 0, 0, SS_LOCK_LAST_WORD, "bob") == 0);
+    pthread_join(carol_thread, NULL);
+    assert(carol.result == 1);
+    assert(strcmp(grant_order[0], "bob") == 0);
+    assert(strcmp(grant_order[1], "carol") == 0);
+
+    // A waiter that runs out of time is refused
+    assert(ss_lock_acquire("fifo.txt", 0, 2, 3, "dave", 50, NULL) == 0);
+    assert(ss_lock_release("fifo.txt", 0, 0, SS_LOCK_LAST_WORD, "carol") == 0);
+
+    printf("✓ Sentence lock waiter order test passed\n");
+}
+
+// Test that an unrenewed lease lapses and can be taken over
+void test_lock_lease() {
+    printf("Testing sentence lock leases...\n");
+
+    int held = ss_lock_count();
+    assert(ss_lock_acquire("lease.txt", 0, 0, SS_LOCK_LAST_WORD, "alice", 0, NULL) == 1);
+    assert(ss_lock_acquire("lease.txt", 1, 0, SS_LOCK_LAST_WORD, "alice", 0, NULL) == 1);
+
+    // Renewing keeps sentence 1 alive past the first lease
+    usleep(SS_LOCK_LEASE_SECONDS * 600000);
+    assert(ss_lock_renew("lease.txt", 1, 0, SS_LOCK_LAST_WORD, "alice") == 0);
+    usleep(SS_LOCK_LEASE_SECONDS * 600000);
+
+    // Sentence 0 lapsed: bob takes it over and alice can no longer renew it
+    assert(ss_lock_acquire("lease.txt", 0, 0, SS_LOCK_LAST_WORD, "bob", 0, NULL) == 1);
+    assert(ss_lock_renew("lease.txt", 0, 0, SS_LOCK_LAST_WORD, "alice") == -1);
+    assert(ss_lock_acquire("lease.txt", 1, 0, SS_LOCK_LAST_WORD, "bob", 0, NULL) == 0);
+
+    // A waiter is granted a lock once its holder's lease lapses
+    assert(ss_lock_acquire("lease.txt", 1, 0, SS_LOCK_LAST_WORD, "bob",
+                           SS_LOCK_LEASE_SECONDS * 2000, NULL) == 1);
+    assert(ss_lock_release("lease.txt", 1, 0, SS_LOCK_LAST_WORD, "alice") == -1);
+
+    assert(ss_lock_release("lease.txt", 0, 0, SS_LOCK_LAST_WORD, "bob") == 0);
+    assert(ss_lock_release("lease.txt", 1, 0, SS_LOCK_LAST_WORD, "bob") == 0);
+    assert(ss_lock_count() == held);
+
+    printf("✓ Sentence lock lease test passed\n");
+}
+
+// Unwritten commits handed back by ss_wal_init
+static int restored_commits = 0;
+static int restored_latest = 0;
+static char restored_content[64];
+static uint32_t restored_version = 0;
+
+static int record_restore(const char* filename, const char* user, const char* content,
+                          size_t length, uint32_t version, int latest) {
+    assert(strcmp(filename, "d.txt") == 0);
+    assert(strcmp(user, "dave") == 0);
+    assert(length < sizeof(restored_content));
+    // Oldest first: nothing comes back after the latest of its file
+    assert(restored_latest == 0);
+    memcpy(restored_content, content, length);
+    restored_content[length] = '\0';
+    restored_version = version;
+    restored_commits++;
+    restored_latest += latest;
+    return 0;
+}
+
+// Word updates replayed by ss_wal_resume
+static char replayed[4][32];
+static int replayed_index[4];
+static int replayed_count = 0;
+
+static int record_edit(void* ctx, int word_index, const char* content) {
+    (void)ctx;
+    assert(replayed_count < 4);
+    replayed_index[replayed_count] = word_index;
+    snprintf(replayed[replayed_count], sizeof(replayed[0]), "%s", content);
+    replayed_count++;
+    return 0;
+}
+
+static int refuse_edit(void* ctx, int word_index, const char* content) {
+    (void)ctx;
+    (void)word_index;
+    (void)content;
+    return -1;
+}
+
+// First lifetime: sessions left open, commits left unwritten, then a crash
+static void wal_first_run(void) {
+    assert(ss_wal_init(test_root, record_restore) == 0);
+
+    uint64_t open_session = ss_wal_begin("a.txt", 0, 0, SS_LOCK_LAST_WORD, "alice",
+                                         "Hello world.", 12);
+    assert(open_session != 0);
+    ss_wal_edit(open_session, 1, "big");
+    ss_wal_edit(open_session, 2, "wide");
+
+    uint64_t changed = ss_wal_begin("b.txt", 1, 0, SS_LOCK_LAST_WORD, "bob", "Old one.", 8);
+    ss_wal_edit(changed, 0, "Changed");
+
+    uint64_t refused = ss_wal_begin("g.txt", 0, 0, SS_LOCK_LAST_WORD, "gina", "Refused.", 8);
+    ss_wal_edit(refused, 0, "Never");
+
+    uint64_t abandoned = ss_wal_begin("h.txt", 0, 0, 1, "hank", NULL, 0);
+    ss_wal_edit(abandoned, 0, "Forgotten");
+
+    // Ended sessions and written commits are not recovered
+    uint64_t ended = ss_wal_begin("c.txt", 0, 0, SS_LOCK_LAST_WORD, "carol", NULL, 0);
+    ss_wal_edit(ended, 0, "Saved.");
+    ss_wal_end(ended, 1);
+    uint64_t written = ss_wal_commit("e.txt", "dave", "Written.", 8, 1);
+    ss_wal_end(written, 1);
+
+    // Every unwritten commit comes back; only the latest of a file is written out
+    assert(ss_wal_commit("d.txt", "dave", "First version.", 14, 1) != 0);
+    assert(ss_wal_commit("d.txt", "dave", "Second version.", 15, 2) != 0);
+
+    // The last record is torn below
+    uint64_t torn = ss_wal_begin("f.txt", 0, 0, SS_LOCK_LAST_WORD, "erin", "Torn.", 5);
+    ss_wal_edit(torn, 0, "lost");
+    ss_wal_flush();
+}
+
+// Second lifetime: replay, resume and roll back
+static void wal_second_run(void) {
+    assert(ss_wal_init(test_root, record_restore) == 5);
+    assert(restored_commits == 2 && restored_latest == 1);
+    assert(strcmp(restored_content, "Second version.") == 0);
+    assert(restored_version == 2);
+
+    // Recovered sessions keep their words locked for their users
+    assert(ss_lock_acquire("a.txt", 0, 0, SS_LOCK_LAST_WORD, "mallory", 0, NULL) == 0);
+    assert(ss_lock_acquire("a.txt", 0, 0, SS_LOCK_LAST_WORD, "alice", 0, NULL) == 1);
+
+    // The same words of an unchanged sentence resume with their updates
+    uint64_t id = 0;
+    assert(ss_wal_resume("a.txt", 0, 0, 1, "alice", "Hello world.", 12, record_edit, NULL, &id) == 0);
+    assert(ss_wal_resume("a.txt", 0, 0, SS_LOCK_LAST_WORD, "alice", "Hello world.", 12,
+                         record_edit, NULL, &id) == 2);
+    assert(id != 0);
+    assert(replayed_count == 2);
+    assert(replayed_index[0] == 1 && strcmp(replayed[0], "big") == 0);
+    assert(replayed_index[1] == 2 && strcmp(replayed[1], "wide") == 0);
+    ss_wal_end(id, 1);
+
+    // A session is handed back only once
+    uint64_t again = 0;
+    assert(ss_wal_resume("a.txt", 0, 0, SS_LOCK_LAST_WORD, "alice", "Hello world.", 12,
+                         record_edit, NULL, &again) == 0);
+    assert(again == 0);
+
+    // A sentence changed since is rolled back
+    uint64_t rolled_back = 0;
+    assert(ss_wal_resume("b.txt", 1, 0, SS_LOCK_LAST_WORD, "bob", "New one.", 8,
+                         record_edit, NULL, &rolled_back) == 0);
+    assert(rolled_back == 0);
+    assert(replayed_count == 2);
+
+    // A failed replay ends the session
+    uint64_t refused = 0;
+    assert(ss_wal_resume("g.txt", 0, 0, SS_LOCK_LAST_WORD, "gina", "Refused.", 8,
+                         refuse_edit, NULL, &refused) == -1);
+
+    // The torn word update is dropped; the session before it survives
+    uint64_t torn = 0;
+    assert(ss_wal_resume("f.txt", 0, 0, SS_LOCK_LAST_WORD, "erin", "Torn.", 5,
+                         record_edit, NULL, &torn) == 0);
+    assert(torn != 0);
+    assert(replayed_count == 2);
+    ss_wal_end(torn, 0);
+
+    // A session not resumed within a lease is rolled back and its lock freed
+    usleep(SS_LOCK_LEASE_SECONDS * 1500000);
+    assert(ss_lock_acquire("h.txt", 0, 0, 1, "mallory", 0, NULL) == 1);
+    uint64_t expired = 0;
+    assert(ss_wal_resume("h.txt", 0, 0, 1, "hank", NULL, 0, record_edit, NULL, &expired) == 0);
+    assert(expired == 0);
+    ss_wal_flush();
+}
+
+// Third lifetime: everything was resumed, rolled back or written out
+static void wal_third_run(void) {
+    assert(ss_wal_init(test_root, record_restore) == 0);
+    assert(restored_commits == 0);
+}
+
+// Test edit log replay across restarts
+void test_wal_replay() {
+    printf("Testing edit log replay, resume and rollback...\n");
+
+    run_server(wal_first_run);
+
+    // Tear the final record, as a crash in the middle of writing it would
+    char path[sizeof(test_root) + 32];
+    snprintf(path, sizeof(path), "%s/%s/%08d.wal", test_root, SS_WAL_DIR, 1);
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    assert(truncate(path, st.st_size - 2) == 0);
+
+    run_server(wal_second_run);
+    run_server(wal_third_run);
+
+    printf("✓ Edit log replay test passed\n");
+}
+
+// Replace a document file in the test storage directory
+static void put_file(const char* filename, const char* content) {
+    char path[sizeof(test_root) + MAX_FILENAME_LEN];
+    snprintf(path, sizeof(path), "%s/%s", test_root, filename);
+    assert(ss_io_write_file(path, content, strlen(content), 0) == 0);
+}
+
+// Test that readers keep the version they started with across a commit
+void test_doc_cache_snapshots() {
+    printf("Testing document cache snapshots...\n");
+
+    put_file("s.txt", "One. Two.");
+    cached_doc_t* reader = doc_cache_acquire("s.txt");
+    assert(reader != NULL);
+    assert(strcmp(reader->content, "One. Two.") == 0);
+    assert(reader->sentence_count == 2 && reader->word_count == 2);
+    assert(reader->version == 0 && reader->fd >= 0);
+
+    // Hits share the cached copy
+    cached_doc_t* again = doc_cache_acquire("s.txt");
+    assert(again == reader);
+    doc_cache_release(again);
+
+    // A commit publishes a new version while the reader holds the old one
+    put_file("s.txt", "One. Two. Three more.");
+    char* content = strdup("One. Two. Three more.");
+    cached_doc_t* published = doc_cache_publish("s.txt", content, strlen(content), 1, 1);
+    assert(published != NULL && published != reader);
+    assert(published->version == 1 && published->fd >= 0 && !published->unwritten);
+    assert(published->sentence_count == 3 && published->word_count == 4);
+    doc_cache_release(published);
+
+    assert(strcmp(reader->content, "One. Two.") == 0);
+    assert(reader->sentence_count == 2 && reader->version == 0);
+
+    // Readers starting after the commit get the new version
+    cached_doc_t* later = doc_cache_acquire("s.txt");
+    assert(later == published);
+    assert(strcmp(later->content + later->sentences[2].offset, "Three more.") == 0);
+    doc_cache_release(later);
+    doc_cache_release(reader);
+
+    // An unwritten version is served even though its file is stale
+    put_file("u.txt", "Stale.");
+    content = strdup("Fresh.");
+    published = doc_cache_publish("u.txt", content, strlen(content), 4, 0);
+    assert(published != NULL && published->unwritten && published->fd < 0);
+    doc_cache_release(published);
+    later = doc_cache_acquire("u.txt");
+    assert(later == published && strcmp(later->content, "Fresh.") == 0);
+
+    // An invalidated document is reloaded from its file; holders keep theirs
+    doc_cache_invalidate("u.txt");
+    cached_doc_t* reloaded = doc_cache_acquire("u.txt");
+    assert(reloaded != NULL && reloaded != later);
+    assert(strcmp(reloaded->content, "Stale.") == 0);
+    assert(strcmp(later->content, "Fresh.") == 0);
+    doc_cache_release(reloaded);
+    doc_cache_release(later);
+
+    // Missing files are not cached
+    assert(doc_cache_acquire("missing.txt") == NULL);
+
+    printf("✓ Document cache snapshot test passed\n");
+}
+
+// Metadata as the first lifetime left it
+static file_metadata_t saved_meta;
+
+static void assert_same_meta(const file_metadata_t* a, const file_metadata_t* b) {
+    assert(strcmp(a->filename, b->filename) == 0);
+    assert(strcmp(a->owner, b->owner) == 0);
+    assert(a->created == b->created && a->last_modified == b->last_modified);
+    assert(a->last_accessed == b->last_accessed);
+    assert(strcmp(a->last_accessed_by, b->last_accessed_by) == 0);
+    assert(a->size == b->size && a->word_count == b->word_count);
+    assert(a->char_count == b->char_count && a->version == b->version);
+    assert(a->access_count == b->access_count);
+    for (int i = 0; i < a->access_count; i++) {
+        assert(strcmp(a->access_list[i], b->access_list[i]) == 0);
+        assert(a->access_permissions[i] == b->access_permissions[i]);
+    }
+}
+
+// Commit a document with the .meta prepared for it
+static int commit_with_meta(const char* filename, const ss_meta_commit_t* prepared) {
+    char path[sizeof(test_root) + MAX_FILENAME_LEN];
+    snprintf(path, sizeof(path), "%s/%s", test_root, filename);
+    ss_io_commit_t commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.path = path;
+    commit.data = "Committed.";
+    commit.length = 10;
+    commit.meta_path = prepared->path;
+    commit.meta = prepared->text;
+    commit.meta_length = prepared->length;
+    return ss_io_commit(&commit);
+}
+
+static void assert_meta_file_version(const char* path, uint32_t version) {
+    char expected[32];
+    snprintf(expected, sizeof(expected), "version=%u\n", version);
+    char* text = NULL;
+    size_t length = 0;
+    assert(ss_io_read_file(path, &text, &length) == 0);
+    assert(strstr(text, expected) != NULL);
+    free(text);
+}
+
+// Parse the .meta the parent wrote; the entry inherited through fork is
+// replaced by what the file holds
+static void meta_reload(void) {
+    ss_meta_init(test_root);
+    file_metadata_t meta;
+    assert(ss_meta_load("meta.txt") == 0);
+    assert(ss_meta_get("meta.txt", &meta) == 0);
+    assert_same_meta(&meta, &saved_meta);
+    assert(ss_meta_check_access("meta.txt", "bob", ACCESS_READ) == 1);
+    assert(ss_meta_check_access("meta.txt", "bob", ACCESS_WRITE) == 0);
+    assert(ss_meta_check_access("meta.txt", "carol", ACCESS_WRITE) == 1);
+}
+
+// Test that metadata survives a serialize and load round trip
+void test_meta_cache() {
+    printf("Testing metadata cache round trip...\n");
+
+    // A new document belongs to its owner alone
+    assert(ss_meta_create("meta.txt", "alice") == 0);
+    assert(ss_meta_check_access("meta.txt", "alice", ACCESS_WRITE) == 1);
+    assert(ss_meta_check_access("meta.txt", "bob", ACCESS_READ) == 0);
+    assert(ss_meta_check_access("missing.txt", "alice", ACCESS_READ) == -1);
+
+    file_metadata_t acl;
+    assert(ss_meta_get("meta.txt", &acl) == 0);
+    strcpy(acl.access_list[1], "bob");
+    acl.access_permissions[1] = ACCESS_READ;
+    strcpy(acl.access_list[2], "carol");
+    acl.access_permissions[2] = ACCESS_BOTH;
+    acl.access_count = 3;
+    assert(ss_meta_set_acl("meta.txt", &acl) == 0);
+    errno = 0;
+    assert(ss_meta_set_acl("missing.txt", &acl) == -1 && errno == ENOENT);
+
+    // A version reaches the .meta in its content's commit and only ever rises
+    char path[sizeof(test_root) + MAX_FILENAME_LEN];
+    snprintf(path, sizeof(path), "%s/meta.txt.meta", test_root);
+    ss_meta_commit_t prepared;
+    assert(ss_meta_prepare_version("meta.txt", 7, &prepared) == 0);
+    assert(strcmp(prepared.path, path) == 0 && strstr(prepared.text, "version=7\n") != NULL);
+    assert(ss_meta_version("meta.txt") == 0);
+    assert(commit_with_meta("meta.txt", &prepared) == 0);
+    ss_meta_finish_version("meta.txt", &prepared, 1);
+    assert(prepared.text == NULL && ss_meta_version("meta.txt") == 7);
+    assert_meta_file_version(path, 7);
+
+    assert(ss_meta_prepare_version("meta.txt", 5, &prepared) == 0);
+    assert(strstr(prepared.text, "version=7\n") != NULL);
+    ss_meta_finish_version("meta.txt", &prepared, 1);
+    assert(ss_meta_version("meta.txt") == 7);
+
+    // A document rename that fails after the .meta's gets the old version back
+    char blocked[sizeof(test_root) + MAX_FILENAME_LEN];
+    snprintf(blocked, sizeof(blocked), "%s/blocked.txt", test_root);
+    assert(mkdir(blocked, 0755) == 0);
+    put_file("blocked.txt/inside", "Keeps the directory non-empty.");
+    assert(ss_meta_prepare_version("meta.txt", 8, &prepared) == 0);
+    ss_io_commit_t commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.path = blocked;
+    commit.data = "Eight.";
+    commit.length = 6;
+    commit.meta_path = prepared.path;
+    commit.meta = prepared.text;
+    commit.meta_length = prepared.length;
+    assert(ss_io_commit(&commit) == -1 && strcmp(commit.failed_step, "write") == 0);
+    assert_meta_file_version(path, 8);
+    ss_meta_finish_version("meta.txt", &prepared, 0);
+    assert(ss_meta_version("meta.txt") == 7);
+    assert_meta_file_version(path, 7);
+
+    // Commit statistics are written behind
+    assert(ss_meta_record_commit("meta.txt", 5, 20, 21, "bob", 8) == 0);
+    assert(ss_meta_record_commit("missing.txt", 5, 20, 21, "bob", 8) == -1);
+    ss_meta_flush();
+    assert(ss_meta_get("meta.txt", &saved_meta) == 0);
+    assert(saved_meta.version == 8 && saved_meta.size == 21);
+    assert(strcmp(saved_meta.last_accessed_by, "bob") == 0);
+
+    run_server(meta_reload);
+
+    // Hand-edited files: gaps in the numbering, W implying R, unknown keys
+    snprintf(path, sizeof(path), "%s/old.txt.meta", test_root);
+    const char* old = "owner=dan\nversion=2\nfuture_key=1\naccess_count=9\n"
+                      "access_0=dan:RW\naccess_4=erin:W\naccess_9=fred:R\n";
+    assert(ss_io_write_file(path, old, strlen(old), 0) == 0);
+    assert(ss_meta_load("old.txt") == 0);
+    file_metadata_t meta;
+    assert(ss_meta_get("old.txt", &meta) == 0);
+    assert(strcmp(meta.owner, "dan") == 0 && meta.version == 2);
+    assert(meta.access_count == 3);
+    assert(strcmp(meta.access_list[1], "erin") == 0 && meta.access_permissions[1] == ACCESS_BOTH);
+    assert(strcmp(meta.access_list[2], "fred") == 0 && meta.access_permissions[2] == ACCESS_READ);
+    assert(ss_meta_load("missing.txt") == -1);
+
+    // Removal forgets the document and its file
+    ss_meta_remove("old.txt");
+    assert(ss_meta_get("old.txt", &meta) == -1);
+    assert(access(path, F_OK) != 0);
+
+    printf("✓ Metadata cache round trip test passed\n");
+}
+
+// Rebuild a revision and compare it byte for byte
+static void assert_revision(const char* filename, int revision, const char* expected) {
+    char* content = NULL;
+    size_t length = 0;
+    assert(ss_revlog_read(filename, revision, &content, &length) == 0);
+    assert(length == strlen(expected));
+    assert(memcmp(content, expected, length) == 0 && content[length] == '\0');
+    free(content);
+}
+
+static off_t revlog_size(const char* filename) {
+    char path[sizeof(test_root) + MAX_FILENAME_LEN + 8];
+    snprintf(path, sizeof(path), "%s/.%s.rev", test_root, filename);
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    return st.st_size;
+}
+
+// Test that every revision reads back as committed
+void test_revlog() {
+    printf("Testing revision log deltas...\n");
+
+    // Edits at the start, middle and end, no-ops, repeated words that the
+    // common prefix and suffix overlap in, shrinking and emptying
+    static const char* versions[] = {
+        "",
+        "Hello world.",
+        "Hello big world.",
+        "Well, hello big world.",
+        "Well, hello big world. Bye.",
+        "Well, hello big world. Bye.",
+        "a a a a a",
+        "a a a a a a",
+        "a a",
+        "a  a\n",
+        "",
+        "New start.\nSecond line.",
+        "New start.\nSecond line!",
+    };
+    int count = (int)(sizeof(versions) / sizeof(versions[0]));
+
+    assert(ss_revlog_head("rev.txt") == 0);
+    for (int i = 1; i < count; i++) {
+        int revision = ss_revlog_append("rev.txt", versions[i - 1], strlen(versions[i - 1]),
+                                        versions[i], strlen(versions[i]), 0);
+        assert(revision == i + 1);
+    }
+    assert(ss_revlog_head("rev.txt") == count);
+    for (int i = 0; i < count; i++) {
+        assert_revision("rev.txt", i + 1, versions[i]);
+    }
+    char* content = NULL;
+    size_t length = 0;
+    assert(ss_revlog_read("rev.txt", 0, &content, &length) == -1);
+    assert(ss_revlog_read("rev.txt", count + 1, &content, &length) == -1);
+    assert(ss_revlog_read("missing.txt", 1, &content, &length) == -1);
+
+    // A one-word edit of a long document costs about that word, across
+    // more deltas than one chain holds
+    const size_t sentence_length = sizeof("Sentence 00000 has a few words in it. ") - 1;
+    size_t big_length = sentence_length * 1000;
+    char* big = malloc(big_length + 1);
+    char* edited = malloc(big_length + 1);
+    assert(big != NULL && edited != NULL);
+    for (size_t i = 0; i < 1000; i++) {
+        snprintf(big + i * sentence_length, sentence_length + 1,
+                 "Sentence %05zu has a few words in it. ", i);
+    }
+    memcpy(edited, big, big_length + 1);
+    assert(ss_revlog_append("big.txt", NULL, 0, big, big_length, 0) == 1);
+    int edits = SS_REVLOG_CHAIN_LIMIT * 2 + 3;
+    for (int i = 0; i < edits; i++) {
+        off_t before = revlog_size("big.txt");
+        size_t at = (size_t)(i * 997 % 1000) * sentence_length + 15;
+        memcpy(edited + at, (i % 2) ? "HAS" : "had", 3);
+        assert(ss_revlog_append("big.txt", big, big_length, edited, big_length, 0) == i + 2);
+        if ((i + 1) % (SS_REVLOG_CHAIN_LIMIT + 1) != 0) {
+            assert(revlog_size("big.txt") - before < 512);
+        }
+        memcpy(big, edited, big_length);
+        assert_revision("big.txt", i + 2, edited);
+    }
+    assert(ss_revlog_read("big.txt", 1, &content, &length) == 0);
+    assert(length == big_length && strncmp(content, "Sentence 00000 has", 18) == 0);
+    free(content);
+    free(big);
+    free(edited);
+
+    // UNDO walks back through restored revisions instead of toggling
+    int head = ss_revlog_head("rev.txt");
+    assert(ss_revlog_undo_target("rev.txt", 1) == head - 1);
+    assert(ss_revlog_undo_target("rev.txt", 2) == head - 2);
+    assert(ss_revlog_append("rev.txt", versions[count - 1], strlen(versions[count - 1]),
+                            versions[count - 2], strlen(versions[count - 2]), head - 1) == head + 1);
+    assert_revision("rev.txt", head + 1, versions[count - 2]);
+    assert(ss_revlog_undo_target("rev.txt", 1) == head - 2);
+    assert(ss_revlog_undo_target("rev.txt", head + 5) == -1);
+
+    // A file changed behind the log's back is recorded in full
+    assert(ss_revlog_append("rev.txt", "Not the head.", 13, "Rewritten.", 10, 0) == head + 2);
+    assert_revision("rev.txt", head + 2, "Rewritten.");
+    assert_revision("rev.txt", head + 1, versions[count - 2]);
+
+    // A torn head is dropped by the next append; the history before it stays
+    char path[sizeof(test_root) + MAX_FILENAME_LEN + 8];
+    snprintf(path, sizeof(path), "%s/.rev.txt.rev", test_root);
+    assert(truncate(path, revlog_size("rev.txt") - 3) == 0);
+    assert(ss_revlog_read("rev.txt", head + 2, &content, &length) == -1);
+    assert(ss_revlog_append("rev.txt", "Rewritten.", 10, "After the tear.", 15, 0) == head + 2);
+    assert_revision("rev.txt", head + 2, "After the tear.");
+    assert_revision("rev.txt", head + 1, versions[count - 2]);
+    assert_revision("rev.txt", 2, versions[1]);
+
+    ss_revlog_remove("rev.txt");
+    assert(ss_revlog_head("rev.txt") == 0);
+
+    printf("✓ Revision log delta test passed\n");
+}
+
+// A document of @count numbered sentences, one of them edited; malloc'd
+static char* numbered_document(int count, int edited, const char* edit) {
+    size_t capacity = (size_t)count * 64 + strlen(edit) + 1;
+    char* text = malloc(capacity);
+    assert(text != NULL);
+    size_t used = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == edited) {
+            used += snprintf(text + used, capacity - used, "%s ", edit);
+        } else if (i % 7 == 6) {
+            used += snprintf(text + used, capacity - used, "Sentence %d ends a paragraph.\n", i);
+        } else {
+            used += snprintf(text + used, capacity - used, "Sentence %d of the document says %x. ",
+                             i, i * 2654435761u);
+        }
+    }
+    return text;
+}
+
+// Publish @content and checkpoint it; returns the new chunks
+static int checkpoint_text(const char* filename, const char* tag, const char* content,
+                           int* total) {
+    char* copy = strdup(content);
+    assert(copy != NULL);
+    cached_doc_t* doc = doc_cache_publish(filename, copy, strlen(copy), 1, 1);
+    assert(doc != NULL);
+    int created = -1;
+    assert(ss_cas_checkpoint(filename, tag, "alice", doc, total, &created) == 0);
+    doc_cache_release(doc);
+    return created;
+}
+
+static void assert_checkpoint(const char* filename, const char* tag, const char* expected) {
+    char* content = NULL;
+    size_t length = 0;
+    assert(ss_cas_read(filename, tag, &content, &length) == 0);
+    assert(length == strlen(expected) && memcmp(content, expected, length) == 0);
+    free(content);
+}
+
+// Check that a manifest's chunks are runs of whole sentences within the
+// size bounds; returns the number of chunks
+static int check_chunk_bounds(const char* filename, const char* tag, const char* content) {
+    char path[sizeof(test_root) + 2 * MAX_FILENAME_LEN + 32];
+    snprintf(path, sizeof(path), "%s/%s/checkpoints/%s/%s", test_root, SS_CAS_DIR, filename, tag);
+    char* manifest = NULL;
+    size_t manifest_length = 0;
+    assert(ss_io_read_file(path, &manifest, &manifest_length) == 0);
+
+    doc_sentence_t* sentences = NULL;
+    int words;
+    size_t length = strlen(content);
+    int sentence_count = index_document_sentences(content, length, &sentences, &words);
+    assert(sentence_count >= 0);
+
+    int chunks = 0;
+    size_t offset = 0;
+    char* save = NULL;
+    for (char* line = strtok_r(manifest, "\n", &save); line != NULL;
+         line = strtok_r(NULL, "\n", &save)) {
+        char hex[65];
+        size_t chunk_length;
+        if (strchr(line, '=') != NULL) {
+            continue;
+        }
+        assert(sscanf(line, "%64s %zu", hex, &chunk_length) == 2 && strlen(hex) == 64);
+        offset += chunk_length;
+        chunks++;
+        if (offset == length) {
+            break;
+        }
+        // Closed at a sentence end, no earlier than the minimum and no
+        // later than the first sentence end past the maximum
+        assert(chunk_length >= SS_CAS_CHUNK_MIN);
+        int at_boundary = 0;
+        for (int i = 1; i < sentence_count; i++) {
+            if (sentences[i].offset == offset) {
+                at_boundary = 1;
+                assert(chunk_length - (sentences[i].offset - sentences[i - 1].offset) <
+                       SS_CAS_CHUNK_MAX);
+            }
+        }
+        assert(at_boundary);
+    }
+    assert(offset == length);
+    free(sentences);
+    free(manifest);
+    return chunks;
+}
+
+// Stored chunks, as files under the chunk directory
+static int stored_chunks() {
+    char root[sizeof(test_root) + 16];
+    snprintf(root, sizeof(root), "%s/%s/chunks", test_root, SS_CAS_DIR);
+    int count = 0;
+    DIR* buckets = opendir(root);
+    assert(buckets != NULL);
+    struct dirent* bucket;
+    while ((bucket = readdir(buckets)) != NULL) {
+        if (bucket->d_name[0] == '.') {
+            continue;
+        }
+        char path[sizeof(root) + MAX_FILENAME_LEN];
+        snprintf(path, sizeof(path), "%s/%s", root, bucket->d_name);
+        DIR* dir = opendir(path);
+        assert(dir != NULL);
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            count += (entry->d_name[0] != '.');
+        }
+        closedir(dir);
+    }
+    closedir(buckets);
+    return count;
+}
+
+// Test that checkpoints split at sentence ends and read back whole
+void test_cas() {
+    printf("Testing chunk store checkpoints...\n");
+
+    assert(ss_cas_init(test_root) == 0);
+    assert(ss_cas_valid_tag("v1.0-final_2") && !ss_cas_valid_tag("2nd"));
+    assert(!ss_cas_valid_tag("") && !ss_cas_valid_tag("a/b"));
+
+    // A long document spans many chunks, each a run of whole sentences
+    char* original = numbered_document(4000, -1, "");
+    int total = 0;
+    assert(checkpoint_text("cas.txt", "v1", original, &total) == total);
+    assert(total > 4 && stored_chunks() == total);
+    assert(check_chunk_bounds("cas.txt", "v1", original) == total);
+    assert_checkpoint("cas.txt", "v1", original);
+
+    // Identical text is stored once, under any tag or file
+    int again = 0;
+    assert(checkpoint_text("cas.txt", "same", original, &again) == 0 && again == total);
+    assert(checkpoint_text("copy.txt", "v1", original, &again) == 0);
+    errno = 0;
+    cached_doc_t* doc = doc_cache_acquire("cas.txt");
+    int created;
+    assert(ss_cas_checkpoint("cas.txt", "v1", "bob", doc, &again, &created) == -1 &&
+           errno == EEXIST);
+    doc_cache_release(doc);
+
+    // An edit only writes the chunks around it
+    char* edited = numbered_document(4000, 2000, "This sentence was rewritten at some length.");
+    int edited_total = 0;
+    int edited_new = checkpoint_text("cas.txt", "v2", edited, &edited_total);
+    assert(edited_new >= 1 && edited_new <= 3);
+    assert(check_chunk_bounds("cas.txt", "v2", edited) == edited_total);
+    assert_checkpoint("cas.txt", "v2", edited);
+    assert_checkpoint("cas.txt", "v1", original);
+
+    // A sentence longer than the maximum is still one chunk
+    size_t long_length = SS_CAS_CHUNK_MAX * 2;
+    char* long_sentence = malloc(long_length + 32);
+    assert(long_sentence != NULL);
+    memset(long_sentence, 'x', long_length);
+    strcpy(long_sentence + long_length, ". Short one.");
+    assert(checkpoint_text("long.txt", "v1", long_sentence, &again) == 2 && again == 2);
+    assert_checkpoint("long.txt", "v1", long_sentence);
+
+    // Empty and one-sentence documents
+    assert(checkpoint_text("small.txt", "empty", "", &again) == 0 && again == 0);
+    assert_checkpoint("small.txt", "empty", "");
+    assert(checkpoint_text("small.txt", "one", "Only sentence", &again) == 1 && again == 1);
+    assert_checkpoint("small.txt", "one", "Only sentence");
+
+    char list[1024];
+    assert(ss_cas_list("cas.txt", list, sizeof(list)) == 3);
+    assert(strstr(list, "same") != NULL && strstr(list, "v2") != NULL);
+    assert(ss_cas_list("missing.txt", list, sizeof(list)) == 0);
+    char* content = NULL;
+    size_t length = 0;
+    assert(ss_cas_read("cas.txt", "v9", &content, &length) == -1);
+
+    // A damaged chunk is detected
+    char path[sizeof(test_root) + 2 * MAX_FILENAME_LEN + 32];
+    snprintf(path, sizeof(path), "%s/%s/checkpoints/small.txt/one", test_root, SS_CAS_DIR);
+    char* manifest = NULL;
+    size_t manifest_length = 0;
+    assert(ss_io_read_file(path, &manifest, &manifest_length) == 0);
+    char* hex = strstr(manifest, "chunks=1\n") + strlen("chunks=1\n");
+    snprintf(path, sizeof(path), "%s/%s/chunks/%.2s/%.64s", test_root, SS_CAS_DIR, hex, hex);
+    free(manifest);
+    assert(ss_io_write_file(path, "Only sentencE", 13, 0) == 0);
+    assert(ss_cas_read("small.txt", "one", &content, &length) == -1);
+
+    // Removing a document sweeps the chunks only it used
+    int before = stored_chunks();
+    ss_cas_remove("cas.txt");
+    assert(ss_cas_list("cas.txt", list, sizeof(list)) == 0);
+    assert(stored_chunks() == before - edited_new);
+    assert_checkpoint("copy.txt", "v1", original);
+    ss_cas_remove("copy.txt");
+    ss_cas_remove("long.txt");
+    ss_cas_remove("small.txt");
+    assert(stored_chunks() == 0);
+
+    // Chunks left by a checkpoint that never got its manifest are swept at startup
+    snprintf(path, sizeof(path), "%s/%s/chunks/ab", test_root, SS_CAS_DIR);
+    assert(mkdir(path, 0755) == 0 || errno == EEXIST);
+    snprintf(path, sizeof(path), "%s/%s/chunks/ab/ab%062d", test_root, SS_CAS_DIR, 0);
+    assert(ss_io_write_file(path, "orphan", 6, 0) == 0);
+    assert(stored_chunks() == 1);
+    assert(ss_cas_init(test_root) == 0);
+    assert(stored_chunks() == 0);
+
+    free(original);
+    free(edited);
+    free(long_sentence);
+    printf("✓ Chunk store checkpoint test passed\n");
+}
+
+// Document files written by the materializer
+static pthread_mutex_t written_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int documents_written = 0;
+static int writes_to_fail = 0;
+static char last_written[64];
+static char last_writer[MAX_USERNAME_LEN];
+static char revisions[256];             // "old>new;" per recorded revision
+
+static int write_document(const cached_doc_t* doc, const char* user) {
+    pthread_mutex_lock(&written_mutex);
+    if (writes_to_fail > 0) {
+        writes_to_fail--;
+        pthread_mutex_unlock(&written_mutex);
+        errno = EIO;
+        return -1;
+    }
+    pthread_mutex_unlock(&written_mutex);
+
+    assert(doc->unwritten);
+    char path[sizeof(test_root) + MAX_FILENAME_LEN];
+    snprintf(path, sizeof(path), "%s/%s", test_root, doc->filename);
+    assert(ss_io_write_file(path, doc->content, doc->length, 0) == 0);
+
+    pthread_mutex_lock(&written_mutex);
+    documents_written++;
+    snprintf(last_written, sizeof(last_written), "%s", doc->content);
+    snprintf(last_writer, sizeof(last_writer), "%s", user);
+    pthread_mutex_unlock(&written_mutex);
+    return 0;
+}
+
+static void record_revision(const cached_doc_t* previous, const cached_doc_t* doc) {
+    pthread_mutex_lock(&written_mutex);
+    size_t used = strlen(revisions);
+    snprintf(revisions + used, sizeof(revisions) - used, "%s>%s;",
+             previous ? previous->content : "-", doc->content);
+    pthread_mutex_unlock(&written_mutex);
+}
+
+static int written_so_far() {
+    pthread_mutex_lock(&written_mutex);
+    int count = documents_written;
+    pthread_mutex_unlock(&written_mutex);
+    return count;
+}
+
+// Publish an unwritten version and queue it, as an early-ack ETIRW does
+static void commit_early(const char* filename, const char* content, uint32_t version,
+                         const char* user) {
+    cached_doc_t* previous = doc_cache_acquire(filename);
+    char* copy = strdup(content);
+    assert(copy != NULL);
+    cached_doc_t* doc = doc_cache_publish(filename, copy, strlen(copy), version, 0);
+    assert(doc != NULL);
+    ss_materializer_queue(doc, previous, user, 0);
+    doc_cache_release(previous);
+}
+
+// Test that queued versions of one file coalesce into one write
+void test_materializer() {
+    printf("Testing early-ack document writes...\n");
+
+    assert(ss_materializer_init(write_document, record_revision) == 0);
+
+    // A burst of commits of one file costs one write of the newest version,
+    // yet each version gets its revision, in order, once it is written
+    commit_early("m.txt", "First.", 1, "alice");
+    commit_early("m.txt", "Second.", 2, "bob");
+    commit_early("m.txt", "Third.", 3, "carol");
+    assert(written_so_far() == 0 && revisions[0] == '\0');
+    ss_materializer_drain("m.txt");
+    assert(written_so_far() == 1);
+    assert(strcmp(last_written, "Third.") == 0);
+    assert(strcmp(last_writer, "carol") == 0);
+    assert(strcmp(revisions, "->First.;First.>Second.;Second.>Third.;") == 0);
+
+    // The written version stays current and is served from its file
+    cached_doc_t* doc = doc_cache_acquire("m.txt");
+    assert(doc != NULL);
+    assert(doc->version == 3 && !doc->unwritten && doc->fd >= 0);
+    doc_cache_release(doc);
+
+    // Without a drain a version is written once its delay passes
+    commit_early("n.txt", "Later.", 1, "alice");
+    usleep(SS_MATERIALIZE_DELAY_MS * 10 * 1000);
+    assert(written_so_far() == 2);
+
+    // A failed write is retried
+    pthread_mutex_lock(&written_mutex);
+    writes_to_fail = 1;
+    pthread_mutex_unlock(&written_mutex);
+    revisions[0] = '\0';
+    commit_early("r.txt", "Retried.", 1, "dave");
+    ss_materializer_drain("r.txt");
+    assert(written_so_far() == 3);
+    assert(writes_to_fail == 0);
+    assert(strcmp(revisions, "->Retried.;") == 0);
+
+    // Different files are not coalesced
+    commit_early("x.txt", "Ex.", 1, "alice");
+    commit_early("y.txt", "Why.", 1, "alice");
+    commit_early("x.txt", "Ex again.", 2, "alice");
+    ss_materializer_drain_all();
+    assert(written_so_far() == 5);
+
+    printf("✓ Early-ack document write test passed\n");
+}
+
+int main() {
+    printf("=== Docs++ Storage Server Test Suite ===\n\n");
+
+    init_logging(NULL, LOG_ERROR, 1);
+    ss_lock_table_init();
+    ss_io_init(SS_IO_SYNC);
+    assert(mkdtemp(test_root) != NULL);
+    doc_cache_init(test_root, SS_DOC_CACHE_BUDGET);
+    ss_meta_init(test_root);
+    ss_revlog_init(test_root);
+
+    test_lock_ranges();
+    test_lock_fifo();
+    test_lock_lease();
+    test_wal_replay();
+    test_doc_cache_snapshots();
+    test_materializer();
+    test_meta_cache();
+    test_revlog();
+    test_cas();
+
+    char cleanup[sizeof(test_root) + 16];
+    snprintf(cleanup, sizeof(cleanup), "rm -rf %s", test_root);
+    assert(system(cleanup) == 0);
+
+    printf("\n=== All Storage Server Tests Passed! ===\n");
+
+    return 0;
+}